@@ -21,6 +21,7 @@
  */
 
 #include "types.h"
+#include "error_codes.h"
 #include "drivers/gfx.h"
 
 #ifdef __cplusplus
@@ -41,14 +42,41 @@ extern "C" {
 /// A callback for printing a character.
 typedef bool(*ConsolePrint)(void* con, int c);
 
-/// A font struct for the console.
+/**
+ * @brief A font struct for the console.
+ *
+ * Glyphs are stored row by row, top row first. Each row is (width + 7) / 8 bytes
+ * with the leftmost pixel in the most significant bit.
+ * Printed text is decoded as UTF-8. Characters without a glyph are drawn as
+ * U+FFFD or '?' if the font has neither.
+ */
 typedef struct ConsoleFont
 {
 	u8* gfx;         ///< A pointer to the font graphics
 	u16 asciiOffset; ///< Offset to the first valid character in the font table
 	u16 numChars;    ///< Number of characters in the font graphics
+	u8 width;        ///< Glyph width in pixels. 0 for the default of 6
+	u8 height;       ///< Glyph height in pixels (max. 32). 0 for the default of 10
+	const u16* codePoints; ///< Code point of each glyph for sparse fonts or NULL if glyphs start at asciiOffset
 }ConsoleFont;
 
+/// A character cell for deferred rendering.
+typedef struct ConsoleCell
+{
+	u16 chr;   ///< Character
+	u16 fg;    ///< Foreground color
+	u16 bg;    ///< Background color
+	u16 flags; ///< Reverse/bright flags
+}ConsoleCell;
+
+/// UTF-8 decoder state of a console.
+typedef struct ConsoleUtf8
+{
+	u32 cp;  ///< Code point bits decoded so far
+	u32 min; ///< Smallest valid code point for the sequence length
+	u8 need; ///< Outstanding continuation bytes
+}ConsoleUtf8;
+
 /**
  * @brief Console structure used to store the state of a console render context.
  *
@@ -61,6 +89,9 @@ typedef struct ConsoleFont
  * 		(u8*)default_font_bin, //font gfx
  * 		0, //first ascii character in the set
  * 		256, //number of characters in the font set
+ * 		6, //glyph width
+ * 		10, //glyph height
+ * 		NULL //code points (linear font)
  *	},
  *	0,0, //cursorX cursorY
  *	0,0, //prevcursorX prevcursorY
@@ -75,7 +106,14 @@ typedef struct ConsoleFont
 *	0, //background color
  *	0, //flags
  *	0,  //print callback
- *	false //console initialized
+ *	false, //console initialized
+ *	GFX_BGR565, //frame buffer format
+ *	NULL, //deferred rendering cells
+ *	0, //number of cells
+ *	0, //first cell row
+ *	0, //dirty rows
+ *	320, //frame buffer width
+ *	{0, 0, 0} //UTF-8 decoder
  * };
  * @endcode
  */
@@ -107,6 +145,17 @@ typedef struct PrintConsole
 	ConsolePrint PrintChar;  ///< Callback for printing a character. Should return true if it has handled rendering the graphics (else the print engine will attempt to render via tiles).
 
 	bool consoleInitialised; ///< True if the console is initialized
+
+	GfxFmt fbFormat;         ///< Frame buffer pixel format. GFX_BGR8 or any 16 bit format
+
+	ConsoleCell *cells;      ///< Cell grid for deferred rendering. NULL renders immediately
+	u32 numCells;            ///< Number of cells in the grid
+	int firstRow;            ///< Internal state. Ring index of the top window row
+	u64 dirtyRows;           ///< Internal state. Window rows to redraw in consoleRender()
+
+	int fbWidth;             ///< Frame buffer width in pixels (the LCD height since they are rotated)
+
+	ConsoleUtf8 utf8;        ///< Internal state. UTF-8 decoder
 }PrintConsole;
 
 #define CONSOLE_COLOR_BOLD	(1<<0) ///< Bold text
@@ -131,10 +180,12 @@ typedef enum {
 
 /**
  * @brief Loads the font into the console.
+ * If the cell size changes the console and window are resized to fill the frame buffer and the cursor is reset.
  * @param console Pointer to the console to update, if NULL it will update the current console.
  * @param font The font to load.
+ * @return false if the font is taller than 32 pixels. The console is left unchanged.
  */
-void consoleSetFont(PrintConsole* console, ConsoleFont* font);
+bool consoleSetFont(PrintConsole* console, ConsoleFont* font);
 
 /**
  * @brief Sets the print window.
@@ -171,6 +222,44 @@ PrintConsole* consoleInit(GfxLcd lcd, PrintConsole* console);
 /// Clears the screen by using iprintf("\x1b[2J");
 void consoleClear(void);
 
+/**
+ * @brief Enables deferred rendering. Printing only updates a cell grid and marks rows dirty.
+ * Call consoleRender() once per frame or whenever the text should become visible.
+ * The window must be at most 64 rows high.
+ * @param console Console to change, if NULL it will change the current console.
+ * @param cells Cell buffer with room for at least windowWidth * windowHeight cells. NULL renders immediately again.
+ * @param numCells Number of cells in the buffer.
+ */
+void consoleSetDeferred(PrintConsole* console, ConsoleCell* cells, u32 numCells);
+
+/**
+ * @brief Draws all dirty rows of a deferred console and flushes the frame buffer.
+ * @param console Console to render, if NULL it will render the current console.
+ */
+void consoleRender(PrintConsole* console);
+
+/**
+ * @brief Captures everything written to the console into a ring buffer.
+ * Only the newest size bytes are kept. Escape sequences are captured as is.
+ * @param buf The buffer. NULL disables capturing.
+ * @param size Size of the buffer in bytes.
+ */
+void consoleSetLogBuffer(char *buf, u32 size);
+
+/**
+ * @brief Returns the captured log in order. The buffer is linearized in place.
+ * @param out Receives a pointer to the oldest captured byte. NULL if capturing is disabled.
+ * @return Number of captured bytes.
+ */
+u32 consoleGetLog(const char **out);
+
+/**
+ * @brief Writes the captured log to a file via fsQuickWrite().
+ * @param path The file path.
+ * @return The result of fsQuickWrite() or RES_INVALID_ARG if capturing is disabled.
+ */
+Result consoleDumpLog(const char *const path);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "error_codes.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Channel manager and memory copy/fill offload for the ARM11 CDMA (DMA-330).
+// Every channel signals the event with the same number as the channel
+// and has its own completion IRQ (IRQ_CDMA_EVENT0 + channel).
+// Only 1 operation can be in flight per channel. Submitting to a busy
+// channel waits for the previous operation first.
+// Faulting channels are killed by the fault IRQ handler and the error
+// is returned by CDMA_fenceWait(). Channels with a restart program
+// are restarted instead.
+
+#define CDMA_CHANNELS     (8u)
+#define CDMA_NO_CHANNEL   (0xFFu)
+#define CDMA_PROG_SIZE    (256u) // Program buffer size per channel.
+
+// Channels used by LgyCap. These are never handed out by CDMA_allocChannel().
+#define CDMA_CH_LGYCAP0   (0u)
+#define CDMA_CH_LGYCAP1   (1u)
+
+
+// Tracks completion of a submitted operation.
+typedef struct
+{
+	u8 ch;   // Channel or CDMA_NO_CHANNEL for an already signaled fence.
+	u32 seq; // Sequence number of the operation on that channel.
+} CdmaFence;
+
+
+
+/**
+ * @brief      Allocates a free channel and registers its completion IRQ.
+ *
+ * @return     The channel or CDMA_NO_CHANNEL if all are in use.
+ */
+u8 CDMA_allocChannel(void);
+
+/**
+ * @brief      Frees a channel. Waits for the last operation to finish.
+ *
+ * @param[in]  ch    The channel.
+ */
+void CDMA_freeChannel(const u8 ch);
+
+/**
+ * @brief      Starts a program on an allocated channel.
+ *             The program must end with SEV ch and stay valid until the fence signals.
+ *             The caller is responsible for cache maintenance including the program itself.
+ *
+ * @param[in]  ch     The channel.
+ * @param[in]  prog   The program.
+ * @param      fence  The fence for this operation. Can be NULL.
+ *
+ * @return     RES_OK or RES_INVALID_ARG.
+ */
+Result CDMA_run(const u8 ch, const u8 *const prog, CdmaFence *const fence);
+
+/**
+ * @brief      Checks if the operation of a fence has finished.
+ *
+ * @param[in]  fence  The fence.
+ *
+ * @return     Returns true if finished.
+ */
+bool CDMA_fenceDone(const CdmaFence *const fence);
+
+/**
+ * @brief      Waits for the operation of a fence to finish.
+ *
+ * @param[in]  fence  The fence.
+ *
+ * @return     RES_OK or a RES_DMA_* error if the channel faulted.
+ */
+Result CDMA_fenceWait(const CdmaFence *const fence);
+
+/**
+ * @brief      Sets a program to restart a channel with after a fault.
+ *             For endless programs like LgyCap. Also works for the reserved channels.
+ *
+ * @param[in]  ch    The channel.
+ * @param[in]  prog  The program or NULL to disable restarts.
+ */
+void CDMA_setRestartProg(const u8 ch, const u8 *const prog);
+
+/**
+ * @brief      Copies memory asynchronously. Don't touch dst until the fence signals.
+ *
+ * @param[in]  ch     The channel.
+ * @param      dst    The destination. Must be 4 bytes aligned.
+ * @param[in]  src    The source. Must be 4 bytes aligned.
+ * @param[in]  size   The size. Must be a multiple of 4.
+ * @param      fence  The fence for this operation. Can be NULL.
+ *
+ * @return     RES_OK, RES_INVALID_ARG or RES_OUT_OF_RANGE if the program doesn't fit (size > ~64 MiB).
+ */
+Result CDMA_copy(const u8 ch, void *dst, const void *src, u32 size, CdmaFence *const fence);
+
+/**
+ * @brief      Fills memory with a 32 bit value asynchronously. Don't touch dst until the fence signals.
+ *
+ * @param[in]  ch     The channel.
+ * @param      dst    The destination. Must be 4 bytes aligned.
+ * @param[in]  value  The fill value.
+ * @param[in]  size   The size. Must be a multiple of 4.
+ * @param      fence  The fence for this operation. Can be NULL.
+ *
+ * @return     RES_OK, RES_INVALID_ARG or RES_OUT_OF_RANGE if the program doesn't fit (size > ~64 MiB).
+ */
+Result CDMA_fill(const u8 ch, void *dst, const u32 value, u32 size, CdmaFence *const fence);
+
+/**
+ * @brief      Copies a rectangle between strided buffers asynchronously.
+ *             For example a texture upload from FCRAM into a larger VRAM buffer.
+ *
+ * @param[in]  ch         The channel.
+ * @param      dst        The destination. Must be 4 bytes aligned.
+ * @param[in]  dstStride  The destination stride in bytes. Must be a multiple of 4 and >= width.
+ * @param[in]  src        The source. Must be 4 bytes aligned.
+ * @param[in]  srcStride  The source stride in bytes. Must be a multiple of 4 and >= width.
+ * @param[in]  width      The bytes per row. Must be a multiple of 4.
+ * @param[in]  height     The number of rows.
+ * @param      fence      The fence for this operation. Can be NULL.
+ *
+ * @return     RES_OK, RES_INVALID_ARG or RES_OUT_OF_RANGE if the program doesn't fit.
+ */
+Result CDMA_copy2D(const u8 ch, void *dst, const u32 dstStride, const void *src, const u32 srcStride,
+                   const u32 width, const u32 height, CdmaFence *const fence);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
@@ -96,6 +96,21 @@ typedef struct
 	s16 y;
 } CpadPos;
 
+// Optional background sampling. A timer IRQ samples the keys at a fixed rate
+// into a ring and a high priority task keeps touch and Circle-Pad up to date.
+// hidScanInput() then reports key edges of all samples since the last scan.
+#define HID_SAMPLE_RATE_DEFAULT  (240u) // In Hz.
+#define HID_SAMPLE_RATE_MAX      (1000u)
+#define HID_RING_SIZE            (64u)  // Samples. Must be a power of 2.
+
+typedef struct
+{
+	u32 seq;        // Sample number. Sample time in seconds is seq / rate.
+	u32 keys;       // Same format as hidKeysHeld().
+	TouchPos touch;
+	CpadPos cpad;
+} HidSample;
+
 
 
 void hidInit(void); // For libn3ds internal usage only.
@@ -107,6 +122,33 @@ const TouchPos* hidGetTouchPosPtr(void);
 const CpadPos* hidGetCpadPosPtr(void);
 u32 hidGetExtraKeys(u32 clearMask);
 
+/**
+ * @brief      Starts, changes or stops background sampling. Uses the MPCore timer while active.
+ *
+ * @param[in]  rateHz  The sample rate in Hz. Max HID_SAMPLE_RATE_MAX. 0 stops sampling.
+ *
+ * @return     Returns false if the rate is invalid or the sampler task could not be created.
+ */
+bool hidSetSampleRate(u32 rateHz);
+
+/**
+ * @brief      Returns the number of the next sample. Use it as start position for hidReadSamples().
+ *
+ * @return     The next sample number.
+ */
+u32 hidGetSamplePos(void);
+
+/**
+ * @brief      Copies samples from the ring. Samples that were already overwritten are skipped.
+ *
+ * @param      pos   The sample number to start at. Advanced past the copied samples.
+ * @param      out   The output samples.
+ * @param[in]  max   The max number of samples to copy.
+ *
+ * @return     Returns the number of copied samples.
+ */
+u32 hidReadSamples(u32 *const pos, HidSample *const out, const u32 max);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
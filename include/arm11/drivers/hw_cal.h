@@ -737,6 +737,8 @@ static_assert(offsetof(Hwcal, unused[0x11F]) == 0x9CF);
 
 extern CodecCalBase g_cdcCal;
 extern BacklightPwmCalBase g_blPwmCal;
+extern TouchCalBase g_touchCal;
+extern CirclePadCal1Base g_cpadCal;
 
 
 Result HWCAL_load(void);
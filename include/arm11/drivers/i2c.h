@@ -20,6 +20,7 @@
 
 #include "types.h"
 #include "mem_map.h"
+#include "kevent.h"
 
 
 #ifdef __cplusplus
@@ -106,6 +107,41 @@ typedef enum
 
 #define I2C_NO_REG_VAL  (0x100u)
 
+// Transfers are queued per bus and run entirely from the bus IRQ.
+// Each byte completes with an IRQ and the ISR starts the next one so
+// the waiting task is only woken once when the whole transfer is done.
+// Transfers on the same bus run in submission order.
+#define I2C_ASYNC_MAX_SIZE  (8u)  // Max data size for I2C_writeAsync().
+#define I2C_ASYNC_SLOTS     (16u) // Max number of pending I2C_writeAsync() transfers.
+
+enum
+{
+	I2C_XFER_OK      = 0u,
+	I2C_XFER_FAILED  = 1u,
+	I2C_XFER_PENDING = 2u  // Queued or in progress.
+};
+
+typedef struct I2cXfer I2cXfer;
+typedef void (*I2cDoneCb)(I2cXfer *const xfer);
+struct I2cXfer
+{
+	// Set by the caller.
+	void *buf;         // Output buffer for reads or input buffer for writes.
+	u32 size;          // Size in bytes. Must not be 0.
+	u16 regAddr;       // Register address. If I2C_NO_REG_VAL use direct transfer (no register).
+	u8 devId;          // The device ID. See I2cDevice.
+	bool read;         // true for reads and false for writes.
+	I2cDoneCb done;    // Optional. Called from the I2C ISR once the transfer is done. May submit transfers.
+
+	// Driver private.
+	volatile u8 state; // One of the I2C_XFER_* states.
+	u8 step;
+	u8 tries;
+	u32 pos;
+	I2cXfer *next;
+	KHandle event;     // Signaled once the transfer is done if someone waits for it.
+};
+
 
 
 /**
@@ -157,6 +193,36 @@ u8 I2C_read(const I2cDevice devId, const u32 regAddr);
  * @return     Returns true on success and false on failure.
  */
 bool I2C_write(const I2cDevice devId, const u32 regAddr, const u8 data);
+
+/**
+ * @brief      Queues a transfer and returns immediately. The transfer and
+ *             its buffer must stay valid until the transfer is done.
+ *
+ * @param      xfer  The transfer. Only the caller fields need to be set.
+ */
+void I2C_submit(I2cXfer *const xfer);
+
+/**
+ * @brief      Waits for a submitted transfer to finish. Only one task may wait for a transfer.
+ *
+ * @param      xfer  The transfer.
+ *
+ * @return     Returns true on success and false on failure.
+ */
+bool I2C_await(I2cXfer *const xfer);
+
+/**
+ * @brief      Queues a write without waiting for it. The data is copied and
+ *             errors are ignored. Blocks only if all slots are in use.
+ *
+ * @param[in]  devId    The device ID.
+ * @param[in]  regAddr  The start register address. If I2C_NO_REG_VAL use direct transfer (no register).
+ * @param[in]  in       The input buffer pointer.
+ * @param[in]  size     The buffer size. Max I2C_ASYNC_MAX_SIZE.
+ *
+ * @return     Returns false if size is invalid otherwise true.
+ */
+bool I2C_writeAsync(const I2cDevice devId, const u32 regAddr, const void *in, u32 size);
 // ---------------------------------------------------------------- //
 
 /**
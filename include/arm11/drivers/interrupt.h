@@ -19,6 +19,7 @@
  */
 
 #include "types.h"
+#include "error_codes.h"
 #include "arm.h"
 
 
@@ -133,11 +134,38 @@ typedef enum
 } Interrupt;
 
 
+// ISRs run with IRQs enabled so higher priority IRQs can preempt them.
+// Nested ISRs run on the stack of the interrupted task. Every task must
+// reserve IRQ_NEST_STACK_BUDGET bytes of stack for them. An ISR only
+// allows preemption if the largest registered ISR still fits into the budget.
+#define IRQ_NEST_STACK_BUDGET  (2048u)
+#define IRQ_ISR_STACK_DEFAULT  (448u)  // Stack size assumed for ISRs. Including the IRQ exception frame.
+
+
 // IRQ interrupt service routine pointer type.
 // intSource: bit 10-12 CPU source ID (0 except for interrupt ID 0-15),
 //            bit 0-9 interrupt ID.
 typedef void (*IrqIsr)(u32 intSource);
 
+// Per IRQ statistics. Only collected if built with LIBN3DS_IRQ_STATS.
+// Times are in CPU cycles measured with the cycle counter (CCNT).
+// ISRs run with IRQs enabled so the time of higher priority
+// IRQs preempting an ISR is included in its time.
+typedef struct
+{
+	u32 count;       // Number of ISR calls.
+	u32 maxCycles;   // Longest ISR call.
+	u64 totalCycles; // Time spent in the ISR in total.
+	u32 maxLatency;  // Longest time from IRQ exception entry to the ISR call.
+} IrqStats;
+
+typedef struct
+{
+	IrqStats stats;
+	u8 id;           // Interrupt ID.
+	u8 core;         // CPU the stats belong to. Only for private interrupts (ID <32).
+} IrqStatsEntry;
+
 
 
 /**
@@ -187,6 +215,18 @@ void IRQ_softInterrupt(const Interrupt id, const u32 target);
  */
 void IRQ_setPriority(const Interrupt id, const u32 prio);
 
+/**
+ * @brief      Sets the nesting behavior of a registered interrupt.
+ *             Time critical ISRs can be made non-preemptible.
+ *             Long running ISRs should stay preemptible.
+ *
+ * @param[in]  id           The interrupt ID. Must be one of the above IDs.
+ * @param[in]  preemptible  If true higher priority IRQs can preempt the ISR.
+ * @param[in]  stackSize    The max stack size the ISR needs including the IRQ exception
+ *                          frame. Max IRQ_NEST_STACK_BUDGET / 2. Default IRQ_ISR_STACK_DEFAULT.
+ */
+void IRQ_setNesting(const Interrupt id, const bool preemptible, const u32 stackSize);
+
 /**
  * @brief      Unregisters the interrupt service routine and disables the IRQ.
  *
@@ -194,6 +234,32 @@ void IRQ_setPriority(const Interrupt id, const u32 prio);
  */
 void IRQ_unregisterIsr(const Interrupt id);
 
+/**
+ * @brief      Gets the statistics of an interrupt.
+ *
+ * @param[in]  id     The interrupt ID. Must be one of the above IDs.
+ * @param[in]  core   The CPU (0-3). Only used for private interrupts (ID <32).
+ * @param      stats  A pointer to an IrqStats struct to fill in.
+ *
+ * @return     RES_OK, RES_INVALID_ARG or RES_NOT_FOUND if built without LIBN3DS_IRQ_STATS.
+ */
+Result IRQ_getStats(const Interrupt id, const u32 core, IrqStats *const stats);
+
+/**
+ * @brief      Gets the statistics of the interrupts which spent the most time in their ISR.
+ *
+ * @param      entries  An array for the stats. Sorted by total ISR time (highest first).
+ * @param[in]  max      Number of array entries.
+ *
+ * @return     Returns the number of entries filled in. Interrupts which never fired are skipped.
+ */
+u32 IRQ_getTopStats(IrqStatsEntry *const entries, const u32 max);
+
+/**
+ * @brief      Resets the statistics of all interrupts.
+ */
+void IRQ_resetStats(void);
+
 #if !__thumb__
 /**
  * @brief      Saves the CPU state and disables IRQs.
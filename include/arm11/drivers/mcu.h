@@ -35,6 +35,14 @@ extern "C"
                                  MCU_IRQ_WIFI_PRESS | MCU_IRQ_HOME_RELEASE | MCU_IRQ_HOME_PRESS | \
                                  MCU_IRQ_POWER_HELD | MCU_IRQ_POWER_PRESS))
 
+#define MCU_MAX_IRQ_SUBS            (4u)
+#define MCU_IRQ_SUB_DEFAULT         (0u)    // Gets all IRQs. Used by MCU_getIrqs() and MCU_waitIrqs().
+#define MCU_IRQ_SUB_INVALID         (0xFFu)
+
+// The status registers MCU_REG_3D_SLIDER_RAW to MCU_REG_EX_HW_STAT are read
+// in one burst and the getters for them are served from a cache.
+#define MCU_STATUS_MAX_AGE_DEFAULT  (33u) // In milliseconds. About 2 frames.
+
 
 typedef struct
 {
@@ -96,23 +104,68 @@ void MCU_init(void);
 //bool MCU_reboot(void);
 
 /**
- * @brief      { function_description }
+ * @brief      Subscribes to MCU IRQs. Each subscriber gets its own copy of the IRQ bits in its mask.
  *
- * @param[in]  mask  The mask
+ * @param[in]  mask  The IRQs to receive.
  *
- * @return     { description_of_the_return_value }
+ * @return     Returns the subscriber or MCU_IRQ_SUB_INVALID if all are in use.
+ */
+u32 MCU_subscribeIrqs(u32 mask);
+
+/**
+ * @brief      Removes a subscriber. Its pending IRQs are discarded.
+ *
+ * @param[in]  sub   The subscriber.
+ */
+void MCU_unsubscribeIrqs(u32 sub);
+
+/**
+ * @brief      Returns and clears pending IRQs of a subscriber. Does not block.
+ *
+ * @param[in]  sub   The subscriber.
+ * @param[in]  mask  The IRQs to return and clear. Others stay pending.
+ *
+ * @return     Returns the pending IRQs in mask.
+ */
+u32 MCU_getSubIrqs(u32 sub, u32 mask);
+
+/**
+ * @brief      Waits for any IRQ in mask, then returns and clears the pending ones in mask.
+ *
+ * @param[in]  sub        The subscriber.
+ * @param[in]  mask       The IRQs to wait for.
+ * @param[in]  timeoutMs  The timeout in milliseconds. 0 waits forever. Limited to about 32 seconds.
+ *
+ * @return     Returns the pending IRQs in mask or 0 on timeout.
+ */
+u32 MCU_waitSubIrqs(u32 sub, u32 mask, u32 timeoutMs);
+
+/**
+ * @brief      MCU_getSubIrqs() for the default subscriber.
+ *
+ * @param[in]  mask  The IRQs to return and clear. Others stay pending.
+ *
+ * @return     Returns the pending IRQs in mask.
  */
 u32 MCU_getIrqs(u32 mask);
 
 /**
- * @brief      { function_description }
+ * @brief      MCU_waitSubIrqs() for the default subscriber without timeout.
  *
- * @param[in]  mask  The mask
+ * @param[in]  mask  The IRQs to wait for.
  *
- * @return     { description_of_the_return_value }
+ * @return     Returns the pending IRQs in mask.
  */
 u32 MCU_waitIrqs(u32 mask);
 
+/**
+ * @brief      Sets how old cached status registers may get before a getter reads all of them again.
+ *             Status change IRQs (sliders, charger, battery) also discard the cache.
+ *
+ * @param[in]  ms    The max age in milliseconds. 0 disables the cache.
+ */
+void MCU_setStatusMaxAge(u32 ms);
+
 
 /**
  * @brief      Reads the MCU firmware version.
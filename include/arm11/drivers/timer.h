@@ -73,6 +73,19 @@ ALWAYS_INLINE Timer* getTimerRegs(void)
 #define TIMER_FREQ(p, f)   (TIMER_BASE_FREQ / ((p) * (f)))
 
 
+typedef void (*TimerAlarmCb)(void *arg);
+
+// One shot alarm on the watchdog timer. All fields are private.
+typedef struct TimerAlarm
+{
+	struct TimerAlarm *next;
+	u64 deadline;
+	TimerAlarmCb cb;
+	void *arg;
+	volatile bool armed; // Cleared right before the callback runs.
+} TimerAlarm;
+
+
 
 /**
  * @brief      Resets/initializes the timer hardware. For libn3ds internal usage only.
@@ -103,6 +116,26 @@ u32 TIMER_getTicks(void);
  */
 u32 TIMER_stop(void);
 
+/**
+ * @brief      Arms a one shot alarm. Alarms of a CPU core share its watchdog
+ *             timer with the sleep functions.
+ *
+ * @param      alarm  The alarm. Must not be armed and stay valid until it fired or was canceled.
+ * @param[in]  ticks  The number of ticks at TIMER_BASE_FREQ from now.
+ * @param[in]  cb     The callback or NULL. Runs in the watchdog ISR.
+ * @param      arg    The callback argument.
+ */
+void TIMER_setAlarm(TimerAlarm *const alarm, const u32 ticks, const TimerAlarmCb cb, void *const arg);
+
+/**
+ * @brief      Cancels an alarm.
+ *
+ * @param      alarm  The alarm.
+ *
+ * @return     Returns true if the alarm was still armed.
+ */
+bool TIMER_cancelAlarm(TimerAlarm *const alarm);
+
 /**
  * @brief      Halts the CPU for ms amount of milliseconds.
  *
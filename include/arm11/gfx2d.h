@@ -0,0 +1,149 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "drivers/gfx.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Colors are passed as {R, G, B, A} in memory from lowest to highest address.
+#define G2D_RGBA(r, g, b, a)  ((u32)(a)<<24 | (u32)(b)<<16 | (u32)(g)<<8 | (u32)(r))
+#define G2D_RGB(r, g, b)      G2D_RGBA((r), (g), (b), 255u)
+
+// Operations on at least this many bytes are offloaded to the GPU if possible.
+#define G2D_GX_MIN_SIZE       (32u * 1024)
+
+
+// A pixel buffer in the same rotated layout as the frame buffers.
+// Pixels are stored column by column. Each column is height pixels
+// long and starts with the bottom pixel (y = height - 1).
+// x/y coordinates are as seen on the LCD with 0, 0 in the top left corner.
+typedef struct
+{
+	void *buf;   // Pixel data.
+	u16 width;   // Width in pixels. The number of columns.
+	u16 height;  // Height in pixels. The column length.
+	GfxFmt fmt;  // Pixel format.
+} G2dSurface;
+
+
+
+/**
+ * @brief      Initializes a surface for the current draw buffer of a LCD.
+ *
+ * @param      surf  The surface to initialize.
+ * @param[in]  lcd   The lcd.
+ * @param[in]  side  The side in 3D mode. Otherwise always use GFX_SIDE_LEFT.
+ */
+void G2D_surfaceFromLcd(G2dSurface *const surf, const GfxLcd lcd, const GfxSide side);
+
+/**
+ * @brief      Converts a color to the native pixel value of a format.
+ *
+ * @param[in]  fmt    The pixel format.
+ * @param[in]  color  The color. See G2D_RGBA().
+ *
+ * @return     The pixel value in the low 16, 24 or 32 bits.
+ */
+u32 G2D_packColor(const GfxFmt fmt, const u32 color);
+
+/**
+ * @brief      Fills a rectangle with a color.
+ *             Full height fills in VRAM are done by the GPU fill engine.
+ *
+ * @param[in]  dst    The destination surface.
+ * @param[in]  x      The left edge.
+ * @param[in]  y      The top edge.
+ * @param[in]  w      The width.
+ * @param[in]  h      The height.
+ * @param[in]  color  The color. See G2D_RGBA().
+ */
+void G2D_fillRect(const G2dSurface *const dst, int x, int y, int w, int h, const u32 color);
+
+/**
+ * @brief      Copies a rectangle and converts the pixel format if needed.
+ *             Source and destination may be the same surface (overlap is handled).
+ *             Large full height copies without format conversion are done by the GPU.
+ *
+ * @param[in]  dst   The destination surface.
+ * @param[in]  dx    The destination left edge.
+ * @param[in]  dy    The destination top edge.
+ * @param[in]  src   The source surface.
+ * @param[in]  sx    The source left edge.
+ * @param[in]  sy    The source top edge.
+ * @param[in]  w     The width.
+ * @param[in]  h     The height.
+ */
+void G2D_copyRect(const G2dSurface *const dst, int dx, int dy, const G2dSurface *const src, int sx, int sy, int w, int h);
+
+/**
+ * @brief      Copies a rectangle with nearest neighbor scaling and converts the pixel format if needed.
+ *             Source and destination must not overlap.
+ *
+ * @param[in]  dst   The destination surface.
+ * @param[in]  dx    The destination left edge.
+ * @param[in]  dy    The destination top edge.
+ * @param[in]  dw    The destination width.
+ * @param[in]  dh    The destination height.
+ * @param[in]  src   The source surface.
+ * @param[in]  sx    The source left edge.
+ * @param[in]  sy    The source top edge.
+ * @param[in]  sw    The source width.
+ * @param[in]  sh    The source height.
+ */
+void G2D_scaleBlit(const G2dSurface *const dst, int dx, int dy, int dw, int dh,
+                   const G2dSurface *const src, int sx, int sy, int sw, int sh);
+
+/**
+ * @brief      Alpha blends a rectangle over the destination.
+ *             The source alpha (255 for formats without alpha) is multiplied by alpha.
+ *             The destination alpha channel is left unchanged.
+ *
+ * @param[in]  dst    The destination surface.
+ * @param[in]  dx     The destination left edge.
+ * @param[in]  dy     The destination top edge.
+ * @param[in]  src    The source surface.
+ * @param[in]  sx     The source left edge.
+ * @param[in]  sy     The source top edge.
+ * @param[in]  w      The width.
+ * @param[in]  h      The height.
+ * @param[in]  alpha  The global alpha. 255 is opaque.
+ */
+void G2D_blendRect(const G2dSurface *const dst, int dx, int dy, const G2dSurface *const src, int sx, int sy, int w, int h, const u8 alpha);
+
+/**
+ * @brief      Alpha blends a color over a rectangle.
+ *
+ * @param[in]  dst    The destination surface.
+ * @param[in]  x      The left edge.
+ * @param[in]  y      The top edge.
+ * @param[in]  w      The width.
+ * @param[in]  h      The height.
+ * @param[in]  color  The color. The alpha component is used for blending.
+ */
+void G2D_blendFill(const G2dSurface *const dst, int x, int y, int w, int h, const u32 color);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "error_codes.h"
+#include "drivers/gfx.h"
+#include "arm11/gfx2d.h"
+#include "img_enc.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Saves frame buffers or any other surface in the rotated frame buffer
+// layout (for example LgyCap frames) as upright BMP or PNG files.
+// The encoded data is streamed to the file in IMGENC_CHUNK_SIZE pieces.
+
+#define SCREENSHOT_DIR  "sdmc:/screenshots"
+
+
+
+/**
+ * @brief      Saves a surface as image file.
+ *             If possible the surface is first copied with the PPF
+ *             so it can be redrawn while the file is being written.
+ *             Otherwise it is read directly.
+ *
+ * @param[in]  surf  The surface.
+ * @param[in]  fmt   The file format.
+ * @param[in]  path  The file path. Existing files are overwritten.
+ *
+ * @return     Returns the result.
+ */
+Result SCREENSHOT_saveSurface(const G2dSurface *const surf, const ImgEncFmt fmt, const char *const path);
+
+/**
+ * @brief      Saves the current draw buffer of a LCD as image file.
+ *
+ * @param[in]  lcd   The lcd.
+ * @param[in]  fmt   The file format.
+ * @param[in]  path  The file path. Existing files are overwritten.
+ *
+ * @return     Returns the result.
+ */
+Result SCREENSHOT_save(const GfxLcd lcd, const ImgEncFmt fmt, const char *const path);
+
+/**
+ * @brief      Saves the current draw buffer of a LCD as the next free
+ *             "scr_NNNN" file in a directory. Calling this once per frame dumps a frame sequence.
+ *
+ * @param[in]  lcd   The lcd.
+ * @param[in]  fmt   The file format.
+ * @param[in]  dir   The directory. Created if it doesn't exist. NULL for SCREENSHOT_DIR.
+ *
+ * @return     Returns the result.
+ */
+Result SCREENSHOT_saveNext(const GfxLcd lcd, const ImgEncFmt fmt, const char *dir);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
@@ -136,6 +136,28 @@ enum
 };
 
 
+#define NDMA_CHANNELS        (8u)
+#define NDMA_NO_CHANNEL      (0xFFu)
+#define NDMA_CH_SYNC         (7u) // Used by NDMA_copy() and NDMA_fill(). Never handed out.
+
+// A transfer. The first 7 members are copied to the channel registers as is.
+typedef struct NdmaDesc NdmaDesc;
+struct NdmaDesc
+{
+	u32 sad;
+	u32 dad;
+	u32 tcnt;
+	u32 wcnt;
+	u32 bcnt;
+	u32 fdata;
+	u32 cnt;
+	const NdmaDesc *next; // Started when this transfer ends. NULL for the last one.
+};
+
+// Called from the channel IRQ after the last transfer of a chain.
+typedef void (*NdmaCallback)(void *arg);
+
+
 
 /**
  * @brief      Initializes all NDMA channels. For libn3ds internal usage only.
@@ -160,6 +182,92 @@ void NDMA_copy(u32 *const dst, const u32 *const src, u32 size);
  */
 void NDMA_fill(u32 *const dst, const u32 value, u32 size);
 
+/**
+ * @brief      Allocates a free channel.
+ *
+ * @return     The channel or NDMA_NO_CHANNEL if all are in use.
+ */
+u8 NDMA_allocChannel(void);
+
+/**
+ * @brief      Stops and frees a channel.
+ *
+ * @param[in]  ch    The channel.
+ */
+void NDMA_freeChannel(const u8 ch);
+
+/**
+ * @brief      Initializes a memory copy descriptor.
+ *
+ * @param      desc  The descriptor. next is set to NULL.
+ * @param      dst   Pointer to destination memory. Must be 4 bytes aligned.
+ * @param      src   Pointer to source data. Must be 4 bytes aligned.
+ * @param[in]  size  The size of the data. Must be multiple of 4.
+ */
+void NDMA_descCopy(NdmaDesc *const desc, void *const dst, const void *const src, u32 size);
+
+/**
+ * @brief      Initializes a memory fill descriptor.
+ *
+ * @param      desc   The descriptor. next is set to NULL.
+ * @param      dst    Pointer to destination memory. Must be 4 bytes aligned.
+ * @param[in]  value  The value each 32-bit word will be set to.
+ * @param[in]  size   The size of the memory to fill. Must be multiple of 4.
+ */
+void NDMA_descFill(NdmaDesc *const desc, void *const dst, const u32 value, u32 size);
+
+/**
+ * @brief      Initializes a descriptor for a transfer started by a device (TMIO, SHA, AES...).
+ *             Every startup request transfers 1 block.
+ *
+ * @param      desc       The descriptor. next is set to NULL.
+ * @param[in]  startup    The startup mode. See NDMA_START_* above.
+ * @param[in]  addrMode   Source and destination address modes. For example NDMA_SAD_INC | NDMA_DAD_FIX.
+ * @param[in]  dst        The destination address.
+ * @param[in]  src        The source address.
+ * @param[in]  size       The total size. Must be multiple of blockSize. 0 repeats until stopped.
+ * @param[in]  blockSize  The size transferred per request. Must be multiple of 4.
+ */
+void NDMA_descStartup(NdmaDesc *const desc, const u32 startup, const u32 addrMode, const u32 dst,
+                      const u32 src, const u32 size, const u32 blockSize);
+
+/**
+ * @brief      Starts a chain of transfers on a channel. Returns immediately.
+ *             The descriptors must stay valid until the chain ends.
+ *             Transfers in repeat mode (size 0) never end and must be stopped with NDMA_stop().
+ *
+ * @param[in]  ch    The channel. Must be allocated with NDMA_allocChannel().
+ * @param[in]  desc  The first descriptor.
+ * @param[in]  cb    Called from the IRQ handler after the last transfer. Can be NULL.
+ * @param      arg   Passed to cb.
+ *
+ * @return     Returns false if the channel is busy or not allocated.
+ */
+bool NDMA_submit(const u8 ch, const NdmaDesc *const desc, const NdmaCallback cb, void *const arg);
+
+/**
+ * @brief      Checks if a chain is still running on a channel.
+ *
+ * @param[in]  ch    The channel.
+ *
+ * @return     Returns true if busy.
+ */
+bool NDMA_isBusy(const u8 ch);
+
+/**
+ * @brief      Waits for the chain on a channel to end.
+ *
+ * @param[in]  ch    The channel.
+ */
+void NDMA_wait(const u8 ch);
+
+/**
+ * @brief      Stops a channel. The callback is not called.
+ *
+ * @param[in]  ch    The channel.
+ */
+void NDMA_stop(const u8 ch);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
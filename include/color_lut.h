@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Per channel 8 bit in, 8 bit out lookup table.
+// Same layout as the display controller color LUT (one entry per channel intensity).
+typedef struct
+{
+	u8 r[256];
+	u8 g[256];
+	u8 b[256];
+} ColorLut;
+
+
+
+/**
+ * @brief      Fills all channels with a 1:1 mapping.
+ *
+ * @param      lut   The lookup table to fill.
+ */
+void colorLutIdentity(ColorLut *const lut);
+
+/**
+ * @brief      Fills each channel with a power curve. out = in^gamma.
+ *             A gamma of 1.0 is identity, >1.0 darkens and <1.0 brightens.
+ *
+ * @param      lut     The lookup table to fill.
+ * @param[in]  gammaR  The red channel gamma.
+ * @param[in]  gammaG  The green channel gamma.
+ * @param[in]  gammaB  The blue channel gamma.
+ */
+void colorLutGamma(ColorLut *const lut, const float gammaR, const float gammaG, const float gammaB);
+
+/**
+ * @brief      Maps sRGB encoded input to a display with a pure power law response.
+ *             The sRGB curve is decoded to linear light and then re-encoded with 1/lcdGamma.
+ *
+ * @param      lut       The lookup table to fill.
+ * @param[in]  lcdGamma  The native gamma of the LCD. Usually ~2.2.
+ */
+void colorLutSrgb2Lcd(ColorLut *const lut, const float lcdGamma);
+
+/**
+ * @brief      GBA LCD look (darker, less washed out colors) for GBA games.
+ *             The display controller LUT can't mix channels so this only
+ *             contains the tone curve part of the usual GBA color correction.
+ *
+ * @param      lut   The lookup table to fill.
+ */
+void colorLutGbaCorrection(ColorLut *const lut);
+
+/**
+ * @brief      Packs entry i of all 3 channels into the display controller word format.
+ *
+ * @param[in]  lut   The lookup table.
+ * @param[in]  i     The entry index 0-255.
+ *
+ * @return     The packed entry. Red in bits 0-7, green 8-15, blue 16-23.
+ */
+static inline u32 colorLutPackEntry(const ColorLut *const lut, const u32 i)
+{
+	return (u32)lut->b[i]<<16 | (u32)lut->g[i]<<8 | lut->r[i];
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
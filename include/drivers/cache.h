@@ -47,6 +47,7 @@ void invalidateDCache(void);
 
 /**
  * @brief      Invalidates data cache lines in an address range.
+ *             Partial lines at the start and end are cleaned first.
  *
  * @param[in]  base  The base address.
  * @param[in]  size  The range size in bytes.
@@ -20,6 +20,7 @@
 
 #include "types.h"
 #include "mem_map.h"
+#include "error_codes.h"
 
 
 #ifdef __cplusplus
@@ -103,7 +104,7 @@ ALWAYS_INLINE Dma330* getDma330Regs(void)
 
 // REG_DMA330_DSR
 #define DSR_WAKE_EVNT_SHIFT       (4u)
-#define DSR_WAKE_EVNT_MASK        (0x1Fu<<DSR_WAKEUP_EVNT_SHIFT)
+#define DSR_WAKE_EVNT_MASK        (0x1Fu<<DSR_WAKE_EVNT_SHIFT)
 #define DSR_DNS                   BIT(9) // DMA Manager is non-secure.
 
 enum
@@ -160,7 +161,7 @@ enum
 
 // REG_DMA330_CSR0-7
 #define CSR_WAKE_EVNT_SHIFT       (4u)
-#define CSR_WAKE_EVNT_MASK        (0x1Fu<<CSR_WAKEUP_EVNT_SHIFT)
+#define CSR_WAKE_EVNT_MASK        (0x1Fu<<CSR_WAKE_EVNT_SHIFT)
 #define CSR_DMAWFP_B_NS           BIT(14) // DMAWFP executed with burst operand set.
 #define CSR_DMAWFP_PERIPH         BIT(15) // DMAWFP executed with periph operand set.
 #define CSR_CNS                   BIT(21) // DMA channel is non-secure.
@@ -206,6 +207,17 @@ enum
 #define CCR_END_SWP_SIZE_SHIFT    (28u) // Endian swap size.
 #define CCR_END_SWP_SIZE_MASK     (0x7u<<CCR_END_SWP_SIZE_SHIFT)
 
+// Field helpers. Burst size is log2 of the bytes per transfer, burst length 1-16 transfers.
+#define CCR_SRC_BURST_SIZE(s)     ((s)<<CCR_SRC_BURST_SIZE_SHIFT)
+#define CCR_SRC_BURST_LEN(l)      (((l) - 1)<<CCR_SRC_BURST_LEN_SHIFT)
+#define CCR_SRC_PROT_CTRL(p)      ((p)<<CCR_SRC_PROT_CTRL_SHIFT)
+#define CCR_SRC_CACHE_CTRL(c)     ((c)<<CCR_SRC_CACHE_CTRL_SHIFT)
+#define CCR_DST_BURST_SIZE(s)     ((s)<<CCR_DST_BURST_SIZE_SHIFT)
+#define CCR_DST_BURST_LEN(l)      (((l) - 1)<<CCR_DST_BURST_LEN_SHIFT)
+#define CCR_DST_PROT_CTRL(p)      ((p)<<CCR_DST_PROT_CTRL_SHIFT)
+#define CCR_DST_CACHE_CTRL(c)     ((c)<<CCR_DST_CACHE_CTRL_SHIFT)
+#define CCR_END_SWP_SIZE(s)       ((s)<<CCR_END_SWP_SIZE_SHIFT)
+
 // REG_DMA330_DBGSTATUS
 #define DBGSTATUS_BUSY            BIT(0)
 
@@ -227,8 +239,43 @@ void DMA330_ackIrq(u8 eventIrq);
 void DMA330_sev(u8 event);
 void DMA330_kill(u8 ch);
 
+/**
+ * @brief      Returns the channels in faulting state as bitmask (REG_DMA330_FSRC).
+ *
+ * @return     Bit N is set if channel N is faulting.
+ */
+u32 DMA330_faultingChannels(void);
+
+/**
+ * @brief      Returns the fault type of a channel (REG_DMA330_FTR0-7).
+ *
+ * @param[in]  ch    The channel.
+ *
+ * @return     The FTR_* bits.
+ */
+u32 DMA330_faultType(u8 ch);
+
+/**
+ * @brief      Converts channel fault type bits to a Result.
+ *
+ * @param[in]  ftr   The FTR_* bits.
+ *
+ * @return     RES_DMA_* error or RES_OK for 0.
+ */
+Result DMA330_fault2Res(u32 ftr);
+
+/**
+ * @brief      Kills the DMA manager thread if it is faulting.
+ *
+ * @return     The FTRD_* bits of the fault or 0 if it wasn't faulting.
+ */
+u32 DMA330_recoverManager(void);
+
 #ifdef __ARM11__
-//void DMA330_dbgPrint(void);
+/**
+ * @brief      Prints the manager and channel state including decoded faults.
+ */
+void DMA330_dbgPrint(void);
 #endif // ifdef __ARM11__
 
 #ifdef __cplusplus
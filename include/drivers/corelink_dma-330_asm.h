@@ -0,0 +1,296 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Builds DMA-330 channel programs at runtime.
+// Errors are sticky and reported by DMA330_asmEnd(). The reason is kept in Dma330Asm.error.
+// Has no hardware dependencies and also builds for the host.
+
+// Default MFIFO size used for validation. The real size is in REG_DMA330_CRD.
+#define DMA330_ASM_MFIFO_SIZE  (128u)
+
+// Max length of a disassembled instruction including the null terminator.
+#define DMA330_DISASM_MAX_LEN  (64u)
+
+
+// MOV destination registers.
+typedef enum
+{
+	DMA330_SAR = 0u,
+	DMA330_CCR = 1u,
+	DMA330_DAR = 2u
+} Dma330Reg;
+
+// Condition suffix for LD/ST/LPEND. Matches the bs/x instruction bits.
+typedef enum
+{
+	DMA330_ALWAYS = 0u,
+	DMA330_SINGLE = 1u, // S
+	DMA330_BURST  = 3u  // B
+} Dma330Cond;
+
+// WFP request type.
+typedef enum
+{
+	DMA330_WFP_SINGLE = 0u,
+	DMA330_WFP_PERIPH = 1u,
+	DMA330_WFP_BURST  = 2u
+} Dma330Wfp;
+
+typedef enum
+{
+	DMA330_ASM_OK       = 0u,
+	DMA330_ASM_OVERFLOW = 1u, // Program buffer too small.
+	DMA330_ASM_LOOP     = 2u, // Bad loop count, too many/unbalanced loops or jump too far.
+	DMA330_ASM_MFIFO    = 3u, // MFIFO over- or underflow or a loop body that doesn't drain it.
+	DMA330_ASM_ARG      = 4u  // Invalid argument.
+} Dma330AsmErr;
+
+typedef struct
+{
+	u16 start;  // Jump target of the LPEND.
+	u16 mfifo;  // MFIFO fill level at loop start.
+	u8 type;    // Internal loop type.
+	u8 lc;      // Loop counter. Unused for LPFE.
+} Dma330AsmLoop;
+
+typedef struct
+{
+	u8 *buf;
+	u16 size;              // Buffer size in bytes.
+	u16 pos;               // Current write position.
+	u8 loops;              // Number of open loops.
+	u8 counters;           // Bitmask of loop counters in use.
+	u8 error;              // Dma330AsmErr.
+	u16 mfifoSize;         // MFIFO size for validation.
+	u16 mfifo;             // MFIFO fill level in bytes assuming all instructions execute.
+	u32 ccr;               // Last value moved into CCR.
+	Dma330AsmLoop loop[3]; // Open loops. 2 counted + 1 LPFE at most.
+} Dma330Asm;
+
+// Called by DMA330_asmRepeat() to emit the loop body.
+typedef void (*Dma330AsmBody)(Dma330Asm *const a, void *arg);
+
+
+
+/**
+ * @brief      Starts a new program.
+ *
+ * @param      a     The assembler state.
+ * @param      buf   The program buffer.
+ * @param[in]  size  The buffer size in bytes.
+ */
+void DMA330_asmInit(Dma330Asm *const a, u8 *const buf, const u16 size);
+
+/**
+ * @brief      Finishes the program with DMAEND.
+ *             The MFIFO must be empty and all loops closed.
+ *
+ * @param      a     The assembler state.
+ *
+ * @return     The program size in bytes or 0 on error.
+ */
+u32 DMA330_asmEnd(Dma330Asm *const a);
+
+/**
+ * @brief      Emits DMAMOV. Moves an immediate into SAR, CCR or DAR.
+ *
+ * @param      a    The assembler state.
+ * @param[in]  reg  The destination register.
+ * @param[in]  val  The value.
+ */
+void DMA330_asmMov(Dma330Asm *const a, const Dma330Reg reg, const u32 val);
+
+/**
+ * @brief      Emits DMAADDH. Adds an immediate to SAR or DAR.
+ *
+ * @param      a    The assembler state.
+ * @param[in]  reg  The register. SAR or DAR only.
+ * @param[in]  val  The value to add.
+ */
+void DMA330_asmAddh(Dma330Asm *const a, const Dma330Reg reg, const u16 val);
+
+/**
+ * @brief      Emits DMALD. Loads into the MFIFO.
+ *
+ * @param      a     The assembler state.
+ * @param[in]  cond  The condition.
+ */
+void DMA330_asmLd(Dma330Asm *const a, const Dma330Cond cond);
+
+/**
+ * @brief      Emits DMAST. Stores from the MFIFO.
+ *
+ * @param      a     The assembler state.
+ * @param[in]  cond  The condition.
+ */
+void DMA330_asmSt(Dma330Asm *const a, const Dma330Cond cond);
+
+/**
+ * @brief      Emits DMALDP. Loads and notifies the peripheral.
+ *
+ * @param      a       The assembler state.
+ * @param[in]  cond    The condition. SINGLE or BURST only.
+ * @param[in]  periph  The peripheral number.
+ */
+void DMA330_asmLdp(Dma330Asm *const a, const Dma330Cond cond, const u8 periph);
+
+/**
+ * @brief      Emits DMASTP. Stores and notifies the peripheral.
+ *
+ * @param      a       The assembler state.
+ * @param[in]  cond    The condition. SINGLE or BURST only.
+ * @param[in]  periph  The peripheral number.
+ */
+void DMA330_asmStp(Dma330Asm *const a, const Dma330Cond cond, const u8 periph);
+
+/**
+ * @brief      Emits DMAWFP. Waits for a peripheral request.
+ *
+ * @param      a       The assembler state.
+ * @param[in]  type    The request type.
+ * @param[in]  periph  The peripheral number.
+ */
+void DMA330_asmWfp(Dma330Asm *const a, const Dma330Wfp type, const u8 periph);
+
+/**
+ * @brief      Emits DMAWFE. Waits for an event.
+ *
+ * @param      a      The assembler state.
+ * @param[in]  event  The event number.
+ */
+void DMA330_asmWfe(Dma330Asm *const a, const u8 event);
+
+/**
+ * @brief      Emits DMAFLUSHP. Flushes the peripheral request state.
+ *
+ * @param      a       The assembler state.
+ * @param[in]  periph  The peripheral number.
+ */
+void DMA330_asmFlushp(Dma330Asm *const a, const u8 periph);
+
+/**
+ * @brief      Emits DMASEV. Signals an event or IRQ.
+ *
+ * @param      a      The assembler state.
+ * @param[in]  event  The event number.
+ */
+void DMA330_asmSev(Dma330Asm *const a, const u8 event);
+
+/**
+ * @brief      Emits DMAWMB. Waits for all outstanding writes.
+ *
+ * @param      a  The assembler state.
+ */
+void DMA330_asmWmb(Dma330Asm *const a);
+
+/**
+ * @brief      Emits DMARMB. Waits for all outstanding reads.
+ *
+ * @param      a  The assembler state.
+ */
+void DMA330_asmRmb(Dma330Asm *const a);
+
+/**
+ * @brief      Opens a counted loop with the next free loop counter. Max 2 nested counted loops.
+ *
+ * @param      a      The assembler state.
+ * @param[in]  count  The number of iterations (1-256).
+ */
+void DMA330_asmLp(Dma330Asm *const a, const u32 count);
+
+/**
+ * @brief      Opens a loop forever (LPFE). Ends when a peripheral signals the last request.
+ *             Doesn't use a loop counter.
+ *
+ * @param      a     The assembler state.
+ */
+void DMA330_asmLpForever(Dma330Asm *const a);
+
+/**
+ * @brief      Opens a loop that never ends, not even on a last request.
+ *             This is a counted loop with the LPEND jumping back to the LP so it uses a loop counter.
+ *             The channel must be killed to stop it.
+ *
+ * @param      a     The assembler state.
+ */
+void DMA330_asmLpEndless(Dma330Asm *const a);
+
+/**
+ * @brief      Closes the innermost loop. The loop body must not change the MFIFO fill level.
+ *
+ * @param      a     The assembler state.
+ */
+void DMA330_asmLpEnd(Dma330Asm *const a);
+
+/**
+ * @brief      Emits a body count times using nested loops.
+ *             Counts beyond what the free loop counters can do repeat the loop code.
+ *
+ * @param      a      The assembler state.
+ * @param[in]  count  The number of repetitions. 0 emits nothing.
+ * @param[in]  body   Emits one iteration.
+ * @param      arg    Passed to body.
+ */
+void DMA330_asmRepeat(Dma330Asm *const a, u32 count, Dma330AsmBody body, void *arg);
+
+/**
+ * @brief      Emits a memory to memory copy of size bytes using the current CCR.
+ *             Full bursts are done in loops. A remainder is done with one shorter burst
+ *             which changes the burst lengths in CCR. Source and destination burst
+ *             must have the same size in bytes and size must be a multiple of the transfer size.
+ *
+ * @param      a     The assembler state.
+ * @param[in]  size  The size in bytes.
+ */
+void DMA330_asmTransfer(Dma330Asm *const a, const u32 size);
+
+/**
+ * @brief      Disassembles one instruction.
+ *
+ * @param[in]  prog  The program.
+ * @param[in]  size  The program size in bytes.
+ * @param[in]  pos   The instruction offset.
+ * @param      out   Output buffer for the text. Should be DMA330_DISASM_MAX_LEN bytes.
+ * @param[in]  len   The output buffer size.
+ *
+ * @return     The instruction size in bytes or 0 if invalid or truncated.
+ */
+u32 DMA330_disasm(const u8 *const prog, const u32 size, const u32 pos, char *const out, const u32 len);
+
+/**
+ * @brief      Formats a CCR value like the disassembler. For example "SB16 SS64 SAF SP2 DB16 DS64 DAI DP2".
+ *
+ * @param[in]  ccr   The CCR value.
+ * @param      out   Output buffer for the text. Should be DMA330_DISASM_MAX_LEN bytes.
+ * @param[in]  len   The output buffer size.
+ */
+void DMA330_ccr2Str(const u32 ccr, char *const out, const u32 len);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
@@ -20,6 +20,7 @@
 
 #include "types.h"
 #include "rgb_conv.h"
+#include "color_lut.h"
 
 
 #ifdef __cplusplus
@@ -224,6 +225,16 @@ void GFX_waitForEvent(const GfxEvent event);
 #define GFX_waitForPPF()      GFX_waitForEvent(GFX_EVENT_PPF)
 #define GFX_waitForP3D()      GFX_waitForEvent(GFX_EVENT_P3D)
 
+/**
+ * @brief      Sets the display controller color lookup table for a LCD.
+ *             The table is staged and uploaded atomically in the next VBlank.
+ *             Staging again before that VBlank replaces the previous table.
+ *
+ * @param[in]  lcd   The lcd.
+ * @param[in]  lut   The lookup table. NULL restores 1:1 mapping.
+ */
+void GFX_setColorLut(const GfxLcd lcd, const ColorLut *const lut);
+
 /**
  * @brief      Fill memory with a pattern via DMA. 2 fill engines.
  *
@@ -97,11 +97,43 @@ ALWAYS_INLINE Pxi* getPxiRegs(void)
 
 
 
+// Maximum number of commands in flight per core. Each gets its own request tag.
+#define PXI_MAX_PENDING                (4u)
+
+
 // All of the below functions for libn3ds internal usage only.
 void PXI_init(void);
 void PXI_deinit(void);
+
+/**
+ * @brief      Sends a command to the other core and waits for its response.
+ *             Multiple tasks can have commands in flight at the same time.
+ *             Responses are matched by request tag, not by command.
+ *
+ * @param[in]  cmd    The command.
+ * @param[in]  buf    The command parameters.
+ * @param[in]  words  The number of parameter words. Max IPC_MAX_PARAMS.
+ *
+ * @return     The result returned by the command handler.
+ */
 u32 PXI_sendCmd(u32 cmd, const u32 *buf, u32 words);
 
+#ifdef __ARM11__
+/**
+ * @brief      Same as PXI_sendCmd() but the command goes through the shared memory ring.
+ *             Allows up to IPC_RING_MAX_WORDS parameter words. Small buffers
+ *             like paths and FILINFO structs are copied into the ring which avoids
+ *             cache maintenance on the caller's buffers.
+ *
+ * @param[in]  cmd    The command.
+ * @param[in]  buf    The command parameters.
+ * @param[in]  words  The number of parameter words. Max IPC_RING_MAX_WORDS.
+ *
+ * @return     The result returned by the command handler.
+ */
+u32 PXI_sendCmdRing(u32 cmd, const u32 *buf, u32 words);
+#endif // #ifdef __ARM11__
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
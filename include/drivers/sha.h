@@ -78,14 +78,40 @@ ALWAYS_INLINE volatile ShaFifo* getShaFifo(Sha *const regs)
 #define SHA_RB_FIFO_NE   BIT(9)  // Readback mode FIFO not empty status.
 #define SHA_O_DMA_EN     BIT(10) // Output DMA enable (readback mode).
 
+// sha_auto() hashes smaller inputs in software.
+#define SHA_HW_MIN_SIZE  (64u)
+
+
+// Saved engine state between whole blocks.
+typedef struct
+{
+	u32 hash[8];
+	u32 blkcnt;
+	u16 cnt;     // Mode and endianess.
+} ShaEngineCtx;
+
+// A hash stream which only holds the engine during update/finish calls.
+// Multiple streams can time-share the engine and updates can have any size.
+typedef struct
+{
+	ShaEngineCtx engine;
+	alignas(4) u8 block[64]; // Partial block not yet sent to the engine.
+	u8 used;                 // Bytes in block.
+	bool started;            // The engine state is valid (at least one block hashed).
+	u16 params;
+} ShaCtx;
+
 
 
 /**
  * @brief      Sets input mode, endianess and starts the hash operation.
+ *             Claims the engine until SHA_finish(). Does not wait if the engine is in use.
  *
  * @param[in]  params  Extra parameters like endianess. See REG_SHA_CNT defines above.
+ *
+ * @return     Returns false and leaves the engine alone if it is in use.
  */
-void SHA_start(u16 params);
+bool SHA_start(u16 params);
 
 /**
  * @brief      Hashes the data pointed to.
@@ -110,8 +136,54 @@ void SHA_finish(u32 *const hash, u16 endianess);
  */
 void SHA_getState(u32 *const out);
 
+/**
+ * @brief      Saves the engine state. Only valid between whole blocks.
+ *             Note: Not verified on hardware yet.
+ *
+ * @param      ctx   Pointer to memory to save the state to.
+ */
+void SHA_saveContext(ShaEngineCtx *const ctx);
+
+/**
+ * @brief      Restores a saved engine state and restarts the engine with it.
+ *             Continue with SHA_update() and SHA_finish() as usual.
+ *             Note: Not verified on hardware yet. Writing the hash and block
+ *             count registers after starting the engine is an assumption.
+ *
+ * @param[in]  ctx   The saved state.
+ */
+void SHA_restoreContext(const ShaEngineCtx *const ctx);
+
+/**
+ * @brief      Initializes a hash stream. Does not touch the engine.
+ *
+ * @param      ctx     The hash stream.
+ * @param[in]  params  Extra parameters like endianess. See REG_SHA_CNT defines above.
+ */
+void SHA_ctxInit(ShaCtx *const ctx, u16 params);
+
+/**
+ * @brief      Hashes data of any size and alignment.
+ *             Waits for the engine if another stream is using it.
+ *
+ * @param      ctx   The hash stream.
+ * @param[in]  data  Pointer to data to hash.
+ * @param[in]  size  Size of the data to hash.
+ */
+void SHA_ctxUpdate(ShaCtx *const ctx, const void *data, u32 size);
+
+/**
+ * @brief      Generates the final hash of a stream.
+ *
+ * @param      ctx        The hash stream.
+ * @param      hash       Pointer to memory to copy the hash to.
+ * @param[in]  endianess  Endianess bitmask for the hash.
+ */
+void SHA_ctxFinish(ShaCtx *const ctx, u32 *const hash, u16 endianess);
+
 /**
  * @brief      Hashes a single block of data and outputs the hash.
+ *             Hashes in software if the engine is in use.
  *
  * @param[in]  data           Pointer to data to hash.
  * @param[in]  size           Size of the data to hash.
@@ -121,6 +193,19 @@ void SHA_getState(u32 *const out);
  */
 void sha(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess);
 
+/**
+ * @brief      Hashes a single block of data and outputs the hash.
+ *             Uses the hardware engine if it is free and the input is big enough
+ *             and word aligned. Otherwise the data is hashed in software (see sha_sw.h).
+ *
+ * @param[in]  data           Pointer to data to hash.
+ * @param[in]  size           Size of the data to hash.
+ * @param      hash           Pointer to memory to copy the hash to.
+ * @param[in]  params         Extra parameters like endianess. See REG_SHA_CNT defines above.
+ * @param[in]  hashEndianess  Endianess bitmask for the hash.
+ */
+void sha_auto(const void *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess);
+
 /**
  * @brief      Hashes a single block of data with DMA and outputs the hash.
  *
@@ -130,9 +215,7 @@ void sha(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndiane
  * @param[in]  params         Extra parameters like endianess. See REG_SHA_CNT defines above.
  * @param[in]  hashEndianess  Endianess bitmask for the hash.
  */
-#ifdef __ARM9__
 void sha_dma(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess);
-#endif // #ifdef __ARM9__
 
 #ifdef __cplusplus
 } // extern "C"
@@ -68,7 +68,13 @@ enum
 	// Lgy errors.
 	RES_GBA_RTC_ERR            = 27u,
 
-	MAX_LIBN3DS_RES_VALUE      = RES_GBA_RTC_ERR
+	// DMA errors.
+	RES_DMA_BUS_ERR            = 28u, // Instruction fetch, data read or data write error.
+	RES_DMA_PROG_ERR           = 29u, // Undefined instruction, invalid operand or MFIFO error.
+	RES_DMA_SECURITY_ERR       = 30u, // Secure event, periphal or memory access from non-secure state.
+	RES_DMA_LOCKUP             = 31u, // Aborted by the watchdog because of resource starvation.
+
+	MAX_LIBN3DS_RES_VALUE      = RES_DMA_LOCKUP
 };
 
 
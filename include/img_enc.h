@@ -0,0 +1,126 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "error_codes.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Streaming BMP and PNG encoder. Rows go in, encoded data comes out in
+// chunks of at most IMGENC_CHUNK_SIZE bytes (+12 for PNG chunk framing)
+// through a write callback. The whole encoded image is never held in memory.
+// The output only depends on the input pixels so it's byte for byte reproducible.
+
+#define IMGENC_MAX_WIDTH   (1024u)
+#define IMGENC_CHUNK_SIZE  (8u * 1024)
+
+// Deflate sliding window. Matches are searched at most IMGENC_WINDOW_SIZE bytes back.
+#define IMGENC_WINDOW_SIZE (8u * 1024)
+#define IMGENC_HASH_BITS   (12u)
+
+
+typedef enum
+{
+	IMGENC_BMP = 0u, // 24 bits per pixel, uncompressed.
+	IMGENC_PNG = 1u  // 24 bits per pixel RGB, deflate with fixed Huffman codes.
+} ImgEncFmt;
+
+/**
+ * @brief      Called for each encoded chunk.
+ *
+ * @param      arg   The user argument.
+ * @param[in]  buf   The encoded data.
+ * @param[in]  size  The size of the data in bytes.
+ *
+ * @return     RES_OK or an error which aborts encoding.
+ */
+typedef Result (*ImgEncWriteCb)(void *arg, const void *buf, u32 size);
+
+// All fields are private. This struct is big so don't put it on the stack.
+typedef struct
+{
+	ImgEncWriteCb write;
+	void *arg;
+	Result res;            // First error. Sticky.
+	ImgEncFmt fmt;
+	u32 width;
+	u32 height;
+	u32 rowsLeft;
+
+	// PNG only.
+	u32 bitBuf;
+	u32 bitCnt;
+	u32 adler;
+	u32 pos;               // Number of bytes fed to the compressor.
+	u32 hash[1u<<IMGENC_HASH_BITS];
+	u8 window[IMGENC_WINDOW_SIZE * 2];
+	u8 row[1 + IMGENC_MAX_WIDTH * 3];
+
+	// Encoded data. Reserves room for the PNG chunk length, type and CRC.
+	u32 outPos;
+	u8 out[8 + IMGENC_CHUNK_SIZE + 4];
+} ImgEnc;
+
+
+
+/**
+ * @brief      Starts encoding an image and writes the file header.
+ *
+ * @param      enc     The encoder state.
+ * @param[in]  fmt     The output format.
+ * @param[in]  width   The width in pixels. 1 to IMGENC_MAX_WIDTH.
+ * @param[in]  height  The height in pixels.
+ * @param[in]  write   The write callback.
+ * @param      arg     The argument passed to the write callback.
+ *
+ * @return     Returns the result.
+ */
+Result IMGENC_start(ImgEnc *const enc, const ImgEncFmt fmt, const u32 width, const u32 height,
+                    ImgEncWriteCb write, void *const arg);
+
+/**
+ * @brief      Encodes rows from top to bottom.
+ *
+ * @param      enc     The encoder state.
+ * @param[in]  rows    The rows in GFX_BGR8 format.
+ * @param[in]  stride  The row stride in bytes.
+ * @param[in]  num     The number of rows.
+ *
+ * @return     Returns the result.
+ */
+Result IMGENC_writeRows(ImgEnc *const enc, const u8 *rows, const u32 stride, u32 num);
+
+/**
+ * @brief      Finishes the image and writes all remaining data.
+ *             All rows must have been written.
+ *
+ * @param      enc   The encoder state.
+ *
+ * @return     Returns the result.
+ */
+Result IMGENC_finish(ImgEnc *const enc);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
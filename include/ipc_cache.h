@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Cache maintenance for IPC buffers. Each buffer is handled according
+// to its direction (see ipc_handler.h) instead of flushing everything:
+//
+// Direction      Sender before   Sender after   Receiver before   Receiver after
+// send           clean           -              invalidate        -
+// receive        flush           invalidate*    invalidate        flush
+// receive (out)  invalidate      invalidate*    invalidate        flush
+//
+// * ARM11 only. Speculative prefetches may have pulled in lines during the command.
+//
+// Range invalidates clean partial lines at the start and end first so
+// only lines shared with other data are written back.
+// Memory sharing a cache line with a receive buffer must not
+// be written while the command is in flight.
+
+
+
+/**
+ * @brief      Cache maintenance before sending a command.
+ *
+ * @param[in]  cmd       The command code.
+ * @param[in]  buf       The command parameters.
+ * @param[in]  skipMask  Bit n set skips buffer n. For buffers copied elsewhere.
+ */
+void IPCCACHE_beforeSend(const u32 cmd, const u32 *const buf, const u32 skipMask);
+
+/**
+ * @brief      Cache maintenance after the response arrived.
+ *
+ * @param[in]  cmd       The command code.
+ * @param[in]  buf       The command parameters.
+ * @param[in]  skipMask  Bit n set skips buffer n. For buffers copied elsewhere.
+ */
+void IPCCACHE_afterResponse(const u32 cmd, const u32 *const buf, const u32 skipMask);
+
+/**
+ * @brief      Cache maintenance on the receiving side before handling a command.
+ *
+ * @param[in]  cmd       The command code.
+ * @param[in]  buf       The command parameters.
+ * @param[in]  skipMask  Bit n set skips buffer n. For buffers copied elsewhere.
+ */
+void IPCCACHE_beforeHandle(const u32 cmd, const u32 *const buf, const u32 skipMask);
+
+/**
+ * @brief      Cache maintenance on the receiving side after handling a command.
+ *
+ * @param[in]  cmd       The command code.
+ * @param[in]  buf       The command parameters.
+ * @param[in]  skipMask  Bit n set skips buffer n. For buffers copied elsewhere.
+ */
+void IPCCACHE_afterHandle(const u32 cmd, const u32 *const buf, const u32 skipMask);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
@@ -27,13 +27,24 @@ extern "C"
 #endif
 
 #define IPC_MAX_PARAMS               (15)
+#define IPC_CMD_OUT_BUF(n)           BIT(24u + (n))      // Buffer n is output only. See below.
+#define IPC_CMD_OUT_BUFS_MASK(cmd)   ((cmd)>>24 & 0x3Fu) // Bit n = buffer n.
+#define IPC_CMD_TAG_SHIFT            (16u)
+#define IPC_CMD_TAG_MASK(cmd)        ((cmd)>>16 & 0xFFu) // Request tag. 0 = untagged.
 #define IPC_CMD_RESP_FLAG            BIT(15)
-#define IPC_CMD_ID_MASK(cmd)         ((cmd)>>8)      // Max 127.
-#define IPC_CMD_SEND_BUFS_MASK(cmd)  ((cmd)>>6 & 3u) // Max 3.
-#define IPC_CMD_RECV_BUFS_MASK(cmd)  ((cmd)>>4 & 3u) // Max 3.
-#define IPC_CMD_PARAMS_MASK(cmd)     ((cmd) & 15u)   // Max 15.
+#define IPC_CMD_ID_MASK(cmd)         ((cmd)>>8 & 0x7Fu)  // Max 127.
+#define IPC_CMD_SEND_BUFS_MASK(cmd)  ((cmd)>>6 & 3u)     // Max 3.
+#define IPC_CMD_RECV_BUFS_MASK(cmd)  ((cmd)>>4 & 3u)     // Max 3.
+#define IPC_CMD_PARAMS_MASK(cmd)     ((cmd) & 15u)       // Max 15.
 
 
+// Buffer directions:
+// Send buffers are only read by the remote side.
+// Receive buffers are by default read and written. Bytes the remote side doesn't
+// write keep their old contents. Receive buffers marked with IPC_CMD_OUT_BUF()
+// are always fully written on success so their old contents are discarded
+// instead of written back. Buffers are counted from 0 starting with the send buffers.
+
 // https://stackoverflow.com/a/52770279
 // Note: __COUNTER__ is non standard.
 #define MAKE_CMD9(sendBufs, recvBufs, params) ((__COUNTER__ - _CMD9_C_BASE)<<8 | (sendBufs)<<6 | (recvBufs)<<4 | params)
@@ -45,18 +56,18 @@ typedef enum
 	// Filesystem API.
 	IPC_CMD9_FMOUNT          = MAKE_CMD9(0, 0, 1),
 	IPC_CMD9_FUNMOUNT        = MAKE_CMD9(0, 0, 1),
-	IPC_CMD9_FGETFREE        = MAKE_CMD9(0, 1, 1),
-	IPC_CMD9_FOPEN           = MAKE_CMD9(1, 1, 1),
+	IPC_CMD9_FGETFREE        = MAKE_CMD9(0, 1, 1) | IPC_CMD_OUT_BUF(0),
+	IPC_CMD9_FOPEN           = MAKE_CMD9(1, 1, 1) | IPC_CMD_OUT_BUF(1),
 	IPC_CMD9_FREAD           = MAKE_CMD9(0, 2, 1),
-	IPC_CMD9_FWRITE          = MAKE_CMD9(1, 1, 1),
+	IPC_CMD9_FWRITE          = MAKE_CMD9(1, 1, 1) | IPC_CMD_OUT_BUF(1),
 	IPC_CMD9_FSYNC           = MAKE_CMD9(0, 0, 1),
 	IPC_CMD9_FLSEEK          = MAKE_CMD9(0, 0, 2),
 	IPC_CMD9_FTELL           = MAKE_CMD9(0, 0, 1),
 	IPC_CMD9_FSIZE           = MAKE_CMD9(0, 0, 1),
 	IPC_CMD9_FCLOSE          = MAKE_CMD9(0, 0, 1),
-	IPC_CMD9_FSTAT           = MAKE_CMD9(1, 1, 0),
+	IPC_CMD9_FSTAT           = MAKE_CMD9(1, 1, 0) | IPC_CMD_OUT_BUF(1),
 	IPC_CMD9_FCHDIR          = MAKE_CMD9(1, 0, 0),
-	IPC_CMD9_FOPEN_DIR       = MAKE_CMD9(1, 1, 0),
+	IPC_CMD9_FOPEN_DIR       = MAKE_CMD9(1, 1, 0) | IPC_CMD_OUT_BUF(1),
 	IPC_CMD9_FREAD_DIR       = MAKE_CMD9(0, 2, 2),
 	IPC_CMD9_FCLOSE_DIR      = MAKE_CMD9(0, 0, 1),
 	IPC_CMD9_FMKDIR          = MAKE_CMD9(1, 0, 0),
@@ -64,14 +75,14 @@ typedef enum
 	IPC_CMD9_FUNLINK         = MAKE_CMD9(1, 0, 0),
 
 	// PRNG API.
-	IPC_CMD9_PRNG_GET_SEED   = MAKE_CMD9(0, 1, 0),
-	IPC_CMD9_PRNG_GET_RAND0  = MAKE_CMD9(0, 1, 0),
-	IPC_CMD9_PRNG_GET_RAND1  = MAKE_CMD9(0, 1, 0),
+	IPC_CMD9_PRNG_GET_SEED   = MAKE_CMD9(0, 1, 0) | IPC_CMD_OUT_BUF(0),
+	IPC_CMD9_PRNG_GET_RAND0  = MAKE_CMD9(0, 1, 0) | IPC_CMD_OUT_BUF(0),
+	IPC_CMD9_PRNG_GET_RAND1  = MAKE_CMD9(0, 1, 0) | IPC_CMD_OUT_BUF(0),
 
 	// open_agb_firm specific API.
 	IPC_CMD9_PREPARE_GBA     = MAKE_CMD9(1, 0, 2),
 	IPC_CMD9_SET_GBA_RTC     = MAKE_CMD9(0, 0, 2),
-	IPC_CMD9_GET_GBA_RTC     = MAKE_CMD9(0, 1, 0),
+	IPC_CMD9_GET_GBA_RTC     = MAKE_CMD9(0, 1, 0) | IPC_CMD_OUT_BUF(0),
 	IPC_CMD9_BACKUP_GBA_SAVE = MAKE_CMD9(0, 0, 0),
 
 	// Miscellaneous API.
@@ -0,0 +1,201 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Single producer (ARM11), single consumer (ARM9) command ring in shared memory.
+// The ring is split into cache lines and every line has exactly one writer at a
+// time so the two incoherent data caches only need clean/invalidate by range.
+// Records are whole lines: a header line, the parameter words and inline buffers.
+// Records never wrap. The rest of the ring is skipped with a padding record instead.
+// Completion is signaled in the header line. PXI sync IRQs are only used as doorbells.
+
+#define IPC_RING_LINE_SIZE    (32u)  // ARM9 and ARM11 cache line size.
+#define IPC_RING_LINES        (128u) // Must be a power of 2.
+#define IPC_RING_MAX_REC      (32u)  // Max record size in lines.
+#define IPC_RING_MAX_WORDS    (64u)  // Max parameter words per record.
+
+
+typedef struct
+{
+	u32 cmd;        // Tagged command code. 0 marks padding up to the end of the ring.
+	u32 lines;      // Record size in lines including this header.
+	u32 words;      // Number of parameter words. They start at the next line.
+	u32 inlineMask; // Bit n set if IpcBuffer n was copied into the record. Its ptr is then a ring offset.
+	u32 res;        // Command result. Written by the consumer.
+	u32 done;       // Written by the consumer after res and all output data.
+	u32 released;   // Producer only. Set once the record can be reused.
+	u32 _unused;
+} IpcRingRec;
+static_assert(sizeof(IpcRingRec) == IPC_RING_LINE_SIZE);
+
+typedef struct
+{
+	vu32 head;                                   // Published write position in lines. Producer only.
+	u32 _unused0[7];
+	vu32 readPos;                                // Read position in lines. Consumer only.
+	u32 _unused1[7];
+	u8 data[IPC_RING_LINES * IPC_RING_LINE_SIZE];
+} IpcRing;
+static_assert(offsetof(IpcRing, data) % IPC_RING_LINE_SIZE == 0);
+
+// Private state of each side. The positions are free running line counters.
+typedef struct
+{
+	IpcRing *ring;
+	u32 head;
+	u32 tail;       // Oldest record that was not released yet.
+} IpcRingProducer;
+
+typedef struct
+{
+	IpcRing *ring;
+	u32 readPos;
+} IpcRingConsumer;
+
+
+
+/**
+ * @brief      Returns the number of lines needed for a record.
+ *
+ * @param[in]  words        The number of parameter words.
+ * @param[in]  inlineBytes  The total size of all inline buffers. Each starts on a new line.
+ * @param[in]  inlineBufs   The number of inline buffers.
+ *
+ * @return     The record size in lines.
+ */
+static inline u32 IPCRING_recLines(const u32 words, const u32 inlineBytes, const u32 inlineBufs)
+{
+	const u32 paramLines = (words * 4 + IPC_RING_LINE_SIZE - 1) / IPC_RING_LINE_SIZE;
+	return 1 + paramLines + (inlineBytes + inlineBufs * (IPC_RING_LINE_SIZE - 1)) / IPC_RING_LINE_SIZE;
+}
+
+/**
+ * @brief      Returns a pointer to the parameter words of a record.
+ *
+ * @param      rec   The record.
+ *
+ * @return     The parameter words.
+ */
+static inline u32* IPCRING_params(IpcRingRec *const rec)
+{
+	return (u32*)(rec + 1);
+}
+
+/**
+ * @brief      Initializes the ring and the producer state. The ring must be line aligned.
+ *
+ * @param      prod  The producer state.
+ * @param      ring  The ring.
+ */
+void IPCRING_init(IpcRingProducer *const prod, IpcRing *const ring);
+
+/**
+ * @brief      Reserves a record. Reserve, fill and publish must not be interleaved
+ *             with another record. The header fields except cmd, words and inlineMask are set.
+ *
+ * @param      prod   The producer state.
+ * @param[in]  lines  The record size in lines. Max IPC_RING_MAX_REC.
+ *
+ * @return     The record or NULL if the ring is full.
+ */
+IpcRingRec* IPCRING_reserve(IpcRingProducer *const prod, const u32 lines);
+
+/**
+ * @brief      Copies a buffer into a record and returns its ring offset for the IpcBuffer.
+ *
+ * @param      prod  The producer state.
+ * @param      dst   Where to copy to inside the record. Must be line aligned.
+ * @param[in]  src   The source. NULL for output only buffers.
+ * @param[in]  size  The size.
+ *
+ * @return     The ring offset.
+ */
+u32 IPCRING_putInline(const IpcRingProducer *const prod, void *const dst, const void *const src, const u32 size);
+
+/**
+ * @brief      Makes the reserved record visible to the consumer.
+ *
+ * @param      prod  The producer state.
+ * @param      rec   The record.
+ */
+void IPCRING_publish(IpcRingProducer *const prod, IpcRingRec *const rec);
+
+/**
+ * @brief      Checks if the consumer completed a record.
+ *             After it returned true the whole record is up to date.
+ *
+ * @param      rec   The record.
+ *
+ * @return     Returns true if done.
+ */
+bool IPCRING_isDone(IpcRingRec *const rec);
+
+/**
+ * @brief      Returns a pointer to an inline buffer of a completed record.
+ *
+ * @param[in]  prod  The producer state.
+ * @param[in]  off   The ring offset returned by IPCRING_putInline().
+ *
+ * @return     The buffer.
+ */
+void* IPCRING_inlinePtr(const IpcRingProducer *const prod, const u32 off);
+
+/**
+ * @brief      Releases a completed record for reuse.
+ *
+ * @param      rec   The record.
+ */
+void IPCRING_release(IpcRingRec *const rec);
+
+/**
+ * @brief      Initializes the consumer state.
+ *
+ * @param      cons  The consumer state.
+ * @param      ring  The ring set up by the producer.
+ */
+void IPCRING_attach(IpcRingConsumer *const cons, IpcRing *const ring);
+
+/**
+ * @brief      Returns the next published record. Inline buffer offsets are turned into pointers.
+ *
+ * @param      cons  The consumer state.
+ *
+ * @return     The record or NULL if there is none.
+ */
+IpcRingRec* IPCRING_next(IpcRingConsumer *const cons);
+
+/**
+ * @brief      Completes a record. Output data written to inline buffers is made visible first.
+ *
+ * @param      rec   The record.
+ * @param[in]  res   The result.
+ */
+void IPCRING_complete(IpcRingRec *const rec, const u32 res);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
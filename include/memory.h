@@ -32,6 +32,21 @@ extern "C"
 void copy32(u32 *restrict dst, const u32 *restrict src, u32 size);
 void clear32(u32 *ptr, const u32 value, u32 size);
 
+#ifdef __ARM11__
+// ARM11 tuned versions with PLD prefetching. No alignment requirements.
+// Same semantics as memcpy(), memmove(), memset() and memcmp().
+void copyMem(void *restrict dst, const void *restrict src, u32 size);
+void moveMem(void *dst, const void *src, u32 size);
+void fillMem(void *ptr, const u8 value, u32 size);
+int compareMem(const void *a, const void *b, u32 size);
+#endif // #ifdef __ARM11__
+
+// Portable C reference versions of the above. Also build for the host.
+void copyMemRef(void *restrict dst, const void *restrict src, u32 size);
+void moveMemRef(void *dst, const void *src, u32 size);
+void fillMemRef(void *ptr, const u8 value, u32 size);
+int compareMemRef(const void *a, const void *b, u32 size);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
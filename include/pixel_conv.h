@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "drivers/gfx.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Bulk pixel format conversion between all GfxFmt pairs.
+// Results are bit exact to converting each pixel to 8 bits per channel and back
+// with the functions in rgb_conv.h. Formats without alpha read as opaque.
+// The ARM11 build uses packed halfword ops, the C fallback builds everywhere.
+
+
+
+/**
+ * @brief      Converts contiguous pixels. Word aligned buffers are converted 4 pixels at a time.
+ *             Overlapping buffers are only supported if dst == src and the formats have the same size.
+ *
+ * @param      dst     The destination.
+ * @param[in]  dstFmt  The destination format.
+ * @param[in]  src     The source.
+ * @param[in]  srcFmt  The source format.
+ * @param[in]  count   The number of pixels.
+ */
+void convertPixels(void *dst, const GfxFmt dstFmt, const void *src, const GfxFmt srcFmt, u32 count);
+
+/**
+ * @brief      Converts upright rows of a frame buffer in the native rotated layout.
+ *             Pixel x, y of the frame buffer is at index x * height + (height - 1 - y).
+ *             For example a screenshot of the top LCD uses width 400 and height 240.
+ *
+ * @param      dst        The destination. Rows are stored from top to bottom.
+ * @param[in]  dstFmt     The destination format.
+ * @param[in]  dstStride  The destination row stride in bytes.
+ * @param[in]  fb         The frame buffer.
+ * @param[in]  fbFmt      The frame buffer format.
+ * @param[in]  width      The frame buffer width in upright orientation.
+ * @param[in]  height     The frame buffer height in upright orientation.
+ * @param[in]  y          The first row to convert.
+ * @param[in]  rows       The number of rows to convert.
+ */
+void convertPixelsRotated(void *dst, const GfxFmt dstFmt, const u32 dstStride, const void *fb, const GfxFmt fbFmt,
+                          const u32 width, const u32 height, const u32 y, const u32 rows);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Software SHA-1/224/256 with the same parameters as the hardware engine.
+// Mode and endianess use the REG_SHA_CNT defines from drivers/sha.h.
+// Unlike the hardware input can have any size and alignment in every update call.
+typedef struct
+{
+	u32 state[8];
+	u64 length;     // Total input bytes so far.
+	u8 block[64];   // Partial block. length % 64 bytes are valid.
+	u16 params;     // Mode and input endianess.
+} ShaSwState;
+
+
+
+/**
+ * @brief      Sets input mode, endianess and starts the hash operation.
+ *             SHA_IN_LITTLE byte swaps every 32 bit input word like the hardware does.
+ *
+ * @param      st      The software SHA state.
+ * @param[in]  params  Mode and input endianess. See REG_SHA_CNT defines.
+ */
+void SHA_swStart(ShaSwState *const st, u16 params);
+
+/**
+ * @brief      Hashes the data pointed to.
+ *
+ * @param      st    The software SHA state.
+ * @param[in]  data  Pointer to data to hash.
+ * @param[in]  size  Size of the data to hash.
+ */
+void SHA_swUpdate(ShaSwState *const st, const void *data, u32 size);
+
+/**
+ * @brief      Generates the final hash.
+ *
+ * @param      st         The software SHA state.
+ * @param      hash       Pointer to memory to copy the hash to.
+ * @param[in]  endianess  Endianess bitmask for the hash.
+ */
+void SHA_swFinish(ShaSwState *const st, u32 *const hash, u16 endianess);
+
+/**
+ * @brief      Hashes a single block of data in software and outputs the hash.
+ *
+ * @param[in]  data           Pointer to data to hash.
+ * @param[in]  size           Size of the data to hash.
+ * @param      hash           Pointer to memory to copy the hash to.
+ * @param[in]  params         Mode and input endianess. See REG_SHA_CNT defines.
+ * @param[in]  hashEndianess  Endianess bitmask for the hash.
+ */
+void sha_sw(const void *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
\ No newline at end of file
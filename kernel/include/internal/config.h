@@ -25,7 +25,7 @@
  * Maximum number of objects we can create (Slabheap).
 */
 #define MAX_TASKS        (4) // Including main and idle task.
-#define MAX_EVENTS       (16)
+#define MAX_EVENTS       (24)
 #define MAX_MUTEXES      (8)
 #define MAX_SEMAPHORES   (2)
 #define MAX_TIMERS       (0)
@@ -2,12 +2,15 @@
 // https://github.com/devkitPro/libctru
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "types.h"
 #include "drivers/gfx.h"
 #include "arm11/console.h"
 #include "arm11/fmt.h"
 #include "util.h"
+#include "memory.h"
+#include "fsutil.h"
 
 #include "arm11/font_6x10.h"
 
@@ -57,7 +60,10 @@ PrintConsole defaultConsole =
 	{
 		(u8*)default_font, //font gfx
 		0, //first ascii character in the set
-		256 //number of characters in the font set
+		256, //number of characters in the font set
+		FONT_WIDTH, //glyph width
+		FONT_HEIGHT, //glyph height
+		NULL //code points (linear font)
 	},
 	(u16*)NULL,
 	0,0,	//cursorX cursorY
@@ -73,7 +79,14 @@ PrintConsole defaultConsole =
 	0,		// background color
 	0,		// flags
 	0,		//print callback
-	false	//console initialized
+	false,	//console initialized
+	GFX_BGR565,	//frame buffer format
+	NULL,	//deferred rendering cells
+	0,		//number of cells
+	0,		//first cell row
+	0,		//dirty rows
+	LCD_HEIGHT_BOT,	//frame buffer width
+	{0, 0, 0}	//UTF-8 decoder
 };
 
 PrintConsole currentCopy;
@@ -84,109 +97,540 @@ PrintConsole* consoleGetDefault(void){return &defaultConsole;}
 
 void consolePrintChar(int c);
 void consoleDrawChar(int c);
+static void newRow();
+
+//---------------------------------------------------------------------------------
+// Font atlas
+//---------------------------------------------------------------------------------
+#define COL_H			(LCD_WIDTH_BOT)	// Frame buffer column height in pixels (the LCDs are rotated 90° CCW).
+#define MAX_ATLASES		(4)			// Fonts with precomputed glyphs. Slot 0 is the default font.
+#define NO_GLYPH		(0xFFFFu)
+
+// Precomputed glyphs of a font.
+typedef struct
+{
+	const u8 *gfx;		// Font graphics this atlas was built from. NULL if the slot is free.
+	const u16 *codePoints;	// Code points of the font this atlas was built from.
+	u8 width;			// Glyph width in pixels.
+	u8 height;			// Glyph height in pixels.
+	u16 numGlyphs;
+	u16 asciiOffset;	// First code point for linear fonts.
+	u16 fallback;		// Glyph for unknown characters or NO_GLYPH.
+	bool sparse;		// Code points are mapped via pages.
+	u32 *cols;			// Glyph columns in frame buffer order, glyph major.
+						// Bit n is the nth pixel counted from the bottom of the cell.
+	u16 *pages;			// 256 glyph indices per used page.
+	u16 pageIdx[256];	// BMP code point bits 8-15 to page or NO_GLYPH.
+} FontAtlas;
+
+static FontAtlas atlases[MAX_ATLASES];
+static FontAtlas *lastAtlas = NULL;
+static u32 defaultAtlasCols[256 * FONT_WIDTH]; // No heap usage for the default (exception) font.
+static u32 nextAtlasSlot = 1;
+
+static void freeAtlas(FontAtlas *atlas)
+{
+	if (atlas->cols != defaultAtlasCols) free(atlas->cols);
+	free(atlas->pages);
+	memset(atlas, 0, sizeof(FontAtlas));
+}
+
+static u32 atlasLookupRaw(const FontAtlas *atlas, u32 cp)
+{
+	u32 glyph;
+	if (!atlas->sparse) {
+		glyph = cp - atlas->asciiOffset;
+	} else if (cp <= 0xFFFFu) {
+		const u32 page = atlas->pageIdx[cp>>8];
+		glyph = (page != NO_GLYPH ? atlas->pages[page * 256 + (cp & 0xFFu)] : NO_GLYPH);
+	} else {
+		glyph = NO_GLYPH;
+	}
+
+	return (glyph < atlas->numGlyphs ? glyph : NO_GLYPH);
+}
+
+// Code point to glyph index. Returns the fallback glyph for unknown characters.
+static inline u32 atlasLookup(const FontAtlas *atlas, u32 cp)
+{
+	const u32 glyph = atlasLookupRaw(atlas, cp);
+	return (glyph != NO_GLYPH ? glyph : atlas->fallback);
+}
+
+static bool buildAtlas(FontAtlas *atlas, const ConsoleFont *font)
+{
+	const u32 width = font->width;
+	const u32 height = font->height;
+	const u32 numGlyphs = font->numChars;
+	const u32 rowBytes = (width + 7) / 8;
+
+	atlas->cols = (font->gfx == (const u8*)default_font && numGlyphs <= 256 && width == FONT_WIDTH ?
+	               defaultAtlasCols : malloc(numGlyphs * width * sizeof(u32)));
+	if (atlas->cols == NULL) return false;
+
+	// Transpose the row major font into columns.
+	u32 *cols = atlas->cols;
+	const u8 *glyphRows = font->gfx;
+	for (u32 c = 0; c < numGlyphs; c++) {
+		for (u32 x = 0; x < width; x++) {
+			const u8 *row = &glyphRows[x / 8];
+			const u32 shift = 7 - (x % 8);
+			u32 col = 0;
+			for (u32 y = 0; y < height; y++, row += rowBytes)
+				col |= ((*row>>shift) & 1u)<<(height - 1 - y);
+			*cols++ = col;
+		}
+		glyphRows += rowBytes * height;
+	}
+
+	atlas->width = width;
+	atlas->height = height;
+	atlas->numGlyphs = numGlyphs;
+	atlas->asciiOffset = font->asciiOffset;
+	atlas->sparse = font->codePoints != NULL;
+	atlas->pages = NULL;
+
+	if (atlas->sparse) {
+		// Count used pages first so all of them fit in one allocation.
+		memset(atlas->pageIdx, 0xFF, sizeof(atlas->pageIdx));
+		u32 numPages = 0;
+		for (u32 i = 0; i < numGlyphs; i++) {
+			u16 *const idx = &atlas->pageIdx[font->codePoints[i]>>8];
+			if (*idx == NO_GLYPH) *idx = numPages++;
+		}
+
+		atlas->pages = malloc(numPages * 256 * sizeof(u16));
+		if (atlas->pages == NULL) return false;
+		memset(atlas->pages, 0xFF, numPages * 256 * sizeof(u16));
+
+		for (u32 i = 0; i < numGlyphs; i++) {
+			const u32 cp = font->codePoints[i];
+			atlas->pages[atlas->pageIdx[cp>>8] * 256 + (cp & 0xFFu)] = i;
+		}
+	}
+
+	u32 fallback = atlasLookupRaw(atlas, 0xFFFDu);
+	if (fallback == NO_GLYPH) fallback = atlasLookupRaw(atlas, '?');
+	atlas->fallback = fallback;
+
+	atlas->codePoints = font->codePoints;
+	atlas->gfx = font->gfx;
+	return true;
+}
+
+// Fonts may share graphics but differ in glyph size or mapping.
+static inline bool atlasMatches(const FontAtlas *atlas, const ConsoleFont *font)
+{
+	return atlas->gfx == font->gfx && atlas->width == font->width && atlas->height == font->height &&
+	       atlas->numGlyphs == font->numChars && atlas->asciiOffset == font->asciiOffset &&
+	       atlas->codePoints == font->codePoints;
+}
+
+// Returns the atlas for a font. Built on first use.
+static const FontAtlas* getAtlas(const ConsoleFont *font)
+{
+	if (lastAtlas != NULL && atlasMatches(lastAtlas, font)) return lastAtlas;
+
+	FontAtlas *atlas = NULL;
+	for (u32 i = 0; i < MAX_ATLASES; i++) {
+		if (atlases[i].gfx != NULL && atlasMatches(&atlases[i], font)) {
+			atlas = &atlases[i];
+			break;
+		}
+	}
+
+	if (atlas == NULL) {
+		if (font->gfx == (const u8*)default_font) {
+			atlas = &atlases[0];
+		} else {
+			// Replace fonts round robin.
+			atlas = &atlases[nextAtlasSlot];
+			if (++nextAtlasSlot >= MAX_ATLASES) nextAtlasSlot = 1;
+		}
+
+		freeAtlas(atlas);
+		if (!buildAtlas(atlas, font)) {
+			freeAtlas(atlas);
+			return NULL;
+		}
+	}
+
+	lastAtlas = atlas;
+	return atlas;
+}
+
+//---------------------------------------------------------------------------------
+// UTF-8
+//---------------------------------------------------------------------------------
+enum
+{
+	UTF8_MORE   = -1,	// Need more bytes.
+	UTF8_BROKEN = -2	// Sequence interrupted. Feed the byte again after handling this.
+};
+
+// Each console has its own decoder so sequences to different consoles don't mix.
+static int utf8Decode(ConsoleUtf8 *utf8, u8 b)
+{
+	if (utf8->need > 0) {
+		if ((b & 0xC0u) != 0x80u) {
+			utf8->need = 0;
+			return UTF8_BROKEN;
+		}
+
+		utf8->cp = utf8->cp<<6 | (b & 0x3Fu);
+		if (--utf8->need > 0) return UTF8_MORE;
+
+		// Reject overlong encodings, surrogates and anything above U+10FFFF.
+		const u32 cp = utf8->cp;
+		if (cp < utf8->min || (cp >= 0xD800u && cp <= 0xDFFFu) || cp > 0x10FFFFu) return 0xFFFD;
+		return cp;
+	}
+
+	if (b < 0x80u) return b;
+	if ((b & 0xE0u) == 0xC0u) { utf8->cp = b & 0x1Fu; utf8->need = 1; utf8->min = 0x80u; }
+	else if ((b & 0xF0u) == 0xE0u) { utf8->cp = b & 0x0Fu; utf8->need = 2; utf8->min = 0x800u; }
+	else if ((b & 0xF8u) == 0xF0u) { utf8->cp = b & 0x07u; utf8->need = 3; utf8->min = 0x10000u; }
+	else return 0xFFFD; // Stray continuation byte or invalid lead byte.
+
+	return UTF8_MORE;
+}
+
+//---------------------------------------------------------------------------------
+// Renderer
+//---------------------------------------------------------------------------------
+// Resolved colors for a run of characters with the same attributes.
+typedef struct
+{
+	u32 extraMask;			// Underline/crossed out pixels ORed into every column.
+	union
+	{
+		u32 pair[4];		// 16 bit formats: 2 pixels per word for each 2 bit mask.
+		u32 quad[16][3];	// BGR8: 4 pixels in 3 words for each 4 bit mask.
+	};
+} CellStyle;
+
+static inline u32 fbBytesPerPixel(void)
+{
+	return (currentConsole->fbFormat == GFX_BGR8 ? 3 : 2);
+}
+
+// Returns the bottom pixel of a character cell column. x in pixels, y in cells.
+static inline u8* cellColumnPtr(int x, int y)
+{
+	const u32 pixel = x * COL_H + (COL_H - (y + 1) * currentConsole->font.height);
+	return (u8*)currentConsole->frameBuffer + pixel * fbBytesPerPixel();
+}
+
+static void consoleBuildStyle(CellStyle *style, u16 fg, u16 bg, int flags, bool forFill)
+{
+	if (!(flags & CONSOLE_FG_CUSTOM)) {
+		if (flags & CONSOLE_COLOR_BOLD) {
+			fg = colorTable[fg + 8];
+		} else if (flags & CONSOLE_COLOR_FAINT) {
+			fg = colorTable[fg + 16];
+		} else {
+			fg = colorTable[fg];
+		}
+	}
+
+	if (!(flags & CONSOLE_BG_CUSTOM)) {
+		bg = colorTable[bg];
+	}
+
+	if (flags & CONSOLE_COLOR_REVERSE) {
+		u16 tmp = fg;
+		fg = bg;
+		bg = tmp;
+	}
+
+	u32 extraMask = 0;
+	if (!forFill) {
+		const u32 height = currentConsole->font.height;
+		if (flags & CONSOLE_UNDERLINE) extraMask |= BIT(0);
+		if (flags & CONSOLE_CROSSED_OUT) extraMask |= BIT(height - height / 2);
+	}
+	style->extraMask = extraMask;
+
+	if (currentConsole->fbFormat != GFX_BGR8) {
+		for (u32 i = 0; i < 4; i++)
+			style->pair[i] = (u32)(i & 2u ? fg : bg)<<16 | (i & 1u ? fg : bg);
+	} else {
+		u8 fg8[3] = {rgbFive2Eight(fg & 0x1Fu), rgbSix2Eight(fg>>5 & 0x3Fu), rgbFive2Eight(fg>>11)};
+		u8 bg8[3] = {rgbFive2Eight(bg & 0x1Fu), rgbSix2Eight(bg>>5 & 0x3Fu), rgbFive2Eight(bg>>11)};
+		for (u32 i = 0; i < 16; i++) {
+			u8 bytes[12];
+			for (u32 p = 0; p < 4; p++)
+				memcpy(&bytes[p * 3], (i & BIT(p) ? fg8 : bg8), 3);
+			memcpy(style->quad[i], bytes, 12);
+		}
+	}
+}
+
+static inline void drawColumn16(u8 *dst, u32 mask, u32 height, const CellStyle *style)
+{
+	// Odd cell heights can start a column on a halfword.
+	if ((uintptr_t)dst & 2u) {
+		*(u16*)dst = style->pair[mask & 1u];
+		dst += 2;
+		mask >>= 1;
+		height--;
+	}
+
+	u32 *dst32 = (u32*)dst;
+	for (; height >= 2; height -= 2) {
+		*dst32++ = style->pair[mask & 3u];
+		mask >>= 2;
+	}
+
+	if (height > 0) *(u16*)dst32 = style->pair[mask & 1u];
+}
+
+static inline void drawColumn24(u8 *dst, u32 mask, u32 height, const CellStyle *style)
+{
+	// Expand into an aligned buffer and copy the column in one go.
+	u32 tmp[32 / 4 * 3];
+	u32 *tmpPtr = tmp;
+	for (u32 i = 0; i < (height + 3) / 4; i++) {
+		const u32 *q = style->quad[mask & 0xFu];
+		*tmpPtr++ = q[0];
+		*tmpPtr++ = q[1];
+		*tmpPtr++ = q[2];
+		mask >>= 4;
+	}
+	memcpy(dst, tmp, height * 3);
+}
+
+static inline bool consoleIsDeferred(void)
+{
+	return currentConsole->cells != NULL;
+}
+
+// Returns the cell row in the ring for window row y.
+static inline ConsoleCell* consoleCellRow(int y)
+{
+	int row = currentConsole->firstRow + y;
+	if (row >= currentConsole->windowHeight) row -= currentConsole->windowHeight;
+	return &currentConsole->cells[row * currentConsole->windowWidth];
+}
+
+static inline void consoleMarkDirty(int y, int height)
+{
+	const u64 rows = (height >= 64 ? ~UINT64_C(0) : BIT64(height) - 1);
+	currentConsole->dirtyRows |= rows<<y;
+}
+
+// Draws glyphs of a single row. x and y in window cells.
+// chars are code points stride bytes apart.
+static void consoleDrawGlyphs(int x, int y, const CellStyle *style, const u16 *chars, u32 stride, u32 len) {
+	const FontAtlas *atlas = getAtlas(&currentConsole->font);
+	if (atlas == NULL) return;
+
+	const u32 width = atlas->width;
+	const u32 height = atlas->height;
+	const u32 colStride = COL_H * fbBytesPerPixel();
+	u8 *dst = cellColumnPtr((currentConsole->windowX + x) * width, currentConsole->windowY + y);
+
+	const u32 extraMask = style->extraMask;
+	const bool is24 = currentConsole->fbFormat == GFX_BGR8;
+	while (len--) {
+		const u32 glyph = atlasLookup(atlas, *chars);
+		chars = (const u16*)((const u8*)chars + stride);
+		if (glyph == NO_GLYPH) {
+			dst += colStride * width;
+			continue;
+		}
+
+		const u32 *cols = &atlas->cols[glyph * width];
+		for (u32 i = 0; i < width; i++) {
+			if (is24) drawColumn24(dst, cols[i] | extraMask, height, style);
+			else      drawColumn16(dst, cols[i] | extraMask, height, style);
+			dst += colStride;
+		}
+	}
+}
+
+// Fills a rectangle of window cells with the background color.
+static void consoleFillRect(int cellX, int cellY, int width, int height, const CellStyle *style) {
+	const u32 bpp = fbBytesPerPixel();
+	const u32 colStride = COL_H * bpp;
+	const int x = (currentConsole->windowX + cellX) * currentConsole->font.width;
+	const int y = currentConsole->windowY + cellY + height - 1; // Bottom row is lowest in memory.
+	u8 *dst = cellColumnPtr(x, y);
+	const u32 pixels = height * currentConsole->font.height;
+	u32 columns = width * currentConsole->font.width;
+
+	if (bpp == 2) {
+		// Columns are contiguous if the rectangle covers the full frame buffer height.
+		if (pixels == COL_H) {
+			clear32((u32*)dst, style->pair[0], columns * colStride);
+			return;
+		}
+
+		while (columns--) {
+			// Odd cell heights can start a column on a halfword.
+			u8 *ptr = dst;
+			u32 left = pixels;
+			if ((uintptr_t)ptr & 2u) {
+				*(u16*)ptr = style->pair[0];
+				ptr += 2;
+				left--;
+			}
+			clear32((u32*)ptr, style->pair[0], left * 2);
+			dst += colStride;
+		}
+	} else {
+		while (columns--) {
+			u8 *ptr = dst;
+			u32 left = pixels;
+			for (; left >= 4; left -= 4, ptr += 12) memcpy(ptr, style->quad[0], 12);
+			memcpy(ptr, style->quad[0], left * 3);
+			dst += colStride;
+		}
+	}
+}
+
+// Draws code points at the cursor without wrapping or control character handling.
+static void consoleDrawString(const u16 *str, u32 len) {
+	const int x = currentConsole->cursorX;
+	const int y = currentConsole->cursorY;
+
+	if (consoleIsDeferred()) {
+		ConsoleCell *cell = consoleCellRow(y) + x;
+		const ConsoleCell tmpl = {0, currentConsole->fg, currentConsole->bg, currentConsole->flags};
+		while (len--) {
+			*cell = tmpl;
+			(cell++)->chr = *str++;
+		}
+		consoleMarkDirty(y, 1);
+		return;
+	}
+
+	CellStyle style;
+	consoleBuildStyle(&style, currentConsole->fg, currentConsole->bg, currentConsole->flags, false);
+	consoleDrawGlyphs(x, y, &style, str, sizeof(u16), len);
+}
+
+// Clears a rectangle of window cells with the current background color.
+static void consoleFillCells(int cellX, int cellY, int width, int height) {
+	if (cellX < 0) { width += cellX; cellX = 0; }
+	if (cellX + width > currentConsole->windowWidth) width = currentConsole->windowWidth - cellX;
+	if (width <= 0 || height <= 0) return;
+
+	// Underline and crossed out don't apply to cleared cells.
+	const int flags = currentConsole->flags & ~(CONSOLE_UNDERLINE | CONSOLE_CROSSED_OUT);
+	if (consoleIsDeferred()) {
+		const ConsoleCell tmpl = {' ', currentConsole->fg, currentConsole->bg, flags};
+		for (int y = cellY; y < cellY + height; y++) {
+			ConsoleCell *cell = consoleCellRow(y) + cellX;
+			for (int i = 0; i < width; i++) *cell++ = tmpl;
+		}
+		consoleMarkDirty(cellY, height);
+		return;
+	}
+
+	CellStyle style;
+	consoleBuildStyle(&style, currentConsole->fg, currentConsole->bg, flags, true);
+	consoleFillRect(cellX, cellY, width, height, &style);
+}
+
+static void consoleScrollWindow(void) {
+	if (consoleIsDeferred()) {
+		// Rotate the ring instead of moving cells. Every row moves on screen.
+		if (++currentConsole->firstRow >= currentConsole->windowHeight) currentConsole->firstRow = 0;
+		consoleMarkDirty(0, currentConsole->windowHeight);
+		consoleFillCells(0, currentConsole->windowHeight - 1, currentConsole->windowWidth, 1);
+		return;
+	}
+
+	const u32 bpp = fbBytesPerPixel();
+	const u32 colStride = COL_H * bpp;
+	const u32 rowBytes = currentConsole->font.height * bpp;
+	const u32 columns = currentConsole->windowWidth * currentConsole->font.width;
+	const u32 scrollBytes = (currentConsole->windowHeight - 1) * rowBytes;
+
+	// Text moves up which is towards higher addresses in the rotated frame buffer.
+	u8 *src = cellColumnPtr(currentConsole->windowX * currentConsole->font.width, currentConsole->windowY + currentConsole->windowHeight - 1);
+	if (currentConsole->windowHeight * currentConsole->font.height == COL_H) {
+		// Full height window. All columns are contiguous so move them at once.
+		// The garbage shifted into the bottom row is cleared below.
+		memmove(src + rowBytes, src, columns * colStride - rowBytes);
+	} else {
+		for (u32 i = 0; i < columns; i++) {
+			memmove(src + rowBytes, src, scrollBytes);
+			src += colStride;
+		}
+	}
+
+	consoleFillCells(0, currentConsole->windowHeight - 1, currentConsole->windowWidth, 1);
+}
+
+static void consoleFlush(void) {
+	// Deferred consoles flush in consoleRender().
+	if (!consoleIsDeferred()) GFX_flushBuffers();
+}
 
 //---------------------------------------------------------------------------------
 static void consoleCls(int mode) {
 //---------------------------------------------------------------------------------
 
-	int i = 0;
-	int colTemp,rowTemp;
+	const int cursorX = currentConsole->cursorX;
+	const int cursorY = currentConsole->cursorY;
+	const int width = currentConsole->windowWidth;
+	const int height = currentConsole->windowHeight;
 
 	switch (mode)
 	{
 		case 0:
 		{
-			colTemp = currentConsole->cursorX ;
-			rowTemp = currentConsole->cursorY ;
-
-			while(i++ < ((currentConsole->windowHeight * currentConsole->windowWidth) - (rowTemp * currentConsole->consoleWidth + colTemp)))
-				consolePrintChar(' ');
-
-			currentConsole->cursorX  = colTemp;
-			currentConsole->cursorY  = rowTemp;
+			// Cursor to end of window.
+			consoleFillCells(cursorX, cursorY, width - cursorX, 1);
+			consoleFillCells(0, cursorY + 1, width, height - (cursorY + 1));
 			break;
 		}
 		case 1:
 		{
-			colTemp = currentConsole->cursorX ;
-			rowTemp = currentConsole->cursorY ;
-
-			currentConsole->cursorY  = 0;
-			currentConsole->cursorX  = 0;
-
-			while (i++ < (rowTemp * currentConsole->windowWidth + colTemp))
-				consolePrintChar(' ');
-
-			currentConsole->cursorX  = colTemp;
-			currentConsole->cursorY  = rowTemp;
+			// Start of window to cursor.
+			consoleFillCells(0, 0, width, cursorY);
+			consoleFillCells(0, cursorY, cursorX, 1);
 			break;
 		}
 		case 2:
 		{
-			currentConsole->cursorY  = 0;
-			currentConsole->cursorX  = 0;
-
-			while(i++ < currentConsole->windowHeight * currentConsole->windowWidth)
-				consolePrintChar(' ');
+			consoleFillCells(0, 0, width, height);
 
 			currentConsole->cursorY  = 0;
 			currentConsole->cursorX  = 0;
 			break;
 		}
 	}
-	GFX_flushBuffers();
+	consoleFlush();
 }
 //---------------------------------------------------------------------------------
 static void consoleClearLine(int mode) {
 //---------------------------------------------------------------------------------
 
-	int i = 0;
-	int colTemp;
+	const int cursorX = currentConsole->cursorX;
+	const int cursorY = currentConsole->cursorY;
 
 	switch (mode)
 	{
 		case 0:
 		{
-			colTemp = currentConsole->cursorX ;
-
-			while(i++ < (currentConsole->windowWidth - colTemp)) {
-				consolePrintChar(' ');
-			}
-
-			currentConsole->cursorX  = colTemp;
-
+			consoleFillCells(cursorX, cursorY, currentConsole->windowWidth - cursorX, 1);
 			break;
 		}
 		case 1:
 		{
-			colTemp = currentConsole->cursorX ;
-
-			currentConsole->cursorX  = 0;
-
-			while(i++ < ((currentConsole->windowWidth - colTemp)-2)) {
-				consolePrintChar(' ');
-			}
-
-			currentConsole->cursorX  = colTemp;
-
+			consoleFillCells(0, cursorY, cursorX + 1, 1);
 			break;
 		}
 		case 2:
 		{
-			colTemp = currentConsole->cursorX ;
-
-			currentConsole->cursorX  = 0;
-
-			while(i++ < currentConsole->windowWidth) {
-				consolePrintChar(' ');
-			}
-
-			currentConsole->cursorX  = colTemp;
-
+			consoleFillCells(0, cursorY, currentConsole->windowWidth, 1);
 			break;
 		}
 	}
-	GFX_flushBuffers();
+	consoleFlush();
 }
 
 
@@ -481,6 +925,158 @@ static void consoleColorApply(void)
 	currentConsole->flags = escapeSeq.color.flags;
 }
 
+//---------------------------------------------------------------------------------
+// Log capture
+//---------------------------------------------------------------------------------
+static struct
+{
+	char *buf;
+	u32 size;
+	u32 pos;	// Next write position.
+	bool wrapped;
+} consoleLog;
+
+static void consoleLogWrite(const char *ptr, size_t len) {
+	if (consoleLog.buf == NULL) return;
+
+	// Only the newest size bytes fit.
+	const u32 size = consoleLog.size;
+	if (len >= size) {
+		ptr += len - size;
+		len = size;
+	}
+
+	u32 pos = consoleLog.pos;
+	const u32 first = (len > size - pos ? size - pos : len);
+	memcpy(&consoleLog.buf[pos], ptr, first);
+	memcpy(consoleLog.buf, ptr + first, len - first);
+
+	pos += len;
+	if (pos >= size) {
+		pos -= size;
+		consoleLog.wrapped = true;
+	}
+	consoleLog.pos = pos;
+}
+
+static void reverseBytes(char *start, char *end) {
+	while (start < --end) {
+		const char tmp = *start;
+		*start++ = *end;
+		*end = tmp;
+	}
+}
+
+//---------------------------------------------------------------------------------
+void consoleSetLogBuffer(char *buf, u32 size) {
+//---------------------------------------------------------------------------------
+	consoleLog.buf = (size > 0 ? buf : NULL);
+	consoleLog.size = size;
+	consoleLog.pos = 0;
+	consoleLog.wrapped = false;
+}
+
+//---------------------------------------------------------------------------------
+u32 consoleGetLog(const char **out) {
+//---------------------------------------------------------------------------------
+	if (consoleLog.buf == NULL) {
+		*out = NULL;
+		return 0;
+	}
+
+	// Rotate the oldest byte to the start. Afterwards the log continues linearly.
+	if (consoleLog.wrapped) {
+		char *const buf = consoleLog.buf;
+		const u32 pos = consoleLog.pos;
+		reverseBytes(buf, buf + pos);
+		reverseBytes(buf + pos, buf + consoleLog.size);
+		reverseBytes(buf, buf + consoleLog.size);
+		consoleLog.pos = consoleLog.size;
+		consoleLog.wrapped = false;
+	}
+
+	*out = consoleLog.buf;
+	u32 len = consoleLog.pos;
+
+	// A full linear log wraps on the next write.
+	if (consoleLog.pos == consoleLog.size) {
+		consoleLog.pos = 0;
+		consoleLog.wrapped = true;
+	}
+
+	return len;
+}
+
+//---------------------------------------------------------------------------------
+Result consoleDumpLog(const char *const path) {
+//---------------------------------------------------------------------------------
+	const char *log;
+	const u32 len = consoleGetLog(&log);
+	if (log == NULL) return RES_INVALID_ARG;
+
+	return fsQuickWrite(path, log, len);
+}
+
+// Characters drawn as glyphs by consolePrintChar() and UTF-8 sequences.
+static inline bool isRunChar(char c)
+{
+	return c != 0 && c != 8 && c != 9 && c != 10 && c != 13 && c != 0x1b;
+}
+
+//---------------------------------------------------------------------------------
+static void consolePrintRun(const char *str, size_t len) {
+//---------------------------------------------------------------------------------
+	u16 cps[64];
+	u32 n = 0;
+
+	while (len > 0) {
+		int cp = utf8Decode(&currentConsole->utf8, *str);
+		if (cp == UTF8_BROKEN) {
+			// Retry the byte as start of a new sequence.
+			cp = 0xFFFD;
+		} else {
+			str++;
+			len--;
+			if (cp == UTF8_MORE) continue;
+		}
+
+		if (currentConsole->cursorX + (int)n >= currentConsole->windowWidth) {
+			consoleDrawString(cps, n);
+			currentConsole->cursorX  = 0;
+			n = 0;
+
+			newRow();
+		}
+
+		// Cells only store the BMP.
+		cps[n++] = (cp <= 0xFFFF ? cp : 0xFFFD);
+		if (n == ARRAY_ENTRIES(cps)) {
+			consoleDrawString(cps, n);
+			currentConsole->cursorX += n;
+			n = 0;
+		}
+	}
+
+	if (n > 0) {
+		consoleDrawString(cps, n);
+		currentConsole->cursorX += n;
+	}
+}
+
+// Decodes one byte for consoles with a PrintChar callback.
+// The callback gets whole code points like the renderer.
+static void consolePrintByte(u8 b)
+{
+	int cp = utf8Decode(&currentConsole->utf8, b);
+	if (cp == UTF8_BROKEN) {
+		// Retry the byte as start of a new sequence.
+		consolePrintChar(0xFFFD);
+		cp = utf8Decode(&currentConsole->utf8, b);
+	}
+
+	if (cp != UTF8_MORE) consolePrintChar(cp);
+}
+
 //---------------------------------------------------------------------------------
 ssize_t con_write(/*struct _reent *r,void *fd,*/const char *ptr, size_t len) {
 //---------------------------------------------------------------------------------
@@ -492,6 +1088,8 @@ ssize_t con_write(/*struct _reent *r,void *fd,*/const char *ptr, size_t len) {
 
 	if(!tmp) return -1;
 
+	consoleLogWrite(ptr, len);
+
 	i = 0;
 
 	while(i<(int)len) {
@@ -504,6 +1102,19 @@ ssize_t con_write(/*struct _reent *r,void *fd,*/const char *ptr, size_t len) {
 			case ESC_NONE:
 				if (chr == 0x1b)
 					escapeSeq.state = ESC_START;
+				else if (isRunChar(chr) && !currentConsole->PrintChar) {
+					// Batch everything up to the next control character.
+					const char *run = tmp - 1;
+					size_t runLen = 1;
+					while (i < (int)len && isRunChar(*tmp)) {
+						tmp++;
+						i++; count++;
+						runLen++;
+					}
+					consolePrintRun(run, runLen);
+				}
+				else if (isRunChar(chr))
+					consolePrintByte(chr);
 				else
 					consolePrintChar(chr);
 				break;
@@ -663,6 +1274,19 @@ ssize_t con_write(/*struct _reent *r,void *fd,*/const char *ptr, size_t len) {
 	return count;
 }
 
+// Fits console and window to the frame buffer with the current cell size.
+static void consoleResize(PrintConsole* console) {
+	console->consoleWidth = console->fbWidth / console->font.width;
+	console->consoleHeight = COL_H / console->font.height;
+	console->windowX = 0;
+	console->windowY = 0;
+	console->windowWidth = console->consoleWidth;
+	console->windowHeight = console->consoleHeight;
+	console->cursorX = 0;
+	console->cursorY = 0;
+	console->firstRow = 0;
+}
+
 //---------------------------------------------------------------------------------
 PrintConsole* consoleInit(GfxLcd lcd, PrintConsole* console) {
 //---------------------------------------------------------------------------------
@@ -689,12 +1313,10 @@ PrintConsole* consoleInit(GfxLcd lcd, PrintConsole* console) {
 	GFX_setDoubleBuffering(lcd, false);
 
 	console->frameBuffer = (u16*)GFX_getBuffer(lcd, GFX_SIDE_LEFT);
+	console->fbFormat = GFX_getFormat(lcd);
+	console->fbWidth = (lcd == GFX_LCD_TOP ? LCD_HEIGHT_TOP : LCD_HEIGHT_BOT);
 
-	if(lcd==GFX_LCD_TOP) {
-		//bool isWide = gfxIsWide();
-		console->consoleWidth = 66;//isWide ? 100 : 50;
-		console->windowWidth = 66;//isWide ? 100 : 50;
-	}
+	consoleResize(console);
 
 	consoleCls(2);
 
@@ -711,112 +1333,104 @@ PrintConsole *consoleSelect(PrintConsole* console){
 }
 
 //---------------------------------------------------------------------------------
-void consoleSetFont(PrintConsole* console, ConsoleFont* font){
+bool consoleSetFont(PrintConsole* console, ConsoleFont* font){
 //---------------------------------------------------------------------------------
 
 	if(!console) console = currentConsole;
 
+	// Atlas columns are 32 bit masks. Taller glyphs don't fit.
+	if(font->height > 32) return false;
+
+	const u8 oldWidth = console->font.width;
+	const u8 oldHeight = console->font.height;
+
 	console->font = *font;
+	if(console->font.width == 0) console->font.width = FONT_WIDTH;
+	if(console->font.height == 0) console->font.height = FONT_HEIGHT;
 
+	if(console->font.width != oldWidth || console->font.height != oldHeight) {
+		consoleResize(console);
+		if (console->cells != NULL) consoleSetDeferred(console, console->cells, console->numCells);
+	}
+
+	return true;
 }
 
 //---------------------------------------------------------------------------------
-static void newRow() {
+void consoleSetDeferred(PrintConsole* console, ConsoleCell* cells, u32 numCells) {
 //---------------------------------------------------------------------------------
 
+	if(!console) console = currentConsole;
 
-	currentConsole->cursorY ++;
-
-
-	if(currentConsole->cursorY  >= currentConsole->windowHeight)  {
-		currentConsole->cursorY --;
-		u16 *dst = &currentConsole->frameBuffer[(currentConsole->windowX * 6 * 240) + (239 - (currentConsole->windowY * 10))];
-		u16 *src = dst - 10;
-
-		int i,j;
+	if (cells != NULL && (numCells < (u32)(console->windowWidth * console->windowHeight) || console->windowHeight > 64))
+		cells = NULL;
 
-		for (i=0; i<currentConsole->windowWidth*6; i++) {
-			u32 *from = (u32*)((int)src & ~3);
-			u32 *to = (u32*)((int)dst & ~3);
-			for (j=0;j<(((currentConsole->windowHeight-1)*10)/2);j++) *(to--) = *(from--);
-			dst += 240;
-			src += 240;
-		}
+	console->cells = cells;
+	console->numCells = (cells != NULL ? numCells : 0);
+	console->firstRow = 0;
+	console->dirtyRows = 0;
 
-		consoleClearLine(2);
-	}
+	// Start with a cleared grid.
+	PrintConsole *prev = consoleSelect(console);
+	consoleFillCells(0, 0, console->windowWidth, console->windowHeight);
+	consoleSelect(prev);
 }
+
 //---------------------------------------------------------------------------------
-void consoleDrawChar(int c) {
+void consoleRender(PrintConsole* console) {
 //---------------------------------------------------------------------------------
-	c -= currentConsole->font.asciiOffset;
-	if ( c < 0 || c > currentConsole->font.numChars ) return;
 
-	u8 *fontdata = currentConsole->font.gfx + (10 * c);
-
-	u16 fg = currentConsole->fg;
-	u16 bg = currentConsole->bg;
-
-	if (!(currentConsole->flags & CONSOLE_FG_CUSTOM)) {
-		if (currentConsole->flags & CONSOLE_COLOR_BOLD) {
-			fg = colorTable[fg + 8];
-		} else if (currentConsole->flags & CONSOLE_COLOR_FAINT) {
-			fg = colorTable[fg + 16];
-		} else {
-			fg = colorTable[fg];
+	if(!console) console = currentConsole;
+	if(console->cells == NULL || console->dirtyRows == 0) return;
+
+	PrintConsole *prev = consoleSelect(console);
+
+	u64 dirty = console->dirtyRows;
+	console->dirtyRows = 0;
+	while (dirty != 0) {
+		const int y = __builtin_ctzll(dirty);
+		dirty &= dirty - 1;
+
+		// Draw runs of cells with the same attributes.
+		const ConsoleCell *row = consoleCellRow(y);
+		int x = 0;
+		while (x < console->windowWidth) {
+			const ConsoleCell *first = &row[x];
+			int len = 1;
+			while (x + len < console->windowWidth && first[len].fg == first->fg &&
+			       first[len].bg == first->bg && first[len].flags == first->flags) len++;
+
+			CellStyle style;
+			consoleBuildStyle(&style, first->fg, first->bg, first->flags, false);
+			consoleDrawGlyphs(x, y, &style, &first->chr, sizeof(ConsoleCell), len);
+			x += len;
 		}
 	}
 
-	if (!(currentConsole->flags & CONSOLE_BG_CUSTOM)) {
-		bg = colorTable[bg];
-	}
-
-	if (currentConsole->flags & CONSOLE_COLOR_REVERSE) {
-		u16 tmp = fg;
-		fg = bg;
-		bg = tmp;
-	}
-
-	u8 b1 = *(fontdata++);
-	u8 b2 = *(fontdata++);
-	u8 b3 = *(fontdata++);
-	u8 b4 = *(fontdata++);
-	u8 b5 = *(fontdata++);
-	u8 b6 = *(fontdata++);
-	u8 b7 = *(fontdata++);
-	u8 b8 = *(fontdata++);
-	u8 b9 = *(fontdata++);
-	u8 b10 = *(fontdata++);
-
-	if (currentConsole->flags & CONSOLE_UNDERLINE) b10 = 0xff;
-
-	if (currentConsole->flags & CONSOLE_CROSSED_OUT) b5 = 0xff;
-
-	u8 mask = 0x80;
+	consoleSelect(prev);
+	GFX_flushBuffers();
+}
 
+//---------------------------------------------------------------------------------
+static void newRow() {
+//---------------------------------------------------------------------------------
 
-	int i;
 
-	int x = (currentConsole->cursorX + currentConsole->windowX) * 6;
-	int y = ((currentConsole->cursorY + currentConsole->windowY) * 10);
+	currentConsole->cursorY ++;
 
-	u16 *screen = &currentConsole->frameBuffer[(x * 240) + (239 - (y + 9))];
 
-	for (i=0;i<6;i++) {
-		if (b10 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b9 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b8 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b7 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b6 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b5 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b4 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b3 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b2 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		if (b1 & mask) { *(screen++) = fg; }else{ *(screen++) = bg; }
-		mask >>= 1;
-		screen += 240 - 10;
+	if(currentConsole->cursorY  >= currentConsole->windowHeight)  {
+		currentConsole->cursorY --;
+		consoleScrollWindow();
 	}
+}
+//---------------------------------------------------------------------------------
+void consoleDrawChar(int c) {
+//---------------------------------------------------------------------------------
+	if (c < 0 || c > 0xFFFF) return;
 
+	const u16 chr = c;
+	consoleDrawString(&chr, 1);
 }
 
 //---------------------------------------------------------------------------------
@@ -867,10 +1481,11 @@ void consolePrintChar(int c) {
 			// Falls through.
 		case 13:
 			currentConsole->cursorX  = 0;
-			GFX_flushBuffers();
+			consoleFlush();
 			break;
 		default:
-			consoleDrawChar(c);
+			// Cells only store the BMP.
+			consoleDrawChar(c <= 0xFFFF ? c : 0xFFFD);
 			++currentConsole->cursorX ;
 			break;
 	}
@@ -896,4 +1511,6 @@ void consoleSetWindow(PrintConsole* console, int x, int y, int width, int height
 	console->cursorX = 0;
 	console->cursorY = 0;
 
+	// The cell grid layout depends on the window size.
+	if (console->cells != NULL) consoleSetDeferred(console, console->cells, console->numCells);
 }
\ No newline at end of file
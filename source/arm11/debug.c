@@ -37,6 +37,13 @@
 
 #define LED_RGB8(r, g, b) ((b)<<16 | (g)<<8 | (r))
 
+#ifdef LIBN3DS_IRQ_STATS
+// Make room for the IRQ stats on exceptions.
+#define STACK_DUMP_WORDS  (54u)
+#else
+#define STACK_DUMP_WORDS  (90u)
+#endif // #ifdef LIBN3DS_IRQ_STATS
+
 
 
 // We are violating our IPC protocol sending data silently
@@ -168,7 +175,7 @@ static void printException(const u32 excType, const u32 *const regs, const bool
 		if(sp >= AXI_RAM_BASE && sp < AXI_RAM_BASE + AXI_RAM_SIZE && (sp % 4) == 0) // TODO: Allow any valid memory region.
 		{
 			u32 stackWords = (AXI_RAM_BASE + AXI_RAM_SIZE - sp) / 4;
-			stackWords = (stackWords > 90 ? 90 : stackWords);
+			stackWords = (stackWords > STACK_DUMP_WORDS ? STACK_DUMP_WORDS : stackWords);
 			for(u32 i = 0; i < stackWords; i++)
 			{
 				ee_printf("%08" PRIX32, ((u32*)sp)[i]);
@@ -192,6 +199,26 @@ static void printException(const u32 excType, const u32 *const regs, const bool
 	}
 }
 
+#ifdef LIBN3DS_IRQ_STATS
+// Lists the IRQs which spent the most time in their ISR.
+// Helps finding ISRs which ran too long or fired in a storm.
+static void printIrqStats(const u32 maxEntries)
+{
+	IrqStatsEntry entries[8];
+	const u32 num = IRQ_getTopStats(entries, (maxEntries > 8 ? 8 : maxEntries));
+	if(num == 0) return;
+
+	ee_printf("\n\nIRQ(c)     count  avg cycles  max cycles max latency");
+	for(u32 i = 0; i < num; i++)
+	{
+		const IrqStats *const stats = &entries[i].stats;
+		const u32 avg = stats->totalCycles / stats->count;
+		ee_printf("\n%3" PRIu32 "(%" PRIu32 ") %9" PRIu32 " %11" PRIu32 " %11" PRIu32 " %11" PRIu32,
+		          (u32)entries[i].id, (u32)entries[i].core, stats->count, avg, stats->maxCycles, stats->maxLatency);
+	}
+}
+#endif // #ifdef LIBN3DS_IRQ_STATS
+
 [[noreturn]] static void exceptionHandlerEnd(void)
 {
 	// Flush D-Cache just in case and also because the frame buffer may be cached.
@@ -219,6 +246,9 @@ static void printException(const u32 excType, const u32 *const regs, const bool
 	{
 		ee_printf("ARM11(%" PRIu32 ") assert() called\n\n", __getCpuId());
 		ee_printf("%s:%u: Assertion '%s' failed.", file, line, cond);
+#ifdef LIBN3DS_IRQ_STATS
+		printIrqStats(8);
+#endif // #ifdef LIBN3DS_IRQ_STATS
 	}
 
 	prepareArm9ForPowerOff();
@@ -231,6 +261,9 @@ static void printException(const u32 excType, const u32 *const regs, const bool
 	{
 		ee_printf("ARM11(%" PRIu32 ") panic() called\n\n", __getCpuId());
 		if(msg != NULL) ee_puts(msg);
+#ifdef LIBN3DS_IRQ_STATS
+		printIrqStats(8);
+#endif // #ifdef LIBN3DS_IRQ_STATS
 	}
 
 	prepareArm9ForPowerOff();
@@ -252,6 +285,9 @@ static void printException(const u32 excType, const u32 *const regs, const bool
 		ee_printf("ARM11(%" PRIu32 ") exception %s\n\n", __getCpuId(), excStrs[type]);
 
 		printException(type, excFrame, false);
+#ifdef LIBN3DS_IRQ_STATS
+		printIrqStats(3);
+#endif // #ifdef LIBN3DS_IRQ_STATS
 	}
 
 	prepareArm9ForPowerOff();
@@ -0,0 +1,322 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdatomic.h>
+#include "types.h"
+#include "arm11/drivers/cdma.h"
+#include "drivers/corelink_dma-330.h"
+#include "drivers/corelink_dma-330_asm.h"
+#include "drivers/cache.h"
+#include "arm11/drivers/interrupt.h"
+#include "kevent.h"
+
+
+// 4 bytes burst with 16 transfers. Total 64 bytes per burst.
+// Source and destination unprivileged, non-secure data access.
+#define CCR_BASE      (CCR_SRC_BURST_LEN(16) | CCR_SRC_BURST_SIZE(2) | CCR_SRC_PROT_CTRL(2) | \
+                       CCR_DST_BURST_LEN(16) | CCR_DST_BURST_SIZE(2) | CCR_DST_PROT_CTRL(2) | CCR_DST_INC)
+#define BURST_BYTES   (64u)
+#define IRQ_PRIO      (13u)
+
+
+typedef struct
+{
+	KHandle event;           // Signaled on completion. Cleared on submission.
+	u32 submitted;           // Sequence number of the last submitted operation.
+	au32 completed;          // Sequence number of the last completed operation.
+	u32 faultSeq;            // Sequence number of the last failed operation.
+	Result faultRes;         // Error of the last failed operation.
+	const u8 *restartProg;   // Restarted on faults instead of failing the fence.
+} CdmaChannel;
+
+static CdmaChannel g_channels[CDMA_CHANNELS] = {0};
+static au8 g_allocMask = BIT(CDMA_CH_LGYCAP0) | BIT(CDMA_CH_LGYCAP1);
+static atomic_bool g_faultIrqRegistered = false;
+
+alignas(32) static u8 g_progs[CDMA_CHANNELS][CDMA_PROG_SIZE];
+alignas(32) static u32 g_fillValues[CDMA_CHANNELS][8]; // 1 cache line each.
+
+
+
+static void cdmaIrqHandler(const u32 intSource)
+{
+	static_assert(IRQ_CDMA_EVENT0 + 7 == IRQ_CDMA_EVENT7);
+	const u32 ch = intSource - IRQ_CDMA_EVENT0;
+	DMA330_ackIrq(ch);
+
+	CdmaChannel *const channel = &g_channels[ch];
+	atomic_fetch_add_explicit(&channel->completed, 1, memory_order_release);
+	signalEvent(channel->event, false);
+}
+
+// The fault IRQ is shared by all channels.
+static void cdmaFaultHandler(UNUSED const u32 intSource)
+{
+	DMA330_recoverManager();
+
+	u32 faulting = DMA330_faultingChannels();
+	while(faulting != 0)
+	{
+		const u32 ch = __builtin_ctz(faulting);
+		faulting &= ~BIT(ch);
+
+		// Killing the channel also clears the fault IRQ once no channel is faulting.
+		const u32 ftr = DMA330_faultType(ch);
+		DMA330_kill(ch);
+
+		CdmaChannel *const channel = &g_channels[ch];
+		if(channel->restartProg != NULL)
+		{
+			DMA330_run(ch, channel->restartProg);
+			continue;
+		}
+
+		// Fail the operation in flight.
+		channel->faultRes = DMA330_fault2Res(ftr);
+		channel->faultSeq = channel->submitted;
+		atomic_store_explicit(&channel->completed, channel->submitted, memory_order_release);
+		if(channel->event != 0) signalEvent(channel->event, false);
+	}
+}
+
+static void registerFaultIrq(void)
+{
+	if(!atomic_exchange_explicit(&g_faultIrqRegistered, true, memory_order_relaxed))
+		IRQ_registerIsr(IRQ_CDMA_FAULT, IRQ_PRIO, 0, cdmaFaultHandler);
+}
+
+static bool isAllocated(const u8 ch)
+{
+	if(ch >= CDMA_CHANNELS || ch == CDMA_CH_LGYCAP0 || ch == CDMA_CH_LGYCAP1) return false;
+	return (atomic_load_explicit(&g_allocMask, memory_order_relaxed) & BIT(ch)) != 0;
+}
+
+u8 CDMA_allocChannel(void)
+{
+	u8 mask = atomic_load_explicit(&g_allocMask, memory_order_relaxed);
+	u8 ch;
+	do
+	{
+		if(mask == 0xFFu) return CDMA_NO_CHANNEL;
+		ch = __builtin_ctz(~mask);
+	} while(!atomic_compare_exchange_weak_explicit(&g_allocMask, &mask, mask | BIT(ch),
+	                                               memory_order_acquire, memory_order_relaxed));
+
+	registerFaultIrq();
+
+	// Events are kept for the next owner.
+	CdmaChannel *const channel = &g_channels[ch];
+	if(channel->event == 0) channel->event = createEvent(false);
+	IRQ_registerIsr(IRQ_CDMA_EVENT0 + ch, IRQ_PRIO, 0, cdmaIrqHandler);
+
+	return ch;
+}
+
+static void waitIdle(const u8 ch)
+{
+	const CdmaFence last = {ch, g_channels[ch].submitted};
+	CDMA_fenceWait(&last);
+}
+
+void CDMA_freeChannel(const u8 ch)
+{
+	if(!isAllocated(ch)) return;
+
+	waitIdle(ch);
+	IRQ_unregisterIsr(IRQ_CDMA_EVENT0 + ch);
+	g_channels[ch].restartProg = NULL;
+	atomic_fetch_and_explicit(&g_allocMask, ~BIT(ch), memory_order_release);
+}
+
+static void signaledFence(CdmaFence *const fence)
+{
+	if(fence != NULL)
+	{
+		fence->ch  = CDMA_NO_CHANNEL;
+		fence->seq = 0;
+	}
+}
+
+Result CDMA_run(const u8 ch, const u8 *const prog, CdmaFence *const fence)
+{
+	if(!isAllocated(ch)) return RES_INVALID_ARG;
+
+	waitIdle(ch);
+	CdmaChannel *const channel = &g_channels[ch];
+	clearEvent(channel->event);
+	if(DMA330_run(ch, prog) != CSR_STAT_STOPPED) return RES_INVALID_ARG;
+
+	const u32 seq = ++channel->submitted;
+	if(fence != NULL)
+	{
+		fence->ch  = ch;
+		fence->seq = seq;
+	}
+
+	return RES_OK;
+}
+
+bool CDMA_fenceDone(const CdmaFence *const fence)
+{
+	if(fence->ch >= CDMA_CHANNELS) return true;
+
+	// Wrap around safe.
+	const u32 completed = atomic_load_explicit(&g_channels[fence->ch].completed, memory_order_acquire);
+	return (s32)(completed - fence->seq) >= 0;
+}
+
+Result CDMA_fenceWait(const CdmaFence *const fence)
+{
+	if(fence->ch >= CDMA_CHANNELS) return RES_OK;
+
+	const CdmaChannel *const channel = &g_channels[fence->ch];
+	while(!CDMA_fenceDone(fence))
+	{
+		waitForEvent(channel->event);
+	}
+
+	return (channel->faultSeq == fence->seq ? channel->faultRes : RES_OK);
+}
+
+void CDMA_setRestartProg(const u8 ch, const u8 *const prog)
+{
+	if(ch >= CDMA_CHANNELS) return;
+
+	registerFaultIrq();
+	g_channels[ch].restartProg = prog;
+}
+
+static bool checkAlign(const void *const dst, const void *const src, const u32 size)
+{
+	return ((uintptr_t)dst | (uintptr_t)src | size) % 4 == 0;
+}
+
+static Result finishProg(const u8 ch, Dma330Asm *const a, CdmaFence *const fence)
+{
+	DMA330_asmWmb(a);
+	DMA330_asmSev(a, ch);
+	if(DMA330_asmEnd(a) == 0) return RES_OUT_OF_RANGE;
+
+	u8 *const prog = g_progs[ch];
+	flushDCacheRange(prog, CDMA_PROG_SIZE);
+
+	return CDMA_run(ch, prog, fence);
+}
+
+Result CDMA_copy(const u8 ch, void *dst, const void *src, u32 size, CdmaFence *const fence)
+{
+	if(!isAllocated(ch) || !checkAlign(dst, src, size)) return RES_INVALID_ARG;
+	if(size == 0)
+	{
+		signaledFence(fence);
+		return RES_OK;
+	}
+
+	// The program buffer is in use until the last operation finished.
+	waitIdle(ch);
+	cleanDCacheRange(src, size);
+	flushDCacheRange(dst, size);
+
+	Dma330Asm a;
+	DMA330_asmInit(&a, g_progs[ch], CDMA_PROG_SIZE);
+	DMA330_asmMov(&a, DMA330_CCR, CCR_BASE | CCR_SRC_INC);
+	DMA330_asmMov(&a, DMA330_SAR, (u32)src);
+	DMA330_asmMov(&a, DMA330_DAR, (u32)dst);
+	DMA330_asmTransfer(&a, size);
+
+	return finishProg(ch, &a, fence);
+}
+
+Result CDMA_fill(const u8 ch, void *dst, const u32 value, u32 size, CdmaFence *const fence)
+{
+	if(!isAllocated(ch) || !checkAlign(dst, NULL, size)) return RES_INVALID_ARG;
+	if(size == 0)
+	{
+		signaledFence(fence);
+		return RES_OK;
+	}
+
+	waitIdle(ch);
+	u32 *const fillValue = g_fillValues[ch];
+	*fillValue = value;
+	cleanDCacheRange(fillValue, 32);
+	flushDCacheRange(dst, size);
+
+	// Every transfer reads the same word from the fixed source address.
+	Dma330Asm a;
+	DMA330_asmInit(&a, g_progs[ch], CDMA_PROG_SIZE);
+	DMA330_asmMov(&a, DMA330_CCR, CCR_BASE);
+	DMA330_asmMov(&a, DMA330_SAR, (u32)fillValue);
+	DMA330_asmMov(&a, DMA330_DAR, (u32)dst);
+	DMA330_asmTransfer(&a, size);
+
+	return finishProg(ch, &a, fence);
+}
+
+static void emitAddh(Dma330Asm *const a, const Dma330Reg reg, u32 val)
+{
+	while(val > 0)
+	{
+		const u32 step = (val > 0xFFFFu ? 0xFFFFu : val);
+		DMA330_asmAddh(a, reg, step);
+		val -= step;
+	}
+}
+
+Result CDMA_copy2D(const u8 ch, void *dst, const u32 dstStride, const void *src, const u32 srcStride,
+                   const u32 width, const u32 height, CdmaFence *const fence)
+{
+	if(!isAllocated(ch) || !checkAlign(dst, src, width) || (dstStride | srcStride) % 4 != 0 ||
+	   dstStride < width || srcStride < width) return RES_INVALID_ARG;
+	if(width == 0 || height == 0)
+	{
+		signaledFence(fence);
+		return RES_OK;
+	}
+
+	// Contiguous rows are a plain copy.
+	if(dstStride == width && srcStride == width)
+		return CDMA_copy(ch, dst, src, width * height, fence);
+
+	waitIdle(ch);
+	cleanDCacheRange(src, srcStride * (height - 1) + width);
+	flushDCacheRange(dst, dstStride * (height - 1) + width);
+
+	// Rows are looped with 1 loop counter so the row transfer gets the other.
+	Dma330Asm a;
+	DMA330_asmInit(&a, g_progs[ch], CDMA_PROG_SIZE);
+	DMA330_asmMov(&a, DMA330_CCR, CCR_BASE | CCR_SRC_INC);
+	DMA330_asmMov(&a, DMA330_SAR, (u32)src);
+	DMA330_asmMov(&a, DMA330_DAR, (u32)dst);
+	for(u32 rows = height; rows > 0;)
+	{
+		const u32 count = (rows > 256 ? 256 : rows);
+		DMA330_asmLp(&a, count);
+		{
+			// The transfer of a partial burst changes CCR.
+			if(width % BURST_BYTES != 0) DMA330_asmMov(&a, DMA330_CCR, CCR_BASE | CCR_SRC_INC);
+			DMA330_asmTransfer(&a, width);
+			emitAddh(&a, DMA330_SAR, srcStride - width);
+			emitAddh(&a, DMA330_DAR, dstStride - width);
+		}
+		DMA330_asmLpEnd(&a);
+		rows -= count;
+	}
+
+	return finishProg(ch, &a, fence);
+}
\ No newline at end of file
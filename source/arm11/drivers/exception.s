@@ -75,6 +75,9 @@ BEGIN_ASM_FUNC irqHandler
 	srsfd sp!, #PSR_SYS_MODE     @ Store lr and spsr on system mode stack
 	cps #PSR_SYS_MODE
 	stmfd sp!, {r0-r3, r12, lr}
+#ifdef LIBN3DS_IRQ_STATS
+	mrc p15, 0, lr, c15, c12, 1  @ Entry time stamp (CCNT)
+#endif
 	ldr r12, =MPCORE_PRIV_BASE
 	ldr r2, =g_irqIsrTable
 	ldr r0, [r12, #0x10C]        @ REG_GICC_INTACK
@@ -87,12 +90,13 @@ BEGIN_ASM_FUNC irqHandler
 	ldr r3, [r2, r1, lsl #2]
 	cmp r3, #0
 	beq irqHandler_skip_processing
-	cpsie i
 	str r0, [sp, #-4]!           @ A single ldr/str can't be interrupted
-	blx r3
+#ifdef LIBN3DS_IRQ_STATS
+	mov r2, lr
+#endif
+	bl irqDispatch               @ r0 = intSource, r1 = table index, r2 = entry time stamp, r3 = ISR
 	ldr r0, [sp], #4
 	ldr r12, =MPCORE_PRIV_BASE
-	cpsid i
 irqHandler_skip_processing:
 	str r0, [r12, #0x110]        @ REG_GICC_EOI
 	ldmfd sp!, {r0-r3, r12, lr}
@@ -38,6 +38,7 @@
 #include "arm11/allocator/vram.h"
 #include "kevent.h"
 #include "drivers/cache.h"
+#include "color_lut.h"
 
 
 #ifndef LIBN3DS_LEGACY
@@ -56,6 +57,18 @@ typedef struct
 	u32 fb_stride; // PDC frame buffer stride.
 } LcdState;
 
+// Double buffered color LUT staging.
+// The PDC IRQ handler uploads the pending buffer during VBlank.
+// Both buffer indices live in one atomic so the switch is published at once.
+#define LUT_BANK_ACTIVE(bank)   ((bank) & 1u)  // Buffer last taken by the IRQ handler.
+#define LUT_BANK_PENDING(bank)  ((bank)>>1)    // 0 = nothing pending, otherwise buffer index + 1.
+
+typedef struct
+{
+	u32 bufs[2][256]; // Packed PDC color LUT entries.
+	au8 bank;         // See LUT_BANK_ACTIVE() and LUT_BANK_PENDING().
+} LutState;
+
 typedef struct
 {
 	KHandle events[6]; // Eevents in order: PSC0, PSC1, PDC0, PDC1, PPF, P3D.
@@ -65,6 +78,7 @@ typedef struct
 	GfxTopMode mode;   // Current topscreen mode.
 	LcdState lcds[2];  // 0 top, 1 bottom.
 	u32 lcdLum;        // Current LCD luminance for both LCDs.
+	LutState luts[2];  // 0 top, 1 bottom.
 } GfxState;
 
 static GfxState g_gfxState = {0};
@@ -197,18 +211,54 @@ static void setPdcPresetAndBufs(const GfxLcd lcd, const GfxTopMode mode)
 	pdc->fb_fmt = state->fb_fmt;
 }
 
+static void uploadColorLut(Pdc *const pdc, const u32 *const lut)
+{
+	pdc->color_lut_idx = 0;
+	for(u32 i = 0; i < 256; i++)
+	{
+		pdc->color_lut_data = lut[i];
+	}
+}
+
 static void setupDisplayController(const GfxLcd lcd, const GfxTopMode mode)
 {
 	// Display timing and frame buffer setup.
 	setPdcPresetAndBufs(lcd, mode);
 
 	// Setup 1:1 color mapping for all channels.
-	Pdc *const pdc = (lcd == GFX_LCD_TOP ? &getGxRegs()->pdc0 : &getGxRegs()->pdc1);
-	pdc->color_lut_idx = 0;
+	LutState *const lutState = &g_gfxState.luts[lcd];
+	u32 *const lut = lutState->bufs[0];
 	for(u32 i = 0; i < 256; i++)
 	{
-		pdc->color_lut_data = PDC_COLOR_RGB(1, 1, 1) * i;
+		lut[i] = PDC_COLOR_RGB(1, 1, 1) * i;
+	}
+	atomic_store_explicit(&lutState->bank, 0, memory_order_relaxed);
+
+	Pdc *const pdc = (lcd == GFX_LCD_TOP ? &getGxRegs()->pdc0 : &getGxRegs()->pdc1);
+	uploadColorLut(pdc, lut);
+}
+
+// Replaces the generic event ISR for PDC0/1 so we can swap color LUTs in VBlank.
+static void pdcIrqHandler(u32 intSource)
+{
+	GfxState *const state = &g_gfxState;
+	const u32 lcd = (intSource & 0x3FFu) - IRQ_PDC0;
+
+	// Make the pending buffer the active one before reading it.
+	// GFX_setColorLut() never writes to the active buffer.
+	LutState *const lutState = &state->luts[lcd];
+	u8 bank = atomic_load_explicit(&lutState->bank, memory_order_acquire);
+	u8 pending;
+	while((pending = LUT_BANK_PENDING(bank)) != 0 &&
+	      !atomic_compare_exchange_weak_explicit(&lutState->bank, &bank, pending - 1,
+	                                             memory_order_acquire, memory_order_acquire));
+	if(pending != 0)
+	{
+		Pdc *const pdc = (lcd == GFX_LCD_TOP ? &getGxRegs()->pdc0 : &getGxRegs()->pdc1);
+		uploadColorLut(pdc, lutState->bufs[pending - 1]);
 	}
+
+	signalEvent(state->events[GFX_EVENT_PDC0 + lcd], false);
 }
 
 static void displayControllerInit(const GfxTopMode mode)
@@ -327,7 +377,10 @@ void GFX_init(const GfxFmt fmtTop, const GfxFmt fmtBot, const GfxTopMode mode)
 	for(unsigned i = 0; i < 6; i++)
 	{
 		KHandle kevent = createEvent(false);
-		bindInterruptToEvent(kevent, IRQ_PSC0 + i, 14);
+		if(i == GFX_EVENT_PDC0 || i == GFX_EVENT_PDC1)
+			IRQ_registerIsr(IRQ_PSC0 + i, 14, 0, pdcIrqHandler);
+		else
+			bindInterruptToEvent(kevent, IRQ_PSC0 + i, 14);
 		state->events[i] = kevent;
 	}
 
@@ -520,6 +573,39 @@ void GFX_waitForEvent(const GfxEvent event)
 	clearEvent(kevent);
 }
 
+void GFX_setColorLut(const GfxLcd lcd, const ColorLut *const lut)
+{
+	LutState *const lutState = &g_gfxState.luts[lcd];
+
+	// Take back a not yet uploaded buffer so the IRQ handler can't read it while we write.
+	// If nothing is pending write to the buffer the IRQ handler didn't take last.
+	u8 bank = atomic_load_explicit(&lutState->bank, memory_order_acquire);
+	while(LUT_BANK_PENDING(bank) != 0 &&
+	      !atomic_compare_exchange_weak_explicit(&lutState->bank, &bank, LUT_BANK_ACTIVE(bank),
+	                                             memory_order_acquire, memory_order_acquire));
+	const u8 pending = LUT_BANK_PENDING(bank);
+	const u8 idx = (pending != 0 ? pending - 1 : LUT_BANK_ACTIVE(bank) ^ 1u);
+
+	u32 *const buf = lutState->bufs[idx];
+	if(lut != NULL)
+	{
+		for(u32 i = 0; i < 256; i++)
+		{
+			buf[i] = colorLutPackEntry(lut, i);
+		}
+	}
+	else
+	{
+		for(u32 i = 0; i < 256; i++)
+		{
+			buf[i] = PDC_COLOR_RGB(1, 1, 1) * i;
+		}
+	}
+
+	// Nothing is pending here and only the IRQ handler takes buffers.
+	atomic_fetch_or_explicit(&lutState->bank, (idx + 1)<<1, memory_order_release);
+}
+
 void GX_memoryFill(u32 *buf0a, u32 buf0v, u32 buf0Sz, u32 val0, u32 *buf1a, u32 buf1v, u32 buf1Sz, u32 val1)
 {
 	GxRegs *const gx = getGxRegs();
@@ -27,6 +27,11 @@
 #include "arm11/drivers/interrupt.h"
 #include "arm11/drivers/gpio.h"
 #include "arm11/drivers/codec.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/hw_cal.h"
+#include "debug.h"
+#include "kernel.h"
+#include "kevent.h"
 
 
 #define MCU_HID_IRQ_MASK  (MCU_IRQ_VOL_SLIDER_CHANGE | MCU_IRQ_BATT_CHARGE_START | \
@@ -37,13 +42,74 @@
 
 #define CPAD_THRESHOLD  (400)
 
+// Bit n is set if the 5 bit pen down mask n has at least 3 samples set.
+#define TOUCH_MAJORITY_LUT  (0xFEE8E880u)
+// Touch calibrations with less raw range than this are rejected.
+#define TOUCH_CAL_MIN_RANGE (256)
+
+
+typedef struct
+{
+	s32 scale;  // Screen pixels per ADC step in 16.16 fixed-point.
+	s32 offset; // Screen position at ADC value 0 in 16.16 fixed-point.
+	s32 max;    // Last pixel on this axis.
+} TouchAxis;
+
 
 static u32 g_kHeld = 0, g_kDown = 0, g_kUp = 0;
 static u32 g_extraKeys = 0;
+static u32 g_mcuIrqSub = MCU_IRQ_SUB_INVALID;
 TouchPos g_tPos = {0};
 CpadPos g_cPos = {0};
 
+static_assert((HID_RING_SIZE & (HID_RING_SIZE - 1)) == 0);
+static HidSample g_ring[HID_RING_SIZE] = {0};
+static au32 g_ringHead = 0;      // Next sample number. Only written by the timer ISR.
+static u32 g_scanPos = 0;        // Next sample for hidScanInput().
+static u32 g_sampleRate = 0;
+static KHandle g_samplerEvent = 0;
+// Latest touch and Circle-Pad state from the sampler task.
+static u32 g_codecKeys = 0;
+static TouchPos g_latestTPos = {0};
+static CpadPos g_latestCPos = {0};
+static TouchAxis g_touchAxes[2] = {0};
+
+
+
+static bool calcTouchAxis(TouchAxis *const axis, const u32 raw0, const u32 raw1,
+                          const u32 point0, const u32 point1, const u32 size)
+{
+	const s32 rawRange = (s32)raw1 - (s32)raw0;
+	const s32 pointRange = (s32)point1 - (s32)point0;
+	if(rawRange > -TOUCH_CAL_MIN_RANGE && rawRange < TOUCH_CAL_MIN_RANGE) return false;
+	if(point0 >= size || point1 > size || pointRange == 0) return false;
+
+	// The only divide. Everything per sample is a multiply and shift.
+	const s32 halfRange = (rawRange ^ pointRange) < 0 ? -(rawRange / 2) : rawRange / 2;
+	const s32 scale = (pointRange * 65536 + halfRange) / rawRange; // Round to nearest.
+	axis->scale  = scale;
+	axis->offset = (s32)(point0<<16) - (s32)raw0 * scale + 0x8000; // Round to nearest.
+	axis->max    = size - 1;
+
+	return true;
+}
+
+static void initTouchCal(void)
+{
+	const TouchCalBase *const cal = &g_touchCal;
+	TouchAxis axes[2];
+	if(!calcTouchAxis(&axes[0], cal->rawX0, cal->rawX1, cal->pointX0, cal->pointX1, 320) ||
+	   !calcTouchAxis(&axes[1], cal->rawY0, cal->rawY1, cal->pointY0, cal->pointY1, 240))
+	{
+		// Broken calibration. Fall back to mapping the full ADC range.
+		// Unlike calibrated axes this truncates like the old raw * 320 / 4096.
+		axes[0] = (TouchAxis){320 * 65536 / 4096, 0, 319};
+		axes[1] = (TouchAxis){240 * 65536 / 4096, 0, 239};
+	}
 
+	g_touchAxes[0] = axes[0];
+	g_touchAxes[1] = axes[1];
+}
 
 void hidInit(void)
 {
@@ -52,6 +118,9 @@ void hidInit(void)
 	inited = true;
 
 	MCU_init();
+	g_mcuIrqSub = MCU_subscribeIrqs(MCU_HID_IRQ_MASK);
+	if(g_mcuIrqSub == MCU_IRQ_SUB_INVALID) panic();
+
 	u16 state = MCU_getExternalHardwareStatus();
 	u32 tmp = ~state<<3 & KEY_SHELL;      // Current shell state. Bit is inverted.
 	tmp |= state<<1 & KEY_BAT_CHARGING;   // Current battery charging state
@@ -59,12 +128,13 @@ void hidInit(void)
 	tmp |= ~state<<1 & KEY_HOME;          // Current HOME button state
 	g_extraKeys = tmp;
 
+	initTouchCal();
 	CODEC_init();
 }
 
 static void updateMcuHidState(void)
 {
-	const u32 state = MCU_getIrqs(MCU_HID_IRQ_MASK);
+	const u32 state = MCU_getSubIrqs(g_mcuIrqSub, MCU_HID_IRQ_MASK);
 	if(state == 0) return;
 
 	u32 tmp = g_extraKeys;
@@ -78,45 +148,231 @@ static void updateMcuHidState(void)
 	g_extraKeys = tmp;
 }
 
-static u32 rawCodec2Hid(void)
+#define SORT2(a, b)  do { if(a > b) { const u32 t_ = a; a = b; b = t_; } } while(0)
+
+// Median of the 5 touch samples. Rejects up to 2 outliers.
+static u32 median5(const u16 raw[5])
+{
+	u32 a = raw[0], b = raw[1], c = raw[2], d = raw[3], e = raw[4];
+
+	// Partial sorting network. 7 compare/swaps instead of a full sort.
+	SORT2(a, b);
+	SORT2(d, e);
+	SORT2(a, d); // a is now the minimum of a, b, d, e.
+	SORT2(b, e); // e is now the maximum of a, b, d, e.
+	SORT2(b, c);
+	SORT2(c, d);
+	SORT2(b, c); // b <= c <= d with a and e out of the way.
+
+	return c;
+}
+
+#undef SORT2
+
+static u32 touchAxisPos(const TouchAxis *const axis, const u32 raw)
+{
+	const s32 pos = ((s32)raw * axis->scale + axis->offset)>>16;
+	if(pos < 0) return 0;
+
+	return (pos > axis->max ? axis->max : pos);
+}
+
+static s32 cpadAxisSum(const u16 raw[8])
+{
+	s32 sum = 0;
+	for(u32 i = 0; i < 8; i++) sum += __builtin_bswap16(raw[i]) & 0xFFFu;
+
+	return sum;
+}
+
+static u32 rawCodec2Hid(TouchPos *const tPos, CpadPos *const cPos)
 {
 	static u32 fakeKeysCache = 0;
 	alignas(4) CdcAdcData adc;
 	if(!CODEC_getRawAdcData(&adc)) return fakeKeysCache;
 
 	// Touchscreen
-	// TODO: Calibration
-	const u16 tx = __builtin_bswap16(adc.touchX[0]);
-	u32 fakeKeys = (~tx & BIT(12))<<8; // KEY_TOUCH
-	g_tPos.x = tx * 320u / 4096u;
-	g_tPos.y = __builtin_bswap16(adc.touchY[0]) * 240u / 4096u;
+	// Bit 12 is set on samples taken with the pen up. A majority of
+	// samples decides about KEY_TOUCH so a single bad sample can't
+	// make it flicker. The position only updates if all samples are good.
+	u32 penDown = 0;
+	for(u32 i = 0; i < 5; i++)
+	{
+		const u16 tx = __builtin_bswap16(adc.touchX[i]);
+		const u16 ty = __builtin_bswap16(adc.touchY[i]);
+		adc.touchX[i] = tx & 0xFFFu;
+		adc.touchY[i] = ty & 0xFFFu;
+		penDown |= (~tx & BIT(12))>>(12 - i);
+	}
+	u32 fakeKeys = (TOUCH_MAJORITY_LUT>>penDown & 1u)<<20; // KEY_TOUCH
+	if(penDown == 0x1Fu)
+	{
+		tPos->x = touchAxisPos(&g_touchAxes[0], median5(adc.touchX));
+		tPos->y = touchAxisPos(&g_touchAxes[1], median5(adc.touchY));
+	}
 
 	// Circle-Pad
-	// TODO: Calibration
-	g_cPos.y = (__builtin_bswap16(adc.cpadY[0]) & 0xFFFu) - 2048u;
-	g_cPos.x = -((__builtin_bswap16(adc.cpadX[0]) & 0xFFFu) - 2048u); // X axis is inverted.
+	// Average of all 8 samples relative to the calibrated center.
+	// The scale and min/max in CirclePadCal2 are deliberately not applied.
+	// They map the pad onto the smaller output range of the HOS HID module
+	// while CpadPos and CPAD_THRESHOLD have always been in raw ADC steps.
+	// Scaling here would silently change the units for all existing users.
+	cPos->y = (cpadAxisSum(adc.cpadY) - g_cpadCal.centerY * 8)>>3;
+	cPos->x = -((cpadAxisSum(adc.cpadX) - g_cpadCal.centerX * 8)>>3); // X axis is inverted.
 
-	if((g_cPos.x >= 0 ? g_cPos.x : -g_cPos.x) > CPAD_THRESHOLD)
+	if((cPos->x >= 0 ? cPos->x : -cPos->x) > CPAD_THRESHOLD)
 	{
-		if(g_cPos.x >= 0) fakeKeys |= KEY_CPAD_RIGHT;
-		else              fakeKeys |= KEY_CPAD_LEFT;
+		if(cPos->x >= 0) fakeKeys |= KEY_CPAD_RIGHT;
+		else             fakeKeys |= KEY_CPAD_LEFT;
 	}
-	if((g_cPos.y >= 0 ? g_cPos.y : -g_cPos.y) > CPAD_THRESHOLD)
+	if((cPos->y >= 0 ? cPos->y : -cPos->y) > CPAD_THRESHOLD)
 	{
-		if(g_cPos.y >= 0) fakeKeys |= KEY_CPAD_UP;
-		else              fakeKeys |= KEY_CPAD_DOWN;
+		if(cPos->y >= 0) fakeKeys |= KEY_CPAD_UP;
+		else             fakeKeys |= KEY_CPAD_DOWN;
 	}
 
 	fakeKeysCache = fakeKeys;
 	return fakeKeys;
 }
 
+static void samplerIrqHandler(UNUSED u32 intSource)
+{
+	getTimerRegs()->int_stat = 1;
+
+	// Keys are sampled right here. Touch and Circle-Pad need SPI
+	// transfers so they come from the task with the last state.
+	const u32 seq = atomic_load_explicit(&g_ringHead, memory_order_relaxed);
+	HidSample *const sample = &g_ring[seq & (HID_RING_SIZE - 1)];
+	sample->seq   = seq;
+	sample->keys  = g_codecKeys | REG_HID_PAD;
+	sample->touch = g_latestTPos;
+	sample->cpad  = g_latestCPos;
+	atomic_store_explicit(&g_ringHead, seq + 1, memory_order_release);
+
+	signalEvent(g_samplerEvent, false);
+}
+
+[[noreturn]] static void samplerTask(UNUSED void *arg)
+{
+	while(1)
+	{
+		waitForEvent(g_samplerEvent);
+
+		TouchPos tPos = g_latestTPos;
+		CpadPos cPos = g_latestCPos;
+		const u32 codecKeys = rawCodec2Hid(&tPos, &cPos);
+
+		// The timer ISR must never see half updated state.
+		const u32 savedState = enterCriticalSection();
+		g_codecKeys   = codecKeys;
+		g_latestTPos  = tPos;
+		g_latestCPos  = cPos;
+		leaveCriticalSection(savedState);
+	}
+}
+
+bool hidSetSampleRate(u32 rateHz)
+{
+	if(rateHz > HID_SAMPLE_RATE_MAX) return false;
+
+	TIMER_stop();
+	if(rateHz == 0)
+	{
+		IRQ_disable(IRQ_TIMER);
+		g_sampleRate = 0;
+		return true;
+	}
+
+	if(g_samplerEvent == 0)
+	{
+		// The task runs only after we block so the event is set by then.
+		const KHandle event = createEvent(true);
+		if(createTask(0x1000, 3, samplerTask, NULL) == 0)
+		{
+			deleteEvent(event);
+			return false;
+		}
+		g_samplerEvent = event;
+		IRQ_registerIsr(IRQ_TIMER, 13, 0, samplerIrqHandler);
+	}
+	else IRQ_enable(IRQ_TIMER);
+
+	// Scans only look at samples taken from now on.
+	if(g_sampleRate == 0) g_scanPos = hidGetSamplePos();
+	g_sampleRate = rateHz;
+	TIMER_start(1, TIMER_FREQ(1, rateHz), TIMER_AUTO_RELOAD | TIMER_IRQ_EN);
+
+	return true;
+}
+
+u32 hidGetSamplePos(void)
+{
+	return atomic_load_explicit(&g_ringHead, memory_order_acquire);
+}
+
+u32 hidReadSamples(u32 *const pos, HidSample *const out, const u32 max)
+{
+	// While the timer ISR writes sample n (possibly on the other core)
+	// the head is still n and the slot of sample n - HID_RING_SIZE is
+	// being overwritten. Only samples newer than that are intact.
+	u32 start = *pos;
+	const u32 head = atomic_load_explicit(&g_ringHead, memory_order_acquire);
+	if(head - start >= HID_RING_SIZE) start = head - (HID_RING_SIZE - 1);
+
+	u32 num = head - start;
+	if(num > max) num = max;
+	for(u32 i = 0; i < num; i++) out[i] = g_ring[(start + i) & (HID_RING_SIZE - 1)];
+
+	// Drop samples the timer ISR started overwriting while we copied them.
+	// The fence keeps the copy from moving past the head check.
+	atomic_thread_fence(memory_order_acquire);
+	const u32 newHead = atomic_load_explicit(&g_ringHead, memory_order_relaxed);
+	u32 skip = 0;
+	if(newHead - start >= HID_RING_SIZE) skip = newHead - (HID_RING_SIZE - 1) - start;
+	if(skip > num) skip = num;
+	for(u32 i = skip; i < num; i++) out[i - skip] = out[i];
+
+	*pos = start + num;
+	return num - skip;
+}
+
+static void scanSamples(const u32 kOld)
+{
+	// Report the edges of all samples since the last scan so short presses are not lost.
+	u32 held = kOld, down = 0, up = 0;
+	HidSample samples[16];
+	u32 num;
+	while((num = hidReadSamples(&g_scanPos, samples, 16)) > 0)
+	{
+		for(u32 i = 0; i < num; i++)
+		{
+			const u32 keys = samples[i].keys;
+			down |= ~held & keys;
+			up   |= held & ~keys;
+			held = keys;
+		}
+
+		g_tPos = samples[num - 1].touch;
+		g_cPos = samples[num - 1].cpad;
+	}
+
+	g_kHeld = held;
+	g_kDown = down;
+	g_kUp   = up;
+}
+
 void hidScanInput(void)
 {
 	updateMcuHidState();
 
 	const u32 kOld = g_kHeld;
-	g_kHeld = rawCodec2Hid() | REG_HID_PAD;
+	if(g_sampleRate != 0)
+	{
+		scanSamples(kOld);
+		return;
+	}
+
+	g_kHeld = rawCodec2Hid(&g_tPos, &g_cPos) | REG_HID_PAD;
 	g_kDown = (~kOld) & g_kHeld;
 	g_kUp = kOld & (~g_kHeld);
 }
@@ -114,6 +114,25 @@ BacklightPwmCalBase g_blPwmCal =
 	.hwBrightnessMin  = 13
 };
 
+// Maps the full 12 bit ADC range onto the screen like uncalibrated hardware.
+TouchCalBase g_touchCal =
+{
+	.rawX0   = 0,
+	.rawY0   = 0,
+	.pointX0 = 0,
+	.pointY0 = 0,
+	.rawX1   = 4096,
+	.rawY1   = 4096,
+	.pointX1 = 320,
+	.pointY1 = 240
+};
+
+CirclePadCal1Base g_cpadCal =
+{
+	.centerX = 2048,
+	.centerY = 2048
+};
+
 static u32 g_calLoadedMask = 0;
 
 
@@ -188,6 +207,28 @@ static void updateCals(const Hwcal *const hwcal)
 		}
 	}
 
+	// Check and update touchscreen calibration.
+	if(agingPassedMask & CAL_MASK_TOUCH)
+	{
+		const u16 crc16 = reverseCrc16Modbus(0x55AA, &hwcal->touch, CAL_CRC_OFFSET(hwcal->touch));
+		if(hwcal->touch.crc16 == crc16)
+		{
+			memcpy(&g_touchCal, &hwcal->touch, sizeof(g_touchCal));
+			calLoadedMask |= CAL_MASK_TOUCH;
+		}
+	}
+
+	// Check and update Circle-Pad calibration.
+	if(agingPassedMask & CAL_MASK_CIRCLE_PAD1)
+	{
+		const u16 crc16 = reverseCrc16Modbus(0x55AA, &hwcal->circlePad1, CAL_CRC_OFFSET(hwcal->circlePad1));
+		if(hwcal->circlePad1.crc16 == crc16)
+		{
+			memcpy(&g_cpadCal, &hwcal->circlePad1, sizeof(g_cpadCal));
+			calLoadedMask |= CAL_MASK_CIRCLE_PAD1;
+		}
+	}
+
 	// Keep track of successfully updated calibrations.
 	g_calLoadedMask = calLoadedMask;
 }
@@ -16,10 +16,11 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "types.h"
 #include "arm11/drivers/i2c.h"
+#include "kernel.h"
 #include "kevent.h"
-#include "kmutex.h"
 #include "arm11/drivers/interrupt.h"
 
 
@@ -49,175 +50,293 @@ static const struct
 	{I2C_BUS3, 0x2Au<<1}  // 0x54
 };
 
+#define I2C_TRIES        (8u)
+#define I2C_WAIT_EVENTS  (4u) // Max number of tasks waiting for a transfer at the same time.
+
+enum
+{
+	STEP_DEV      = 0u, // Select device and start.
+	STEP_REG      = 1u, // Select register.
+	STEP_DEV_READ = 2u, // Select device in read mode and restart.
+	STEP_DATA     = 3u, // Transfer data bytes.
+	STEP_RETRY    = 4u, // Stop after NACK while selecting. Retry afterwards.
+	STEP_FAIL     = 5u  // Stop after NACK on data.
+};
+
 typedef struct
 {
-	KHandle mutex;
 	I2cBus *const i2cBus;
-	KHandle event;
+	I2cXfer *head; // Transfer in progress.
+	I2cXfer *tail;
 } I2cState;
-static I2cState g_i2cState[3] = {{0, (I2cBus*)I2C1_REGS_BASE, 0},
-                                 {0, (I2cBus*)I2C2_REGS_BASE, 0},
-                                 {0, (I2cBus*)I2C3_REGS_BASE, 0}};
+static I2cState g_i2cState[3] = {{(I2cBus*)I2C1_REGS_BASE, NULL, NULL},
+                                 {(I2cBus*)I2C2_REGS_BASE, NULL, NULL},
+                                 {(I2cBus*)I2C3_REGS_BASE, NULL, NULL}};
 
+static KHandle g_waitEvents[I2C_WAIT_EVENTS] = {0};
+static u32 g_freeWaitEvents = 0;
 
-
-static bool checkAck(I2cBus *const i2cBus)
+typedef struct
 {
-	// If we received a NACK stop the transfer.
-	if((i2cBus->cnt & I2C_ACK) == 0)
-	{
-		i2cBus->cnt = I2C_EN | I2C_IRQ_EN | I2C_ERROR | I2C_STOP;
-		return false;
-	}
+	I2cXfer xfer;
+	u8 data[I2C_ASYNC_MAX_SIZE];
+} AsyncSlot;
+static AsyncSlot g_asyncSlots[I2C_ASYNC_SLOTS] = {0};
+static u32 g_nextAsyncSlot = 0;
+
 
-	return true;
-}
 
-static void sendByte(I2cBus *const i2cBus, const u8 data, const u8 params, KHandle const event)
+static inline void sendByte(I2cBus *const i2cBus, const u8 data, const u8 params)
 {
 	i2cBus->data = data;
 	i2cBus->cnt = I2C_EN | I2C_IRQ_EN | I2C_DIR_S | params;
-	waitForEvent(event);
 }
 
-static u8 recvByte(I2cBus *const i2cBus, u8 params, KHandle const event)
+static inline void recvByte(I2cBus *const i2cBus, const u8 params)
 {
 	i2cBus->cnt = I2C_EN | I2C_IRQ_EN | I2C_DIR_R | params;
-	waitForEvent(event);
-	return i2cBus->data;
 }
 
-void I2C_init(void)
+// Starts the bus operation for the current step of a transfer.
+static void startStep(I2cBus *const i2cBus, const I2cXfer *const xfer)
 {
-	static bool inited = false;
-	if(inited) return;
-	inited = true;
-
-	for(unsigned i = 0; i < 3; i++)
+	const u8 devAddr = g_i2cDevTable[xfer->devId].devAddr;
+	switch(xfer->step)
 	{
-		static const Interrupt i2cIrqs[3] = {IRQ_I2C1, IRQ_I2C2, IRQ_I2C3};
-		const KHandle event = createEvent(true);
-		bindInterruptToEvent(event, i2cIrqs[i], 14);
-		g_i2cState[i].event = event;
+		case STEP_DEV:
+			// Direct transfers select the device in the final mode right away.
+			if(xfer->regAddr >= 0x100 && xfer->read) sendByte(i2cBus, devAddr | BIT(0), I2C_START);
+			else                                     sendByte(i2cBus, devAddr, I2C_START);
+			break;
+		case STEP_REG:
+			sendByte(i2cBus, xfer->regAddr, 0);
+			break;
+		case STEP_DEV_READ:
+			sendByte(i2cBus, devAddr | BIT(0), I2C_START);
+			break;
+		case STEP_DATA:
+		{
+			const bool last = xfer->pos == xfer->size - 1;
+			if(xfer->read) recvByte(i2cBus, (last ? I2C_STOP : I2C_ACK));
+			else           sendByte(i2cBus, ((const u8*)xfer->buf)[xfer->pos], (last ? I2C_STOP : 0));
+			break;
+		}
+	}
+}
 
-		g_i2cState[i].mutex = createMutex();
+// Starts the transfer at the queue head if there is one.
+static void startNext(I2cState *const state)
+{
+	I2cXfer *const xfer = state->head;
+	if(xfer == NULL) return;
 
-		I2cBus *const i2cBus = g_i2cState[i].i2cBus;
-		while(i2cBus->cnt & I2C_EN);
-		i2cBus->cntex = I2C_CLK_STRETCH_EN;
-		i2cBus->scl = I2C_DELAYS(5u, 0u);
-	}
+	xfer->step  = STEP_DEV;
+	xfer->tries = I2C_TRIES;
+	xfer->pos   = 0;
+	startStep(state->i2cBus, xfer);
 }
 
-static bool startTransfer(const u8 devAddr, const u32 regAddr, const bool read, const I2cState *const state)
+static void finishXfer(I2cState *const state, I2cXfer *const xfer, const bool success)
 {
-	u32 tries = 8;
+	state->head = xfer->next;
+	if(state->head == NULL) state->tail = NULL;
+
+	// The transfer may be reused as soon as the state is updated.
+	const KHandle event = xfer->event;
+	const I2cDoneCb done = xfer->done;
+	xfer->state = (success ? I2C_XFER_OK : I2C_XFER_FAILED);
+	if(event != 0) signalEvent(event, false);
+
+	startNext(state);
+	if(done != NULL) done(xfer);
+}
+
+static void i2cIrqHandler(const u32 intSource)
+{
+	I2cState *const state = &g_i2cState[intSource == IRQ_I2C1 ? I2C_BUS1 : (intSource == IRQ_I2C2 ? I2C_BUS2 : I2C_BUS3)];
 	I2cBus *const i2cBus = state->i2cBus;
-	const KHandle event = state->event;
-	do
-	{
-		// Edge case on previous transfer error (NACK).
-		// This is a special case where we can't predict when or if
-		// the IRQ has fired. If it fires after checking but
-		// before a wfi this would hang.
-		if(i2cBus->cnt & I2C_EN) waitForEvent(event);
-		clearEvent(event);
-
-		// If regAddr is valid we select a register. Otherwise direct transfer.
-		if(regAddr < 0x100)
-		{
-			// Select device for write and start.
-			sendByte(i2cBus, devAddr, I2C_START, event);
-			if(!checkAck(i2cBus)) continue;
+	I2cXfer *const xfer = state->head;
+	if(xfer == NULL) return;
 
-			// Select register.
-			sendByte(i2cBus, regAddr, 0, event);
-			if(!checkAck(i2cBus)) continue;
+	const u8 cnt = i2cBus->cnt;
+	switch(xfer->step)
+	{
+		case STEP_DEV:
+		case STEP_REG:
+		case STEP_DEV_READ:
+			// If we received a NACK stop the transfer and retry.
+			if((cnt & I2C_ACK) == 0)
+			{
+				i2cBus->cnt = I2C_EN | I2C_IRQ_EN | I2C_ERROR | I2C_STOP;
+				xfer->step = STEP_RETRY;
+				return;
+			}
 
-			// Select device in read mode for read transfer.
-			if(read)
+			if(xfer->step == STEP_DEV && xfer->regAddr < 0x100) xfer->step = STEP_REG;
+			else if(xfer->step == STEP_REG && xfer->read)       xfer->step = STEP_DEV_READ;
+			else                                                xfer->step = STEP_DATA;
+			break;
+		case STEP_DATA:
+			if(xfer->read) ((u8*)xfer->buf)[xfer->pos] = i2cBus->data;
+			else if((cnt & I2C_ACK) == 0)
 			{
-				sendByte(i2cBus, devAddr | BIT(0), I2C_START, event);
-				if(!checkAck(i2cBus)) continue;
+				i2cBus->cnt = I2C_EN | I2C_IRQ_EN | I2C_ERROR | I2C_STOP;
+				xfer->step = STEP_FAIL;
+				return;
 			}
-		}
-		else
-		{
-			// Select device and start.
-			sendByte(i2cBus, (read ? devAddr | BIT(0) : devAddr), I2C_START, event);
-			if(!checkAck(i2cBus)) continue;
-		}
 
-		break;
-	} while(--tries > 0);
+			if(++xfer->pos == xfer->size)
+			{
+				finishXfer(state, xfer, true);
+				return;
+			}
+			break;
+		case STEP_RETRY:
+			if(--xfer->tries == 0)
+			{
+				finishXfer(state, xfer, false);
+				return;
+			}
+			xfer->step = STEP_DEV;
+			break;
+		default: // STEP_FAIL.
+			finishXfer(state, xfer, false);
+			return;
+	}
 
-	return tries > 0;
+	startStep(i2cBus, xfer);
 }
 
-bool I2C_readArray(const I2cDevice devId, const u32 regAddr, void *out, u32 size)
+void I2C_init(void)
 {
-	const u8 devAddr = g_i2cDevTable[devId].devAddr;
-	const I2cState *const state = &g_i2cState[g_i2cDevTable[devId].busId];
-	I2cBus *const i2cBus = state->i2cBus;
-	const KHandle event = state->event;
-	const KHandle mutex = state->mutex;
-	u8 *ptr8 = out;
+	static bool inited = false;
+	if(inited) return;
+	inited = true;
 
+	for(unsigned i = 0; i < I2C_WAIT_EVENTS; i++)
+	{
+		g_waitEvents[i] = createEvent(true);
+	}
+	g_freeWaitEvents = (1u<<I2C_WAIT_EVENTS) - 1;
 
-	bool res = true;
-	lockMutex(mutex);
-	if(startTransfer(devAddr, regAddr, true, state))
+	for(unsigned i = 0; i < 3; i++)
 	{
-		while(--size) *ptr8++ = recvByte(i2cBus, I2C_ACK, event);
+		I2cBus *const i2cBus = g_i2cState[i].i2cBus;
+		while(i2cBus->cnt & I2C_EN);
+		i2cBus->cntex = I2C_CLK_STRETCH_EN;
+		i2cBus->scl = I2C_DELAYS(5u, 0u);
 
-		// Last byte transfer.
-		*ptr8 = recvByte(i2cBus, I2C_STOP, event);
+		static const Interrupt i2cIrqs[3] = {IRQ_I2C1, IRQ_I2C2, IRQ_I2C3};
+		IRQ_registerIsr(i2cIrqs[i], 14, 0, i2cIrqHandler);
 	}
-	else res = false;
-	unlockMutex(mutex);
-
-	return res;
 }
 
-bool I2C_writeArray(const I2cDevice devId, const u32 regAddr, const void *in, u32 size)
+// Must be called with IRQs disabled.
+static void submitLocked(I2cXfer *const xfer)
 {
-	const u8 devAddr = g_i2cDevTable[devId].devAddr;
-	const I2cState *const state = &g_i2cState[g_i2cDevTable[devId].busId];
-	I2cBus *const i2cBus = state->i2cBus;
-	const KHandle event = state->event;
-	const KHandle mutex = state->mutex;
-	const u8 *ptr8 = in;
+	xfer->state = I2C_XFER_PENDING;
+	xfer->next  = NULL;
+	xfer->event = 0;
 
+	I2cState *const state = &g_i2cState[g_i2cDevTable[xfer->devId].busId];
+	if(state->tail != NULL) state->tail->next = xfer;
+	else
+	{
+		state->head = xfer;
+		startNext(state);
+	}
+	state->tail = xfer;
+}
 
-	lockMutex(mutex);
-	if(!startTransfer(devAddr, regAddr, false, state))
+void I2C_submit(I2cXfer *const xfer)
+{
+	if(xfer->size == 0)
 	{
-		unlockMutex(mutex);
-		return false;
+		xfer->state = I2C_XFER_FAILED;
+		return;
 	}
 
-	while(--size)
+	const u32 savedState = enterCriticalSection();
+	submitLocked(xfer);
+	leaveCriticalSection(savedState);
+}
+
+bool I2C_await(I2cXfer *const xfer)
+{
+	u32 savedState = enterCriticalSection();
+	if(xfer->state == I2C_XFER_PENDING)
 	{
-		sendByte(i2cBus, *ptr8++, 0, event);
-		if(!checkAck(i2cBus))
+		const u32 freeEvents = g_freeWaitEvents;
+		if(freeEvents != 0)
 		{
-			unlockMutex(mutex);
-			return false;
+			const u32 i = __builtin_ctz(freeEvents);
+			g_freeWaitEvents = freeEvents & ~BIT(i);
+			xfer->event = g_waitEvents[i];
+			leaveCriticalSection(savedState);
+
+			// Signaled exactly once by the ISR when the transfer is done.
+			waitForEvent(g_waitEvents[i]);
+
+			savedState = enterCriticalSection();
+			g_freeWaitEvents |= BIT(i);
+		}
+		else
+		{
+			leaveCriticalSection(savedState);
+			while(xfer->state == I2C_XFER_PENDING) yieldTask();
+			savedState = enterCriticalSection();
 		}
 	}
+	leaveCriticalSection(savedState);
 
-	// Last byte transfer.
-	sendByte(i2cBus, *ptr8, I2C_STOP, event);
-	if(!checkAck(i2cBus))
+	return xfer->state == I2C_XFER_OK;
+}
+
+bool I2C_writeAsync(const I2cDevice devId, const u32 regAddr, const void *in, u32 size)
+{
+	if(size == 0 || size > I2C_ASYNC_MAX_SIZE) return false;
+
+	u32 savedState = enterCriticalSection();
+	AsyncSlot *slot = &g_asyncSlots[g_nextAsyncSlot];
+	while(slot->xfer.state == I2C_XFER_PENDING)
 	{
-		unlockMutex(mutex);
-		return false;
+		leaveCriticalSection(savedState);
+		yieldTask();
+		savedState = enterCriticalSection();
+		slot = &g_asyncSlots[g_nextAsyncSlot];
 	}
-	unlockMutex(mutex);
+	g_nextAsyncSlot = (g_nextAsyncSlot + 1) % I2C_ASYNC_SLOTS;
+
+	memcpy(slot->data, in, size);
+	I2cXfer *const xfer = &slot->xfer;
+	xfer->buf     = slot->data;
+	xfer->size    = size;
+	xfer->regAddr = regAddr;
+	xfer->devId   = devId;
+	xfer->read    = false;
+	xfer->done    = NULL;
+	submitLocked(xfer);
+	leaveCriticalSection(savedState);
 
 	return true;
 }
 
+bool I2C_readArray(const I2cDevice devId, const u32 regAddr, void *out, u32 size)
+{
+	I2cXfer xfer = {.buf = out, .size = size, .regAddr = regAddr, .devId = devId, .read = true};
+	I2C_submit(&xfer);
+
+	return I2C_await(&xfer);
+}
+
+bool I2C_writeArray(const I2cDevice devId, const u32 regAddr, const void *in, u32 size)
+{
+	I2cXfer xfer = {.buf = (void*)in, .size = size, .regAddr = regAddr, .devId = devId, .read = false};
+	I2C_submit(&xfer);
+
+	return I2C_await(&xfer);
+}
+
 u8 I2C_read(const I2cDevice devId, const u32 regAddr)
 {
 	u8 data;
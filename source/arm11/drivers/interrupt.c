@@ -22,6 +22,9 @@
 #include "memory.h"
 #include "arm.h"
 #include "arm11/drivers/cfg11.h"
+#ifdef LIBN3DS_IRQ_STATS
+#include "arm11/drivers/performance_monitor.h"
+#endif // #ifdef LIBN3DS_IRQ_STATS
 
 
 // Level high active keeps firing until acknowledged (on the periphal side).
@@ -37,9 +40,28 @@
                    (c5)<<10 | (c4)<<8 | (c3)<<6 | (c2)<<4 | (c1)<<2 | (c0))
 
 
+#define ISR_NO_PREEMPT  BIT(15) // In g_irqIsrStack.
+
+
+typedef struct
+{
+	uintptr_t baseSp; // Stack pointer of the outermost ISR call.
+	u32 depth;        // Number of nested ISR calls.
+} IrqNestState;
+
 // First 32 interrupts are private to each core (4 * 32).
 // 96 external interrupts (total 128).
 IrqIsr g_irqIsrTable[224] = {0};
+// Stack size of each ISR + ISR_NO_PREEMPT flag. Same layout as g_irqIsrTable.
+static u16 g_irqIsrStack[224] = {0};
+static u32 g_maxIsrStack = 0;
+static IrqNestState g_irqNest[4] = {0};
+
+
+#ifdef LIBN3DS_IRQ_STATS
+// irq_stats.c
+void irqStatsRecord(const u32 idx, const u32 cycles, const u32 latency);
+#endif // #ifdef LIBN3DS_IRQ_STATS
 
 
 
@@ -152,6 +174,47 @@ void IRQ_init(void)
 
 	// Disable all FIQs. We don't use them.
 	getCfg11Regs()->fiq_mask = FIQ_MASK_CPU3 | FIQ_MASK_CPU2 | FIQ_MASK_CPU1 | FIQ_MASK_CPU0;
+
+#ifdef LIBN3DS_IRQ_STATS
+	// The IRQ stats need the cycle counter. Leave it alone if someone else already started it.
+	if(!(__getPmnc() & PM_EN)) __setPmnc(PM_CCNT_NODIV | PM_EN);
+#endif // #ifdef LIBN3DS_IRQ_STATS
+}
+
+// Called by the IRQ exception handler with IRQs disabled.
+// entryStamp is the cycle counter value at IRQ exception entry (stats only).
+void irqDispatch(const u32 intSource, const u32 idx, UNUSED const u32 entryStamp, const IrqIsr isr)
+{
+	IrqNestState *const nest = &g_irqNest[__getCpuId()];
+	const uintptr_t sp = (uintptr_t)__builtin_frame_address(0);
+	if(nest->depth == 0) nest->baseSp = sp;
+	nest->depth++;
+
+	// Let higher priority IRQs in only if the biggest ISR could still
+	// preempt this one without exceeding the nesting stack budget.
+	// Each nested ISR does the same check so the budget is never exceeded.
+	const u32 isrStack = g_irqIsrStack[idx];
+	const u32 used = nest->baseSp - sp;
+	const bool preempt = !(isrStack & ISR_NO_PREEMPT) &&
+	                     used + isrStack + g_maxIsrStack <= IRQ_NEST_STACK_BUDGET;
+	if(preempt) __cpsie(i);
+
+#ifdef LIBN3DS_IRQ_STATS
+	const u32 start = __getCcnt();
+	isr(intSource);
+	irqStatsRecord(idx, __getCcnt() - start, start - entryStamp);
+#else
+	isr(intSource);
+#endif // #ifdef LIBN3DS_IRQ_STATS
+
+	if(preempt) __cpsid(i);
+	nest->depth--;
+}
+
+static void setIsrStack(const u32 idx, const u32 stackSize, const bool preemptible)
+{
+	g_irqIsrStack[idx] = stackSize | (preemptible ? 0 : ISR_NO_PREEMPT);
+	if(stackSize > g_maxIsrStack) g_maxIsrStack = stackSize;
 }
 
 // TODO: If target is not 0 or doesn't match the executing CPU this will set the wrong ISR table entry for IDs <32.
@@ -169,7 +232,9 @@ void IRQ_registerIsr(const Interrupt id, const u32 prio, u32 target, const IrqIs
 	const u32 savedState = enterCriticalSection();
 
 	// Set ISR function pointer.
-	g_irqIsrTable[(id < 32 ? 32 * cpuId + id : 96u + id)] = isr;
+	const u32 tableIdx = (id < 32 ? 32 * cpuId + id : 96u + id);
+	g_irqIsrTable[tableIdx] = isr;
+	setIsrStack(tableIdx, IRQ_ISR_STACK_DEFAULT, true);
 
 	// Set IRQ priority.
 	const u32 idx = id / 4;
@@ -225,6 +290,15 @@ void IRQ_setPriority(const Interrupt id, const u32 prio)
 	leaveCriticalSection(savedState);
 }
 
+void IRQ_setNesting(const Interrupt id, const bool preemptible, const u32 stackSize)
+{
+	if(stackSize > IRQ_NEST_STACK_BUDGET / 2) return;
+
+	const u32 savedState = enterCriticalSection();
+	setIsrStack((id < 32 ? 32 * __getCpuId() + id : 96u + id), stackSize, preemptible);
+	leaveCriticalSection(savedState);
+}
+
 // Note: The reg write is atomic however if the ISR for this IRQ uses IRQ_disable() + IRQ_enable()
 //       this IRQ could enable itself again without critical section protecting the table write.
 void IRQ_unregisterIsr(const Interrupt id)
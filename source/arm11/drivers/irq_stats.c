@@ -0,0 +1,136 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "error_codes.h"
+#include "arm11/drivers/interrupt.h"
+
+
+#ifdef LIBN3DS_IRQ_STATS
+// Entries are written by the core running the ISR and read from any core.
+// seq is odd while an update is in progress (seqlock).
+typedef struct
+{
+	IrqStats stats;
+	au32 seq;
+} IrqStatsSlot;
+
+// Same layout as g_irqIsrTable.
+static IrqStatsSlot g_irqStats[224] = {0};
+
+
+
+static inline u32 statsIndex(const u32 id, const u32 core)
+{
+	return (id < 32 ? 32 * core + id : 96u + id);
+}
+
+// Called by irqDispatch() after each ISR call.
+void irqStatsRecord(const u32 idx, const u32 cycles, const u32 latency)
+{
+	// Only this core writes the entry and the same IRQ can't preempt its own ISR.
+	IrqStatsSlot *const slot = &g_irqStats[idx];
+	const u32 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed) & ~1u;
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	IrqStats *const stats = &slot->stats;
+	stats->count++;
+	stats->totalCycles += cycles;
+	if(cycles > stats->maxCycles) stats->maxCycles = cycles;
+	if(latency > stats->maxLatency) stats->maxLatency = latency;
+
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+// totalCycles is 64 bit and may be updated by the other core while we copy it.
+// The number of retries is bounded because this is also called from the
+// exception handler which may have interrupted irqStatsRecord() on this core.
+static void readStats(const u32 idx, IrqStats *const out)
+{
+	const IrqStatsSlot *const slot = &g_irqStats[idx];
+	for(u32 tries = 0; tries < 16; tries++)
+	{
+		const u32 seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		*out = slot->stats;
+		atomic_thread_fence(memory_order_acquire);
+		if((seq & 1u) == 0 && atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) break;
+	}
+}
+
+Result IRQ_getStats(const Interrupt id, const u32 core, IrqStats *const stats)
+{
+	if(id >= 128 || core >= 4) return RES_INVALID_ARG;
+
+	const u32 savedState = enterCriticalSection();
+	readStats(statsIndex(id, core), stats);
+	leaveCriticalSection(savedState);
+
+	return RES_OK;
+}
+
+u32 IRQ_getTopStats(IrqStatsEntry *const entries, const u32 max)
+{
+	// Insertion sort into the output array. At most 224 entries.
+	const u32 savedState = enterCriticalSection();
+	u32 num = 0;
+	for(u32 idx = 0; idx < 224; idx++)
+	{
+		IrqStats stats;
+		readStats(idx, &stats);
+		if(stats.count == 0) continue;
+
+		u32 pos = num;
+		while(pos > 0 && entries[pos - 1].stats.totalCycles < stats.totalCycles) pos--;
+		if(pos >= max) continue;
+
+		const u32 last = (num < max ? num : max - 1);
+		memmove(&entries[pos + 1], &entries[pos], (last - pos) * sizeof(IrqStatsEntry));
+		entries[pos].stats = stats;
+		entries[pos].id    = (idx < 128 ? idx % 32 : idx - 96);
+		entries[pos].core  = (idx < 128 ? idx / 32 : 0);
+		if(num < max) num++;
+	}
+	leaveCriticalSection(savedState);
+
+	return num;
+}
+
+void IRQ_resetStats(void)
+{
+	// Leave seq alone. Clearing it could make a concurrent update end odd.
+	const u32 savedState = enterCriticalSection();
+	for(u32 idx = 0; idx < 224; idx++) memset(&g_irqStats[idx].stats, 0, sizeof(IrqStats));
+	leaveCriticalSection(savedState);
+}
+#else
+Result IRQ_getStats(UNUSED const Interrupt id, UNUSED const u32 core, UNUSED IrqStats *const stats)
+{
+	return RES_NOT_FOUND;
+}
+
+u32 IRQ_getTopStats(UNUSED IrqStatsEntry *const entries, UNUSED const u32 max)
+{
+	return 0;
+}
+
+void IRQ_resetStats(void)
+{
+}
+#endif // #ifdef LIBN3DS_IRQ_STATS
\ No newline at end of file
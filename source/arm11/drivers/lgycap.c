@@ -16,12 +16,13 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <string.h>
 #include "types.h"
 #include "arm11/drivers/lgycap.h"
 #include "arm11/drivers/interrupt.h"
 #include "drivers/cache.h"
 #include "drivers/corelink_dma-330.h"
+#include "drivers/corelink_dma-330_asm.h"
+#include "arm11/drivers/cdma.h"
 #include "arm11/drivers/gx.h"
 #include "kevent.h"
 
@@ -29,29 +30,8 @@
 static KHandle g_frameReadyEvents[2] = {0, 0};
 
 // DMA330 docs don't tell you the recommended alignment so we assume it's bus width.
-alignas(8) static u8 g_lgyCapDmaProg[44] =
-{
-	// All transfer settings for A1BGR5 at 360x240 to a 512x512 texture.
-	0xBC, 0x01, 0xF6, 0xC2, 0xBD, 0x00, // MOV CCR, SB16 SS64 SAF SP2 DB16 DS64 DAI DP2
-	0xBC, 0x00, 0x00, 0x10, 0x31, 0x10, // MOV SAR, 0x10311000
-	0x35, 0x70,                         // FLUSHP 14
-	0x20, 0x01,                         // LP 2
-	0xBC, 0x02, 0x00, 0x00, 0x20, 0x18, // MOV DAR, 0x18200000
-	                                    // LPFE
-	0x31, 0x70,                         // WFP 14, periph
-	0x22, 0x2B,                         // LP 44
-	0x04,                               // LD
-	0x08,                               // ST
-	0x3C, 0x02,                         // LPEND
-	0x27, 0x70,                         // LDPB 14
-	0x08,                               // ST
-	0x56, 0x80, 0x09,                   // ADDH DAR, 0x980
-	0x28, 0x0E,                         // LPEND
-	0x13,                               // WMB
-	0x34, 0x08,                         // SEV 1
-	0x38, 0x1B,                         // LPEND ; Modified to jump to "LP 2" so the loop can never exit.
-	0x00                                // END
-};
+// Generated by buildDmaProg(). 44 bytes for all supported widths.
+alignas(8) static u8 g_lgyCapDmaProg[64];
 
 
 
@@ -82,38 +62,69 @@ static void dmaIrqHandler(const u32 intSource)
 	signalEvent(g_frameReadyEvents[dev], false);
 }
 
-// This is a temporary solution and will be replaced by a DMA JIT eventually.
-static bool patchDmaProg(const u16 width, const u32 pixelSize)
+static void emitLdSt(Dma330Asm *const a, UNUSED void *arg)
 {
-	u8 *const prog = g_lgyCapDmaProg;
+	DMA330_asmLd(a, DMA330_ALWAYS);
+	DMA330_asmSt(a, DMA330_ALWAYS);
+}
 
+// Builds the capture program for the given width into g_lgyCapDmaProg.
+static bool buildDmaProg(const u16 width, const u32 pixelSize)
+{
 	// Test if we can divide the size of 8 lines by DMA burst size.
 	const u32 bytesPer8Lines = width * pixelSize * 8;
-	u32 transfers = 16;
-	if(bytesPer8Lines % (16 * 8) == 0)
-	{
-		// Patch DMA prog to do 16 transfers of 8 bytes each.
-		prog[2] = 0xF6; // SB16.
-		prog[4] = 0xBD; // DB16.
-	}
-	else if(bytesPer8Lines % (15 * 8) == 0)
-	{
-		// Patch DMA prog to do 15 transfers of 8 bytes each.
-		transfers = 15;
-		prog[2] = 0xE6; // SB15.
-		prog[4] = 0xB9; // DB15.
-	}
+	u32 transfers;
+	if(bytesPer8Lines % (16 * 8) == 0)     transfers = 16; // 16 transfers of 8 bytes each.
+	else if(bytesPer8Lines % (15 * 8) == 0) transfers = 15; // 15 transfers of 8 bytes each.
 	else return false;
 
-	// Adjust inner loop count. The last transfer is not part of the loop.
-	prog[25] = (bytesPer8Lines / (transfers * 8)) - 2;
-
-	// Skip padding pixels at the right side of the sub texture.
-	const u16 gapSize = (512u - width) * pixelSize * 8;
-	memcpy(&prog[34], &gapSize, 2);
+	// For A1BGR5 at 360x240 to a 512x512 texture:
+	// MOV CCR, SB16 SS64 SAF SP2 DB16 DS64 DAI DP2
+	// MOV SAR, 0x10311000
+	// FLUSHP 14
+	// LP 2                ; Endless. The LPEND jumps back here so the loop can never exit.
+	//   MOV DAR, 0x18200000
+	//   LPFE              ; Ends on the last request of the frame.
+	//     WFP 14, periph
+	//     LP 44
+	//       LD
+	//       ST
+	//     LPEND
+	//     LDPB 14
+	//     ST
+	//     ADDH DAR, 0x980  ; Skip padding pixels at the right side of the sub texture.
+	//   LPEND
+	//   WMB
+	//   SEV 1
+	// LPEND
+	// END
+	Dma330Asm a;
+	DMA330_asmInit(&a, g_lgyCapDmaProg, sizeof(g_lgyCapDmaProg));
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_LEN(transfers) | CCR_SRC_BURST_SIZE(3) | CCR_SRC_PROT_CTRL(2) |
+	                              CCR_DST_BURST_LEN(transfers) | CCR_DST_BURST_SIZE(3) | CCR_DST_INC | CCR_DST_PROT_CTRL(2));
+	DMA330_asmMov(&a, DMA330_SAR, 0x10311000);
+	DMA330_asmFlushp(&a, 14);
+	DMA330_asmLpEndless(&a);
+	{
+		DMA330_asmMov(&a, DMA330_DAR, 0x18200000);
+		DMA330_asmLpForever(&a);
+		{
+			DMA330_asmWfp(&a, DMA330_WFP_PERIPH, 14);
+			// The last burst of the 8 lines is not part of the loop.
+			DMA330_asmRepeat(&a, bytesPer8Lines / (transfers * 8) - 1, emitLdSt, NULL);
+			DMA330_asmLdp(&a, DMA330_BURST, 14);
+			DMA330_asmSt(&a, DMA330_ALWAYS);
+			DMA330_asmAddh(&a, DMA330_DAR, (512u - width) * pixelSize * 8);
+		}
+		DMA330_asmLpEnd(&a);
+		DMA330_asmWmb(&a);
+		DMA330_asmSev(&a, 1);
+	}
+	DMA330_asmLpEnd(&a);
+	if(DMA330_asmEnd(&a) == 0) return false;
 
 	// Make sure the DMA controller can see the code.
-	flushDCacheRange(prog, sizeof(g_lgyCapDmaProg));
+	flushDCacheRange(g_lgyCapDmaProg, sizeof(g_lgyCapDmaProg));
 
 	return true;
 }
@@ -160,8 +171,9 @@ static inline u32 getPixelSize(const u32 lgycap_cnt)
 
 KHandle LGYCAP_init(const LgyCapDev dev, const LgyCapCfg *const cfg)
 {
-	if(!patchDmaProg(cfg->w, getPixelSize(cfg->cnt))) return 0;
+	if(!buildDmaProg(cfg->w, getPixelSize(cfg->cnt))) return 0;
 	if(DMA330_run(dev, g_lgyCapDmaProg)) return 0;
+	CDMA_setRestartProg(dev, g_lgyCapDmaProg); // Recover from DMA faults.
 
 	// Create KEvent for frame ready signal.
 	KHandle frameReadyEvent = createEvent(false);
@@ -194,6 +206,8 @@ KHandle LGYCAP_init(const LgyCapDev dev, const LgyCapCfg *const cfg)
 	lgyCap->cnt = LGYCAP_DMA_EN | cfg->cnt | LGYCAP_EN;
 
 	IRQ_registerIsr(IRQ_CDMA_EVENT0 + dev, 13, 0, dmaIrqHandler);
+	// Nothing may run between reading v_count and writing v_total.
+	IRQ_setNesting(IRQ_CDMA_EVENT0 + dev, false, IRQ_ISR_STACK_DEFAULT);
 
 	return frameReadyEvent;
 }
@@ -208,6 +222,7 @@ void LGYCAP_deinit(const LgyCapDev dev)
 	lgyCap->stat  = LGYCAP_IRQ_MASK;
 
 	// Kill the DMA channel and flush the FIFO.
+	CDMA_setRestartProg(dev, NULL);
 	DMA330_kill(dev);
 	lgyCap->flush = 0;
 
@@ -232,6 +247,7 @@ void LGYCAP_stop(const LgyCapDev dev)
 	lgyCap->stat  = LGYCAP_IRQ_MASK;
 
 	// Kill the DMA channel and flush the FIFO.
+	CDMA_setRestartProg(dev, NULL);
 	DMA330_kill(dev);
 	lgyCap->flush = 0;
 
@@ -253,14 +269,14 @@ KRes LGYCAP_captureFrameUnscaled(const LgyCapDev dev)
 	const u32 dim = lgyCap->dim;
 	const u32 irq = lgyCap->irq;
 
-	// Force native resolution, disable IRQs and patch DMA prog.
+	// Force native resolution, disable IRQs and rebuild DMA prog.
 	// Note: Disabling IRQs is necessary to prevent crashes
 	//       in open_agb_firm's color correction code.
 	// TODO: Support for DS(i) mode resolution.
 	lgyCap->cnt = cnt & ~(LGYCAP_HSCALE_EN | LGYCAP_VSCALE_EN);
 	lgyCap->dim = LGYCAP_DIM(240, 160);
 	lgyCap->irq = 0;
-	patchDmaProg(240, getPixelSize(cnt));
+	buildDmaProg(240, getPixelSize(cnt));
 
 	// Start capture and wait for the frame.
 	LGYCAP_start(dev);
@@ -272,7 +288,7 @@ KRes LGYCAP_captureFrameUnscaled(const LgyCapDev dev)
 	lgyCap->cnt = cnt;
 	lgyCap->dim = dim;
 	lgyCap->irq = irq;
-	patchDmaProg((dim & 0x1FFu) + 1, getPixelSize(cnt));
+	buildDmaProg((dim & 0x1FFu) + 1, getPixelSize(cnt));
 
 	// Capture must be restarted by the caller.
 	//LGYCAP_start(dev);
@@ -284,5 +300,6 @@ void LGYCAP_start(const LgyCapDev dev)
 {
 	// Restart DMA followed by LgyCap.
 	if(DMA330_run(dev, g_lgyCapDmaProg)) return;
+	CDMA_setRestartProg(dev, g_lgyCapDmaProg);
 	getLgyCapRegs(dev)->cnt |= LGYCAP_EN;
 }
\ No newline at end of file
@@ -20,13 +20,32 @@
 #include <string.h>
 #include "arm11/drivers/mcu.h"
 #include "arm11/drivers/i2c.h"
+#include "kevent.h"
 #include "debug.h"
 #include "arm11/drivers/interrupt.h"
 #include "arm11/drivers/gpio.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "arm11/drivers/cfg11.h"
+#include "arm11/drivers/pdn.h"
+#include "arm11/drivers/timer.h"
 
 
-static atomic_bool g_mcuNeedsIrqRead = false;
-static u32 g_mcuIrqs = 0;
+// MCU IRQs are read from the GPIO IRQ with an async I2C transfer and
+// its completion handler hands the bits to all interested subscribers.
+typedef struct
+{
+	u32 mask;         // 0 = unused.
+	vu32 pending;
+	KHandle event;    // Signaled when new IRQs in mask arrived.
+} McuIrqSub;
+static McuIrqSub g_mcuIrqSubs[MCU_MAX_IRQ_SUBS] = {0};
+
+static I2cXfer g_irqXfer = {0};
+static u32 g_irqBuf = 0;
+static bool g_irqReadBusy = false;
+static bool g_irqReread = false; // An edge arrived during the read.
+static u8 g_irqReadTries = 0;
+
 static struct
 {
 	u16 version;             // MCU firmware version ((MCU_REG_VERS_MAJOR - 0x10)<<8 | MCU_REG_VERS_MINOR).
@@ -36,9 +55,27 @@ static struct
 	u8 earlyButtonsHeld;     // Early button state (MCU_REG_RAW_STATE[18]);
 } g_mcuRegCache;
 
+#define MCU_STATUS_FIRST  (MCU_REG_3D_SLIDER_RAW)
+#define MCU_STATUS_SIZE   (MCU_REG_EX_HW_STAT - MCU_REG_3D_SLIDER_RAW + 1u)
+#define MCU_STATUS_IRQS   (MCU_IRQ_VOL_SLIDER_CHANGE | MCU_IRQ_CHARGER_UNPLUG | MCU_IRQ_CHARGER_PLUG | \
+                           MCU_IRQ_LOW_BATT | MCU_IRQ_BATT_CHARGE_STOP | MCU_IRQ_BATT_CHARGE_START)
+
+// Ages are measured with the cycle counter of the core using the MCU driver.
+// It wraps every 16 seconds at 268 MHz so an entry not used for that long
+// can rarely look fresh again. That is fine for these slowly changing values.
+static struct
+{
+	u32 stamp;                // Cycle counter at the last read.
+	u32 maxAge;               // In cycles. 0 = no caching.
+	vu32 gen;                 // Incremented on each invalidation.
+	volatile bool valid;
+	u8 regs[MCU_STATUS_SIZE];
+} g_mcuStatusCache;
+
 
 
 static void mcuIrqHandler(UNUSED u32 intSource);
+static void irqReadDone(I2cXfer *const xfer);
 
 static bool updateRegisterCache(void)
 {
@@ -70,19 +107,33 @@ void MCU_init(void)
 
 	// TODO: Clear alarm regs here like mcu module? Is this really needed?
 
+	// Do first MCU IRQ read to clear all bits.
+	u32 oldIrqs;
+	if(!MCU_readRegArray(MCU_REG_IRQ, &oldIrqs, sizeof(oldIrqs))) panic();
+
+	// The default subscriber gets all IRQs.
+	g_mcuIrqSubs[MCU_IRQ_SUB_DEFAULT].event = createEvent(true);
+	g_mcuIrqSubs[MCU_IRQ_SUB_DEFAULT].mask  = 0xFFFFFFFFu;
+
+	g_irqXfer.buf     = &g_irqBuf;
+	g_irqXfer.size    = sizeof(g_irqBuf);
+	g_irqXfer.regAddr = MCU_REG_IRQ;
+	g_irqXfer.devId   = I2C_DEV_CTR_MCU;
+	g_irqXfer.read    = true;
+	g_irqXfer.done    = irqReadDone;
+
 	// Enable MCU IRQs.
 	IRQ_registerIsr(IRQ_CTR_MCU, 14, 0, mcuIrqHandler);
 
-	// Do first MCU IRQ read to clear all bits.
-	// Discard IRQs we don't care about.
-	atomic_store_explicit(&g_mcuNeedsIrqRead, true, memory_order_relaxed);
-	(void)MCU_getIrqs(~DEFAULT_MCU_IRQ_MASK);
-
 	// Set IRQ mask so we only get IRQs we are interested in.
 	if(!MCU_setIrqMask(DEFAULT_MCU_IRQ_MASK)) panic();
 
 	// Initialize register cache.
 	if(!updateRegisterCache()) panic();
+
+	// The status cache needs the cycle counter. Leave it alone if someone else already started it.
+	if(!(__getPmnc() & PM_EN)) __setPmnc(PM_CCNT_NODIV | PM_EN);
+	MCU_setStatusMaxAge(MCU_STATUS_MAX_AGE_DEFAULT);
 }
 
 /*bool MCU_reboot(void)
@@ -101,43 +152,218 @@ void MCU_init(void)
 	return true;
 }*/
 
-static void mcuIrqHandler(UNUSED u32 intSource)
+static u32 cyclesPerMs(void)
 {
-	atomic_store_explicit(&g_mcuNeedsIrqRead, true, memory_order_relaxed);
+	u32 cycles = 268111u;
+	if(getCfg11Regs()->socinfo & SOCINFO_LGR1)
+	{
+		const u32 socmode = getPdnRegs()->lgr_socmode & SOCMODE_MASK;
+		if(socmode == SOCMODE_LGR1_536MHZ)      cycles *= 2;
+		else if(socmode == SOCMODE_LGR2_804MHZ) cycles *= 3;
+	}
+
+	if(__getPmnc() & PM_CCNT_DIV64) cycles /= 64;
+
+	return cycles;
 }
 
-// TODO: Rewrite using events (needs timeout support).
-u32 MCU_getIrqs(u32 mask)
+static void mcuIrqHandler(UNUSED u32 intSource)
 {
-	u32 irqs = g_mcuIrqs;
+	// One IRQ register read per edge. Edges during a read cause another read.
+	const u32 savedState = enterCriticalSection();
+	if(!g_irqReadBusy)
+	{
+		g_irqReadBusy  = true;
+		g_irqReadTries = 0;
+		I2C_submit(&g_irqXfer);
+	}
+	else g_irqReread = true;
+	leaveCriticalSection(savedState);
+}
 
-	if(atomic_load_explicit(&g_mcuNeedsIrqRead, memory_order_relaxed))
+// Called from the I2C ISR.
+static void irqReadDone(I2cXfer *const xfer)
+{
+	if(xfer->state == I2C_XFER_OK)
 	{
-		atomic_store_explicit(&g_mcuNeedsIrqRead, false, memory_order_relaxed);
+		const u32 irqs = g_irqBuf;
+		if(irqs & MCU_STATUS_IRQS)
+		{
+			g_mcuStatusCache.gen++;
+			g_mcuStatusCache.valid = false;
+		}
+
+		for(u32 i = 0; i < MCU_MAX_IRQ_SUBS; i++)
+		{
+			McuIrqSub *const sub = &g_mcuIrqSubs[i];
+			if(irqs & sub->mask)
+			{
+				sub->pending |= irqs & sub->mask;
+				signalEvent(sub->event, false);
+			}
+		}
+	}
 
-		u32 newIrqs;
-		if(!MCU_readRegArray(MCU_REG_IRQ, &newIrqs, sizeof(newIrqs))) return 0;
+	const u32 savedState = enterCriticalSection();
+	if(xfer->state != I2C_XFER_OK && ++g_irqReadTries < 3) g_irqReread = true; // The bits are still in the MCU.
+	if(g_irqReread)
+	{
+		g_irqReread = false;
+		if(xfer->state == I2C_XFER_OK) g_irqReadTries = 0;
+		I2C_submit(xfer);
+	}
+	else g_irqReadBusy = false;
+	leaveCriticalSection(savedState);
+}
 
-		irqs |= newIrqs;
+u32 MCU_subscribeIrqs(u32 mask)
+{
+	for(u32 i = 0; i < MCU_MAX_IRQ_SUBS; i++)
+	{
+		McuIrqSub *const sub = &g_mcuIrqSubs[i];
+		if(sub->mask != 0) continue;
+
+		// The event is kept for later subscribers even if we lose the slot below.
+		if(sub->event == 0) sub->event = createEvent(true);
+
+		// The IRQ fan-out must never see a half set up subscriber.
+		const u32 savedState = enterCriticalSection();
+		const bool free = (sub->mask == 0);
+		if(free)
+		{
+			sub->pending = 0;
+			sub->mask    = mask;
+		}
+		leaveCriticalSection(savedState);
+
+		if(free) return i;
 	}
 
-	g_mcuIrqs = irqs & ~mask;
+	return MCU_IRQ_SUB_INVALID;
+}
+
+void MCU_unsubscribeIrqs(u32 sub)
+{
+	if(sub == MCU_IRQ_SUB_DEFAULT || sub >= MCU_MAX_IRQ_SUBS) return;
+
+	// The event is kept for the next subscriber.
+	const u32 savedState = enterCriticalSection();
+	g_mcuIrqSubs[sub].mask    = 0;
+	g_mcuIrqSubs[sub].pending = 0;
+	leaveCriticalSection(savedState);
+}
+
+u32 MCU_getSubIrqs(u32 sub, u32 mask)
+{
+	McuIrqSub *const s = &g_mcuIrqSubs[sub];
+
+	const u32 savedState = enterCriticalSection();
+	const u32 irqs = s->pending;
+	s->pending = irqs & ~mask;
+	leaveCriticalSection(savedState);
 
 	return irqs & mask;
 }
 
-// TODO: Rewrite using events (needs timeout support).
-u32 MCU_waitIrqs(u32 mask)
+static void timeoutAlarm(void *arg)
+{
+	signalEvent((KHandle)arg, false);
+}
+
+u32 MCU_waitSubIrqs(u32 sub, u32 mask, u32 timeoutMs)
 {
 	u32 irqs;
-	while((irqs = MCU_getIrqs(mask)) == 0u)
+	if(timeoutMs == 0)
 	{
-		__wfi();
+		// The event may also be signaled for other IRQs of the subscriber.
+		while((irqs = MCU_getSubIrqs(sub, mask)) == 0u)
+		{
+			waitForEvent(g_mcuIrqSubs[sub].event);
+		}
+	}
+	else
+	{
+		// The kernel has no wait timeouts yet. An alarm signals the event at the deadline
+		// instead. If it fires before we wait the event stays signaled.
+		const KHandle event = g_mcuIrqSubs[sub].event;
+		const u64 ticks = (u64)timeoutMs * TIMER_FREQ(1, 1000);
+		TimerAlarm alarm;
+		TIMER_setAlarm(&alarm, (ticks > UINT32_MAX ? UINT32_MAX : ticks), timeoutAlarm, (void*)event);
+		while((irqs = MCU_getSubIrqs(sub, mask)) == 0u && alarm.armed)
+		{
+			waitForEvent(event);
+		}
+		TIMER_cancelAlarm(&alarm);
 	}
 
 	return irqs;
 }
 
+u32 MCU_getIrqs(u32 mask)
+{
+	return MCU_getSubIrqs(MCU_IRQ_SUB_DEFAULT, mask);
+}
+
+u32 MCU_waitIrqs(u32 mask)
+{
+	return MCU_waitSubIrqs(MCU_IRQ_SUB_DEFAULT, mask, 0);
+}
+
+
+void MCU_setStatusMaxAge(u32 ms)
+{
+	// Stay well below the cycle counter wrap.
+	const u64 maxAge = (u64)ms * cyclesPerMs();
+	const u32 savedState = enterCriticalSection();
+	g_mcuStatusCache.maxAge = (maxAge > 0x7FFFFFFFu ? 0x7FFFFFFFu : (u32)maxAge);
+	g_mcuStatusCache.gen++;
+	g_mcuStatusCache.valid  = false;
+	leaveCriticalSection(savedState);
+}
+
+static bool readStatusRegs(const McuReg reg, void *out, const u32 size)
+{
+	if(g_mcuStatusCache.maxAge == 0) return MCU_readRegArray(reg, out, size);
+
+	// One burst read for all status registers instead of one transfer per getter.
+	const u32 now = __getCcnt();
+	if(!g_mcuStatusCache.valid || now - g_mcuStatusCache.stamp >= g_mcuStatusCache.maxAge)
+	{
+		// An IRQ during the read may have changed the registers after
+		// they were read. Only publish the data if nothing invalidated it meanwhile.
+		const u32 gen = g_mcuStatusCache.gen;
+		u8 tmp[MCU_STATUS_SIZE];
+		if(!MCU_readRegArray(MCU_STATUS_FIRST, tmp, sizeof(tmp))) return false;
+
+		const u32 savedState = enterCriticalSection();
+		const bool current = (g_mcuStatusCache.gen == gen);
+		if(current)
+		{
+			memcpy(g_mcuStatusCache.regs, tmp, sizeof(tmp));
+			g_mcuStatusCache.stamp = now;
+			g_mcuStatusCache.valid = true;
+		}
+		leaveCriticalSection(savedState);
+
+		if(!current)
+		{
+			memcpy(out, &tmp[reg - MCU_STATUS_FIRST], size);
+			return true;
+		}
+	}
+
+	memcpy(out, &g_mcuStatusCache.regs[reg - MCU_STATUS_FIRST], size);
+
+	return true;
+}
+
+static u8 readStatusReg(const McuReg reg)
+{
+	u8 data;
+	if(!readStatusRegs(reg, &data, 1)) return 0xFF;
+	return data;
+}
+
 
 u16 MCU_getFirmwareVersion(void)
 {
@@ -176,29 +402,29 @@ bool MCU_setLcdVcomBot(u8 vcom)
 
 u8 MCU_get3dSliderPosition(void)
 {
-	return MCU_readReg(MCU_REG_3D_SLIDER_RAW);
+	return readStatusReg(MCU_REG_3D_SLIDER_RAW);
 }
 
 u8 MCU_getVolumeSliderPosition(void)
 {
-	return MCU_readReg(MCU_REG_VOL_SLIDER);
+	return readStatusReg(MCU_REG_VOL_SLIDER);
 }
 
 s8 MCU_getBatteryTemperature(void)
 {
-	return (s8)MCU_readReg(MCU_REG_BATT_TEMP);
+	return (s8)readStatusReg(MCU_REG_BATT_TEMP);
 }
 
 u8 MCU_getBatteryLevel(void)
 {
 	// The fractional part of the percentage is borderline useless.
 	// It has varying accuracy and is stuck at 0 near 1%.
-	return MCU_readReg(MCU_REG_BATT_LEVEL);
+	return readStatusReg(MCU_REG_BATT_LEVEL);
 }
 
 float MCU_getBatteryVoltage(void)
 {
-	return 0.02f * MCU_readReg(MCU_REG_BATT_VOLT);
+	return 0.02f * readStatusReg(MCU_REG_BATT_VOLT);
 }
 
 u16 MCU_getExternalHardwareStatus(void)
@@ -206,7 +432,7 @@ u16 MCU_getExternalHardwareStatus(void)
 	u16 status;
 
 	// Read both status regs at once.
-	if(!MCU_readRegArray(MCU_REG_EX_HW_STAT2, &status, sizeof(status)))
+	if(!readStatusRegs(MCU_REG_EX_HW_STAT2, &status, sizeof(status)))
 		status = 0;
 
 	return __builtin_bswap16(status);
@@ -23,6 +23,20 @@
 #include "arm.h"
 
 
+// Alarms of one core sorted by deadline. Time is counted in watchdog ticks
+// and only advances while the watchdog runs for the first alarm.
+typedef struct
+{
+	TimerAlarm *alarms;
+	u64 wdStart;        // Time at the last watchdog load.
+	u32 wdLoad;
+} AlarmState;
+
+static AlarmState g_alarmState[4] = {0};
+
+
+
+static void watchdogIsr(UNUSED u32 id);
 
 void TIMER_init(void)
 {
@@ -36,8 +50,14 @@ void TIMER_init(void)
 	timer->wd_disable  = WD_DISABLE_MAGIC1;
 	timer->wd_disable  = WD_DISABLE_MAGIC2;
 	timer->wd_int_stat = 1;
+	timer->wd_load     = 0;
 
-	IRQ_registerIsr(IRQ_WATCHDOG, 12, 0, NULL);
+	AlarmState *const state = &g_alarmState[__getCpuId()];
+	state->alarms  = NULL;
+	state->wdStart = 0;
+	state->wdLoad  = 0;
+
+	IRQ_registerIsr(IRQ_WATCHDOG, 12, 0, watchdogIsr);
 }
 
 void TIMER_start(const u16 prescaler, const u32 ticks, const u8 params)
@@ -64,19 +84,115 @@ u32 TIMER_stop(void)
 	return timer->counter;
 }
 
-static void sleepTicks(const u32 ticks)
+// All alarm functions must be called with IRQs disabled.
+static u64 getAlarmTime(const AlarmState *const state)
+{
+	// The counter stops at 0 in single shot mode.
+	return state->wdStart + (state->wdLoad - getTimerRegs()->wd_counter);
+}
+
+static void armWatchdog(AlarmState *const state)
 {
 	Timer *const timer = getTimerRegs();
+	const u64 now = getAlarmTime(state);
+	timer->wd_cnt      = 0;
+	timer->wd_int_stat = 1;
+
+	// Overdue alarms get 1 tick so the IRQ still fires.
+	u32 ticks = 0;
+	const TimerAlarm *const first = state->alarms;
+	if(first != NULL) ticks = (first->deadline > now ? first->deadline - now : 1);
+
+	// Writing the load register also sets the counter.
+	state->wdStart = now;
+	state->wdLoad  = ticks;
 	timer->wd_load = ticks;
-	timer->wd_cnt = 0u<<TIMER_PRESC_SHIFT | WD_TIMER_MODE | // Prescaler 1.
-	                TIMER_IRQ_EN | TIMER_SINGLE_SHOT | TIMER_EN;
+	if(ticks > 0)
+	{
+		timer->wd_cnt = 0u<<TIMER_PRESC_SHIFT | WD_TIMER_MODE | // Prescaler 1.
+		                TIMER_IRQ_EN | TIMER_SINGLE_SHOT | TIMER_EN;
+	}
+}
+
+static bool unlinkAlarm(AlarmState *const state, TimerAlarm *const alarm)
+{
+	if(!alarm->armed) return false;
+
+	TimerAlarm **pp = &state->alarms;
+	while(*pp != alarm) pp = &(*pp)->next;
+	*pp = alarm->next;
+	alarm->armed = false;
+
+	return true;
+}
+
+static void watchdogIsr(UNUSED u32 id)
+{
+	AlarmState *const state = &g_alarmState[__getCpuId()];
+	while(1)
+	{
+		const u32 savedState = enterCriticalSection();
+		TimerAlarm *const alarm = state->alarms;
+		if(alarm == NULL || alarm->deadline > getAlarmTime(state))
+		{
+			armWatchdog(state);
+			leaveCriticalSection(savedState);
+			break;
+		}
+
+		// The owner may reuse the alarm as soon as armed is cleared.
+		const TimerAlarmCb cb = alarm->cb;
+		void *const arg = alarm->arg;
+		unlinkAlarm(state, alarm);
+		leaveCriticalSection(savedState);
+
+		if(cb != NULL) cb(arg);
+	}
+}
+
+void TIMER_setAlarm(TimerAlarm *const alarm, const u32 ticks, const TimerAlarmCb cb, void *const arg)
+{
+	AlarmState *const state = &g_alarmState[__getCpuId()];
+	const u32 savedState = enterCriticalSection();
+	alarm->deadline = getAlarmTime(state) + ticks;
+	alarm->cb       = cb;
+	alarm->arg      = arg;
+	alarm->armed    = true;
+
+	// Alarms with the same deadline fire in the order they were set.
+	TimerAlarm **pp = &state->alarms;
+	while(*pp != NULL && (*pp)->deadline <= alarm->deadline) pp = &(*pp)->next;
+	alarm->next = *pp;
+	*pp = alarm;
+	if(state->alarms == alarm) armWatchdog(state);
+	leaveCriticalSection(savedState);
+}
+
+bool TIMER_cancelAlarm(TimerAlarm *const alarm)
+{
+	AlarmState *const state = &g_alarmState[__getCpuId()];
+	const u32 savedState = enterCriticalSection();
+	const bool first = (state->alarms == alarm);
+	const bool armed = unlinkAlarm(state, alarm);
+	if(armed && first) armWatchdog(state);
+	leaveCriticalSection(savedState);
+
+	return armed;
+}
+
+static void sleepTicks(const u32 ticks)
+{
+	// A sleep is an alarm without callback.
+	TimerAlarm alarm;
+	TIMER_setAlarm(&alarm, ticks, NULL, NULL);
 
 	do
 	{
 		__wfi();
-	} while(timer->wd_counter); // Checking the cnt enable bit is broken.
 
-	timer->wd_int_stat = 1;
+		// The ISR can't run with IRQs disabled. Expired alarms are handled here instead.
+		if(__getCpsr() & PSR_I) watchdogIsr(IRQ_WATCHDOG);
+	} while(alarm.armed);
 }
 
 void TIMER_sleepMs(const u32 ms)
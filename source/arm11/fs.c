@@ -44,7 +44,7 @@ Result fGetFree(FsDrive drive, u64 *const size)
 	cmdBuf[1] = sizeof(u64);
 	cmdBuf[2] = drive;
 
-	return PXI_sendCmd(IPC_CMD9_FGETFREE, cmdBuf, 3);
+	return PXI_sendCmdRing(IPC_CMD9_FGETFREE, cmdBuf, 3);
 }
 
 Result fOpen(FHandle *const hOut, const char *const path, u8 mode)
@@ -56,7 +56,7 @@ Result fOpen(FHandle *const hOut, const char *const path, u8 mode)
 	cmdBuf[3] = sizeof(FHandle);
 	cmdBuf[4] = mode;
 
-	return PXI_sendCmd(IPC_CMD9_FOPEN, cmdBuf, 5);
+	return PXI_sendCmdRing(IPC_CMD9_FOPEN, cmdBuf, 5);
 }
 
 Result fRead(FHandle h, void *const buf, u32 size, u32 *const bytesRead)
@@ -124,7 +124,7 @@ Result fStat(const char *const path, FILINFO *const fi)
 	cmdBuf[2] = (u32)fi;
 	cmdBuf[3] = sizeof(FILINFO);
 
-	return PXI_sendCmd(IPC_CMD9_FSTAT, cmdBuf, 4);
+	return PXI_sendCmdRing(IPC_CMD9_FSTAT, cmdBuf, 4);
 }
 
 Result fChdir(const char *const path)
@@ -133,7 +133,7 @@ Result fChdir(const char *const path)
 	cmdBuf[0] = (u32)path;
 	cmdBuf[1] = strlen(path) + 1;
 
-	return PXI_sendCmd(IPC_CMD9_FCHDIR, cmdBuf, 2);
+	return PXI_sendCmdRing(IPC_CMD9_FCHDIR, cmdBuf, 2);
 }
 
 Result fOpenDir(DHandle *const hOut, const char *const path)
@@ -144,7 +144,7 @@ Result fOpenDir(DHandle *const hOut, const char *const path)
 	cmdBuf[2] = (u32)hOut;
 	cmdBuf[3] = sizeof(DHandle);
 
-	return PXI_sendCmd(IPC_CMD9_FOPEN_DIR, cmdBuf, 4);
+	return PXI_sendCmdRing(IPC_CMD9_FOPEN_DIR, cmdBuf, 4);
 }
 
 Result fReadDir(DHandle h, FILINFO *const fi, u32 num, u32 *const entriesRead)
@@ -157,7 +157,7 @@ Result fReadDir(DHandle h, FILINFO *const fi, u32 num, u32 *const entriesRead)
 	cmdBuf[4] = h;
 	cmdBuf[5] = num;
 
-	return PXI_sendCmd(IPC_CMD9_FREAD_DIR, cmdBuf, 6);
+	return PXI_sendCmdRing(IPC_CMD9_FREAD_DIR, cmdBuf, 6);
 }
 
 Result fCloseDir(DHandle h)
@@ -172,7 +172,7 @@ Result fMkdir(const char *const path)
 	cmdBuf[0] = (u32)path;
 	cmdBuf[1] = strlen(path) + 1;
 
-	return PXI_sendCmd(IPC_CMD9_FMKDIR, cmdBuf, 2);
+	return PXI_sendCmdRing(IPC_CMD9_FMKDIR, cmdBuf, 2);
 }
 
 Result fRename(const char *const old, const char *const _new)
@@ -183,7 +183,7 @@ Result fRename(const char *const old, const char *const _new)
 	cmdBuf[2] = (u32)_new;
 	cmdBuf[3] = strlen(_new) + 1;
 
-	return PXI_sendCmd(IPC_CMD9_FRENAME, cmdBuf, 4);
+	return PXI_sendCmdRing(IPC_CMD9_FRENAME, cmdBuf, 4);
 }
 
 Result fUnlink(const char *const path)
@@ -192,5 +192,5 @@ Result fUnlink(const char *const path)
 	cmdBuf[0] = (u32)path;
 	cmdBuf[1] = strlen(path) + 1;
 
-	return PXI_sendCmd(IPC_CMD9_FUNLINK, cmdBuf, 2);
+	return PXI_sendCmdRing(IPC_CMD9_FUNLINK, cmdBuf, 2);
 }
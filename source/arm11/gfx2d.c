@@ -0,0 +1,512 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "arm11/gfx2d.h"
+#include "arm11/drivers/gx.h"
+#include "drivers/cache.h"
+#include "mem_map.h"
+#include "memory.h"
+#include "rgb_conv.h"
+#include "pixel_conv.h"
+
+
+typedef u32 (*LoadFn)(const u8 *p);
+typedef void (*StoreFn)(u8 *p, const u32 color);
+
+
+
+// Pixel load/store. Colors are RGBA8 (see G2D_RGBA()).
+static u32 unpackColor(const GfxFmt fmt, const u32 px)
+{
+	u32 r, g, b, a = 255;
+	switch(fmt)
+	{
+		case GFX_ABGR8:
+			return __builtin_bswap32(px);
+		case GFX_BGR8:
+			return 0xFF000000u | (px & 0xFFu)<<16 | (px & 0xFF00u) | (px>>16 & 0xFFu);
+		case GFX_BGR565:
+			r = rgbFive2Eight(px>>11 & 0x1Fu);
+			g = rgbSix2Eight(px>>5 & 0x3Fu);
+			b = rgbFive2Eight(px & 0x1Fu);
+			break;
+		case GFX_A1BGR5:
+			r = rgbFive2Eight(px>>11 & 0x1Fu);
+			g = rgbFive2Eight(px>>6 & 0x1Fu);
+			b = rgbFive2Eight(px>>1 & 0x1Fu);
+			a = (px & 1u ? 255 : 0);
+			break;
+		default: // GFX_ABGR4.
+			r = rgbFour2Eight(px>>12 & 0xFu);
+			g = rgbFour2Eight(px>>8 & 0xFu);
+			b = rgbFour2Eight(px>>4 & 0xFu);
+			a = rgbFour2Eight(px & 0xFu);
+	}
+
+	return G2D_RGBA(r, g, b, a);
+}
+
+u32 G2D_packColor(const GfxFmt fmt, const u32 color)
+{
+	const u32 r = color & 0xFFu;
+	const u32 g = color>>8 & 0xFFu;
+	const u32 b = color>>16 & 0xFFu;
+	const u32 a = color>>24;
+	switch(fmt)
+	{
+		case GFX_ABGR8:
+			return __builtin_bswap32(color);
+		case GFX_BGR8:
+			return r<<16 | g<<8 | b;
+		case GFX_BGR565:
+			return rgbEight2Five(r)<<11 | rgbEight2Six(g)<<5 | rgbEight2Five(b);
+		case GFX_A1BGR5:
+			return rgbEight2Five(r)<<11 | rgbEight2Five(g)<<6 | rgbEight2Five(b)<<1 | a>>7;
+		default: // GFX_ABGR4.
+			return rgbEight2Four(r)<<12 | rgbEight2Four(g)<<8 | rgbEight2Four(b)<<4 | rgbEight2Four(a);
+	}
+}
+
+static u32 loadABGR8(const u8 *p)  { return unpackColor(GFX_ABGR8, *(const u32*)p); }
+static u32 loadBGR8(const u8 *p)   { return unpackColor(GFX_BGR8, p[2]<<16 | p[1]<<8 | p[0]); }
+static u32 loadBGR565(const u8 *p) { return unpackColor(GFX_BGR565, *(const u16*)p); }
+static u32 loadA1BGR5(const u8 *p) { return unpackColor(GFX_A1BGR5, *(const u16*)p); }
+static u32 loadABGR4(const u8 *p)  { return unpackColor(GFX_ABGR4, *(const u16*)p); }
+
+static void storeABGR8(u8 *p, const u32 color)  { *(u32*)p = G2D_packColor(GFX_ABGR8, color); }
+static void storeBGR8(u8 *p, const u32 color)
+{
+	p[0] = color>>16;
+	p[1] = color>>8;
+	p[2] = color;
+}
+static void storeBGR565(u8 *p, const u32 color) { *(u16*)p = G2D_packColor(GFX_BGR565, color); }
+static void storeA1BGR5(u8 *p, const u32 color) { *(u16*)p = G2D_packColor(GFX_A1BGR5, color); }
+static void storeABGR4(u8 *p, const u32 color)  { *(u16*)p = G2D_packColor(GFX_ABGR4, color); }
+
+static const LoadFn g_loadFns[5]   = {loadABGR8, loadBGR8, loadBGR565, loadA1BGR5, loadABGR4};
+static const StoreFn g_storeFns[5] = {storeABGR8, storeBGR8, storeBGR565, storeA1BGR5, storeABGR4};
+
+// Returns the address of pixel x, y.
+static inline u8* pixelPtr(const G2dSurface *const surf, const int x, const int y)
+{
+	const u32 pixel = (u32)x * surf->height + (surf->height - 1 - y);
+	return (u8*)surf->buf + pixel * GFX_getPixelSize(surf->fmt);
+}
+
+static inline u32 columnStride(const G2dSurface *const surf)
+{
+	return surf->height * GFX_getPixelSize(surf->fmt);
+}
+
+static inline bool isGpuAccessible(const void *const p, const u32 size)
+{
+	const uintptr_t start = (uintptr_t)p;
+	return (start >= VRAM_BASE && start + size <= VRAM_BASE + VRAM_SIZE) ||
+	       (start >= FCRAM_BASE && start + size <= FCRAM_BASE + FCRAM_SIZE);
+}
+
+// Clips a rectangle to a surface.
+static bool clipRect(const G2dSurface *const surf, int *const x, int *const y, int *const w, int *const h)
+{
+	if(*x < 0) { *w += *x; *x = 0; }
+	if(*y < 0) { *h += *y; *y = 0; }
+	if(*w > surf->width - *x)  *w = surf->width - *x;
+	if(*h > surf->height - *y) *h = surf->height - *y;
+
+	return *w > 0 && *h > 0;
+}
+
+// Clips a source/destination rectangle pair to both surfaces.
+static bool clipBlit(const G2dSurface *const dst, int *const dx, int *const dy,
+                     const G2dSurface *const src, int *const sx, int *const sy, int *const w, int *const h)
+{
+	int off = (*dx < *sx ? *dx : *sx);
+	if(off < 0) { *dx -= off; *sx -= off; *w += off; }
+	off = (*dy < *sy ? *dy : *sy);
+	if(off < 0) { *dy -= off; *sy -= off; *h += off; }
+
+	if(*w > dst->width - *dx)  *w = dst->width - *dx;
+	if(*w > src->width - *sx)  *w = src->width - *sx;
+	if(*h > dst->height - *dy) *h = dst->height - *dy;
+	if(*h > src->height - *sy) *h = src->height - *sy;
+
+	return *w > 0 && *h > 0;
+}
+
+
+
+// Fills count contiguous pixels with a packed pixel value.
+static void fillSpan(u8 *p, u32 count, const u32 pixelSize, const u32 px)
+{
+	if(pixelSize == 2)
+	{
+		// Halfword head so the rest can use word stores.
+		if((uintptr_t)p & 2u)
+		{
+			*(u16*)p = px;
+			p += 2;
+			count--;
+		}
+		clear32((u32*)p, px<<16 | px, count * 2);
+	}
+	else if(pixelSize == 4)
+	{
+		clear32((u32*)p, px, count * 4);
+	}
+	else
+	{
+		// 3 and 4 are coprime so the pattern is word aligned after at most 3 pixels.
+		while(count > 0 && ((uintptr_t)p & 3u))
+		{
+			p[0] = px;
+			p[1] = px>>8;
+			p[2] = px>>16;
+			p += 3;
+			count--;
+		}
+
+		// 4 pixels in 3 words.
+		const u32 w0 = px | px<<24;
+		const u32 w1 = px>>8 | px<<16;
+		const u32 w2 = px>>16 | px<<8;
+		u32 *p32 = (u32*)p;
+		for(; count >= 4; count -= 4)
+		{
+			*p32++ = w0;
+			*p32++ = w1;
+			*p32++ = w2;
+		}
+
+		p = (u8*)p32;
+		while(count--)
+		{
+			p[0] = px;
+			p[1] = px>>8;
+			p[2] = px>>16;
+			p += 3;
+		}
+	}
+}
+
+// Exact round(x / 255) for x <= 255 * 255 in both 16 bit lanes.
+static inline u32 div255x2(u32 x)
+{
+	x += 0x00800080u;
+	return (x + (x>>8 & 0x00FF00FFu))>>8 & 0x00FF00FFu;
+}
+
+// Blends the color channels of s over d. The alpha of d is kept.
+static inline u32 blendColor(const u32 s, const u32 d, const u32 a)
+{
+	const u32 ia = 255 - a;
+	const u32 rb = div255x2((s & 0x00FF00FFu) * a + (d & 0x00FF00FFu) * ia);
+	const u32 g  = div255x2((s>>8 & 0xFFu) * a + (d>>8 & 0xFFu) * ia);
+
+	return (d & 0xFF000000u) | g<<8 | rb;
+}
+
+
+
+// GPU offload. Both return false if the operation must be done in software.
+static bool gxFill(u8 *const p, const u32 size, const u32 pixelSize, const u32 px)
+{
+	if(size < G2D_GX_MIN_SIZE || !isGpuAccessible(p, size)) return false;
+
+	// The fill engine works on 8 bytes aligned ranges. The middle part must start on a pixel.
+	// There is no such start for 16 and 32 bit pixels at misaligned addresses.
+	uintptr_t start = ((uintptr_t)p + 7) & ~(uintptr_t)7;
+	for(u32 i = 0; (start - (uintptr_t)p) % pixelSize != 0; i++)
+	{
+		if(i == pixelSize) return false;
+		start += 8;
+	}
+	const uintptr_t end = ((uintptr_t)p + size) & ~(uintptr_t)7;
+	if(end <= start) return false;
+
+	static const u32 fillFlags[5] = {PSC_FILL_32_BITS, PSC_FILL_24_BITS, PSC_FILL_16_BITS, PSC_FILL_16_BITS, PSC_FILL_16_BITS};
+	flushDCacheRange((void*)start, end - start);
+	GX_memoryFill((u32*)start, fillFlags[4 - pixelSize], end - start, px, NULL, 0, 0, 0);
+	GFX_waitForPSC0();
+
+	// Head and tail in software after the GPU is done with the cache lines around them.
+	const u32 head = start - (uintptr_t)p;
+	if(head > 0) fillSpan(p, head / pixelSize, pixelSize, px);
+	const u32 tailStart = (end - (uintptr_t)p) / pixelSize;
+	const u32 total = size / pixelSize;
+	if(tailStart < total) fillSpan(p + tailStart * pixelSize, total - tailStart, pixelSize, px);
+
+	return true;
+}
+
+// Raw copies with the texture copy mode of the PPF. Dimensions of 0 copy one
+// contiguous range like the dummy transfer in GFX_init(). Format conversion
+// and the display transfer linear mode are unverified so they are never used.
+static bool gxCopy(u8 *const dst, const u8 *const src, const u32 size)
+{
+	if(size < G2D_GX_MIN_SIZE || size % 16 != 0) return false;
+	if((((uintptr_t)dst | (uintptr_t)src) & 7u) != 0) return false;
+	if(!isGpuAccessible(dst, size) || !isGpuAccessible(src, size)) return false;
+	if(dst < src + size && src < dst + size) return false;
+
+	cleanDCacheRange(src, size);
+	flushDCacheRange(dst, size);
+	GX_textureCopy((const u32*)src, 0, (u32*)dst, 0, size);
+	GFX_waitForPPF();
+
+	return true;
+}
+
+
+
+void G2D_surfaceFromLcd(G2dSurface *const surf, const GfxLcd lcd, const GfxSide side)
+{
+	u32 width = LCD_HEIGHT_BOT;
+	if(lcd == GFX_LCD_TOP)
+		width = (GFX_getTopMode() == GFX_TOP_WIDE ? LCD_WIDE_HEIGHT_TOP : LCD_HEIGHT_TOP);
+
+	surf->buf    = GFX_getBuffer(lcd, side);
+	surf->width  = width;
+	surf->height = LCD_WIDTH_BOT;
+	surf->fmt    = GFX_getFormat(lcd);
+}
+
+void G2D_fillRect(const G2dSurface *const dst, int x, int y, int w, int h, const u32 color)
+{
+	if(!clipRect(dst, &x, &y, &w, &h)) return;
+
+	const u32 pixelSize = GFX_getPixelSize(dst->fmt);
+	const u32 px = G2D_packColor(dst->fmt, color);
+	u8 *p = pixelPtr(dst, x, y + h - 1);
+
+	// Full height rectangles are one contiguous span.
+	if(h == dst->height)
+	{
+		const u32 pixels = (u32)w * h;
+		if(!gxFill(p, pixels * pixelSize, pixelSize, px)) fillSpan(p, pixels, pixelSize, px);
+		return;
+	}
+
+	const u32 stride = columnStride(dst);
+	do
+	{
+		fillSpan(p, h, pixelSize, px);
+		p += stride;
+	} while(--w > 0);
+}
+
+void G2D_copyRect(const G2dSurface *const dst, int dx, int dy, const G2dSurface *const src, int sx, int sy, int w, int h)
+{
+	if(!clipBlit(dst, &dx, &dy, src, &sx, &sy, &w, &h)) return;
+
+	u8 *d = pixelPtr(dst, dx, dy + h - 1);
+	const u8 *s = pixelPtr(src, sx, sy + h - 1);
+	const bool contiguous = h == dst->height && h == src->height;
+	if(dst->fmt == src->fmt)
+	{
+		const u32 spanSize = h * GFX_getPixelSize(dst->fmt);
+		if(contiguous && gxCopy(d, s, spanSize * w)) return;
+		if(contiguous)
+		{
+			memmove(d, s, spanSize * w);
+			return;
+		}
+
+		// Walk columns backwards if the destination overlaps the source from the right.
+		s32 dStride = columnStride(dst);
+		s32 sStride = columnStride(src);
+		if(d > s)
+		{
+			d += dStride * (w - 1);
+			s += sStride * (w - 1);
+			dStride = -dStride;
+			sStride = -sStride;
+		}
+
+		do
+		{
+			memmove(d, s, spanSize);
+			d += dStride;
+			s += sStride;
+		} while(--w > 0);
+		return;
+	}
+
+	if(contiguous)
+	{
+		convertPixels(d, dst->fmt, s, src->fmt, (u32)w * h);
+		return;
+	}
+
+	const u32 dStride = columnStride(dst);
+	const u32 sStride = columnStride(src);
+	do
+	{
+		convertPixels(d, dst->fmt, s, src->fmt, h);
+		d += dStride;
+		s += sStride;
+	} while(--w > 0);
+}
+
+void G2D_scaleBlit(const G2dSurface *const dst, int dx, int dy, int dw, int dh,
+                   const G2dSurface *const src, int sx, int sy, int sw, int sh)
+{
+	if(sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0) return;
+	if(sx < 0 || sy < 0 || sx + sw > src->width || sy + sh > src->height) return;
+
+	// Clip the destination and remember how many pixels were cut off at the top left.
+	int cx = dx, cy = dy, cw = dw, ch = dh;
+	if(!clipRect(dst, &cx, &cy, &cw, &ch)) return;
+	const u32 skipX = cx - dx;
+	const u32 skipY = cy - dy;
+
+	// Pixel i samples the source at the center of its footprint: (2i + 1) * sw / (2 * dw).
+	// Stepped with integer remainders so no precision is lost.
+	const u32 xDen = 2u * dw;
+	const u32 yDen = 2u * dh;
+	const u64 xNum = (2ull * skipX + 1) * sw;
+	const u64 yNum = (2ull * skipY + 1) * sh;
+	u32 srcX = xNum / xDen;
+	u32 xRem = xNum % xDen;
+	const u32 ySrc0 = yNum / yDen;
+	const u32 yRem0 = yNum % yDen;
+
+	const GfxFmt dstFmt = dst->fmt;
+	const GfxFmt srcFmt = src->fmt;
+	const u32 dstSize = GFX_getPixelSize(dstFmt);
+	const u32 srcSize = GFX_getPixelSize(srcFmt);
+	const LoadFn load = g_loadFns[srcFmt];
+	const StoreFn store = g_storeFns[dstFmt];
+	const u32 dStride = columnStride(dst);
+
+	// Rows are walked top to bottom which is downwards in memory.
+	u8 *dCol = pixelPtr(dst, cx, cy);
+	const u8 *prevCol = NULL;
+	u32 prevSrcX = ~0u;
+	for(int i = 0; i < cw; i++)
+	{
+		if(srcX == prevSrcX)
+		{
+			// Upscaled columns are plain copies of the previous one.
+			memcpy(dCol - (ch - 1) * dstSize, prevCol - (ch - 1) * dstSize, ch * dstSize);
+		}
+		else
+		{
+			// Top pixel of the source column.
+			const u8 *const sTop = pixelPtr(src, sx + srcX, sy);
+			u32 srcY = ySrc0;
+			u32 yRem = yRem0;
+			u8 *d = dCol;
+			for(int j = 0; j < ch; j++)
+			{
+				const u8 *const s = sTop - srcY * srcSize;
+				if(dstFmt == srcFmt)
+				{
+					if(dstSize == 2)      *(u16*)d = *(const u16*)s;
+					else if(dstSize == 4) *(u32*)d = *(const u32*)s;
+					else                  { d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; }
+				}
+				else store(d, load(s));
+				d -= dstSize;
+
+				yRem += 2u * sh;
+				while(yRem >= yDen) { yRem -= yDen; srcY++; }
+			}
+		}
+
+		prevCol = dCol;
+		prevSrcX = srcX;
+		dCol += dStride;
+
+		xRem += 2u * sw;
+		while(xRem >= xDen) { xRem -= xDen; srcX++; }
+	}
+}
+
+void G2D_blendRect(const G2dSurface *const dst, int dx, int dy, const G2dSurface *const src, int sx, int sy, int w, int h, const u8 alpha)
+{
+	if(alpha == 0 || !clipBlit(dst, &dx, &dy, src, &sx, &sy, &w, &h)) return;
+
+	const LoadFn loadSrc = g_loadFns[src->fmt];
+	const LoadFn loadDst = g_loadFns[dst->fmt];
+	const StoreFn store = g_storeFns[dst->fmt];
+	const u32 dstSize = GFX_getPixelSize(dst->fmt);
+	const u32 srcSize = GFX_getPixelSize(src->fmt);
+	const u32 dStride = columnStride(dst);
+	const u32 sStride = columnStride(src);
+
+	u8 *dCol = pixelPtr(dst, dx, dy + h - 1);
+	const u8 *sCol = pixelPtr(src, sx, sy + h - 1);
+	do
+	{
+		u8 *d = dCol;
+		const u8 *s = sCol;
+		for(int j = 0; j < h; j++)
+		{
+			const u32 sc = loadSrc(s);
+			const u32 a = div255x2((sc>>24) * alpha);
+			if(a == 255)     store(d, (loadDst(d) & 0xFF000000u) | (sc & 0xFFFFFFu));
+			else if(a != 0)  store(d, blendColor(sc, loadDst(d), a));
+			d += dstSize;
+			s += srcSize;
+		}
+
+		dCol += dStride;
+		sCol += sStride;
+	} while(--w > 0);
+}
+
+void G2D_blendFill(const G2dSurface *const dst, int x, int y, int w, int h, const u32 color)
+{
+	// Opaque fills are plain fills unless the destination alpha must be kept.
+	const u32 a = color>>24;
+	if(a == 255 && (dst->fmt == GFX_BGR8 || dst->fmt == GFX_BGR565))
+	{
+		G2D_fillRect(dst, x, y, w, h, color);
+		return;
+	}
+	if(a == 0 || !clipRect(dst, &x, &y, &w, &h)) return;
+
+	const LoadFn load = g_loadFns[dst->fmt];
+	const StoreFn store = g_storeFns[dst->fmt];
+	const u32 pixelSize = GFX_getPixelSize(dst->fmt);
+	const u32 stride = columnStride(dst);
+
+	// Premultiply once. Same math as blendColor().
+	const u32 ia = 255 - a;
+	const u32 rbS = (color & 0x00FF00FFu) * a;
+	const u32 gS  = (color>>8 & 0xFFu) * a;
+
+	u8 *col = pixelPtr(dst, x, y + h - 1);
+	do
+	{
+		u8 *p = col;
+		for(int j = 0; j < h; j++)
+		{
+			const u32 d = load(p);
+			const u32 rb = div255x2(rbS + (d & 0x00FF00FFu) * ia);
+			const u32 g  = div255x2(gS + (d>>8 & 0xFFu) * ia);
+			store(p, (d & 0xFF000000u) | g<<8 | rb);
+			p += pixelSize;
+		}
+
+		col += stride;
+	} while(--w > 0);
+}
\ No newline at end of file
@@ -0,0 +1,333 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+@ Memory primitives tuned for the ARM11 MPCore.
+@ Cache lines are 32 bytes. Sources are prefetched with PLD 2-3 lines ahead.
+@ Nothing here relies on unaligned word access (CR bit 22) so it's safe to
+@ use before the MMU is set up. LDRD/STRD are only used on 8 bytes aligned addresses.
+
+#include "asm_macros.h"
+
+.syntax unified
+.cpu mpcore
+.fpu vfpv2
+
+
+
+@ void copyMem(void *restrict dst, const void *restrict src, u32 size)
+BEGIN_ASM_FUNC copyMem
+	pld    [r1]                      @ Prefetch the first source line.
+	cmp    r2, #16                   @ if(r2 < 16) goto copyMem_bytes;
+	blo    copyMem_bytes
+
+	@ Copy bytes until dst is 4 bytes aligned.
+	ands   r12, r0, #3               @ r12 = r0 & 3u;
+	beq    copyMem_dst_aligned       @ if(r12 == 0) goto copyMem_dst_aligned;
+	rsb    r12, r12, #4              @ r12 = 4 - r12;
+	sub    r2, r2, r12               @ r2 -= r12;
+	copyMem_head_lp:
+		ldrb   r3, [r1], #1          @ r3 = *r1++; // u8.
+		subs   r12, r12, #1          @ r12--;
+		strb   r3, [r0], #1          @ *r0++ = r3; // u8.
+		bne    copyMem_head_lp       @ while(r12 != 0);
+
+copyMem_dst_aligned:
+	ands   r12, r1, #3               @ r12 = r1 & 3u;
+	bne    copyMem_src_unaligned     @ if(r12 != 0) goto copyMem_src_unaligned;
+	subs   r2, r2, #32               @ r2 -= 32;
+	bcc    copyMem_words             @ if(carryClear) goto copyMem_words;
+
+	@ Copy 32 bytes (1 cache line) at a time.
+	push   {r4-r9}                   @ Save regs.
+	copyMem_block_lp:
+		pld    [r1, #96]             @ Prefetch 3 lines ahead.
+		ldmia  r1!, {r3-r9, r12}     @ r3_to_r9_r12 = *((Block32*)r1); r1 += 32;
+		subs   r2, r2, #32           @ r2 -= 32; // Update flags.
+		stmia  r0!, {r3-r9, r12}     @ *((Block32*)r0) = r3_to_r9_r12; r0 += 32;
+		bcs    copyMem_block_lp      @ while(carrySet);
+	pop    {r4-r9}                   @ Restore regs.
+
+copyMem_words:
+	ands   r12, r2, #28              @ r12 = r2 & 28u;
+	beq    copyMem_halfword_byte     @ if(r12 == 0) goto copyMem_halfword_byte;
+
+	@ Copy 4 bytes at a time.
+	copyMem_word_lp:
+		ldr    r3, [r1], #4          @ r3 = *r1++; // u32.
+		subs   r12, r12, #4          @ r12 -= 4;
+		str    r3, [r0], #4          @ *r0++ = r3; // u32.
+		bne    copyMem_word_lp       @ while(r12 != 0);
+
+	@ Copy 0-3 bytes.
+copyMem_halfword_byte:
+	movs   r2, r2, lsl #31           @ r2 <<= 31;
+	ldrhcs r3, [r1], #2              @ if(carrySet) r3 = *r1++; // u16.
+	strhcs r3, [r0], #2              @ if(carrySet) *r0++ = r3; // u16.
+	ldrbmi r3, [r1]                  @ if(r2 < 0) r3 = *r1;     // u8.
+	strbmi r3, [r0]                  @ if(r2 < 0) *r0 = r3;     // u8.
+	bx     lr                        @ return;
+
+	@ dst is aligned but src is not. Load aligned words and merge them with shifts.
+	@ Never reads outside of the words containing source bytes.
+copyMem_src_unaligned:
+	push   {r4-r9}                   @ Save regs.
+	bic    r1, r1, #3                @ r1 &= ~3u;
+	mov    r4, r12, lsl #3           @ r4 = r12 * 8; // Right shift.
+	rsb    r5, r4, #32               @ r5 = 32 - r4; // Left shift.
+	ldr    r3, [r1], #4              @ r3 = *r1++; // First partial word.
+	subs   r2, r2, #16               @ r2 -= 16;
+	bcc    copyMem_src_unaligned_words @ if(carryClear) goto copyMem_src_unaligned_words;
+
+	@ Copy 16 bytes at a time.
+	copyMem_src_unaligned_block_lp:
+		pld    [r1, #64]             @ Prefetch 2 lines ahead.
+		ldmia  r1!, {r6-r9}          @ r6_to_r9 = *((Block16*)r1); r1 += 16;
+		mov    r3, r3, lsr r4        @ r3 >>= r4;
+		orr    r3, r3, r6, lsl r5    @ r3 |= r6<<r5;
+		mov    r6, r6, lsr r4        @ r6 >>= r4;
+		orr    r6, r6, r7, lsl r5    @ r6 |= r7<<r5;
+		mov    r7, r7, lsr r4        @ r7 >>= r4;
+		orr    r7, r7, r8, lsl r5    @ r7 |= r8<<r5;
+		mov    r8, r8, lsr r4        @ r8 >>= r4;
+		orr    r8, r8, r9, lsl r5    @ r8 |= r9<<r5;
+		subs   r2, r2, #16           @ r2 -= 16; // Update flags.
+		stmia  r0!, {r3, r6-r8}      @ *((Block16*)r0) = r3_r6_to_r8; r0 += 16;
+		mov    r3, r9                @ r3 = r9; // Carry the last word over.
+		bcs    copyMem_src_unaligned_block_lp @ while(carrySet);
+
+copyMem_src_unaligned_words:
+	adds   r2, r2, #12               @ r2 += 12; // Now remaining - 4.
+	bcc    copyMem_src_unaligned_tail @ if(carryClear) goto copyMem_src_unaligned_tail;
+
+	@ Copy 4 bytes at a time.
+	copyMem_src_unaligned_word_lp:
+		ldr    r6, [r1], #4          @ r6 = *r1++; // u32.
+		mov    r3, r3, lsr r4        @ r3 >>= r4;
+		orr    r3, r3, r6, lsl r5    @ r3 |= r6<<r5;
+		subs   r2, r2, #4            @ r2 -= 4; // Update flags.
+		str    r3, [r0], #4          @ *r0++ = r3; // u32.
+		mov    r3, r6                @ r3 = r6;
+		bcs    copyMem_src_unaligned_word_lp @ while(carrySet);
+
+copyMem_src_unaligned_tail:
+	add    r2, r2, #4                @ r2 += 4; // 0-3 bytes left.
+	sub    r1, r1, #4                @ r1 -= 4;
+	add    r1, r1, r4, lsr #3        @ r1 += r4 / 8; // Back to the real source position.
+	pop    {r4-r9}                   @ Restore regs.
+
+	@ Copy 0-15 bytes.
+copyMem_bytes:
+	cmp    r2, #0                    @ if(r2 == 0) return;
+	bxeq   lr
+	copyMem_byte_lp:
+		ldrb   r3, [r1], #1          @ r3 = *r1++; // u8.
+		subs   r2, r2, #1            @ r2--;
+		strb   r3, [r0], #1          @ *r0++ = r3; // u8.
+		bne    copyMem_byte_lp       @ while(r2 != 0);
+	bx     lr                        @ return;
+END_ASM_FUNC
+
+
+@ void moveMem(void *dst, const void *src, u32 size)
+BEGIN_ASM_FUNC moveMem
+	@ copyMem() loads every byte before the store to the same address
+	@ when copying forward. This makes it safe for dst below src.
+	sub    r12, r0, r1               @ r12 = r0 - r1;
+	cmp    r12, r2                   @ if(r12 >= r2) goto copyMem; // Unsigned. No overlap or dst < src.
+	bhs    copyMem
+	cmp    r12, #0                   @ if(r12 == 0) return;
+	bxeq   lr
+
+	@ dst overlaps the end of src. Copy backwards.
+	add    r0, r0, r2                @ r0 += r2;
+	add    r1, r1, r2                @ r1 += r2;
+	eor    r3, r0, r1                @ r3 = r0 ^ r1;
+	tst    r3, #3                    @ if((r3 & 3u) != 0) goto moveMem_bytes;
+	bne    moveMem_bytes
+
+	@ Copy bytes until dst is 4 bytes aligned.
+moveMem_head:
+	tst    r0, #3                    @ if((r0 & 3u) == 0) goto moveMem_aligned;
+	beq    moveMem_aligned
+	subs   r2, r2, #1                @ r2--;
+	bxcc   lr                        @ if(carryClear) return;
+	ldrb   r3, [r1, #-1]!            @ r3 = *--r1; // u8.
+	strb   r3, [r0, #-1]!            @ *--r0 = r3; // u8.
+	b      moveMem_head
+
+moveMem_aligned:
+	subs   r2, r2, #32               @ r2 -= 32;
+	bcc    moveMem_words             @ if(carryClear) goto moveMem_words;
+
+	@ Copy 32 bytes at a time.
+	push   {r4-r9}                   @ Save regs.
+	moveMem_block_lp:
+		pld    [r1, #-96]            @ Prefetch 3 lines ahead.
+		ldmdb  r1!, {r3-r9, r12}     @ r1 -= 32; r3_to_r9_r12 = *((Block32*)r1);
+		subs   r2, r2, #32           @ r2 -= 32; // Update flags.
+		stmdb  r0!, {r3-r9, r12}     @ r0 -= 32; *((Block32*)r0) = r3_to_r9_r12;
+		bcs    moveMem_block_lp      @ while(carrySet);
+	pop    {r4-r9}                   @ Restore regs.
+
+moveMem_words:
+	adds   r2, r2, #28               @ r2 += 28; // Now remaining - 4.
+	bcc    moveMem_tail              @ if(carryClear) goto moveMem_tail;
+
+	@ Copy 4 bytes at a time.
+	moveMem_word_lp:
+		ldr    r3, [r1, #-4]!        @ r3 = *--r1; // u32.
+		subs   r2, r2, #4            @ r2 -= 4; // Update flags.
+		str    r3, [r0, #-4]!        @ *--r0 = r3; // u32.
+		bcs    moveMem_word_lp       @ while(carrySet);
+
+moveMem_tail:
+	add    r2, r2, #4                @ r2 += 4; // 0-3 bytes left.
+
+	@ Copy the rest bytewise.
+moveMem_bytes:
+	subs   r2, r2, #1                @ r2--;
+	bxcc   lr                        @ if(carryClear) return;
+	ldrb   r3, [r1, #-1]!            @ r3 = *--r1; // u8.
+	strb   r3, [r0, #-1]!            @ *--r0 = r3; // u8.
+	b      moveMem_bytes
+END_ASM_FUNC
+
+
+@ void fillMem(void *ptr, const u8 value, u32 size)
+BEGIN_ASM_FUNC fillMem
+	and    r1, r1, #0xFF             @ r1 &= 0xFFu;
+	orr    r1, r1, r1, lsl #8        @ r1 |= r1<<8;
+	orr    r1, r1, r1, lsl #16       @ r1 |= r1<<16;
+	cmp    r2, #16                   @ if(r2 < 16) goto fillMem_bytes;
+	blo    fillMem_bytes
+
+	@ Fill bytes until ptr is 8 bytes aligned for STRD.
+	ands   r12, r0, #7               @ r12 = r0 & 7u;
+	beq    fillMem_aligned           @ if(r12 == 0) goto fillMem_aligned;
+	rsb    r12, r12, #8              @ r12 = 8 - r12;
+	sub    r2, r2, r12               @ r2 -= r12;
+	fillMem_head_lp:
+		strb   r1, [r0], #1          @ *r0++ = r1; // u8.
+		subs   r12, r12, #1          @ r12--;
+		bne    fillMem_head_lp       @ while(r12 != 0);
+
+fillMem_aligned:
+	mov    r12, r2                   @ r12 = r2;
+	mov    r2, r1                    @ r2 = r1;
+	mov    r3, r1                    @ r3 = r1;
+	subs   r12, r12, #32             @ r12 -= 32;
+	bcc    fillMem_dwords            @ if(carryClear) goto fillMem_dwords;
+
+	@ Fill 32 bytes at a time.
+	fillMem_block_lp:
+		strd   r2, r3, [r0], #8      @ *((u64*)r0) = r2_r3; r0 += 8;
+		strd   r2, r3, [r0], #8      @ *((u64*)r0) = r2_r3; r0 += 8;
+		subs   r12, r12, #32         @ r12 -= 32;
+		strd   r2, r3, [r0], #8      @ *((u64*)r0) = r2_r3; r0 += 8;
+		strd   r2, r3, [r0], #8      @ *((u64*)r0) = r2_r3; r0 += 8;
+		bcs    fillMem_block_lp      @ while(carrySet);
+
+	@ Fill 0-31 bytes.
+fillMem_dwords:
+	tst    r12, #16                  @ if(r12 & 16u)
+	strdne r2, r3, [r0], #8          @ { *((u64*)r0) = r2_r3; r0 += 8;
+	strdne r2, r3, [r0], #8          @   *((u64*)r0) = r2_r3; r0 += 8; }
+	tst    r12, #8                   @ if(r12 & 8u)
+	strdne r2, r3, [r0], #8          @   { *((u64*)r0) = r2_r3; r0 += 8; }
+	tst    r12, #4                   @ if(r12 & 4u)
+	strne  r2, [r0], #4              @   *r0++ = r2; // u32.
+	movs   r12, r12, lsl #31         @ r12 <<= 31;
+	strhcs r2, [r0], #2              @ if(carrySet) *r0++ = r2; // u16.
+	strbmi r2, [r0]                  @ if(r12 < 0)  *r0 = r2;   // u8.
+	bx     lr                        @ return;
+
+	@ Fill 0-15 bytes.
+fillMem_bytes:
+	subs   r2, r2, #1                @ r2--;
+	bxcc   lr                        @ if(carryClear) return;
+	strb   r1, [r0], #1              @ *r0++ = r1; // u8.
+	b      fillMem_bytes
+END_ASM_FUNC
+
+
+@ int compareMem(const void *a, const void *b, u32 size)
+BEGIN_ASM_FUNC compareMem
+	pld    [r0]                      @ Prefetch the first lines.
+	pld    [r1]
+	eor    r3, r0, r1                @ r3 = r0 ^ r1;
+	tst    r3, #3                    @ if((r3 & 3u) != 0) goto compareMem_bytes;
+	bne    compareMem_bytes
+
+	@ Compare bytes until both are 4 bytes aligned.
+compareMem_head:
+	tst    r0, #3                    @ if((r0 & 3u) == 0) goto compareMem_aligned;
+	beq    compareMem_aligned
+	subs   r2, r2, #1                @ r2--;
+	bcc    compareMem_equal          @ if(carryClear) goto compareMem_equal;
+	ldrb   r3, [r0], #1              @ r3 = *r0++;  // u8.
+	ldrb   r12, [r1], #1             @ r12 = *r1++; // u8.
+	subs   r3, r3, r12               @ r3 -= r12;
+	beq    compareMem_head           @ if(r3 == 0) goto compareMem_head;
+	mov    r0, r3                    @ return r3;
+	bx     lr
+
+compareMem_aligned:
+	subs   r2, r2, #16               @ r2 -= 16;
+	bcc    compareMem_aligned_end    @ if(carryClear) goto compareMem_aligned_end;
+
+	@ Compare 16 bytes at a time.
+	push   {r4-r8, lr}               @ Save regs.
+	compareMem_block_lp:
+		pld    [r0, #64]             @ Prefetch 2 lines ahead.
+		pld    [r1, #64]
+		ldmia  r0!, {r3-r6}          @ r3_to_r6 = *((Block16*)r0); r0 += 16;
+		ldmia  r1!, {r7, r8, r12, lr} @ r7_r8_r12_lr = *((Block16*)r1); r1 += 16;
+		cmp    r3, r7                @ if(r3 != r7 || r4 != r8 ||
+		cmpeq  r4, r8                @    r5 != r12 || r6 != lr) goto compareMem_mismatch;
+		cmpeq  r5, r12
+		cmpeq  r6, lr
+		bne    compareMem_mismatch
+		subs   r2, r2, #16           @ r2 -= 16; // Update flags.
+		bcs    compareMem_block_lp   @ while(carrySet);
+	pop    {r4-r8, lr}               @ Restore regs.
+
+compareMem_aligned_end:
+	add    r2, r2, #16               @ r2 += 16; // 0-15 bytes left.
+
+	@ Compare the rest bytewise.
+compareMem_bytes:
+	subs   r2, r2, #1                @ r2--;
+	bcc    compareMem_equal          @ if(carryClear) goto compareMem_equal;
+	ldrb   r3, [r0], #1              @ r3 = *r0++;  // u8.
+	ldrb   r12, [r1], #1             @ r12 = *r1++; // u8.
+	subs   r3, r3, r12               @ r3 -= r12;
+	beq    compareMem_bytes          @ if(r3 == 0) goto compareMem_bytes;
+	mov    r0, r3                    @ return r3;
+	bx     lr
+
+	@ The difference is somewhere in the last 16 bytes. Find it bytewise.
+compareMem_mismatch:
+	pop    {r4-r8, lr}               @ Restore regs.
+	sub    r0, r0, #16               @ r0 -= 16;
+	sub    r1, r1, #16               @ r1 -= 16;
+	b      compareMem_aligned_end
+
+compareMem_equal:
+	mov    r0, #0                    @ return 0;
+	bx     lr
+END_ASM_FUNC
\ No newline at end of file
@@ -0,0 +1,180 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "arm11/screenshot.h"
+#include "arm11/allocator/fcram.h"
+#include "arm11/drivers/gx.h"
+#include "arm11/fmt.h"
+#include "drivers/cache.h"
+#include "mem_map.h"
+#include "pixel_conv.h"
+#include "fs.h"
+#include "fsutil.h"
+
+
+// Rows converted per encoder call.
+#define ROWS_PER_BATCH  (8u)
+#define MAX_FILES       (10000u)
+
+
+// First index to try in g_nextDir.
+static u32 g_nextIdx = 0;
+static char g_nextDir[256] = {0};
+
+
+
+static inline bool isGpuAccessible(const void *const p, const u32 size)
+{
+	const uintptr_t start = (uintptr_t)p;
+	return (start >= VRAM_BASE && start + size <= VRAM_BASE + VRAM_SIZE) ||
+	       (start >= FCRAM_BASE && start + size <= FCRAM_BASE + FCRAM_SIZE);
+}
+
+// Copies the surface with a raw PPF texture copy so the frame can't change
+// while encoding. Conversion and rotation are done by convertPixelsRotated()
+// while encoding.
+// Returns false if the surface must be read directly.
+static bool snapshotGx(G2dSurface *const snap, const G2dSurface *const surf)
+{
+	const u32 size = surf->width * surf->height * GFX_getPixelSize(surf->fmt);
+	if(size % 16 != 0 || ((uintptr_t)surf->buf & 7u) != 0 || !isGpuAccessible(surf->buf, size)) return false;
+
+	void *const buf = fcramAlloc(size);
+	if(buf == NULL) return false;
+	if(!isGpuAccessible(buf, size))
+	{
+		fcramFree(buf);
+		return false;
+	}
+
+	cleanDCacheRange(surf->buf, size);
+	flushDCacheRange(buf, size);
+	GX_textureCopy((const u32*)surf->buf, 0, (u32*)buf, 0, size);
+	GFX_waitForPPF();
+
+	snap->buf    = buf;
+	snap->width  = surf->width;
+	snap->height = surf->height;
+	snap->fmt    = surf->fmt;
+
+	return true;
+}
+
+static Result fileWrite(void *arg, const void *buf, u32 size)
+{
+	u32 written;
+	const Result res = fWrite(*(FHandle*)arg, buf, size, &written);
+	if(res != RES_OK) return res;
+
+	return (written == size ? RES_OK : RES_DISK_FULL);
+}
+
+static Result encodeSurface(const G2dSurface *const surf, const ImgEncFmt fmt, FHandle f)
+{
+	const u32 width = surf->width;
+	const u32 height = surf->height;
+	ImgEnc *const enc = (ImgEnc*)malloc(sizeof(ImgEnc));
+	u8 *const rows = (u8*)malloc(width * 3 * ROWS_PER_BATCH);
+	Result res = RES_OUT_OF_MEM;
+	if(enc != NULL && rows != NULL)
+	{
+		res = IMGENC_start(enc, fmt, width, height, fileWrite, &f);
+		for(u32 y = 0; y < height && res == RES_OK; y += ROWS_PER_BATCH)
+		{
+			const u32 num = (height - y < ROWS_PER_BATCH ? height - y : ROWS_PER_BATCH);
+			convertPixelsRotated(rows, GFX_BGR8, width * 3, surf->buf, surf->fmt, width, height, y, num);
+			res = IMGENC_writeRows(enc, rows, width * 3, num);
+		}
+		if(res == RES_OK) res = IMGENC_finish(enc);
+	}
+
+	free(rows);
+	free(enc);
+
+	return res;
+}
+
+Result SCREENSHOT_saveSurface(const G2dSurface *const surf, const ImgEncFmt fmt, const char *const path)
+{
+	if(surf->buf == NULL || surf->width == 0 || surf->height == 0) return RES_INVALID_ARG;
+
+	G2dSurface snap;
+	const bool snapped = snapshotGx(&snap, surf);
+
+	FHandle f;
+	Result res = fOpen(&f, path, FA_CREATE_ALWAYS | FA_WRITE);
+	if(res == RES_OK)
+	{
+		res = encodeSurface((snapped ? &snap : surf), fmt, f);
+
+		// Errors on the last partial cluster only show up on close.
+		const Result closeRes = fClose(f);
+		if(res == RES_OK) res = closeRes;
+		if(res != RES_OK) fUnlink(path);
+	}
+
+	if(snapped) fcramFree(snap.buf);
+
+	return res;
+}
+
+Result SCREENSHOT_save(const GfxLcd lcd, const ImgEncFmt fmt, const char *const path)
+{
+	G2dSurface surf;
+	G2D_surfaceFromLcd(&surf, lcd, GFX_SIDE_LEFT);
+
+	return SCREENSHOT_saveSurface(&surf, fmt, path);
+}
+
+Result SCREENSHOT_saveNext(const GfxLcd lcd, const ImgEncFmt fmt, const char *dir)
+{
+	if(dir == NULL) dir = SCREENSHOT_DIR;
+
+	Result res = fsMakePath(dir);
+	if(res != RES_OK && res != RES_FR_EXIST) return res;
+
+	// Continues after the last saved file so frame dumps don't rescan the whole directory.
+	if(strcmp(dir, g_nextDir) != 0)
+	{
+		ee_snprintf(g_nextDir, sizeof(g_nextDir), "%s", dir);
+		g_nextIdx = 0;
+	}
+
+	char path[256];
+	for(u32 i = g_nextIdx; i < MAX_FILES; i++)
+	{
+		if(ee_snprintf(path, sizeof(path), "%s/scr_%04lu.%s", dir, i, (fmt == IMGENC_PNG ? "png" : "bmp")) >= sizeof(path))
+			return RES_PATH_TOO_LONG;
+
+		FILINFO fi;
+		res = fStat(path, &fi);
+		if(res == RES_OK) continue;
+		if(res != RES_FR_NO_FILE) return res;
+
+		// Failed saves are deleted. Try the same name next time.
+		res = SCREENSHOT_save(lcd, fmt, path);
+		if(res == RES_OK) g_nextIdx = i + 1;
+
+		return res;
+	}
+
+	return RES_OUT_OF_RANGE;
+}
\ No newline at end of file
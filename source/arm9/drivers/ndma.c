@@ -16,6 +16,7 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdatomic.h>
 #include "types.h"
 #include "fb_assert.h"
 #include "arm9/drivers/ndma.h"
@@ -26,6 +27,52 @@
 #define MAX_BURST_WORDS  (4u) // In log2. 4 is 16 words (64 bytes).
 
 
+typedef struct
+{
+	const NdmaDesc *_Atomic cur; // Running transfer or NULL if idle.
+	NdmaCallback cb;
+	void *arg;
+} NdmaState;
+
+static NdmaState g_ndmaState[NDMA_CHANNELS] = {0};
+static u8 g_ndmaAllocMask = BIT(NDMA_CH_SYNC);
+
+
+
+// NDMA hardware bug workaround. Only for memory on the AXI bus.
+// Device FIFOs must not be read.
+static void axiReadWorkaround(const u32 sad, const u32 cnt)
+{
+	if((cnt & NDMA_SAD_FILL) == NDMA_SAD_FILL) return;
+	if(sad >= VRAM_BASE && sad < FCRAM_EXT_BASE + FCRAM_EXT_SIZE) (void)*((const vu8*)sad);
+}
+
+static void startDesc(const u8 ch, const NdmaDesc *const desc)
+{
+	NdmaCh *const ndmaCh = getNdmaChRegs(ch);
+	ndmaCh->sad   = desc->sad;
+	ndmaCh->dad   = desc->dad;
+	ndmaCh->tcnt  = desc->tcnt;
+	ndmaCh->wcnt  = desc->wcnt;
+	ndmaCh->bcnt  = desc->bcnt;
+	ndmaCh->fdata = desc->fdata;
+	ndmaCh->cnt   = desc->cnt;
+}
+
+static void ndmaIrqHandler(const u32 id)
+{
+	const u32 ch = id - IRQ_DMAC_1_0;
+	NdmaState *const state = &g_ndmaState[ch];
+	const NdmaDesc *desc = atomic_load_explicit(&state->cur, memory_order_relaxed);
+	if(desc == NULL) return; // Chain already done or stopped by NDMA_stop().
+
+	axiReadWorkaround(desc->sad, desc->cnt);
+
+	desc = desc->next;
+	atomic_store_explicit(&state->cur, desc, memory_order_relaxed);
+	if(desc != NULL) startDesc(ch, desc);
+	else if(state->cb != NULL) state->cb(state->arg);
+}
 
 static_assert(IRQ_DMAC_1_7 == 7, "Error: IRQ number for NDMA channel 7 is not 7!");
 void NDMA_init(void)
@@ -33,9 +80,10 @@ void NDMA_init(void)
 	for(u32 i = 0; i < 8; i++)
 	{
 		getNdmaChRegs(i)->cnt = 0;
+		atomic_store_explicit(&g_ndmaState[i].cur, NULL, memory_order_relaxed);
 
 		// Channel and IRQ numbers are in order so we can get away with this.
-		IRQ_registerIsr(IRQ_DMAC_1_0 + i, NULL);
+		IRQ_registerIsr(IRQ_DMAC_1_0 + i, ndmaIrqHandler);
 	}
 
 	// Note: The readback bit is not supported in DSi mode.
@@ -43,53 +91,158 @@ void NDMA_init(void)
 	REG_NDMA_GCNT = NDMA_ROUND_ROBIN(32) | NDMA_REG_READBACK;
 }
 
-void NDMA_copy(u32 *const dst, const u32 *const src, u32 size)
+static u32 burstFor(const u32 words)
 {
-	fb_assert(((u32)dst >= ITCM_BOOT9_MIRROR + ITCM_SIZE) && (((u32)dst < DTCM_BASE) || ((u32)dst >= DTCM_BASE + DTCM_SIZE)));
-	fb_assert(((u32)src >= ITCM_BOOT9_MIRROR + ITCM_SIZE) && (((u32)src < DTCM_BASE) || ((u32)src >= DTCM_BASE + DTCM_SIZE)));
+	u32 burst = __builtin_ctzl(words); // 31u - __builtin_clzl(-(s32)size & size);
+	if(burst > MAX_BURST_WORDS) burst = MAX_BURST_WORDS;
+
+	return burst<<NDMA_BURST_SHIFT;
+}
 
+void NDMA_descCopy(NdmaDesc *const desc, void *const dst, const void *const src, u32 size)
+{
 	size /= 4; // Sizes need to be in words.
 
-	// TODO: Test iomemcpy() with struct vs. setting the regs manually.
-	NdmaCh *const ndmaCh = getNdmaChRegs(7);
-	ndmaCh->sad  = (const u32)src;
-	ndmaCh->dad  = (const u32)dst;
-	ndmaCh->wcnt = size;
-	ndmaCh->bcnt = NDMA_FASTEST;
+	desc->sad   = (u32)src;
+	desc->dad   = (u32)dst;
+	desc->tcnt  = 0;
+	desc->wcnt  = size;
+	desc->bcnt  = NDMA_FASTEST;
+	desc->fdata = 0;
+	desc->cnt   = NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE | burstFor(size) | NDMA_SAD_INC | NDMA_DAD_INC;
+	desc->next  = NULL;
+}
 
-	u32 burst = __builtin_ctzl(size); // 31u - __builtin_clzl(-(s32)size & size);
-	if(burst > MAX_BURST_WORDS) burst = MAX_BURST_WORDS;
-	ndmaCh->cnt  = NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE |
-	               burst<<NDMA_BURST_SHIFT | NDMA_SAD_INC | NDMA_DAD_INC;
+void NDMA_descFill(NdmaDesc *const desc, void *const dst, const u32 value, u32 size)
+{
+	size /= 4; // Sizes need to be in words.
 
-	do
+	desc->sad   = 0;
+	desc->dad   = (u32)dst;
+	desc->tcnt  = 0;
+	desc->wcnt  = size;
+	desc->bcnt  = NDMA_FASTEST;
+	desc->fdata = value;
+	desc->cnt   = NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE | burstFor(size) | NDMA_SAD_FILL | NDMA_DAD_INC;
+	desc->next  = NULL;
+}
+
+void NDMA_descStartup(NdmaDesc *const desc, const u32 startup, const u32 addrMode, const u32 dst,
+                      const u32 src, const u32 size, const u32 blockSize)
+{
+	const u32 blockWords = blockSize / 4;
+
+	desc->sad   = src;
+	desc->dad   = dst;
+	desc->tcnt  = size / 4;
+	desc->wcnt  = blockWords;
+	desc->bcnt  = NDMA_FASTEST;
+	desc->fdata = 0;
+	desc->cnt   = NDMA_EN | startup | burstFor(blockWords) | addrMode |
+	              (size == 0 ? NDMA_REPEAT_MODE : NDMA_IRQ_EN | NDMA_TCNT_MODE);
+	desc->next  = NULL;
+}
+
+u8 NDMA_allocChannel(void)
+{
+	const u32 savedState = enterCriticalSection();
+
+	u8 ch = NDMA_NO_CHANNEL;
+	const u8 mask = g_ndmaAllocMask;
+	if(mask != 0xFFu)
 	{
-		__wfi();
-	} while(ndmaCh->cnt & NDMA_EN);
+		ch = __builtin_ctz(~mask);
+		g_ndmaAllocMask = mask | BIT(ch);
+	}
+
+	leaveCriticalSection(savedState);
 
-	// NDMA hardware bug workaround.
-	(void)*((const vu8*)src);
+	return ch;
 }
 
-void NDMA_fill(u32 *const dst, const u32 value, u32 size)
+void NDMA_freeChannel(const u8 ch)
 {
-	fb_assert(((u32)dst >= ITCM_BOOT9_MIRROR + ITCM_SIZE) && (((u32)dst < DTCM_BASE) || ((u32)dst >= DTCM_BASE + DTCM_SIZE)));
+	if(ch >= NDMA_CHANNELS || ch == NDMA_CH_SYNC) return;
 
-	size /= 4; // Sizes need to be in words.
+	NDMA_stop(ch);
 
-	NdmaCh *const ndmaCh = getNdmaChRegs(7);
-	ndmaCh->dad   = (const u32)dst;
-	ndmaCh->wcnt  = size;
-	ndmaCh->bcnt  = NDMA_FASTEST;
-	ndmaCh->fdata = value;
+	const u32 savedState = enterCriticalSection();
+	g_ndmaAllocMask &= ~BIT(ch);
+	leaveCriticalSection(savedState);
+}
 
-	u32 burst = __builtin_ctzl(size); // 31u - __builtin_clzl(-(s32)size & size);
-	if(burst > MAX_BURST_WORDS) burst = MAX_BURST_WORDS;
-	ndmaCh->cnt   = NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE |
-	                burst<<NDMA_BURST_SHIFT | NDMA_SAD_FILL | NDMA_DAD_INC;
+static bool submitDesc(const u8 ch, const NdmaDesc *const desc, const NdmaCallback cb, void *const arg)
+{
+	NdmaState *const state = &g_ndmaState[ch];
+	if(atomic_load_explicit(&state->cur, memory_order_relaxed) != NULL) return false;
+
+	state->cb  = cb;
+	state->arg = arg;
+	atomic_store_explicit(&state->cur, desc, memory_order_relaxed);
+	atomic_signal_fence(memory_order_release);
+	startDesc(ch, desc);
+
+	return true;
+}
 
-	do
+bool NDMA_submit(const u8 ch, const NdmaDesc *const desc, const NdmaCallback cb, void *const arg)
+{
+	// NDMA_CH_SYNC is reserved for NDMA_copy() and NDMA_fill().
+	if(ch >= NDMA_CHANNELS || ch == NDMA_CH_SYNC || (g_ndmaAllocMask & BIT(ch)) == 0) return false;
+
+	return submitDesc(ch, desc, cb, arg);
+}
+
+bool NDMA_isBusy(const u8 ch)
+{
+	return atomic_load_explicit(&g_ndmaState[ch].cur, memory_order_relaxed) != NULL;
+}
+
+void NDMA_wait(const u8 ch)
+{
+	// The IRQ wakes us up after each transfer. Check with IRQs disabled
+	// so the last one can't end the chain right before we sleep.
+	while(1)
 	{
-		__wfi();
-	} while(ndmaCh->cnt & NDMA_EN);
+		const u32 savedState = enterCriticalSection();
+		if(!NDMA_isBusy(ch))
+		{
+			leaveCriticalSection(savedState);
+			break;
+		}
+		__wfi(); // Wakes up on pending IRQs even with IRQs disabled.
+		leaveCriticalSection(savedState);
+	}
+	atomic_signal_fence(memory_order_acquire);
 }
+
+void NDMA_stop(const u8 ch)
+{
+	const u32 savedState = enterCriticalSection();
+
+	getNdmaChRegs(ch)->cnt = 0;
+	atomic_store_explicit(&g_ndmaState[ch].cur, NULL, memory_order_relaxed);
+
+	leaveCriticalSection(savedState);
+}
+
+void NDMA_copy(u32 *const dst, const u32 *const src, u32 size)
+{
+	fb_assert(((u32)dst >= ITCM_BOOT9_MIRROR + ITCM_SIZE) && (((u32)dst < DTCM_BASE) || ((u32)dst >= DTCM_BASE + DTCM_SIZE)));
+	fb_assert(((u32)src >= ITCM_BOOT9_MIRROR + ITCM_SIZE) && (((u32)src < DTCM_BASE) || ((u32)src >= DTCM_BASE + DTCM_SIZE)));
+
+	NdmaDesc desc;
+	NDMA_descCopy(&desc, dst, src, size);
+	submitDesc(NDMA_CH_SYNC, &desc, NULL, NULL);
+	NDMA_wait(NDMA_CH_SYNC);
+}
+
+void NDMA_fill(u32 *const dst, const u32 value, u32 size)
+{
+	fb_assert(((u32)dst >= ITCM_BOOT9_MIRROR + ITCM_SIZE) && (((u32)dst < DTCM_BASE) || ((u32)dst >= DTCM_BASE + DTCM_SIZE)));
+
+	NdmaDesc desc;
+	NDMA_descFill(&desc, dst, value, size);
+	submitDesc(NDMA_CH_SYNC, &desc, NULL, NULL);
+	NDMA_wait(NDMA_CH_SYNC);
+}
\ No newline at end of file
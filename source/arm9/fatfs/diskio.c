@@ -17,6 +17,18 @@
 #include "arm9/drivers/timer.h"
 
 
+static u8 g_sdDmaCh = NDMA_NO_CHANNEL;
+
+
+
+// Allocated on first use. Returns NDMA_NO_CHANNEL if none is free.
+static u8 getSdDmaChannel(void)
+{
+	if(g_sdDmaCh == NDMA_NO_CHANNEL) g_sdDmaCh = NDMA_allocChannel();
+	return g_sdDmaCh;
+}
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
@@ -73,18 +85,17 @@ DRESULT disk_read (
 	(void)pdrv;
 
 	DRESULT res = RES_OK;
-	if((uintptr_t)buff % 4 == 0)
+	const u8 ch = getSdDmaChannel();
+	if((uintptr_t)buff % 4 == 0 && ch != NDMA_NO_CHANNEL)
 	{
 		// Warning! Flush before transfer only works on ARM9 (no speculative prefetching)!
 		flushDCacheRange(buff, 512 * count);
 
-		NdmaCh *const ndmaCh = getNdmaChRegs(5);
-		ndmaCh->sad  = (u32)getTmioFifo(getTmioRegs(1)); // TODO: SDMMC dev to FIFO function.
-		ndmaCh->dad  = (u32)buff;
-		ndmaCh->wcnt = 512 / 4;
-		ndmaCh->bcnt = NDMA_FASTEST;
-		ndmaCh->cnt  = NDMA_EN | NDMA_START_TMIO3 | NDMA_REPEAT_MODE |
-		               NDMA_BURST(64 / 4) | NDMA_SAD_FIX | NDMA_DAD_INC;
+		// Every TMIO FIFO request transfers 1 sector until stopped.
+		NdmaDesc desc;
+		NDMA_descStartup(&desc, NDMA_START_TMIO3, NDMA_SAD_FIX | NDMA_DAD_INC, (u32)buff,
+		                 (u32)getTmioFifo(getTmioRegs(1)), 0, 512); // TODO: SDMMC dev to FIFO function.
+		NDMA_submit(ch, &desc, NULL, NULL);
 
 		do
 		{
@@ -100,7 +111,7 @@ DRESULT disk_read (
 		} while(count > 0);
 
 		// Stop DMA.
-		ndmaCh->cnt = 0;
+		NDMA_stop(ch);
 	}
 	else
 	{
@@ -141,17 +152,15 @@ DRESULT disk_write (
 	(void)pdrv;
 
 	DRESULT res = RES_OK;
-	if((uintptr_t)buff % 4 == 0)
+	const u8 ch = getSdDmaChannel();
+	if((uintptr_t)buff % 4 == 0 && ch != NDMA_NO_CHANNEL)
 	{
 		flushDCacheRange(buff, 512 * count);
 
-		NdmaCh *const ndmaCh = getNdmaChRegs(5);
-		ndmaCh->sad  = (u32)buff;
-		ndmaCh->dad  = (u32)getTmioFifo(getTmioRegs(1)); // TODO: SDMMC dev to FIFO function.
-		ndmaCh->wcnt = 512 / 4;
-		ndmaCh->bcnt = NDMA_FASTEST;
-		ndmaCh->cnt  = NDMA_EN | NDMA_START_TMIO3 | NDMA_REPEAT_MODE |
-		               NDMA_BURST(64 / 4) | NDMA_SAD_INC | NDMA_DAD_FIX;
+		NdmaDesc desc;
+		NDMA_descStartup(&desc, NDMA_START_TMIO3, NDMA_SAD_INC | NDMA_DAD_FIX,
+		                 (u32)getTmioFifo(getTmioRegs(1)), (u32)buff, 0, 512); // TODO: SDMMC dev to FIFO function.
+		NDMA_submit(ch, &desc, NULL, NULL);
 
 		do
 		{
@@ -167,7 +176,7 @@ DRESULT disk_write (
 		} while(count > 0);
 
 		// Stop DMA.
-		ndmaCh->cnt = 0;
+		NDMA_stop(ch);
 
 		// NDMA hardware bug workaround.
 		(void)*((const vu8*)buff);
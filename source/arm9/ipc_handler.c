@@ -18,7 +18,6 @@
 
 #include "types.h"
 #include "ipc_handler.h"
-#include "drivers/cache.h"
 #include "fs.h"
 #include "drivers/prng.h"
 #include "drivers/lgy_common.h"
@@ -26,14 +25,8 @@
 
 
 
-u32 IPC_handleCmd(u8 cmdId, u32 sendBufs, u32 recvBufs, const u32 *const buf)
+u32 IPC_handleCmd(u8 cmdId, UNUSED u32 sendBufs, UNUSED u32 recvBufs, const u32 *const buf)
 {
-	for(u32 i = 0; i < sendBufs; i++)
-	{
-		const IpcBuffer *const sendBuf = (IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
-		if(sendBuf->ptr && sendBuf->size) invalidateDCacheRange(sendBuf->ptr, sendBuf->size);
-	}
-
 	u32 result = 0;
 	switch(cmdId)
 	{
@@ -136,11 +129,5 @@ u32 IPC_handleCmd(u8 cmdId, u32 sendBufs, u32 recvBufs, const u32 *const buf)
 			panic();
 	}
 
-	for(u32 i = sendBufs; i < sendBufs + recvBufs; i++)
-	{
-		const IpcBuffer *const recvBuf = (IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
-		if(recvBuf->ptr && recvBuf->size) flushDCacheRange(recvBuf->ptr, recvBuf->size);
-	}
-
 	return result;
 }
@@ -0,0 +1,88 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include "types.h"
+#include "color_lut.h"
+
+
+// Gamma values commonly used for GBA color correction shaders.
+// The GBA LCD is treated as gamma 4.0 and the target as gamma 2.2.
+#define GBA_LCD_GAMMA     (4.f)
+#define GBA_TARGET_GAMMA  (2.2f)
+
+
+
+static u8 float2Entry(const float v)
+{
+	// Clamp to 0.0-1.0 and round to nearest.
+	if(!(v > 0.f)) return 0; // Also catches NaN.
+	if(v >= 1.f)   return 255;
+
+	return (u8)(v * 255.f + 0.5f);
+}
+
+static void fillPowerCurve(u8 ch[256], const float gamma)
+{
+	// Endpoints are always exact.
+	ch[0] = 0;
+	for(u32 i = 1; i < 255; i++)
+	{
+		ch[i] = float2Entry(powf((float)i / 255.f, gamma));
+	}
+	ch[255] = 255;
+}
+
+void colorLutIdentity(ColorLut *const lut)
+{
+	for(u32 i = 0; i < 256; i++)
+	{
+		lut->r[i] = i;
+		lut->g[i] = i;
+		lut->b[i] = i;
+	}
+}
+
+void colorLutGamma(ColorLut *const lut, const float gammaR, const float gammaG, const float gammaB)
+{
+	fillPowerCurve(lut->r, gammaR);
+	fillPowerCurve(lut->g, gammaG);
+	fillPowerCurve(lut->b, gammaB);
+}
+
+void colorLutSrgb2Lcd(ColorLut *const lut, const float lcdGamma)
+{
+	const float invGamma = 1.f / lcdGamma;
+	for(u32 i = 0; i < 256; i++)
+	{
+		// sRGB EOTF (IEC 61966-2-1).
+		const float c = (float)i / 255.f;
+		const float lin = (c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f));
+
+		const u8 out = float2Entry(powf(lin, invGamma));
+		lut->r[i] = out;
+		lut->g[i] = out;
+		lut->b[i] = out;
+	}
+}
+
+void colorLutGbaCorrection(ColorLut *const lut)
+{
+	const float gamma = GBA_LCD_GAMMA / GBA_TARGET_GAMMA;
+	colorLutGamma(lut, gamma, gamma, gamma);
+}
\ No newline at end of file
@@ -141,16 +141,129 @@ void DMA330_kill(u8 ch)
 	}
 }
 
-/*#ifdef __ARM11__
+u32 DMA330_faultingChannels(void)
+{
+	return getDma330Regs()->fsrc & (BIT(CHANNELS) - 1);
+}
+
+u32 DMA330_faultType(u8 ch)
+{
+	return getDma330Regs()->ftr[ch];
+}
+
+Result DMA330_fault2Res(u32 ftr)
+{
+	// Most specific first. A lockup can come with other bits set.
+	if(ftr & FTR_LOCKUP_ERR) return RES_DMA_LOCKUP;
+	if(ftr & (FTR_INSTR_FETCH_ERR | FTR_DATA_WRITE_ERR | FTR_DATA_READ_ERR)) return RES_DMA_BUS_ERR;
+	if(ftr & (FTR_CH_EVNT_ERR | FTR_CH_PERIPH_ERR | FTR_CH_RDWR_ERR)) return RES_DMA_SECURITY_ERR;
+	if(ftr != 0) return RES_DMA_PROG_ERR;
+
+	return RES_OK;
+}
+
+u32 DMA330_recoverManager(void)
+{
+	Dma330 *const dma330 = getDma330Regs();
+
+	if((dma330->fsrd & FSRD_FAULTING) == 0) return 0;
+
+	// DMAKILL manager.
+	const u32 ftrd = dma330->ftrd;
+	sendDebugCmd(dma330, DBGINST0(0x01u, 0, DBGINST0_THR_MGR), 0);
+
+	return ftrd;
+}
+
+#ifdef __ARM11__
 #include "arm11/fmt.h"
+#include "drivers/corelink_dma-330_asm.h"
+
+
+static const char* csrStat2Str(const u32 stat)
+{
+	switch(stat)
+	{
+		case CSR_STAT_STOPPED:             return "stopped";
+		case CSR_STAT_EXECUTING:           return "executing";
+		case CSR_STAT_CACHE_MISS:          return "cache miss";
+		case CSR_STAT_UPDATING_PC:         return "updating PC";
+		case CSR_STAT_WFE:                 return "waiting for event";
+		case CSR_STAT_AT_BARRIER:          return "at barrier";
+		case CSR_STAT_WFP:                 return "waiting for periphal";
+		case CSR_STAT_KILLING:             return "killing";
+		case CSR_STAT_COMPLETING:          return "completing";
+		case CSR_STAT_FAULTING_COMPLETING: return "faulting completing";
+		case CSR_STAT_FAULTING:            return "faulting";
+	}
+
+	return "unknown";
+}
+
+static void printFaultBits(const u32 ftr, const bool manager)
+{
+	static const struct
+	{
+		u32 bit;
+		const char *name;
+	} faults[] =
+	{
+		{FTR_UNDEF_INSTR,        "undefined instruction"},
+		{FTR_OPERAND_INVALID,    "invalid operand"},
+		{FTRD_DMAGO_ERR,         "secure DMAGO"},
+		{FTR_CH_EVNT_ERR,        "secure event"},
+		{FTR_CH_PERIPH_ERR,      "secure periphal"},
+		{FTR_CH_RDWR_ERR,        "secure read/write"},
+		{FTR_CH_MFIFO_ERR,       "MFIFO too small"},
+		{FTR_CH_ST_DATA_UNAVAIL, "MFIFO underrun"},
+		{FTR_INSTR_FETCH_ERR,    "instruction fetch"},
+		{FTR_DATA_WRITE_ERR,     "data write"},
+		{FTR_DATA_READ_ERR,      "data read"},
+		{FTR_DBG_INSTR,          "from debug interface"},
+		{FTR_LOCKUP_ERR,         "lockup"}
+	};
+	static_assert(FTRD_MGR_EVNT_ERR == FTR_CH_EVNT_ERR);
+
+	ee_printf("  fault %08lX:", ftr);
+	const char *sep = " ";
+	for(u32 i = 0; i < sizeof(faults) / sizeof(*faults); i++)
+	{
+		if(faults[i].bit == FTRD_DMAGO_ERR && !manager) continue; // Manager only.
+		if(ftr & faults[i].bit)
+		{
+			ee_printf("%s%s", sep, faults[i].name);
+			sep = ", ";
+		}
+	}
+	ee_puts("");
+}
+
 void DMA330_dbgPrint(void)
 {
 	Dma330 *const dma330 = getDma330Regs();
 
-	ee_printf("DSR: %08lX FTRD: %08lX\n", dma330->dsr, dma330->ftrd);
+	const u32 dsr = dma330->dsr;
+	// The manager states are a subset of the channel states.
+	ee_printf("DMA330 manager: %s, PC %08lX, wake event %lu\n", csrStat2Str(dsr & DSR_STAT_MASK),
+	          dma330->dpc, (dsr & DSR_WAKE_EVNT_MASK)>>DSR_WAKE_EVNT_SHIFT);
+	if(dma330->fsrd & FSRD_FAULTING) printFaultBits(dma330->ftrd, true);
+
+	const u32 fsrc = dma330->fsrc;
 	for(u32 i = 0; i < CHANNELS; i++)
 	{
-		ee_printf(" CSR/FTR%lu: %08lX %08lX\n", i, dma330->chStat[i].csr, dma330->ftr[i]);
+		const u32 csr = dma330->chStat[i].csr;
+		const u32 stat = csr & CSR_STAT_MASK;
+		ee_printf("ch%lu: %s, PC %08lX", i, csrStat2Str(stat), dma330->chStat[i].cpc);
+		if(stat == CSR_STAT_WFE) ee_printf(", event %lu", (csr & CSR_WAKE_EVNT_MASK)>>CSR_WAKE_EVNT_SHIFT);
+		if(stat == CSR_STAT_WFP) ee_printf(", periphal %lu", (csr & CSR_WAKE_EVNT_MASK)>>CSR_WAKE_EVNT_SHIFT);
+		ee_puts("");
+		if(stat == CSR_STAT_STOPPED) continue;
+
+		char ccrStr[DMA330_DISASM_MAX_LEN];
+		DMA330_ccr2Str(dma330->chCtrl[i].ccr, ccrStr, sizeof(ccrStr));
+		ee_printf("  SAR %08lX DAR %08lX LC0 %lu LC1 %lu\n  CCR %s\n", dma330->chCtrl[i].sar,
+		          dma330->chCtrl[i].dar, dma330->chCtrl[i].lc0, dma330->chCtrl[i].lc1, ccrStr);
+		if(fsrc & FSRC_FAULTING(i)) printFaultBits(dma330->ftr[i], false);
 	}
 }
-#endif*/ // ifdef __ARM11__
\ No newline at end of file
+#endif // ifdef __ARM11__
\ No newline at end of file
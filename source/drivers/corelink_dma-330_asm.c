@@ -0,0 +1,559 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "drivers/corelink_dma-330_asm.h"
+#include "drivers/corelink_dma-330.h"
+
+
+// Instruction encodings (see the DMA-330 TRM instruction set chapter).
+#define OP_END       (0x00u)
+#define OP_KILL      (0x01u)
+#define OP_RMB       (0x12u)
+#define OP_WMB       (0x13u)
+#define OP_NOP       (0x18u)
+#define OP_LD        (0x04u) // | cond.
+#define OP_ST        (0x08u) // | cond.
+#define OP_STZ       (0x0Cu)
+#define OP_LP        (0x20u) // | lc<<1.
+#define OP_LDP       (0x24u) // | cond.
+#define OP_STP       (0x28u) // | cond.
+#define OP_LPEND_FE  (0x28u) // | lc<<2 | cond. Loop forever (nf bit clear).
+#define OP_WFP       (0x30u) // | type.
+#define OP_SEV       (0x34u)
+#define OP_FLUSHP    (0x35u)
+#define OP_WFE       (0x36u)
+#define OP_LPEND     (0x38u) // | lc<<2 | cond. Counted loop (nf bit set).
+#define OP_ADDH      (0x54u) // | ra<<1.
+#define OP_ADNH      (0x5Cu) // | ra<<1.
+#define OP_GO        (0xA0u) // | ns<<1.
+#define OP_MOV       (0xBCu)
+
+#define MAX_LOOP_ITERATIONS  (256u)
+#define MAX_LOOPS            (3u)
+
+enum
+{
+	LOOP_COUNTED = 0u,
+	LOOP_FOREVER = 1u,
+	LOOP_ENDLESS = 2u
+};
+
+
+
+static void setError(Dma330Asm *const a, const Dma330AsmErr err)
+{
+	// Keep the first error.
+	if(a->error == DMA330_ASM_OK) a->error = err;
+}
+
+static void emit(Dma330Asm *const a, const u8 *const bytes, const u32 len)
+{
+	if(a->error != DMA330_ASM_OK) return;
+	if(a->pos + len > a->size)
+	{
+		setError(a, DMA330_ASM_OVERFLOW);
+		return;
+	}
+
+	memcpy(&a->buf[a->pos], bytes, len);
+	a->pos += len;
+}
+
+static inline void emit1(Dma330Asm *const a, const u8 b0)
+{
+	emit(a, &b0, 1);
+}
+
+static inline void emit2(Dma330Asm *const a, const u8 b0, const u8 b1)
+{
+	const u8 bytes[2] = {b0, b1};
+	emit(a, bytes, 2);
+}
+
+static u32 srcTransferBytes(const u32 ccr, const Dma330Cond cond)
+{
+	const u32 size = 1u<<((ccr & CCR_SRC_BURST_SIZE_MASK)>>CCR_SRC_BURST_SIZE_SHIFT);
+	if(cond == DMA330_SINGLE) return size;
+	return size * (((ccr & CCR_SRC_BURST_LEN_MASK)>>CCR_SRC_BURST_LEN_SHIFT) + 1);
+}
+
+static u32 dstTransferBytes(const u32 ccr, const Dma330Cond cond)
+{
+	const u32 size = 1u<<((ccr & CCR_DST_BURST_SIZE_MASK)>>CCR_DST_BURST_SIZE_SHIFT);
+	if(cond == DMA330_SINGLE) return size;
+	return size * (((ccr & CCR_DST_BURST_LEN_MASK)>>CCR_DST_BURST_LEN_SHIFT) + 1);
+}
+
+// Single transfers move 1 item, everything else a full burst.
+static void mfifoLoad(Dma330Asm *const a, const Dma330Cond cond)
+{
+	const u32 fill = a->mfifo + srcTransferBytes(a->ccr, cond);
+	if(fill > a->mfifoSize) setError(a, DMA330_ASM_MFIFO);
+	else                    a->mfifo = fill;
+}
+
+static void mfifoStore(Dma330Asm *const a, const Dma330Cond cond)
+{
+	const u32 bytes = dstTransferBytes(a->ccr, cond);
+	if(bytes > a->mfifo) setError(a, DMA330_ASM_MFIFO);
+	else                 a->mfifo -= bytes;
+}
+
+void DMA330_asmInit(Dma330Asm *const a, u8 *const buf, const u16 size)
+{
+	a->buf       = buf;
+	a->size      = size;
+	a->pos       = 0;
+	a->loops     = 0;
+	a->counters  = 0;
+	a->error     = DMA330_ASM_OK;
+	a->mfifoSize = DMA330_ASM_MFIFO_SIZE;
+	a->mfifo     = 0;
+	a->ccr       = 0;
+}
+
+u32 DMA330_asmEnd(Dma330Asm *const a)
+{
+	if(a->loops != 0) setError(a, DMA330_ASM_LOOP);
+	if(a->mfifo != 0) setError(a, DMA330_ASM_MFIFO);
+	emit1(a, OP_END);
+
+	return (a->error != DMA330_ASM_OK ? 0 : a->pos);
+}
+
+void DMA330_asmMov(Dma330Asm *const a, const Dma330Reg reg, const u32 val)
+{
+	if(reg == DMA330_CCR) a->ccr = val;
+
+	const u8 bytes[6] = {OP_MOV, reg, val, val>>8, val>>16, val>>24};
+	emit(a, bytes, 6);
+}
+
+void DMA330_asmAddh(Dma330Asm *const a, const Dma330Reg reg, const u16 val)
+{
+	if(reg == DMA330_CCR)
+	{
+		setError(a, DMA330_ASM_ARG);
+		return;
+	}
+
+	const u8 bytes[3] = {OP_ADDH | (reg == DMA330_DAR)<<1, val, val>>8};
+	emit(a, bytes, 3);
+}
+
+void DMA330_asmLd(Dma330Asm *const a, const Dma330Cond cond)
+{
+	mfifoLoad(a, cond);
+	emit1(a, OP_LD | cond);
+}
+
+void DMA330_asmSt(Dma330Asm *const a, const Dma330Cond cond)
+{
+	mfifoStore(a, cond);
+	emit1(a, OP_ST | cond);
+}
+
+void DMA330_asmLdp(Dma330Asm *const a, const Dma330Cond cond, const u8 periph)
+{
+	if(cond == DMA330_ALWAYS || periph > 31) setError(a, DMA330_ASM_ARG);
+	mfifoLoad(a, cond);
+	emit2(a, OP_LDP | cond, periph<<3);
+}
+
+void DMA330_asmStp(Dma330Asm *const a, const Dma330Cond cond, const u8 periph)
+{
+	if(cond == DMA330_ALWAYS || periph > 31) setError(a, DMA330_ASM_ARG);
+	mfifoStore(a, cond);
+	emit2(a, OP_STP | cond, periph<<3);
+}
+
+void DMA330_asmWfp(Dma330Asm *const a, const Dma330Wfp type, const u8 periph)
+{
+	if(periph > 31) setError(a, DMA330_ASM_ARG);
+	emit2(a, OP_WFP | type, periph<<3);
+}
+
+void DMA330_asmWfe(Dma330Asm *const a, const u8 event)
+{
+	if(event > 31) setError(a, DMA330_ASM_ARG);
+	emit2(a, OP_WFE, event<<3);
+}
+
+void DMA330_asmFlushp(Dma330Asm *const a, const u8 periph)
+{
+	if(periph > 31) setError(a, DMA330_ASM_ARG);
+	emit2(a, OP_FLUSHP, periph<<3);
+}
+
+void DMA330_asmSev(Dma330Asm *const a, const u8 event)
+{
+	if(event > 31) setError(a, DMA330_ASM_ARG);
+	emit2(a, OP_SEV, event<<3);
+}
+
+void DMA330_asmWmb(Dma330Asm *const a)
+{
+	emit1(a, OP_WMB);
+}
+
+void DMA330_asmRmb(Dma330Asm *const a)
+{
+	emit1(a, OP_RMB);
+}
+
+static void openLoop(Dma330Asm *const a, const u8 type, const u32 count)
+{
+	const bool counted = (type != LOOP_FOREVER);
+	if(a->loops >= MAX_LOOPS || (counted && a->counters == 3u) ||
+	   count == 0 || count > MAX_LOOP_ITERATIONS)
+	{
+		setError(a, DMA330_ASM_LOOP);
+		return;
+	}
+
+	Dma330AsmLoop *const loop = &a->loop[a->loops++];
+	loop->type  = type;
+	loop->mfifo = a->mfifo;
+	loop->lc    = 0;
+	if(counted)
+	{
+		const u8 lc = (a->counters & 1u ? 1u : 0u);
+		a->counters |= 1u<<lc;
+		loop->lc = lc;
+
+		// Endless loops jump back to the LP which reloads the counter.
+		if(type == LOOP_ENDLESS) loop->start = a->pos;
+		emit2(a, OP_LP | lc<<1, count - 1);
+		if(type == LOOP_COUNTED) loop->start = a->pos;
+	}
+	else loop->start = a->pos; // LPFE has no instruction.
+}
+
+void DMA330_asmLp(Dma330Asm *const a, const u32 count)
+{
+	openLoop(a, LOOP_COUNTED, count);
+}
+
+void DMA330_asmLpForever(Dma330Asm *const a)
+{
+	openLoop(a, LOOP_FOREVER, 1);
+}
+
+void DMA330_asmLpEndless(Dma330Asm *const a)
+{
+	// The LPEND decrements 1 to 0 and jumps back. The LP sets it to 1 again.
+	openLoop(a, LOOP_ENDLESS, 2);
+}
+
+void DMA330_asmLpEnd(Dma330Asm *const a)
+{
+	if(a->loops == 0)
+	{
+		setError(a, DMA330_ASM_LOOP);
+		return;
+	}
+
+	const Dma330AsmLoop *const loop = &a->loop[--a->loops];
+	if(a->mfifo != loop->mfifo) setError(a, DMA330_ASM_MFIFO);
+
+	const u32 jump = a->pos - loop->start;
+	if(jump > 255) setError(a, DMA330_ASM_LOOP); // Backwards jump is an 8 bit offset.
+
+	if(loop->type == LOOP_FOREVER) emit2(a, OP_LPEND_FE, jump);
+	else
+	{
+		a->counters &= ~(1u<<loop->lc);
+		emit2(a, OP_LPEND | loop->lc<<2, jump);
+	}
+}
+
+// Emits count (1 to 256^levels) iterations with up to levels nested loops.
+static void repeatLevels(Dma330Asm *const a, const u32 count, const u32 levels, Dma330AsmBody body, void *arg)
+{
+	if(count == 1 || levels == 0)
+	{
+		for(u32 i = 0; i < count; i++) body(a, arg);
+		return;
+	}
+
+	if(count <= MAX_LOOP_ITERATIONS)
+	{
+		DMA330_asmLp(a, count);
+		body(a, arg);
+		DMA330_asmLpEnd(a);
+		return;
+	}
+
+	// Full inner loops nested in an outer loop plus a remainder loop.
+	const u32 outer = count / MAX_LOOP_ITERATIONS;
+	if(outer > 1) DMA330_asmLp(a, outer);
+	DMA330_asmLp(a, MAX_LOOP_ITERATIONS);
+	body(a, arg);
+	DMA330_asmLpEnd(a);
+	if(outer > 1) DMA330_asmLpEnd(a);
+
+	const u32 rest = count % MAX_LOOP_ITERATIONS;
+	if(rest > 0) repeatLevels(a, rest, 1, body, arg);
+}
+
+void DMA330_asmRepeat(Dma330Asm *const a, u32 count, Dma330AsmBody body, void *arg)
+{
+	const u32 levels = (a->counters == 0 ? 2u : (a->counters == 3u ? 0u : 1u));
+	const u32 maxCount = (levels == 2 ? MAX_LOOP_ITERATIONS * MAX_LOOP_ITERATIONS :
+	                      (levels == 1 ? MAX_LOOP_ITERATIONS : 1));
+
+	// Counts beyond one full loop nest repeat the loop code.
+	while(count > maxCount && a->error == DMA330_ASM_OK)
+	{
+		repeatLevels(a, maxCount, levels, body, arg);
+		count -= maxCount;
+	}
+	if(count > 0) repeatLevels(a, count, levels, body, arg);
+}
+
+static void emitLdSt(Dma330Asm *const a, UNUSED void *arg)
+{
+	DMA330_asmLd(a, DMA330_ALWAYS);
+	DMA330_asmSt(a, DMA330_ALWAYS);
+}
+
+void DMA330_asmTransfer(Dma330Asm *const a, const u32 size)
+{
+	const u32 ccr = a->ccr;
+	const u32 burst = srcTransferBytes(ccr, DMA330_ALWAYS);
+	const u32 srcItem = srcTransferBytes(ccr, DMA330_SINGLE);
+	const u32 dstItem = dstTransferBytes(ccr, DMA330_SINGLE);
+	if(burst != dstTransferBytes(ccr, DMA330_ALWAYS) || size % srcItem != 0 || size % dstItem != 0)
+	{
+		setError(a, DMA330_ASM_ARG);
+		return;
+	}
+
+	DMA330_asmRepeat(a, size / burst, emitLdSt, NULL);
+
+	// The remainder is shorter than a burst so the lengths always fit.
+	const u32 rest = size % burst;
+	if(rest > 0)
+	{
+		const u32 newCcr = (ccr & ~(CCR_SRC_BURST_LEN_MASK | CCR_DST_BURST_LEN_MASK)) |
+		                   CCR_SRC_BURST_LEN(rest / srcItem) | CCR_DST_BURST_LEN(rest / dstItem);
+		DMA330_asmMov(a, DMA330_CCR, newCcr);
+		emitLdSt(a, NULL);
+	}
+}
+
+
+// Disassembler.
+typedef struct
+{
+	char *p;
+	u32 left; // Including space for the null terminator.
+} TextBuf;
+
+static void putStr(TextBuf *const t, const char *str)
+{
+	while(*str != '\0' && t->left > 1)
+	{
+		*t->p++ = *str++;
+		t->left--;
+	}
+	*t->p = '\0';
+}
+
+static void putDec(TextBuf *const t, u32 val)
+{
+	char tmp[11];
+	char *p = &tmp[10];
+	*p = '\0';
+	do
+	{
+		*--p = '0' + val % 10;
+		val /= 10;
+	} while(val != 0);
+
+	putStr(t, p);
+}
+
+static void putHex(TextBuf *const t, const u32 val, u32 digits)
+{
+	static const char hexDigits[] = "0123456789ABCDEF";
+	char tmp[11] = "0x";
+	char *p = &tmp[2];
+	while(digits-- > 0) *p++ = hexDigits[(val>>(digits * 4)) & 0xFu];
+	*p = '\0';
+
+	putStr(t, tmp);
+}
+
+static const char* condSuffix(const u8 cond)
+{
+	static const char *const suffixes[4] = {"", "S", "?", "B"};
+	return suffixes[cond & 3u];
+}
+
+// Same notation as the hand written programs. For example "SB16 SS64 SAF SP2 DB16 DS64 DAI DP2".
+static void putCcr(TextBuf *const t, const u32 ccr)
+{
+	putStr(t, "SB");
+	putDec(t, ((ccr & CCR_SRC_BURST_LEN_MASK)>>CCR_SRC_BURST_LEN_SHIFT) + 1);
+	putStr(t, " SS");
+	putDec(t, 8u<<((ccr & CCR_SRC_BURST_SIZE_MASK)>>CCR_SRC_BURST_SIZE_SHIFT));
+	putStr(t, (ccr & CCR_SRC_INC ? " SAI SP" : " SAF SP"));
+	putDec(t, (ccr & CCR_SRC_PROT_CTRL_MASK)>>CCR_SRC_PROT_CTRL_SHIFT);
+	if(ccr & CCR_SRC_CACHE_CTRL_MASK)
+	{
+		putStr(t, " SC");
+		putDec(t, (ccr & CCR_SRC_CACHE_CTRL_MASK)>>CCR_SRC_CACHE_CTRL_SHIFT);
+	}
+
+	putStr(t, " DB");
+	putDec(t, ((ccr & CCR_DST_BURST_LEN_MASK)>>CCR_DST_BURST_LEN_SHIFT) + 1);
+	putStr(t, " DS");
+	putDec(t, 8u<<((ccr & CCR_DST_BURST_SIZE_MASK)>>CCR_DST_BURST_SIZE_SHIFT));
+	putStr(t, (ccr & CCR_DST_INC ? " DAI DP" : " DAF DP"));
+	putDec(t, (ccr & CCR_DST_PROT_CTRL_MASK)>>CCR_DST_PROT_CTRL_SHIFT);
+	if(ccr & CCR_DST_CACHE_CTRL_MASK)
+	{
+		putStr(t, " DC");
+		putDec(t, (ccr & CCR_DST_CACHE_CTRL_MASK)>>CCR_DST_CACHE_CTRL_SHIFT);
+	}
+
+	if(ccr & CCR_END_SWP_SIZE_MASK)
+	{
+		putStr(t, " ES");
+		putDec(t, 8u<<((ccr & CCR_END_SWP_SIZE_MASK)>>CCR_END_SWP_SIZE_SHIFT));
+	}
+}
+
+void DMA330_ccr2Str(const u32 ccr, char *const out, const u32 len)
+{
+	if(len == 0) return;
+	TextBuf t = {out, len};
+	*out = '\0';
+	putCcr(&t, ccr);
+}
+
+u32 DMA330_disasm(const u8 *const prog, const u32 size, const u32 pos, char *const out, const u32 len)
+{
+	if(len == 0) return 0;
+	TextBuf t = {out, len};
+	*out = '\0';
+	if(pos >= size) return 0;
+
+	const u8 *const in = &prog[pos];
+	const u32 avail = size - pos;
+	const u8 op = in[0];
+	u32 instLen = 1;
+	switch(op)
+	{
+		case OP_END:  putStr(&t, "END");  break;
+		case OP_KILL: putStr(&t, "KILL"); break;
+		case OP_RMB:  putStr(&t, "RMB");  break;
+		case OP_WMB:  putStr(&t, "WMB");  break;
+		case OP_NOP:  putStr(&t, "NOP");  break;
+		case OP_STZ:  putStr(&t, "STZ");  break;
+		case OP_LD:
+		case OP_LD | DMA330_SINGLE:
+		case OP_LD | DMA330_BURST:
+			putStr(&t, "LD");
+			putStr(&t, condSuffix(op));
+			break;
+		case OP_ST:
+		case OP_ST | DMA330_SINGLE:
+		case OP_ST | DMA330_BURST:
+			putStr(&t, "ST");
+			putStr(&t, condSuffix(op));
+			break;
+		default:
+			instLen = 2;
+			if(avail < 2) return 0;
+
+			if((op & ~2u) == OP_LP)
+			{
+				putStr(&t, (op & 2u ? "LP lc1, " : "LP lc0, "));
+				putDec(&t, in[1] + 1u);
+			}
+			else if(op == (OP_LDP | DMA330_SINGLE) || op == (OP_LDP | DMA330_BURST) ||
+			        op == (OP_STP | DMA330_SINGLE) || op == (OP_STP | DMA330_BURST))
+			{
+				putStr(&t, ((op & ~3u) == OP_LDP ? "LDP" : "STP"));
+				putStr(&t, condSuffix(op));
+				putStr(&t, " ");
+				putDec(&t, in[1]>>3);
+			}
+			else if((op & 0xE8u) == OP_LPEND_FE && (op & 3u) != 2u)
+			{
+				// STP overlaps some of the forever encodings which is handled above.
+				putStr(&t, "LPEND");
+				putStr(&t, condSuffix(op));
+				putStr(&t, (op & BIT(4) ? (op & 4u ? " lc1" : " lc0") : " fe")); // nf bit.
+				putStr(&t, " @");
+				putHex(&t, pos - in[1], 4);
+			}
+			else if(op == (OP_WFP | DMA330_WFP_SINGLE) || op == (OP_WFP | DMA330_WFP_PERIPH) ||
+			        op == (OP_WFP | DMA330_WFP_BURST))
+			{
+				static const char *const types[3] = {", single", ", periph", ", burst"};
+				putStr(&t, "WFP ");
+				putDec(&t, in[1]>>3);
+				putStr(&t, types[op & 3u]);
+			}
+			else if(op == OP_SEV || op == OP_FLUSHP || op == OP_WFE)
+			{
+				putStr(&t, (op == OP_SEV ? "SEV " : (op == OP_FLUSHP ? "FLUSHP " : "WFE ")));
+				putDec(&t, in[1]>>3);
+			}
+			else if((op & ~2u) == OP_ADDH || (op & ~2u) == OP_ADNH)
+			{
+				instLen = 3;
+				if(avail < 3) return 0;
+				putStr(&t, ((op & ~2u) == OP_ADDH ? "ADDH " : "ADNH "));
+				putStr(&t, (op & 2u ? "DAR, " : "SAR, "));
+				putHex(&t, in[1] | (u32)in[2]<<8, 4);
+			}
+			else if(op == OP_MOV)
+			{
+				static const char *const regs[3] = {"MOV SAR, ", "MOV CCR, ", "MOV DAR, "};
+				instLen = 6;
+				if(avail < 6 || in[1] > DMA330_DAR) return 0;
+				const u32 val = in[2] | (u32)in[3]<<8 | (u32)in[4]<<16 | (u32)in[5]<<24;
+				putStr(&t, regs[in[1]]);
+				if(in[1] == DMA330_CCR) putCcr(&t, val);
+				else                    putHex(&t, val, 8);
+			}
+			else if((op & ~2u) == OP_GO)
+			{
+				instLen = 6;
+				if(avail < 6) return 0;
+				const u32 val = in[2] | (u32)in[3]<<8 | (u32)in[4]<<16 | (u32)in[5]<<24;
+				putStr(&t, (op & 2u ? "GO ns ch" : "GO ch"));
+				putDec(&t, in[1] & 7u);
+				putStr(&t, ", ");
+				putHex(&t, val, 8);
+			}
+			else
+			{
+				*out = '\0';
+				return 0;
+			}
+	}
+
+	return instLen;
+}
\ No newline at end of file
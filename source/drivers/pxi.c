@@ -16,6 +16,7 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "types.h"
 #include "drivers/pxi.h"
 #ifdef __ARM9__
@@ -25,11 +26,47 @@
 #endif // #ifdef __ARM9__
 #include "debug.h"
 #include "ipc_handler.h"
+#include "ipc_ring.h"
+#include "ipc_cache.h"
 #include "fb_assert.h"
-#include "drivers/cache.h"
+#ifdef __ARM11__
+#include "kernel.h"
+#include "kevent.h"
+#include "kmutex.h"
+#endif // #ifdef __ARM11__
 
 
-static vu32 g_lastResp[2] = {0};
+// Tags are made of the request slot in the low bits and a sequence
+// number above it so a stray response for a reused slot is caught.
+// Tag 0 is reserved for untagged commands from the fatal error/power off paths.
+#define TAG_SLOT_BITS  (2u)
+#define TAG_SEQ_MAX    (0xFFu>>TAG_SLOT_BITS)
+static_assert(PXI_MAX_PENDING == 1u<<TAG_SLOT_BITS);
+
+
+typedef struct
+{
+	vu32 cmd;       // Tagged command code while in flight. 0 if the slot is free.
+	vu32 res;
+	volatile bool done;
+#ifdef __ARM11__
+	KHandle event;  // Signaled when the response arrived.
+	IpcRingRec *rec; // Ring record if sent through the command ring.
+#endif // #ifdef __ARM11__
+} PxiRequest;
+
+static PxiRequest g_reqs[PXI_MAX_PENDING] = {0};
+static u32 g_tagSeq = 0;
+
+// The ring lives in ARM11 memory. Its address is sent to the ARM9 during the handshake.
+#ifdef __ARM11__
+alignas(IPC_RING_LINE_SIZE) static IpcRing g_ipcRing;
+static IpcRingProducer g_ringProd;
+static KHandle g_sendMutex = 0; // Serializes PXI_sendCmd() callers.
+static KHandle g_ringMutex = 0; // Serializes ring records from reserve to publish.
+#elif __ARM9__
+static IpcRingConsumer g_ringCons;
+#endif // #ifdef __ARM11__
 
 
 
@@ -41,6 +78,14 @@ static inline void sendWord(Pxi *const pxi, u32 word)
 	pxi->send = word;
 }
 
+#ifdef __ARM11__
+static void sendWordYield(Pxi *const pxi, u32 word)
+{
+	while(pxi->cnt & PXI_CNT_SEND_FULL) yieldTask();
+	pxi->send = word;
+}
+#endif // #ifdef __ARM11__
+
 static inline u32 recvWord(const Pxi *const pxi)
 {
 	while(pxi->cnt & PXI_CNT_RECV_EMPTY);
@@ -67,11 +112,22 @@ void PXI_init(void)
 #ifdef __ARM9__
 	sendWord(pxi, 0x99);
 	while(recvWord(pxi) != 0x11);
+	IPCRING_attach(&g_ringCons, (IpcRing*)recvWord(pxi));
 
 	IRQ_registerIsr(IRQ_PXI_SYNC, pxiIrqHandler);
 #elif __ARM11__
+	IPCRING_init(&g_ringProd, &g_ipcRing);
+
 	while(recvWord(pxi) != 0x99);
 	sendWord(pxi, 0x11);
+	sendWord(pxi, (u32)&g_ipcRing);
+
+	for(u32 i = 0; i < PXI_MAX_PENDING; i++)
+	{
+		if(g_reqs[i].event == 0) g_reqs[i].event = createEvent(true);
+	}
+	if(g_sendMutex == 0) g_sendMutex = createMutex();
+	if(g_ringMutex == 0) g_ringMutex = createMutex();
 
 	IRQ_registerIsr(IRQ_PXI_SYNC, 13, 0, pxiIrqHandler);
 #endif // #ifdef __ARM9__
@@ -84,74 +140,281 @@ void PXI_deinit(void)
 	pxi->sync = 0;
 }
 
+static void handleResponse(Pxi *const pxi, const u32 cmdCode)
+{
+	const u32 res = recvWord(pxi);
+	const u32 tag = IPC_CMD_TAG_MASK(cmdCode);
+	if(tag == 0) return; // Untagged commands are only sent by the fatal error paths.
+
+	PxiRequest *const req = &g_reqs[tag & (PXI_MAX_PENDING - 1)];
+	if(req->cmd != (cmdCode & ~IPC_CMD_RESP_FLAG)) panic();
+
+	req->res  = res;
+	req->done = true;
+#ifdef __ARM11__
+	signalEvent(req->event, false);
+#endif // #ifdef __ARM11__
+}
+
 static void pxiIrqHandler(UNUSED u32 id)
 {
 	Pxi *const pxi = getPxiRegs();
-	const u32 cmdCode = recvWord(pxi);
-	if(cmdCode & IPC_CMD_RESP_FLAG)
+
+	// Sync IRQs don't queue up. One IRQ may cover multiple messages
+	// and later IRQs may find the FIFO already empty.
+	while(!(pxi->cnt & PXI_CNT_RECV_EMPTY))
 	{
-		g_lastResp[0] = cmdCode;
-		g_lastResp[1] = recvWord(pxi);
-		return;
+		const u32 cmdCode = pxi->recv;
+		if(cmdCode & IPC_CMD_RESP_FLAG)
+		{
+			handleResponse(pxi, cmdCode);
+			continue;
+		}
+
+		const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmdCode);
+		const u32 recvBufs = IPC_CMD_RECV_BUFS_MASK(cmdCode);
+		const u32 params   = IPC_CMD_PARAMS_MASK(cmdCode);
+		const u32 words    = (sendBufs * 2) + (recvBufs * 2) + params;
+		if(words > IPC_MAX_PARAMS) panic();
+
+		u32 buf[IPC_MAX_PARAMS];
+		for(u32 i = 0; i < words; i++) buf[i] = recvWord(pxi);
+		if(getFifoError(pxi)) panic();
+
+		// The response carries the tag so the sender can match it to the request.
+		IPCCACHE_beforeHandle(cmdCode, buf, 0);
+		const u32 res = IPC_handleCmd(IPC_CMD_ID_MASK(cmdCode), sendBufs, recvBufs, buf);
+		IPCCACHE_afterHandle(cmdCode, buf, 0);
+		sendWord(pxi, IPC_CMD_RESP_FLAG | cmdCode);
+		sendWord(pxi, res);
+		sendSyncRequest(pxi);
 	}
 
-	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmdCode);
-	const u32 recvBufs = IPC_CMD_RECV_BUFS_MASK(cmdCode);
-	const u32 params   = IPC_CMD_PARAMS_MASK(cmdCode);
-	const u32 words    = (sendBufs * 2) + (recvBufs * 2) + params;
-	if(words > IPC_MAX_PARAMS) panic();
+#ifdef __ARM9__
+	// Ring commands. All queued records are handled in one go.
+	// The sync IRQ afterwards is only a doorbell. The result is in the record.
+	IpcRingRec *rec;
+	while((rec = IPCRING_next(&g_ringCons)) != NULL)
+	{
+		// Inline buffers are already up to date with the record.
+		const u32 cmd = rec->cmd;
+		const u32 *const params = IPCRING_params(rec);
+		IPCCACHE_beforeHandle(cmd, params, rec->inlineMask);
+		const u32 res = IPC_handleCmd(IPC_CMD_ID_MASK(cmd), IPC_CMD_SEND_BUFS_MASK(cmd),
+		                              IPC_CMD_RECV_BUFS_MASK(cmd), params);
+		IPCCACHE_afterHandle(cmd, params, rec->inlineMask);
+		IPCRING_complete(rec, res);
+		sendSyncRequest(pxi);
+	}
+#elif __ARM11__
+	// Ring command completions.
+	for(u32 i = 0; i < PXI_MAX_PENDING; i++)
+	{
+		PxiRequest *const req = &g_reqs[i];
+		if(req->rec != NULL && !req->done && IPCRING_isDone(req->rec))
+		{
+			req->res  = req->rec->res;
+			req->done = true;
+			signalEvent(req->event, false);
+		}
+	}
+#endif // #ifdef __ARM9__
+}
 
-	u32 buf[IPC_MAX_PARAMS];
-	for(u32 i = 0; i < words; i++) buf[i] = recvWord(pxi);
-	if(getFifoError(pxi)) panic();
+// Must be called with IRQs disabled.
+static PxiRequest* allocRequest(const u32 cmd)
+{
+	for(u32 i = 0; i < PXI_MAX_PENDING; i++)
+	{
+		PxiRequest *const req = &g_reqs[i];
+		if(req->cmd == 0)
+		{
+			u32 seq = g_tagSeq + 1;
+			if(seq > TAG_SEQ_MAX) seq = 1;
+			g_tagSeq = seq;
 
-	const u32 res = IPC_handleCmd(IPC_CMD_ID_MASK(cmdCode), sendBufs, recvBufs, buf);
-	sendWord(pxi, IPC_CMD_RESP_FLAG | cmdCode);
-	sendWord(pxi, res);
-	sendSyncRequest(pxi);
+			req->done = false;
+			req->cmd  = cmd | (seq<<TAG_SLOT_BITS | i)<<IPC_CMD_TAG_SHIFT;
+
+			return req;
+		}
+	}
+
+	return NULL;
+}
+
+static u32 waitForResponse(PxiRequest *const req)
+{
+#ifdef __ARM11__
+	// Tasks blocked here don't hold anything up. The IRQ handler wakes exactly this request.
+	if(waitForEvent(req->event) != KRES_OK) panic();
+#elif __ARM9__
+	while(1)
+	{
+		const u32 savedState = enterCriticalSection();
+		if(req->done)
+		{
+			leaveCriticalSection(savedState);
+			break;
+		}
+		__wfi(); // Wakes up on pending IRQs even with IRQs disabled.
+		leaveCriticalSection(savedState);
+	}
+#endif // #ifdef __ARM11__
+
+	const u32 res = req->res;
+#ifdef __ARM11__
+	req->rec = NULL;
+#endif // #ifdef __ARM11__
+	req->cmd = 0; // Free the slot.
+
+	return res;
 }
 
 u32 PXI_sendCmd(u32 cmd, const u32 *buf, u32 words)
 {
 	fb_assert(words <= IPC_MAX_PARAMS);
 
-	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmd);
-	const u32 recvBufs = IPC_CMD_RECV_BUFS_MASK(cmd);
-	for(u32 i = 0; i < sendBufs; i++)
-	{
-		const IpcBuffer *const sendBuf = (IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
-		if(sendBuf->ptr && sendBuf->size) cleanDCacheRange(sendBuf->ptr, sendBuf->size);
-	}
-	// Edge case:
-	// memset() 256 bytes string buffer, fRead() 256 bytes from 10 bytes file and fWrite() them to another
-	// file. The buffer will be filled with garbage where it wasn't overwritten because of the invalidate.
-	// TODO: Should we flush here instead?
-	for(u32 i = sendBufs; i < sendBufs + recvBufs; i++)
+	IPCCACHE_beforeSend(cmd, buf, 0);
+
+	// Only the request slot allocation runs with IRQs disabled.
+	PxiRequest *req;
+	while(1)
 	{
-		const IpcBuffer *const recvBuf = (IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
-		if(recvBuf->ptr && recvBuf->size) flushDCacheRange(recvBuf->ptr, recvBuf->size);
+		const u32 savedState = enterCriticalSection();
+		req = allocRequest(cmd);
+		leaveCriticalSection(savedState);
+		if(req != NULL) break;
+
+#ifdef __ARM11__
+		yieldTask();
+#elif __ARM9__
+		__wfi();
+#endif // #ifdef __ARM11__
 	}
 
+	// The whole command must be in the FIFO before anyone else can send.
+	// At most PXI_MAX_PENDING responses (2 words each) can be queued
+	// on our side which always fits into the receive FIFO.
 	Pxi *const pxi = getPxiRegs();
-	sendWord(pxi, cmd);
+#ifdef __ARM11__
+	// The ARM9 handles one command at a time including any storage
+	// access before it reads the next one. Sending can stall for that
+	// long so other tasks and IRQs keep running while the FIFO is full.
+	if(lockMutex(g_sendMutex) != KRES_OK) panic();
+	sendWordYield(pxi, req->cmd);
+	sendSyncRequest(pxi);
+	for(u32 i = 0; i < words; i++) sendWordYield(pxi, buf[i]);
+	if(getFifoError(pxi)) panic();
+	unlockMutex(g_sendMutex);
+#elif __ARM9__
+	// Our IRQ handler sends responses so it must not run in between.
+	// The ARM11 drains its receive FIFO from its IRQ handler right
+	// away so the busy waits here are short.
+	const u32 savedState = enterCriticalSection();
+	sendWord(pxi, req->cmd);
 	sendSyncRequest(pxi);
-
 	for(u32 i = 0; i < words; i++) sendWord(pxi, buf[i]);
 	if(getFifoError(pxi)) panic();
+	leaveCriticalSection(savedState);
+#endif // #ifdef __ARM11__
+
+	const u32 res = waitForResponse(req);
+
+	IPCCACHE_afterResponse(cmd, buf, 0);
 
-	while(g_lastResp[0] != (IPC_CMD_RESP_FLAG | cmd)) __wfi();
-	g_lastResp[0] = 0;
-	const u32 res = g_lastResp[1];
+	return res;
+}
 
 #ifdef __ARM11__
-	// The CPU may do speculative prefetches of data after the first invalidation
-	// so we need to do it again.
+u32 PXI_sendCmdRing(u32 cmd, const u32 *buf, u32 words)
+{
+	fb_assert(words <= IPC_RING_MAX_WORDS);
+
+	// Small buffers are copied into the record as long as it stays
+	// within IPC_RING_MAX_REC lines. The rest is passed by pointer.
+	// Receive buffers are copied in too so bytes the command doesn't write stay unchanged.
+	// Except output only buffers. Their old contents don't matter.
+	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmd);
+	const u32 recvBufs = IPC_CMD_RECV_BUFS_MASK(cmd);
+	u32 inlineMask = 0;
+	u32 inlineBytes = 0;
+	u32 inlineBufs = 0;
+	for(u32 i = 0; i < sendBufs + recvBufs; i++)
+	{
+		const IpcBuffer *const ipcBuf = (IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
+		if(ipcBuf->ptr == NULL || ipcBuf->size == 0) continue;
+
+		if(IPCRING_recLines(words, inlineBytes + ipcBuf->size, inlineBufs + 1) <= IPC_RING_MAX_REC)
+		{
+			inlineMask |= BIT(i);
+			inlineBytes += ipcBuf->size;
+			inlineBufs++;
+		}
+	}
+	IPCCACHE_beforeSend(cmd, buf, inlineMask);
+	const u32 lines = IPCRING_recLines(words, inlineBytes, inlineBufs);
+
+	// Records must be filled and published in the order they were reserved.
+	// Only the reservation and publishing run with IRQs disabled. The copies
+	// of up to IPC_RING_MAX_REC lines don't.
+	Pxi *const pxi = getPxiRegs();
+	if(lockMutex(g_ringMutex) != KRES_OK) panic();
+	PxiRequest *req;
+	IpcRingRec *rec = NULL;
+	while(1)
+	{
+		const u32 savedState = enterCriticalSection();
+		req = allocRequest(cmd);
+		if(req != NULL)
+		{
+			rec = IPCRING_reserve(&g_ringProd, lines);
+			if(rec == NULL) req->cmd = 0;
+		}
+		leaveCriticalSection(savedState);
+		if(req != NULL && rec != NULL) break;
+
+		yieldTask();
+	}
+
+	rec->cmd        = req->cmd;
+	rec->words      = words;
+	rec->inlineMask = inlineMask;
+	u32 *const params = IPCRING_params(rec);
+	memcpy(params, buf, words * 4);
+
+	// The ARM9 replaces the offsets in the record with pointers so keep our own copy.
+	u32 inlineOffs[6];
+	u8 *data = (u8*)params + ((words * 4 + IPC_RING_LINE_SIZE - 1) & ~(IPC_RING_LINE_SIZE - 1));
+	for(u32 i = 0; i < sendBufs + recvBufs; i++)
+	{
+		if(!(inlineMask & BIT(i))) continue;
+
+		IpcBuffer *const ipcBuf = (IpcBuffer*)&params[i * sizeof(IpcBuffer) / 4];
+		const void *const src = (IPC_CMD_OUT_BUFS_MASK(cmd) & BIT(i) ? NULL : ipcBuf->ptr);
+		inlineOffs[i] = IPCRING_putInline(&g_ringProd, data, src, ipcBuf->size);
+		ipcBuf->ptr = (void*)inlineOffs[i];
+		data += (ipcBuf->size + IPC_RING_LINE_SIZE - 1) & ~(IPC_RING_LINE_SIZE - 1);
+	}
+
+	const u32 savedState = enterCriticalSection();
+	req->rec = rec;
+	IPCRING_publish(&g_ringProd, rec);
+	sendSyncRequest(pxi);
+	leaveCriticalSection(savedState);
+	unlockMutex(g_ringMutex);
+
+	const u32 res = waitForResponse(req);
+
+	// The record stays valid until it's released.
+	IPCCACHE_afterResponse(cmd, buf, inlineMask);
 	for(u32 i = sendBufs; i < sendBufs + recvBufs; i++)
 	{
 		const IpcBuffer *const recvBuf = (IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
-		if(recvBuf->ptr && recvBuf->size) invalidateDCacheRange(recvBuf->ptr, recvBuf->size);
+		if(inlineMask & BIT(i)) memcpy(recvBuf->ptr, IPCRING_inlinePtr(&g_ringProd, inlineOffs[i]), recvBuf->size);
 	}
-#endif // #ifdef __ARM11__
+	IPCRING_release(rec);
 
 	return res;
-}
\ No newline at end of file
+}
+#endif // #ifdef __ARM11__
\ No newline at end of file
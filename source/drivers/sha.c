@@ -16,23 +16,88 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "drivers/sha.h"
+#include "sha_sw.h"
 #include "memory.h"
+#ifdef __ARM11__
+#include "kernel.h"
+#endif // #ifdef __ARM11__
+
+
+// Engine owners. Sessions (ShaCtx, sha_auto() and sha_dma()) release the
+// engine themselves. SHA_finish() only releases a claim made by SHA_start().
+#define OWNER_NONE     (0u)
+#define OWNER_SESSION  (1u)
+#define OWNER_LEGACY   (2u) // SHA_start() to SHA_finish().
+
+
+// Set while someone uses the engine.
+static au8 g_shaInUse = OWNER_NONE;
 
 
 
 void SHA_getState(u32 *const out);
 
+static bool tryClaimEngine(const u8 owner)
+{
+#ifdef __ARM11__
+	u8 expected = OWNER_NONE;
+	return atomic_compare_exchange_strong_explicit(&g_shaInUse, &expected, owner,
+	                                               memory_order_acquire, memory_order_relaxed);
+#elif __ARM9__
+	// Relaxed load/store + signal fence prevents atomic library calls.
+	// Good enough for the single core ARM9.
+	if(atomic_load_explicit(&g_shaInUse, memory_order_relaxed) != OWNER_NONE) return false;
+	atomic_store_explicit(&g_shaInUse, owner, memory_order_relaxed);
+	atomic_signal_fence(memory_order_acquire);
+	return true;
+#endif // #ifdef __ARM11__
+}
+
+static void releaseEngine(void)
+{
+#ifdef __ARM11__
+	atomic_store_explicit(&g_shaInUse, OWNER_NONE, memory_order_release);
+#elif __ARM9__
+	atomic_signal_fence(memory_order_release);
+	atomic_store_explicit(&g_shaInUse, OWNER_NONE, memory_order_relaxed);
+#endif // #ifdef __ARM11__
+}
+
+// Waits until no one else uses the engine.
+static void acquireEngine(const u8 owner)
+{
+#ifdef __ARM11__
+	while(!tryClaimEngine(owner)) yieldTask();
+#elif __ARM9__
+	// Single core. Nobody can hold the engine across our calls.
+	atomic_signal_fence(memory_order_release);
+	atomic_store_explicit(&g_shaInUse, owner, memory_order_relaxed);
+	atomic_signal_fence(memory_order_acquire);
+#endif // #ifdef __ARM11__
+}
+
 ALWAYS_INLINE void waitBusy(const Sha *const sha)
 {
 	while(sha->cnt & SHA_EN);
 }
 
-void SHA_start(u16 params)
+static void startEngine(u16 params)
 {
 	getShaRegs()->cnt = params | SHA_EN;
 }
 
+bool SHA_start(u16 params)
+{
+	// Never wait here. A caller which doesn't call SHA_finish() would
+	// otherwise block every later SHA_start().
+	if(!tryClaimEngine(OWNER_LEGACY)) return false;
+
+	startEngine(params);
+	return true;
+}
+
 // TODO: If we call this with less than 64 bytes first and then with
 //       64 bytes the FIFO triggers a data abort (busy).
 void SHA_update(const u32 *data, u32 size)
@@ -54,7 +119,7 @@ void SHA_update(const u32 *data, u32 size)
 	}
 }
 
-void SHA_finish(u32 *const hash, u16 endianess)
+static void finishEngine(u32 *const hash, u16 endianess)
 {
 	Sha *const sha = getShaRegs();
 	sha->cnt = (sha->cnt & SHA_MODE_MASK) | endianess | SHA_FINAL_ROUND;
@@ -63,6 +128,23 @@ void SHA_finish(u32 *const hash, u16 endianess)
 	SHA_getState(hash);
 }
 
+// Hashes with the CPU feeding the FIFO. For when DMA can't be used.
+// The caller must own the engine.
+static void hashPio(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
+{
+	startEngine(params);
+	SHA_update(data, size);
+	finishEngine(hash, hashEndianess);
+}
+
+void SHA_finish(u32 *const hash, u16 endianess)
+{
+	finishEngine(hash, endianess);
+
+	// Never release a session's claim.
+	if(atomic_load_explicit(&g_shaInUse, memory_order_relaxed) == OWNER_LEGACY) releaseEngine();
+}
+
 void SHA_getState(u32 *const out)
 {
 	Sha *const sha = getShaRegs();
@@ -83,77 +165,241 @@ void SHA_getState(u32 *const out)
 	copy32(out, (u32*)sha->hash, size);
 }
 
+void SHA_saveContext(ShaEngineCtx *const ctx)
+{
+	Sha *const sha = getShaRegs();
+	waitBusy(sha);
+
+	copy32(ctx->hash, (u32*)sha->hash, sizeof(ctx->hash));
+	ctx->blkcnt = sha->blkcnt;
+	ctx->cnt    = sha->cnt & (SHA_MODE_MASK | SHA_IN_BIG);
+}
+
+void SHA_restoreContext(const ShaEngineCtx *const ctx)
+{
+	// Starting resets the state to the initial hash.
+	// The hash and block count registers are writable so we can overwrite it
+	// before the first FIFO write. Same endianess as on save so the words round trip.
+	Sha *const sha = getShaRegs();
+	startEngine(ctx->cnt);
+	waitBusy(sha);
+	copy32((u32*)sha->hash, ctx->hash, sizeof(ctx->hash));
+	sha->blkcnt = ctx->blkcnt;
+}
+
+// Sends whole blocks to the engine.
+static void feedBlocks(ShaCtx *const ctx, const u8 *data, u32 size)
+{
+	if(((uintptr_t)data & 3u) == 0)
+	{
+		SHA_update((const u32*)data, size);
+		return;
+	}
+
+	// The FIFO needs word accesses. Bounce unaligned input through the block buffer.
+	for(; size > 0; size -= 64, data += 64)
+	{
+		memcpy(ctx->block, data, 64);
+		SHA_update((const u32*)ctx->block, 64);
+	}
+}
+
+static void beginSession(ShaCtx *const ctx)
+{
+	acquireEngine(OWNER_SESSION);
+	if(ctx->started) SHA_restoreContext(&ctx->engine);
+	else             startEngine(ctx->params);
+}
+
+void SHA_ctxInit(ShaCtx *const ctx, u16 params)
+{
+	ctx->used    = 0;
+	ctx->started = false;
+	ctx->params  = params & (SHA_MODE_MASK | SHA_IN_BIG);
+}
+
+void SHA_ctxUpdate(ShaCtx *const ctx, const void *data, u32 size)
+{
+	const u8 *in = (const u8*)data;
+	u32 used = ctx->used;
+
+	// Small updates only fill the partial block.
+	if(used + size < 64)
+	{
+		memcpy(&ctx->block[used], in, size);
+		ctx->used = used + size;
+		return;
+	}
+
+	beginSession(ctx);
+
+	if(used > 0)
+	{
+		const u32 fill = 64 - used;
+		memcpy(&ctx->block[used], in, fill);
+		SHA_update((const u32*)ctx->block, 64);
+		in += fill;
+		size -= fill;
+	}
+
+	const u32 whole = size & ~63u;
+	if(whole > 0) feedBlocks(ctx, in, whole);
+
+	SHA_saveContext(&ctx->engine);
+	ctx->started = true;
+	releaseEngine();
+
+	// Keep the rest for the next update.
+	size -= whole;
+	memcpy(ctx->block, in + whole, size);
+	ctx->used = size;
+}
+
+void SHA_ctxFinish(ShaCtx *const ctx, u32 *const hash, u16 endianess)
+{
+	beginSession(ctx);
+	if(ctx->used > 0) SHA_update((const u32*)ctx->block, ctx->used);
+	finishEngine(hash, endianess);
+	releaseEngine();
+
+	ctx->used    = 0;
+	ctx->started = false;
+}
+
 void sha(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
 {
-	SHA_start(params);
+	if(!SHA_start(params))
+	{
+		sha_sw(data, size, hash, params, hashEndianess);
+		return;
+	}
+
 	SHA_update(data, size);
 	SHA_finish(hash, hashEndianess);
 }
 
+void sha_auto(const void *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
+{
+	// The FIFO needs word aligned input and setting up the engine
+	// costs more than hashing a single block on the CPU.
+	if(size >= SHA_HW_MIN_SIZE && ((uintptr_t)data & 3u) == 0 && tryClaimEngine(OWNER_SESSION))
+	{
+		hashPio((const u32*)data, size, hash, params, hashEndianess);
+		releaseEngine();
+		return;
+	}
+
+	sha_sw(data, size, hash, params, hashEndianess);
+}
+
 #ifdef __ARM11__
-// Note: The FIFO is 64 bit capable but 64 bit is slower than 32 bit.
-/*SHA CDMA test prog:
-# 4 bytes burst with 16 transfers. Total 64 bytes per burst.
-# Source incrementing and destination fixed.
-# Source and destination unprivileged, non-secure data access.
-MOV CCR, SB16 SS32 SAI SP2 DB16 DS32 DAF DP2
-MOV SAR, 0xDEADBEEF
-MOV DAR, 0x10301000
-
-FLUSHP 11
-
-
-LP 8 # 128 KiB
-	LP 256 # 16 KiB
-		LD
-		WFP 11, burst
-		STPB 11
-	LPEND
-LPEND
-WMB
-SEV 1
-END
 
-void sha_dma(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
+#include "drivers/corelink_dma-330.h"
+#include "drivers/corelink_dma-330_asm.h"
+#include "drivers/cache.h"
+#include "arm11/drivers/cdma.h"
+
+
+#define SHA_DMA_PERIPH  (11u)
+
+// Each full loop nest (4 MiB) takes 13 bytes of program.
+// Inputs of more than about 70 MiB don't fit and are hashed by the CPU.
+alignas(32) static u8 g_shaDmaProg[256];
+static u8 g_shaDmaCh = CDMA_NO_CHANNEL;
+
+
+
+// One 64 bytes burst from memory into the FIFO.
+static void emitShaBurst(Dma330Asm *const a, UNUSED void *arg)
 {
-	IRQ_registerIsr(IRQ_CDMA_EVENT1, 14, 0, blah); // TODO: Move this elsewhere.
+	DMA330_asmLd(a, DMA330_ALWAYS);
+	DMA330_asmWfp(a, DMA330_WFP_BURST, SHA_DMA_PERIPH);
+	DMA330_asmStp(a, DMA330_BURST, SHA_DMA_PERIPH);
+}
 
-	// TODO: DMA JIT.
+static u32 buildShaDmaProg(const u32 *const data, const u32 blocks, const u8 ch)
+{
+	// Note: The FIFO is 64 bit capable but 64 bit is slower than 32 bit.
+	// 4 bytes burst with 16 transfers. Total 64 bytes per burst.
+	// Source incrementing and destination fixed.
+	// Source and destination unprivileged, non-secure data access.
+	Dma330Asm a;
+	DMA330_asmInit(&a, g_shaDmaProg, sizeof(g_shaDmaProg));
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_LEN(16) | CCR_SRC_BURST_SIZE(2) | CCR_SRC_INC | CCR_SRC_PROT_CTRL(2) |
+	                              CCR_DST_BURST_LEN(16) | CCR_DST_BURST_SIZE(2) | CCR_DST_PROT_CTRL(2));
+	DMA330_asmMov(&a, DMA330_SAR, (u32)data);
+	DMA330_asmMov(&a, DMA330_DAR, (u32)getShaFifo(getShaRegs()));
+	DMA330_asmFlushp(&a, SHA_DMA_PERIPH);
+	DMA330_asmRepeat(&a, blocks, emitShaBurst, NULL);
+	DMA330_asmWmb(&a);
+	DMA330_asmSev(&a, ch);
 
-	SHA_start(params | SHA_I_DMA_EN);
-	do
-	{
-		__wfi();
-	} while(DMA330_status(1)); // TODO: Use events.
-	while(sha->cnt & SHA_EN);
-	SHA_finish(hash, hashEndianess);
-}*/
+	return DMA330_asmEnd(&a);
+}
+
+// Feeds all data to the engine using DMA. Returns false if DMA could
+// not be used. The engine must be owned and is restarted either way.
+static bool hashDma(const u32 *data, u32 size, u16 params)
+{
+	// The channel and program buffer are protected by the engine ownership.
+	// The channel is kept once allocated.
+	if(g_shaDmaCh == CDMA_NO_CHANNEL) g_shaDmaCh = CDMA_allocChannel();
+	const u32 blocks = size / 64;
+	if(g_shaDmaCh == CDMA_NO_CHANNEL || blocks == 0 || buildShaDmaProg(data, blocks, g_shaDmaCh) == 0)
+		return false; // No channel, nothing to DMA or the program didn't fit.
+	flushDCacheRange(g_shaDmaProg, sizeof(g_shaDmaProg));
+	cleanDCacheRange(data, blocks * 64);
+
+	startEngine(params | SHA_I_DMA_EN);
+	CdmaFence fence;
+	if(CDMA_run(g_shaDmaCh, g_shaDmaProg, &fence) != RES_OK) return false; // Channel busy.
+	if(CDMA_fenceWait(&fence) != RES_OK) return false; // The channel faulted and has been killed.
+
+	// The last partial block is written by the CPU.
+	Sha *const sha = getShaRegs();
+	waitBusy(sha);
+	sha->cnt &= ~SHA_I_DMA_EN;
+	if(size % 64 != 0) SHA_update(data + blocks * 16, size % 64);
+
+	return true;
+}
+
+void sha_dma(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
+{
+	acquireEngine(OWNER_SESSION);
+	if(hashDma(data, size, params)) finishEngine(hash, hashEndianess);
+	else                            hashPio(data, size, hash, params, hashEndianess); // Start over with the CPU.
+	releaseEngine();
+}
 
 #elif __ARM9__
 
 #include "arm9/drivers/ndma.h"
-#include "arm9/drivers/interrupt.h"
 void sha_dma(const u32 *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
 {
 	// Note: XDMA is quite a bit faster.
-	NdmaCh *const ndmaCh = getNdmaChRegs(2);
-	ndmaCh->sad  = (u32)data;
-	ndmaCh->dad  = (u32)getShaFifo(getShaRegs());
-	ndmaCh->tcnt = size / 4;
-	ndmaCh->wcnt = 64 / 4;
-	ndmaCh->bcnt = NDMA_FASTEST;
-	ndmaCh->cnt  = NDMA_EN | NDMA_IRQ_EN | NDMA_START_SHA_IN | NDMA_TCNT_MODE |
-	               NDMA_BURST(64 / 4) | NDMA_SAD_INC | NDMA_DAD_FIX;
-
-	SHA_start(params | SHA_I_DMA_EN);
-	do
+	static u8 ch = NDMA_NO_CHANNEL;
+	if(ch == NDMA_NO_CHANNEL) ch = NDMA_allocChannel();
+	if(ch == NDMA_NO_CHANNEL)
 	{
-		__wfi();
-	} while(ndmaCh->cnt & NDMA_EN);
+		// All channels in use. Hash on the CPU instead.
+		acquireEngine(OWNER_SESSION);
+		hashPio(data, size, hash, params, hashEndianess);
+		releaseEngine();
+		return;
+	}
 
-	// NDMA hardware bug workaround.
-	(void)*((const vu8*)data);
+	acquireEngine(OWNER_SESSION);
+	NdmaDesc desc;
+	NDMA_descStartup(&desc, NDMA_START_SHA_IN, NDMA_SAD_INC | NDMA_DAD_FIX,
+	                 (u32)getShaFifo(getShaRegs()), (u32)data, size, 64);
+	NDMA_submit(ch, &desc, NULL, NULL);
 
-	SHA_finish(hash, hashEndianess);
+	// The IRQ handler does the NDMA hardware bug workaround.
+	startEngine(params | SHA_I_DMA_EN);
+	NDMA_wait(ch);
+
+	finishEngine(hash, hashEndianess);
+	releaseEngine();
 }
 #endif // #ifdef __ARM11__
@@ -56,7 +56,13 @@ const char* result2String(Result res)
 		"FatFs invalid parameter",
 
 		// Lgy errors.
-		"Invalid GBA RTC time/date"
+		"Invalid GBA RTC time/date",
+
+		// DMA errors.
+		"DMA bus error",
+		"DMA program error",
+		"DMA security violation",
+		"DMA channel lockup"
 	};
 
 	return (res <= MAX_LIBN3DS_RES_VALUE ? resultStrings[res] : NULL);
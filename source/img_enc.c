@@ -0,0 +1,412 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "img_enc.h"
+
+
+#define WINDOW_MASK    (IMGENC_WINDOW_SIZE * 2 - 1)
+#define MIN_MATCH      (3u)
+#define MAX_MATCH      (258u)
+#define ADLER_MOD      (65521u)
+#define ADLER_NMAX     (5552u) // Max bytes before the sums must be reduced.
+
+
+static const u32 g_crcNibble[16] =
+{
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// Fixed Huffman codes with the bits reversed because deflate
+// stores them MSB first in a LSB first bit stream.
+static u16 g_litCodes[288];
+static u8 g_distCodes[30];
+
+
+
+static u32 reverseBits(u32 code, u32 len)
+{
+	u32 res = 0;
+	while(len-- > 0)
+	{
+		res = res<<1 | (code & 1u);
+		code >>= 1;
+	}
+
+	return res;
+}
+
+static void initFixedCodes(void)
+{
+	if(g_litCodes[0] != 0) return;
+
+	for(u32 i = 0; i < 288; i++)
+	{
+		u16 code;
+		if(i < 144)      code = reverseBits(0x30 + i, 8);
+		else if(i < 256) code = reverseBits(0x190 + i - 144, 9);
+		else if(i < 280) code = reverseBits(i - 256, 7);
+		else             code = reverseBits(0xC0 + i - 280, 8);
+		g_litCodes[i] = code;
+	}
+	for(u32 i = 0; i < 30; i++) g_distCodes[i] = reverseBits(i, 5);
+}
+
+static inline u32 litCodeLen(const u32 sym)
+{
+	if(sym < 144) return 8;
+	if(sym < 256) return 9;
+	if(sym < 280) return 7;
+	return 8;
+}
+
+static u32 crc32(u32 crc, const u8 *data, u32 size)
+{
+	crc = ~crc;
+	while(size-- > 0)
+	{
+		crc ^= *data++;
+		crc = g_crcNibble[crc & 0xFu] ^ crc>>4;
+		crc = g_crcNibble[crc & 0xFu] ^ crc>>4;
+	}
+
+	return ~crc;
+}
+
+static u32 adler32(const u32 adler, const u8 *data, u32 size)
+{
+	u32 s1 = adler & 0xFFFFu;
+	u32 s2 = adler>>16;
+	while(size > 0)
+	{
+		u32 blockSize = (size < ADLER_NMAX ? size : ADLER_NMAX);
+		size -= blockSize;
+		while(blockSize-- > 0)
+		{
+			s1 += *data++;
+			s2 += s1;
+		}
+		s1 %= ADLER_MOD;
+		s2 %= ADLER_MOD;
+	}
+
+	return s2<<16 | s1;
+}
+
+static inline void put32BE(u8 *const p, const u32 val)
+{
+	p[0] = val>>24;
+	p[1] = val>>16;
+	p[2] = val>>8;
+	p[3] = val;
+}
+
+static inline void put32LE(u8 *const p, const u32 val)
+{
+	p[0] = val;
+	p[1] = val>>8;
+	p[2] = val>>16;
+	p[3] = val>>24;
+}
+
+static void sink(ImgEnc *const enc, const void *const buf, const u32 size)
+{
+	if(enc->res == RES_OK) enc->res = enc->write(enc->arg, buf, size);
+}
+
+// Writes out all buffered data. PNG data is wrapped in an IDAT chunk.
+static void flushOut(ImgEnc *const enc)
+{
+	const u32 size = enc->outPos;
+	if(size == 0) return;
+	enc->outPos = 0;
+
+	if(enc->fmt == IMGENC_PNG)
+	{
+		u8 *const out = enc->out;
+		put32BE(out, size);
+		memcpy(&out[4], "IDAT", 4);
+		put32BE(&out[8 + size], crc32(0, &out[4], 4 + size));
+		sink(enc, out, 8 + size + 4);
+	}
+	else sink(enc, &enc->out[8], size);
+}
+
+static inline void emitByte(ImgEnc *const enc, const u8 b)
+{
+	enc->out[8 + enc->outPos++] = b;
+	if(enc->outPos == IMGENC_CHUNK_SIZE) flushOut(enc);
+}
+
+static void emitBytes(ImgEnc *const enc, const u8 *data, u32 size)
+{
+	while(size > 0)
+	{
+		u32 n = IMGENC_CHUNK_SIZE - enc->outPos;
+		if(n > size) n = size;
+		memcpy(&enc->out[8 + enc->outPos], data, n);
+		enc->outPos += n;
+		data += n;
+		size -= n;
+		if(enc->outPos == IMGENC_CHUNK_SIZE) flushOut(enc);
+	}
+}
+
+static inline void putBits(ImgEnc *const enc, const u32 bits, const u32 num)
+{
+	u32 bitBuf = enc->bitBuf | bits<<enc->bitCnt;
+	u32 bitCnt = enc->bitCnt + num;
+	while(bitCnt >= 8)
+	{
+		emitByte(enc, bitBuf);
+		bitBuf >>= 8;
+		bitCnt -= 8;
+	}
+	enc->bitBuf = bitBuf;
+	enc->bitCnt = bitCnt;
+}
+
+static inline void putLiteral(ImgEnc *const enc, const u32 sym)
+{
+	putBits(enc, g_litCodes[sym], litCodeLen(sym));
+}
+
+static void putMatch(ImgEnc *const enc, const u32 len, const u32 dist)
+{
+	// Length code 257-285.
+	if(len == MAX_MATCH) putLiteral(enc, 285);
+	else
+	{
+		const u32 m = len - MIN_MATCH;
+		if(m < 8) putLiteral(enc, 257 + m);
+		else
+		{
+			const u32 n = 31 - __builtin_clz(m);
+			putLiteral(enc, 257 + 4 * (n - 1) + (m>>(n - 2) & 3u));
+			putBits(enc, m & (BIT(n - 2) - 1), n - 2);
+		}
+	}
+
+	// Distance code 0-29.
+	const u32 d = dist - 1;
+	if(d < 4) putBits(enc, g_distCodes[d], 5);
+	else
+	{
+		const u32 n = 31 - __builtin_clz(d);
+		putBits(enc, g_distCodes[2 * n + (d>>(n - 1) & 1u)], 5);
+		putBits(enc, d & (BIT(n - 1) - 1), n - 1);
+	}
+}
+
+static inline u32 hash3(const u8 *const win, const u32 pos)
+{
+	const u32 v = (u32)win[pos & WINDOW_MASK]<<16 | (u32)win[(pos + 1) & WINDOW_MASK]<<8 | win[(pos + 2) & WINDOW_MASK];
+	return (v * 2654435761u)>>(32 - IMGENC_HASH_BITS);
+}
+
+// Greedy LZ77 with a single hash candidate per position. Matches never reach past
+// the data fed so far which keeps the output independent of the caller's buffering
+// as long as the same rows come in.
+static void deflateData(ImgEnc *const enc, const u8 *data, u32 size)
+{
+	enc->adler = adler32(enc->adler, data, size);
+
+	u8 *const win = enc->window;
+	u32 *const hash = enc->hash;
+	while(size > 0)
+	{
+		u32 n = (size < IMGENC_WINDOW_SIZE ? size : IMGENC_WINDOW_SIZE);
+		u32 p = enc->pos;
+		const u32 end = p + n;
+		for(u32 i = 0; i < n; i++) win[(p + i) & WINDOW_MASK] = data[i];
+		data += n;
+		size -= n;
+
+		while(p < end)
+		{
+			const u32 avail = end - p;
+			u32 len = 0;
+			u32 cand = 0;
+			if(avail >= MIN_MATCH)
+			{
+				const u32 h = hash3(win, p);
+				cand = hash[h];
+				hash[h] = p;
+
+				// Entries start out as 0 which is fine because the bytes are compared anyway.
+				if(cand < p && p - cand <= IMGENC_WINDOW_SIZE)
+				{
+					const u32 maxLen = (avail < MAX_MATCH ? avail : MAX_MATCH);
+					while(len < maxLen && win[(cand + len) & WINDOW_MASK] == win[(p + len) & WINDOW_MASK]) len++;
+				}
+			}
+
+			if(len >= MIN_MATCH)
+			{
+				putMatch(enc, len, p - cand);
+				for(u32 i = 1; i < len && end - (p + i) >= MIN_MATCH; i++) hash[hash3(win, p + i)] = p + i;
+				p += len;
+			}
+			else
+			{
+				putLiteral(enc, win[p & WINDOW_MASK]);
+				p++;
+			}
+		}
+
+		enc->pos = end;
+	}
+}
+
+static void writePngChunk(ImgEnc *const enc, const char *const type, const u8 *const data, const u32 size)
+{
+	// Only used for the small header chunks.
+	u8 buf[8 + 13 + 4];
+	put32BE(buf, size);
+	memcpy(&buf[4], type, 4);
+	if(size > 0) memcpy(&buf[8], data, size);
+	put32BE(&buf[8 + size], crc32(0, &buf[4], 4 + size));
+	sink(enc, buf, 8 + size + 4);
+}
+
+static void startBmp(ImgEnc *const enc)
+{
+	const u32 imageSize = ((enc->width * 3 + 3) & ~3u) * enc->height;
+	u8 hdr[54] = {'B', 'M'};
+	put32LE(&hdr[2], sizeof(hdr) + imageSize);
+	put32LE(&hdr[10], sizeof(hdr));       // Pixel data offset.
+	put32LE(&hdr[14], 40);                // BITMAPINFOHEADER size.
+	put32LE(&hdr[18], enc->width);
+	put32LE(&hdr[22], -enc->height);      // Negative height means rows are stored top to bottom.
+	hdr[26] = 1;                          // Planes.
+	hdr[28] = 24;                         // Bits per pixel.
+	put32LE(&hdr[34], imageSize);
+	put32LE(&hdr[38], 2835);              // 72 DPI.
+	put32LE(&hdr[42], 2835);
+	sink(enc, hdr, sizeof(hdr));
+}
+
+static void startPng(ImgEnc *const enc)
+{
+	static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	sink(enc, signature, sizeof(signature));
+
+	u8 ihdr[13];
+	put32BE(&ihdr[0], enc->width);
+	put32BE(&ihdr[4], enc->height);
+	ihdr[8]  = 8; // Bit depth.
+	ihdr[9]  = 2; // Color type RGB.
+	ihdr[10] = 0; // Deflate.
+	ihdr[11] = 0; // Adaptive filtering.
+	ihdr[12] = 0; // No interlace.
+	writePngChunk(enc, "IHDR", ihdr, sizeof(ihdr));
+
+	// zlib header followed by one final block with fixed Huffman codes.
+	initFixedCodes();
+	memset(enc->hash, 0, sizeof(enc->hash));
+	enc->bitBuf = 0;
+	enc->bitCnt = 0;
+	enc->adler  = 1;
+	enc->pos    = 0;
+	emitByte(enc, 0x78);
+	emitByte(enc, 0x01);
+	putBits(enc, 3, 3); // BFINAL = 1, BTYPE = 1.
+}
+
+Result IMGENC_start(ImgEnc *const enc, const ImgEncFmt fmt, const u32 width, const u32 height,
+                    ImgEncWriteCb write, void *const arg)
+{
+	if(fmt > IMGENC_PNG || width == 0 || width > IMGENC_MAX_WIDTH || height == 0 || height > 0x7FFFFFFFu / (width * 3 + 4) || write == NULL)
+		return RES_INVALID_ARG;
+
+	enc->write    = write;
+	enc->arg      = arg;
+	enc->res      = RES_OK;
+	enc->fmt      = fmt;
+	enc->width    = width;
+	enc->height   = height;
+	enc->rowsLeft = height;
+	enc->outPos   = 0;
+
+	if(fmt == IMGENC_PNG) startPng(enc);
+	else                  startBmp(enc);
+
+	return enc->res;
+}
+
+Result IMGENC_writeRows(ImgEnc *const enc, const u8 *rows, const u32 stride, u32 num)
+{
+	if(enc->res != RES_OK) return enc->res;
+	if(num > enc->rowsLeft) return RES_INVALID_ARG;
+	enc->rowsLeft -= num;
+
+	const u32 rowSize = enc->width * 3;
+	u8 *const row = enc->row;
+	for(; num > 0 && enc->res == RES_OK; num--)
+	{
+		if(enc->fmt == IMGENC_PNG)
+		{
+			// Filter type 1 (sub). Also swaps BGR to RGB.
+			row[0] = 1;
+			row[1] = rows[2];
+			row[2] = rows[1];
+			row[3] = rows[0];
+			for(u32 i = 3; i < rowSize; i += 3)
+			{
+				row[1 + i]     = rows[i + 2] - rows[i - 1];
+				row[1 + i + 1] = rows[i + 1] - rows[i - 2];
+				row[1 + i + 2] = rows[i]     - rows[i - 3];
+			}
+			deflateData(enc, row, 1 + rowSize);
+		}
+		else
+		{
+			static const u8 pad[3] = {0};
+			emitBytes(enc, rows, rowSize);
+			emitBytes(enc, pad, -rowSize & 3u);
+		}
+
+		rows += stride;
+	}
+
+	return enc->res;
+}
+
+Result IMGENC_finish(ImgEnc *const enc)
+{
+	if(enc->res != RES_OK) return enc->res;
+	if(enc->rowsLeft != 0) return RES_INVALID_ARG;
+
+	if(enc->fmt == IMGENC_PNG)
+	{
+		putLiteral(enc, 256);             // End of block.
+		putBits(enc, 0, -enc->bitCnt & 7u); // Pad to a byte boundary.
+
+		u8 adler[4];
+		put32BE(adler, enc->adler);
+		emitBytes(enc, adler, sizeof(adler));
+		flushOut(enc);
+
+		writePngChunk(enc, "IEND", NULL, 0);
+	}
+	else flushOut(enc);
+
+	return enc->res;
+}
\ No newline at end of file
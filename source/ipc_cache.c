@@ -0,0 +1,94 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "ipc_cache.h"
+#include "ipc_handler.h"
+#include "drivers/cache.h"
+
+
+
+static inline const IpcBuffer* getBuf(const u32 *const buf, const u32 i)
+{
+	return (const IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
+}
+
+void IPCCACHE_beforeSend(const u32 cmd, const u32 *const buf, const u32 skipMask)
+{
+	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmd);
+	const u32 bufs     = sendBufs + IPC_CMD_RECV_BUFS_MASK(cmd);
+	const u32 outMask  = IPC_CMD_OUT_BUFS_MASK(cmd);
+	for(u32 i = 0; i < bufs; i++)
+	{
+		const IpcBuffer *const ipcBuf = getBuf(buf, i);
+		if(ipcBuf->ptr == NULL || ipcBuf->size == 0 || (skipMask & BIT(i))) continue;
+
+		if(i < sendBufs)          cleanDCacheRange(ipcBuf->ptr, ipcBuf->size);
+		// Old contents are overwritten anyway. Only partial lines are written back.
+		else if(outMask & BIT(i)) invalidateDCacheRange(ipcBuf->ptr, ipcBuf->size);
+		// Bytes the remote side doesn't write must survive so dirty lines are written back.
+		// Invalidating here would lose them.
+		else                      flushDCacheRange(ipcBuf->ptr, ipcBuf->size);
+	}
+}
+
+void IPCCACHE_afterResponse(UNUSED const u32 cmd, UNUSED const u32 *const buf, UNUSED const u32 skipMask)
+{
+#ifdef __ARM11__
+	// The CPU may do speculative prefetches of data after the first invalidation
+	// so we need to do it again.
+	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmd);
+	const u32 bufs     = sendBufs + IPC_CMD_RECV_BUFS_MASK(cmd);
+	for(u32 i = sendBufs; i < bufs; i++)
+	{
+		const IpcBuffer *const ipcBuf = getBuf(buf, i);
+		if(ipcBuf->ptr == NULL || ipcBuf->size == 0 || (skipMask & BIT(i))) continue;
+
+		invalidateDCacheRange(ipcBuf->ptr, ipcBuf->size);
+	}
+#endif // #ifdef __ARM11__
+}
+
+void IPCCACHE_beforeHandle(const u32 cmd, const u32 *const buf, const u32 skipMask)
+{
+	// Drop stale lines of everything we are going to touch. Writes to receive buffers
+	// must not hit lines cached by an earlier command or the bytes around
+	// them would be written back with stale data.
+	const u32 bufs = IPC_CMD_SEND_BUFS_MASK(cmd) + IPC_CMD_RECV_BUFS_MASK(cmd);
+	for(u32 i = 0; i < bufs; i++)
+	{
+		const IpcBuffer *const ipcBuf = getBuf(buf, i);
+		if(ipcBuf->ptr == NULL || ipcBuf->size == 0 || (skipMask & BIT(i))) continue;
+
+		invalidateDCacheRange(ipcBuf->ptr, ipcBuf->size);
+	}
+}
+
+void IPCCACHE_afterHandle(const u32 cmd, const u32 *const buf, const u32 skipMask)
+{
+	// Flush instead of clean. Keeps lines of the other side's memory out of our cache.
+	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmd);
+	const u32 bufs     = sendBufs + IPC_CMD_RECV_BUFS_MASK(cmd);
+	for(u32 i = sendBufs; i < bufs; i++)
+	{
+		const IpcBuffer *const ipcBuf = getBuf(buf, i);
+		if(ipcBuf->ptr == NULL || ipcBuf->size == 0 || (skipMask & BIT(i))) continue;
+
+		flushDCacheRange(ipcBuf->ptr, ipcBuf->size);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "ipc_ring.h"
+#include "ipc_handler.h"
+#include "drivers/cache.h"
+
+
+static_assert((IPC_RING_LINES & (IPC_RING_LINES - 1)) == 0);
+static_assert(IPC_RING_MAX_REC <= IPC_RING_LINES / 2);
+
+
+
+static inline IpcRingRec* recAt(IpcRing *const ring, const u32 pos)
+{
+	return (IpcRingRec*)&ring->data[(pos % IPC_RING_LINES) * IPC_RING_LINE_SIZE];
+}
+
+void IPCRING_init(IpcRingProducer *const prod, IpcRing *const ring)
+{
+	prod->ring = ring;
+	prod->head = 0;
+	prod->tail = 0;
+
+	memset(ring, 0, sizeof(IpcRing));
+	cleanDCacheRange(ring, sizeof(IpcRing));
+}
+
+// Frees released records in order. Never passes the consumer so padding
+// records are only reused after the consumer skipped them.
+static void reclaim(IpcRingProducer *const prod)
+{
+	IpcRing *const ring = prod->ring;
+	invalidateDCacheRange((const void*)&ring->readPos, IPC_RING_LINE_SIZE);
+	const u32 readPos = ring->readPos;
+
+	u32 tail = prod->tail;
+	while(tail != prod->head && tail != readPos)
+	{
+		const IpcRingRec *const rec = recAt(ring, tail);
+		if(rec->cmd != 0 && !rec->released) break;
+		tail += rec->lines;
+	}
+	prod->tail = tail;
+}
+
+IpcRingRec* IPCRING_reserve(IpcRingProducer *const prod, const u32 lines)
+{
+	if(lines < 2 || lines > IPC_RING_MAX_REC) return NULL;
+
+	const u32 idx = prod->head % IPC_RING_LINES;
+	const u32 pad = (idx + lines > IPC_RING_LINES ? IPC_RING_LINES - idx : 0);
+	if(prod->head + pad + lines - prod->tail > IPC_RING_LINES)
+	{
+		reclaim(prod);
+		if(prod->head + pad + lines - prod->tail > IPC_RING_LINES) return NULL;
+	}
+
+	// Padding is published together with the record.
+	if(pad > 0)
+	{
+		IpcRingRec *const padRec = recAt(prod->ring, prod->head);
+		memset(padRec, 0, sizeof(IpcRingRec));
+		padRec->lines = pad;
+		prod->head += pad;
+	}
+
+	IpcRingRec *const rec = recAt(prod->ring, prod->head);
+	memset(rec, 0, sizeof(IpcRingRec));
+	rec->lines = lines;
+
+	return rec;
+}
+
+u32 IPCRING_putInline(const IpcRingProducer *const prod, void *const dst, const void *const src, const u32 size)
+{
+	if(src != NULL) memcpy(dst, src, size);
+	return (u32)((u8*)dst - prod->ring->data);
+}
+
+void IPCRING_publish(IpcRingProducer *const prod, IpcRingRec *const rec)
+{
+	IpcRing *const ring = prod->ring;
+	const u32 start = prod->head;
+	prod->head = start + rec->lines;
+
+	// Padding sits right before the record at the end of the ring.
+	// The consumer only reads its header line.
+	if((start % IPC_RING_LINES) == 0 && ring->head != start)
+		cleanDCacheRange(recAt(ring, ring->head), IPC_RING_LINE_SIZE);
+	cleanDCacheRange(rec, rec->lines * IPC_RING_LINE_SIZE);
+
+	// The record must be in memory before the consumer can see the new head.
+	ring->head = prod->head;
+	cleanDCacheRange((const void*)&ring->head, IPC_RING_LINE_SIZE);
+}
+
+bool IPCRING_isDone(IpcRingRec *const rec)
+{
+	// The consumer writes the header line last. Once done is set
+	// the rest of the record can be invalidated safely.
+	invalidateDCacheRange(rec, IPC_RING_LINE_SIZE);
+	if(!rec->done) return false;
+
+	invalidateDCacheRange(rec + 1, (rec->lines - 1) * IPC_RING_LINE_SIZE);
+	return true;
+}
+
+void* IPCRING_inlinePtr(const IpcRingProducer *const prod, const u32 off)
+{
+	return &prod->ring->data[off];
+}
+
+void IPCRING_release(IpcRingRec *const rec)
+{
+	// Producer private. The consumer never writes this line again.
+	rec->released = 1;
+}
+
+void IPCRING_attach(IpcRingConsumer *const cons, IpcRing *const ring)
+{
+	cons->ring    = ring;
+	cons->readPos = 0;
+}
+
+IpcRingRec* IPCRING_next(IpcRingConsumer *const cons)
+{
+	IpcRing *const ring = cons->ring;
+	invalidateDCacheRange((const void*)&ring->head, IPC_RING_LINE_SIZE);
+
+	while(cons->readPos != ring->head)
+	{
+		IpcRingRec *const rec = recAt(ring, cons->readPos);
+		invalidateDCacheRange(rec, IPC_RING_LINE_SIZE);
+		const u32 lines = rec->lines;
+		cons->readPos += lines;
+
+		// Let the producer know how far we are.
+		ring->readPos = cons->readPos;
+		cleanDCacheRange((const void*)&ring->readPos, IPC_RING_LINE_SIZE);
+
+		if(rec->cmd == 0) continue; // Padding.
+
+		invalidateDCacheRange(rec + 1, (lines - 1) * IPC_RING_LINE_SIZE);
+		u32 *const params = IPCRING_params(rec);
+		const u32 bufs = IPC_CMD_SEND_BUFS_MASK(rec->cmd) + IPC_CMD_RECV_BUFS_MASK(rec->cmd);
+		for(u32 i = 0; i < bufs; i++)
+		{
+			IpcBuffer *const buf = (IpcBuffer*)&params[i * sizeof(IpcBuffer) / 4];
+			if(rec->inlineMask & BIT(i)) buf->ptr = &ring->data[(u32)buf->ptr];
+		}
+
+		return rec;
+	}
+
+	return NULL;
+}
+
+void IPCRING_complete(IpcRingRec *const rec, const u32 res)
+{
+	// Output data first, the header line with the done flag last.
+	cleanDCacheRange(rec + 1, (rec->lines - 1) * IPC_RING_LINE_SIZE);
+	rec->res  = res;
+	rec->done = 1;
+	cleanDCacheRange(rec, IPC_RING_LINE_SIZE);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "types.h"
+#include "memory.h"
+
+
+// Kept deliberately simple. These define the expected results
+// for the optimized versions and are not meant to be fast.
+
+void copyMemRef(void *restrict dst, const void *restrict src, u32 size)
+{
+	u8 *restrict d = (u8*)dst;
+	const u8 *restrict s = (const u8*)src;
+	while(size-- > 0) *d++ = *s++;
+}
+
+void moveMemRef(void *dst, const void *src, u32 size)
+{
+	u8 *d = (u8*)dst;
+	const u8 *s = (const u8*)src;
+	if(d == s || size == 0) return;
+
+	// Copy backwards if dst overlaps the end of src.
+	if((uintptr_t)d - (uintptr_t)s >= size)
+	{
+		while(size-- > 0) *d++ = *s++;
+	}
+	else
+	{
+		d += size;
+		s += size;
+		while(size-- > 0) *--d = *--s;
+	}
+}
+
+void fillMemRef(void *ptr, const u8 value, u32 size)
+{
+	u8 *p = (u8*)ptr;
+	while(size-- > 0) *p++ = value;
+}
+
+int compareMemRef(const void *a, const void *b, u32 size)
+{
+	const u8 *pa = (const u8*)a;
+	const u8 *pb = (const u8*)b;
+	for(u32 i = 0; i < size; i++)
+	{
+		if(pa[i] != pb[i]) return (int)pa[i] - pb[i];
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,269 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "pixel_conv.h"
+#ifdef __ARM11__
+#include "arm_intrinsic.h"
+#endif
+
+
+// All conversions go through RGBA8 (r in the lowest byte, see G2D_RGBA()).
+// Channels are converted 2 at a time in 16 bit lanes. The rgb_conv.h
+// formulas never exceed 16 bits for valid inputs so the lanes can't overflow.
+
+#define NUM_FMTS  (5u)
+
+
+// Red and blue of an RGBA8 color in the low bytes of 2 halfword lanes.
+static inline u32 lanesRB(const u32 c)
+{
+#ifdef __ARM11__
+	return __uxtb16(c);
+#else
+	return c & 0x00FF00FFu;
+#endif
+}
+
+// Green and alpha of an RGBA8 color in the low bytes of 2 halfword lanes.
+static inline u32 lanesGA(const u32 c)
+{
+#ifdef __ARM11__
+	u32 res;
+	__asm__("uxtb16 %0, %1, ror #8" : "=r" (res) : "r" (c) : );
+	return res;
+#else
+	return c>>8 & 0x00FF00FFu;
+#endif
+}
+
+// Same as rgbFive2Eight(), rgbSix2Eight() and rgbFour2Eight() for 2 lanes.
+static inline u32 lanesFive2Eight(const u32 l) { return (527 * l + 0x00170017u)>>6 & 0x00FF00FFu; }
+static inline u32 lanesSix2Eight(const u32 l)  { return (259 * l + 0x00210021u)>>6 & 0x00FF00FFu; }
+static inline u32 lanesFour2Eight(const u32 l) { return 17 * l; }
+
+// Same as rgbEight2Five(), rgbEight2Six() and rgbEight2Four() for 2 lanes.
+static inline u32 lanesEight2Five(const u32 l) { return (249 * l + 0x04000400u)>>11 & 0x001F001Fu; }
+static inline u32 lanesEight2Six(const u32 l)  { return (253 * l + 0x02000200u)>>10 & 0x003F003Fu; }
+static inline u32 lanesEight2Four(const u32 l) { return (15 * l + 0x00870087u)>>8 & 0x000F000Fu; }
+
+// Raw pixel to RGBA8.
+ALWAYS_INLINE u32 decode(const GfxFmt fmt, const u32 px)
+{
+	u32 rb, ga;
+	switch(fmt)
+	{
+		case GFX_ABGR8:
+			return __builtin_bswap32(px);
+		case GFX_BGR8:
+			return __builtin_bswap32(px<<8) | 0xFF000000u;
+		case GFX_BGR565:
+			rb = lanesFive2Eight(px>>11 | (px & 0x1Fu)<<16);
+			ga = lanesSix2Eight(px>>5 & 0x3Fu) | 0x00FF0000u;
+			break;
+		case GFX_A1BGR5:
+			rb = lanesFive2Eight(px>>11 | (px>>1 & 0x1Fu)<<16);
+			ga = lanesFive2Eight(px>>6 & 0x1Fu) | (px & 1u ? 0x00FF0000u : 0u);
+			break;
+		default: // GFX_ABGR4.
+			rb = lanesFour2Eight(px>>12 | (px>>4 & 0xFu)<<16);
+			ga = lanesFour2Eight((px>>8 & 0xFu) | (px & 0xFu)<<16);
+	}
+
+	return rb | ga<<8;
+}
+
+// RGBA8 to raw pixel.
+ALWAYS_INLINE u32 encode(const GfxFmt fmt, const u32 c)
+{
+	u32 rb, ga;
+	switch(fmt)
+	{
+		case GFX_ABGR8:
+			return __builtin_bswap32(c);
+		case GFX_BGR8:
+			return __builtin_bswap32(c)>>8;
+		case GFX_BGR565:
+			rb = lanesEight2Five(lanesRB(c));
+			return (rb & 0x1Fu)<<11 | lanesEight2Six(c>>8 & 0xFFu)<<5 | rb>>16;
+		case GFX_A1BGR5:
+			rb = lanesEight2Five(lanesRB(c));
+			return (rb & 0x1Fu)<<11 | lanesEight2Five(c>>8 & 0xFFu)<<6 | (rb>>16)<<1 | c>>31;
+		default: // GFX_ABGR4.
+			rb = lanesEight2Four(lanesRB(c));
+			ga = lanesEight2Four(lanesGA(c));
+			return (rb & 0xFu)<<12 | (ga & 0xFu)<<8 | (rb>>16)<<4 | ga>>16;
+	}
+}
+
+ALWAYS_INLINE u32 convert(const GfxFmt dstFmt, const GfxFmt srcFmt, const u32 px)
+{
+	if(dstFmt == srcFmt) return px;
+	return encode(dstFmt, decode(srcFmt, px));
+}
+
+ALWAYS_INLINE u32 loadPixel(const u8 *const p, const GfxFmt fmt)
+{
+	if(fmt == GFX_ABGR8) return p[0] | p[1]<<8 | p[2]<<16 | (u32)p[3]<<24;
+	if(fmt == GFX_BGR8)  return p[0] | p[1]<<8 | p[2]<<16;
+	return p[0] | p[1]<<8;
+}
+
+ALWAYS_INLINE void storePixel(u8 *const p, const GfxFmt fmt, const u32 px)
+{
+	p[0] = px;
+	p[1] = px>>8;
+	if(fmt == GFX_BGR565 || fmt == GFX_A1BGR5 || fmt == GFX_ABGR4) return;
+	p[2] = px>>16;
+	if(fmt == GFX_ABGR8) p[3] = px>>24;
+}
+
+// Loads 4 pixels from a word aligned address.
+ALWAYS_INLINE void load4(const u32 *const p, const GfxFmt fmt, u32 px[4])
+{
+	if(fmt == GFX_ABGR8)
+	{
+		px[0] = p[0];
+		px[1] = p[1];
+		px[2] = p[2];
+		px[3] = p[3];
+	}
+	else if(fmt == GFX_BGR8)
+	{
+		const u32 w0 = p[0], w1 = p[1], w2 = p[2];
+		px[0] = w0 & 0xFFFFFFu;
+		px[1] = (w0>>24 | w1<<8) & 0xFFFFFFu;
+		px[2] = (w1>>16 | w2<<16) & 0xFFFFFFu;
+		px[3] = w2>>8;
+	}
+	else
+	{
+		const u32 w0 = p[0], w1 = p[1];
+		px[0] = w0 & 0xFFFFu;
+		px[1] = w0>>16;
+		px[2] = w1 & 0xFFFFu;
+		px[3] = w1>>16;
+	}
+}
+
+// Stores 4 pixels to a word aligned address.
+ALWAYS_INLINE void store4(u32 *const p, const GfxFmt fmt, const u32 px[4])
+{
+	if(fmt == GFX_ABGR8)
+	{
+		p[0] = px[0];
+		p[1] = px[1];
+		p[2] = px[2];
+		p[3] = px[3];
+	}
+	else if(fmt == GFX_BGR8)
+	{
+		p[0] = px[0] | px[1]<<24;
+		p[1] = px[1]>>8 | px[2]<<16;
+		p[2] = px[2]>>16 | px[3]<<8;
+	}
+	else
+	{
+		p[0] = px[0] | px[1]<<16;
+		p[1] = px[2] | px[3]<<16;
+	}
+}
+
+// One conversion loop per format pair. The switch below instantiates them
+// so all the format checks above are resolved at compile time.
+ALWAYS_INLINE void convertLoop(u8 *dst, const GfxFmt dstFmt, const u32 dstStep, const u8 *src,
+                               const GfxFmt srcFmt, const u32 srcStep, u32 count)
+{
+	const u32 dstSize = GFX_getPixelSize(dstFmt);
+	const u32 srcSize = GFX_getPixelSize(srcFmt);
+
+	// 4 pixels are always a whole number of words.
+	if(dstStep == dstSize && srcStep == srcSize && (((uintptr_t)dst | (uintptr_t)src) & 3u) == 0)
+	{
+		for(; count >= 4; count -= 4)
+		{
+			u32 px[4];
+			load4((const u32*)src, srcFmt, px);
+			px[0] = convert(dstFmt, srcFmt, px[0]);
+			px[1] = convert(dstFmt, srcFmt, px[1]);
+			px[2] = convert(dstFmt, srcFmt, px[2]);
+			px[3] = convert(dstFmt, srcFmt, px[3]);
+			store4((u32*)dst, dstFmt, px);
+
+			src += 4 * srcSize;
+			dst += 4 * dstSize;
+		}
+	}
+
+	for(; count > 0; count--)
+	{
+		storePixel(dst, dstFmt, convert(dstFmt, srcFmt, loadPixel(src, srcFmt)));
+		src += srcStep;
+		dst += dstStep;
+	}
+}
+
+#define CONV_CASE(d, s)                                                   \
+	case (d) * NUM_FMTS + (s):                                            \
+		convertLoop(dst, (d), dstStep, src, (s), srcStep, count); break;
+
+#define CONV_CASES(d)                                                     \
+	CONV_CASE(d, GFX_ABGR8) CONV_CASE(d, GFX_BGR8) CONV_CASE(d, GFX_BGR565) \
+	CONV_CASE(d, GFX_A1BGR5) CONV_CASE(d, GFX_ABGR4)
+
+static void convertStrided(u8 *const dst, const GfxFmt dstFmt, const u32 dstStep, const u8 *const src,
+                           const GfxFmt srcFmt, const u32 srcStep, const u32 count)
+{
+	switch(dstFmt * NUM_FMTS + srcFmt)
+	{
+		CONV_CASES(GFX_ABGR8)
+		CONV_CASES(GFX_BGR8)
+		CONV_CASES(GFX_BGR565)
+		CONV_CASES(GFX_A1BGR5)
+		CONV_CASES(GFX_ABGR4)
+		default:
+			break;
+	}
+}
+
+void convertPixels(void *dst, const GfxFmt dstFmt, const void *src, const GfxFmt srcFmt, u32 count)
+{
+	if(dstFmt == srcFmt)
+	{
+		if(dst != src) memmove(dst, src, count * GFX_getPixelSize(dstFmt));
+		return;
+	}
+
+	convertStrided(dst, dstFmt, GFX_getPixelSize(dstFmt), src, srcFmt, GFX_getPixelSize(srcFmt), count);
+}
+
+void convertPixelsRotated(void *dst, const GfxFmt dstFmt, const u32 dstStride, const void *fb, const GfxFmt fbFmt,
+                          const u32 width, const u32 height, const u32 y, const u32 rows)
+{
+	// A row of the upright image is a strided walk over all columns.
+	const u32 fbSize = GFX_getPixelSize(fbFmt);
+	const u32 colStride = height * fbSize;
+	u8 *d = (u8*)dst;
+	for(u32 row = y; row < y + rows; row++)
+	{
+		const u8 *const s = (const u8*)fb + (height - 1 - row) * fbSize;
+		convertStrided(d, dstFmt, GFX_getPixelSize(dstFmt), s, fbFmt, colStride, width);
+		d += dstStride;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,325 @@
+/*
+ *   This file is part of libn3ds
+ *   Copyright (C) 2024 derrek, profi200
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "types.h"
+#include "sha_sw.h"
+#include "drivers/sha.h"
+
+
+#define ROR(x, n)  ((x)>>(n) | (x)<<(32 - (n)))
+#define ROL(x, n)  ((x)<<(n) | (x)>>(32 - (n)))
+
+
+static const u32 g_sha256K[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static const u32 g_sha256Init[8] =
+{
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const u32 g_sha224Init[8] =
+{
+	0xC1059ED8, 0x367CD507, 0x3070DD17, 0xF70E5939, 0xFFC00B31, 0x68581511, 0x64F98FA7, 0xBEFA4FA4
+};
+
+static const u32 g_sha1Init[5] =
+{
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+
+
+static inline u32 loadWord(const u8 *const p, const bool swap)
+{
+	u32 w;
+	memcpy(&w, p, 4); // Unaligned safe. Compiles to a single load on ARM11.
+	return (swap ? __builtin_bswap32(w) : w);
+}
+
+// Big endian message words unless the input is in little endian mode.
+static inline void loadBlock(u32 w[16], const u8 *const block, const bool bigInput)
+{
+	for(u32 i = 0; i < 16; i++) w[i] = loadWord(&block[i * 4], bigInput);
+}
+
+static inline u32 hashSize(const u16 mode)
+{
+	switch(mode)
+	{
+		case SHA_256_MODE:
+			return 32;
+		case SHA_224_MODE:
+			return 28;
+		case SHA_1_MODE:
+		default:           // 2 and 3 SHA1.
+			return 20;
+	}
+}
+
+
+
+#define S256_0(x)     (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define S256_1(x)     (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define s256_0(x)     (ROR(x, 7) ^ ROR(x, 18) ^ ((x)>>3))
+#define s256_1(x)     (ROR(x, 17) ^ ROR(x, 19) ^ ((x)>>10))
+#define CH(x, y, z)   ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z)  (((x) & (y)) | ((z) & ((x) | (y))))
+
+// Message schedule in a 16 word ring.
+#define SCHED256(w, i)  (w[(i) & 15] += s256_1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + s256_0(w[((i) - 15) & 15]))
+
+static void sha256Blocks(u32 state[8], const u8 *data, u32 blocks, const bool bigInput)
+{
+	u32 w[16];
+	do
+	{
+		loadBlock(w, data, bigInput);
+		u32 a = state[0], b = state[1], c = state[2], d = state[3];
+		u32 e = state[4], f = state[5], g = state[6], h = state[7];
+
+#ifdef __ARM11__
+		// 8 rounds per iteration with the variables rotating by name instead
+		// of being moved. Keeps everything in registers on ARM11.
+#define R256(a, b, c, d, e, f, g, h, i, wi)                        \
+		{                                                          \
+			const u32 t = h + S256_1(e) + CH(e, f, g) + g_sha256K[i] + (wi); \
+			d += t;                                                \
+			h = t + S256_0(a) + MAJ(a, b, c);                      \
+		}
+#define R256_8(i, W)                       \
+		R256(a, b, c, d, e, f, g, h, i + 0, W(i + 0)) \
+		R256(h, a, b, c, d, e, f, g, i + 1, W(i + 1)) \
+		R256(g, h, a, b, c, d, e, f, i + 2, W(i + 2)) \
+		R256(f, g, h, a, b, c, d, e, i + 3, W(i + 3)) \
+		R256(e, f, g, h, a, b, c, d, i + 4, W(i + 4)) \
+		R256(d, e, f, g, h, a, b, c, i + 5, W(i + 5)) \
+		R256(c, d, e, f, g, h, a, b, i + 6, W(i + 6)) \
+		R256(b, c, d, e, f, g, h, a, i + 7, W(i + 7))
+#define W_PLAIN(i)  w[(i) & 15]
+#define W_SCHED(i)  SCHED256(w, i)
+
+		R256_8(0, W_PLAIN)
+		R256_8(8, W_PLAIN)
+		for(u32 i = 16; i < 64; i += 8)
+		{
+			R256_8(i, W_SCHED)
+		}
+
+#undef W_SCHED
+#undef W_PLAIN
+#undef R256_8
+#undef R256
+#else
+		// Compact variant for the ARM9.
+		for(u32 i = 0; i < 64; i++)
+		{
+			const u32 wi = (i < 16 ? w[i] : SCHED256(w, i));
+			const u32 t1 = h + S256_1(e) + CH(e, f, g) + g_sha256K[i] + wi;
+			const u32 t2 = S256_0(a) + MAJ(a, b, c);
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+#endif // #ifdef __ARM11__
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		data += 64;
+	} while(--blocks > 0);
+}
+
+#define F1(b, c, d)  CH(b, c, d)
+#define F2(b, c, d)  ((b) ^ (c) ^ (d))
+#define F3(b, c, d)  MAJ(b, c, d)
+#define SCHED1(w, i)  (w[(i) & 15] = ROL(w[((i) - 3) & 15] ^ w[((i) - 8) & 15] ^ w[((i) - 14) & 15] ^ w[(i) & 15], 1))
+
+static void sha1Blocks(u32 state[8], const u8 *data, u32 blocks, const bool bigInput)
+{
+	u32 w[16];
+	do
+	{
+		loadBlock(w, data, bigInput);
+		u32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+#ifdef __ARM11__
+#define R1(a, b, c, d, e, F, k, wi)                         \
+		{                                                   \
+			e += ROL(a, 5) + F(b, c, d) + (k) + (wi);       \
+			b = ROL(b, 30);                                 \
+		}
+#define R1_5(i, F, k, W)                      \
+		R1(a, b, c, d, e, F, k, W(i + 0))     \
+		R1(e, a, b, c, d, F, k, W(i + 1))     \
+		R1(d, e, a, b, c, F, k, W(i + 2))     \
+		R1(c, d, e, a, b, F, k, W(i + 3))     \
+		R1(b, c, d, e, a, F, k, W(i + 4))
+#define W_PLAIN(i)  w[(i) & 15]
+#define W_SCHED(i)  SCHED1(w, i)
+
+		R1_5(0, F1, 0x5A827999, W_PLAIN)
+		R1_5(5, F1, 0x5A827999, W_PLAIN)
+		R1_5(10, F1, 0x5A827999, W_PLAIN)
+		R1(a, b, c, d, e, F1, 0x5A827999, w[15])
+		R1(e, a, b, c, d, F1, 0x5A827999, W_SCHED(16))
+		R1(d, e, a, b, c, F1, 0x5A827999, W_SCHED(17))
+		R1(c, d, e, a, b, F1, 0x5A827999, W_SCHED(18))
+		R1(b, c, d, e, a, F1, 0x5A827999, W_SCHED(19))
+		for(u32 i = 20; i < 40; i += 5) { R1_5(i, F2, 0x6ED9EBA1, W_SCHED) }
+		for(u32 i = 40; i < 60; i += 5) { R1_5(i, F3, 0x8F1BBCDC, W_SCHED) }
+		for(u32 i = 60; i < 80; i += 5) { R1_5(i, F2, 0xCA62C1D6, W_SCHED) }
+
+#undef W_SCHED
+#undef W_PLAIN
+#undef R1_5
+#undef R1
+#else
+		for(u32 i = 0; i < 80; i++)
+		{
+			const u32 wi = (i < 16 ? w[i] : SCHED1(w, i));
+			u32 f, k;
+			if(i < 20)      { f = F1(b, c, d); k = 0x5A827999; }
+			else if(i < 40) { f = F2(b, c, d); k = 0x6ED9EBA1; }
+			else if(i < 60) { f = F3(b, c, d); k = 0x8F1BBCDC; }
+			else            { f = F2(b, c, d); k = 0xCA62C1D6; }
+
+			const u32 t = ROL(a, 5) + f + e + k + wi;
+			e = d; d = c; c = ROL(b, 30); b = a; a = t;
+		}
+#endif // #ifdef __ARM11__
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+		data += 64;
+	} while(--blocks > 0);
+}
+
+static inline void processBlocks(ShaSwState *const st, const u8 *const data, const u32 blocks, const bool bigInput)
+{
+	if((st->params & SHA_MODE_MASK) >= SHA_1_MODE) sha1Blocks(st->state, data, blocks, bigInput);
+	else                                            sha256Blocks(st->state, data, blocks, bigInput);
+}
+
+
+
+void SHA_swStart(ShaSwState *const st, u16 params)
+{
+	const u16 mode = params & SHA_MODE_MASK;
+	const u32 *init = g_sha256Init;
+	u32 words = 8;
+	if(mode == SHA_224_MODE) init = g_sha224Init;
+	else if(mode >= SHA_1_MODE)
+	{
+		init = g_sha1Init;
+		words = 5;
+	}
+
+	memcpy(st->state, init, words * 4);
+	st->length = 0;
+	st->params = params & (SHA_MODE_MASK | SHA_IN_BIG);
+}
+
+void SHA_swUpdate(ShaSwState *const st, const void *data, u32 size)
+{
+	const u8 *in = (const u8*)data;
+	const bool bigInput = (st->params & SHA_IN_BIG) != 0;
+	u32 used = st->length % 64;
+	st->length += size;
+
+	// Top up a partial block first.
+	if(used > 0)
+	{
+		const u32 fill = (size < 64 - used ? size : 64 - used);
+		memcpy(&st->block[used], in, fill);
+		in += fill;
+		size -= fill;
+		used += fill;
+		if(used < 64) return;
+
+		processBlocks(st, st->block, 1, bigInput);
+	}
+
+	// Whole blocks straight from the input.
+	const u32 blocks = size / 64;
+	if(blocks > 0)
+	{
+		processBlocks(st, in, blocks, bigInput);
+		in += blocks * 64;
+		size %= 64;
+	}
+
+	if(size > 0) memcpy(st->block, in, size);
+}
+
+void SHA_swFinish(ShaSwState *const st, u32 *const hash, u16 endianess)
+{
+	u8 *const block = st->block;
+	u32 used = st->length % 64;
+
+	// Padding is in message byte order. Undo the input word swap for
+	// the buffered data so the last block(s) can be hashed as big endian.
+	if(!(st->params & SHA_IN_BIG))
+	{
+		for(u32 i = 0; i + 4 <= used; i += 4)
+		{
+			const u32 w = loadWord(&block[i], true);
+			memcpy(&block[i], &w, 4);
+		}
+	}
+
+	block[used++] = 0x80;
+	if(used > 56)
+	{
+		memset(&block[used], 0, 64 - used);
+		processBlocks(st, block, 1, true);
+		used = 0;
+	}
+	memset(&block[used], 0, 56 - used);
+
+	const u64 bits = st->length * 8;
+	const u32 lenHi = __builtin_bswap32(bits>>32);
+	const u32 lenLo = __builtin_bswap32(bits);
+	memcpy(&block[56], &lenHi, 4);
+	memcpy(&block[60], &lenLo, 4);
+	processBlocks(st, block, 1, true);
+
+	// SHA_OUT_BIG gives the usual byte order. Otherwise native words like the hardware.
+	const u32 size = hashSize(st->params & SHA_MODE_MASK);
+	const bool bigOutput = (endianess & SHA_OUT_BIG) != 0;
+	for(u32 i = 0; i < size / 4; i++)
+	{
+		const u32 w = st->state[i];
+		hash[i] = (bigOutput ? __builtin_bswap32(w) : w);
+	}
+}
+
+void sha_sw(const void *data, u32 size, u32 *const hash, u16 params, u16 hashEndianess)
+{
+	ShaSwState st;
+	SHA_swStart(&st, params);
+	SHA_swUpdate(&st, data, size);
+	SHA_swFinish(&st, hash, hashEndianess);
+}
\ No newline at end of file
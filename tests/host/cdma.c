@@ -0,0 +1,246 @@
+#include <string.h>
+#include "test.h"
+#include "dma330_sim.h"
+#include "arm11/drivers/cdma.h"
+#include "drivers/corelink_dma-330.h"
+#include "drivers/cache.h"
+#include "arm11/drivers/interrupt.h"
+#include "kevent.h"
+
+
+// The driver passes addresses as u32 so this test is linked without PIE
+// and all buffers are static.
+#define BUF_SIZE  (5u * 1024 * 1024)
+
+
+static IrqIsr g_isrs[128];
+static const u8 *g_running[CDMA_CHANNELS]; // Started but not executed programs.
+static u32 g_faulting = 0;
+static u32 g_kills = 0;
+static u8 g_src[BUF_SIZE + 64];
+static u8 g_dst[BUF_SIZE + 64];
+
+
+
+KHandle createEvent(bool oneShot)
+{
+	static KHandle next = 1;
+	return next++;
+}
+
+void signalEvent(KHandle const kevent, bool reschedule)
+{
+}
+
+void clearEvent(KHandle const kevent)
+{
+}
+
+static void runChannels(void);
+
+// The "hardware" finishes all started programs while the CPU waits.
+KRes waitForEvent(KHandle const kevent)
+{
+	runChannels();
+	return 0;
+}
+
+void IRQ_registerIsr(const Interrupt id, const u32 prio, u32 target, const IrqIsr isr)
+{
+	g_isrs[id] = isr;
+}
+
+void IRQ_unregisterIsr(const Interrupt id)
+{
+	g_isrs[id] = NULL;
+}
+
+void cleanDCacheRange(const void *base, size_t size)
+{
+}
+
+void flushDCacheRange(const void *base, size_t size)
+{
+}
+
+u8 DMA330_run(u8 ch, const u8 *const prog)
+{
+	if(g_running[ch] != NULL) return CSR_STAT_EXECUTING;
+
+	g_running[ch] = prog;
+	return CSR_STAT_STOPPED;
+}
+
+void DMA330_ackIrq(u8 eventIrq)
+{
+}
+
+void DMA330_kill(u8 ch)
+{
+	g_running[ch] = NULL;
+	g_faulting &= ~BIT(ch);
+	g_kills++;
+}
+
+u32 DMA330_faultingChannels(void)
+{
+	return g_faulting;
+}
+
+u32 DMA330_faultType(u8 ch)
+{
+	return BIT(31); // Lockup.
+}
+
+Result DMA330_fault2Res(u32 ftr)
+{
+	return RES_DMA_LOCKUP;
+}
+
+u32 DMA330_recoverManager(void)
+{
+	return 0;
+}
+
+
+static u8* simMem(const u32 addr, const bool write)
+{
+	return (addr != 0 ? (u8*)(uintptr_t)addr : NULL);
+}
+
+static void runChannels(void)
+{
+	for(u32 ch = 0; ch < CDMA_CHANNELS; ch++)
+	{
+		const u8 *const prog = g_running[ch];
+		if(prog == NULL) continue;
+
+		Dma330Sim s;
+		dma330SimInit(&s, simMem, 0, 0);
+		const bool ok = dma330SimRun(&s, prog, CDMA_PROG_SIZE);
+		TEST_CHECK(ok && s.sevMask == BIT(ch));
+		g_running[ch] = NULL;
+		g_isrs[IRQ_CDMA_EVENT0 + ch](IRQ_CDMA_EVENT0 + ch);
+	}
+}
+
+static void testAlloc(void)
+{
+	// The LgyCap channels are never handed out.
+	for(u32 ch = 2; ch < CDMA_CHANNELS; ch++) TEST_CHECK(CDMA_allocChannel() == ch);
+	TEST_CHECK(CDMA_allocChannel() == CDMA_NO_CHANNEL);
+	TEST_CHECK(g_isrs[IRQ_CDMA_EVENT7] != NULL && g_isrs[IRQ_CDMA_FAULT] != NULL);
+
+	CDMA_freeChannel(4);
+	TEST_CHECK(g_isrs[IRQ_CDMA_EVENT4] == NULL);
+	TEST_CHECK(CDMA_copy(4, g_dst, g_src, 4, NULL) == RES_INVALID_ARG);
+	TEST_CHECK(CDMA_allocChannel() == 4);
+
+	CDMA_freeChannel(CDMA_CH_LGYCAP0);
+	TEST_CHECK(CDMA_copy(CDMA_CH_LGYCAP0, g_dst, g_src, 4, NULL) == RES_INVALID_ARG);
+	TEST_CHECK(CDMA_copy(CDMA_NO_CHANNEL, g_dst, g_src, 4, NULL) == RES_INVALID_ARG);
+	for(u32 ch = 3; ch < CDMA_CHANNELS; ch++) CDMA_freeChannel(ch);
+}
+
+static void testCopyFill(const u8 ch)
+{
+	for(u32 it = 0; it < 300; it++)
+	{
+		// Sizes around the 64 byte burst and loop counter limits.
+		const u32 size = (testRand() % (1u<<(testRand() % 21))) & ~3u;
+		u8 *const src = &g_src[testRange(0, 15) * 4];
+		u8 *const dst = &g_dst[testRange(1, 15) * 4];
+		for(u32 i = 0; i < size; i++) src[i] = testRand();
+		memset(dst - 4, 0xAA, size + 8);
+
+		CdmaFence fence;
+		TEST_CHECK(CDMA_copy(ch, dst, src, size, &fence) == RES_OK);
+		TEST_CHECK(CDMA_fenceWait(&fence) == RES_OK && CDMA_fenceDone(&fence));
+		TEST_CHECK(memcmp(dst, src, size) == 0 && dst[-1] == 0xAA && dst[size] == 0xAA);
+
+		const u32 value = testRand();
+		TEST_CHECK(CDMA_fill(ch, dst, value, size, &fence) == RES_OK);
+		TEST_CHECK(CDMA_fenceWait(&fence) == RES_OK);
+		bool filled = dst[-1] == 0xAA && dst[size] == 0xAA;
+		for(u32 i = 0; i < size; i += 4) filled &= memcmp(&dst[i], &value, 4) == 0;
+		TEST_CHECK(filled);
+	}
+
+	// More than one full loop nest.
+	for(u32 i = 0; i < BUF_SIZE; i++) g_src[i] = testRand();
+	CdmaFence fence;
+	TEST_CHECK(CDMA_copy(ch, g_dst, g_src, BUF_SIZE, &fence) == RES_OK);
+	TEST_CHECK(CDMA_fenceWait(&fence) == RES_OK && memcmp(g_dst, g_src, BUF_SIZE) == 0);
+
+	// Unaligned and empty operations.
+	TEST_CHECK(CDMA_copy(ch, g_dst + 2, g_src, 4, &fence) == RES_INVALID_ARG);
+	TEST_CHECK(CDMA_copy(ch, g_dst, g_src + 1, 4, &fence) == RES_INVALID_ARG);
+	TEST_CHECK(CDMA_fill(ch, g_dst, 0, 6, &fence) == RES_INVALID_ARG);
+	fence.ch = ch;
+	TEST_CHECK(CDMA_copy(ch, g_dst, g_src, 0, &fence) == RES_OK);
+	TEST_CHECK(fence.ch == CDMA_NO_CHANNEL && CDMA_fenceDone(&fence));
+}
+
+static void testCopy2D(const u8 ch)
+{
+	for(u32 it = 0; it < 300; it++)
+	{
+		const u32 width = testRange(0, 1024) * 4, height = testRange(0, 700);
+		const u32 srcStride = width + (testRand() & 1 ? 0 : testRange(0, 20000) * 4);
+		const u32 dstStride = width + (testRand() & 1 ? 0 : testRange(0, 20000) * 4);
+		if((u64)srcStride * height > BUF_SIZE || (u64)dstStride * height > BUF_SIZE) continue;
+
+		for(u32 i = 0; i < srcStride * height; i++) g_src[i] = testRand();
+		memset(g_dst, 0x55, dstStride * height + 4);
+
+		CdmaFence fence;
+		TEST_CHECK(CDMA_copy2D(ch, g_dst, dstStride, g_src, srcStride, width, height, &fence) == RES_OK);
+		TEST_CHECK(CDMA_fenceWait(&fence) == RES_OK);
+		for(u32 y = 0; y < height; y++)
+		{
+			u8 *const row = &g_dst[dstStride * y];
+			TEST_CHECK(memcmp(row, &g_src[srcStride * y], width) == 0);
+			if(dstStride > width || y == height - 1) TEST_CHECK(row[width] == 0x55);
+		}
+	}
+
+	TEST_CHECK(CDMA_copy2D(ch, g_dst, 8, g_src, 16, 12, 2, NULL) == RES_INVALID_ARG);
+	TEST_CHECK(CDMA_copy2D(ch, g_dst, 16, g_src, 18, 12, 2, NULL) == RES_INVALID_ARG);
+}
+
+static void testFaults(const u8 ch)
+{
+	// The fault fails the operation in flight but not the next one.
+	CdmaFence fence;
+	TEST_CHECK(CDMA_copy(ch, g_dst, g_src, 4096, &fence) == RES_OK);
+	TEST_CHECK(!CDMA_fenceDone(&fence));
+	g_faulting = BIT(ch);
+	g_isrs[IRQ_CDMA_FAULT](IRQ_CDMA_FAULT);
+	TEST_CHECK(g_faulting == 0 && g_running[ch] == NULL);
+	TEST_CHECK(CDMA_fenceDone(&fence) && CDMA_fenceWait(&fence) == RES_DMA_LOCKUP);
+
+	TEST_CHECK(CDMA_copy(ch, g_dst, g_src, 4096, &fence) == RES_OK);
+	TEST_CHECK(CDMA_fenceWait(&fence) == RES_OK);
+
+	// Channels with a restart program are restarted instead.
+	static const u8 restartProg[1] = {0};
+	CDMA_setRestartProg(CDMA_CH_LGYCAP0, restartProg);
+	const u32 kills = g_kills;
+	g_faulting = BIT(CDMA_CH_LGYCAP0);
+	g_isrs[IRQ_CDMA_FAULT](IRQ_CDMA_FAULT);
+	TEST_CHECK(g_kills == kills + 1 && g_running[CDMA_CH_LGYCAP0] == restartProg);
+	g_running[CDMA_CH_LGYCAP0] = NULL;
+}
+
+int main(void)
+{
+	testAlloc();
+
+	const u8 ch = CDMA_allocChannel();
+	testCopyFill(ch);
+	testCopy2D(ch);
+	testFaults(ch);
+	CDMA_freeChannel(ch);
+
+	return testResult();
+}
\ No newline at end of file
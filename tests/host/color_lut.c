@@ -0,0 +1,55 @@
+#include <math.h>
+#include "test.h"
+#include "color_lut.h"
+
+
+
+static void checkMonotonic(const u8 ch[256])
+{
+	for(u32 i = 1; i < 256; i++) TEST_CHECK(ch[i] >= ch[i - 1]);
+	TEST_CHECK(ch[0] == 0 && ch[255] == 255);
+}
+
+int main(void)
+{
+	ColorLut lut;
+
+	colorLutIdentity(&lut);
+	for(u32 i = 0; i < 256; i++)
+	{
+		TEST_CHECK(lut.r[i] == i && lut.g[i] == i && lut.b[i] == i);
+		TEST_CHECK(colorLutPackEntry(&lut, i) == (i<<16 | i<<8 | i));
+	}
+
+	// Gamma 1.0 must be an exact identity despite float rounding.
+	colorLutGamma(&lut, 1.f, 1.f, 1.f);
+	for(u32 i = 0; i < 256; i++) TEST_CHECK(lut.r[i] == i && lut.g[i] == i && lut.b[i] == i);
+
+	// Per channel curves against a double precision reference.
+	colorLutGamma(&lut, 0.5f, 2.2f, 4.f);
+	checkMonotonic(lut.r);
+	checkMonotonic(lut.g);
+	checkMonotonic(lut.b);
+	for(u32 i = 0; i < 256; i++)
+	{
+		TEST_CHECK(abs(lut.r[i] - (int)lround(pow(i / 255.0, 0.5) * 255)) <= 1);
+		TEST_CHECK(abs(lut.g[i] - (int)lround(pow(i / 255.0, 2.2) * 255)) <= 1);
+		TEST_CHECK(abs(lut.b[i] - (int)lround(pow(i / 255.0, 4.0) * 255)) <= 1);
+	}
+	TEST_CHECK(lut.r[64] > 64 && lut.g[128] < 128);
+
+	// sRGB on a gamma 2.2 LCD is close to identity. Max deviation is in the dark end.
+	colorLutSrgb2Lcd(&lut, 2.2f);
+	checkMonotonic(lut.r);
+	for(u32 i = 0; i < 256; i++)
+	{
+		TEST_CHECK(lut.r[i] == lut.g[i] && lut.g[i] == lut.b[i]);
+		TEST_CHECK(abs(lut.r[i] - (int)i) <= 16);
+	}
+
+	colorLutGbaCorrection(&lut);
+	checkMonotonic(lut.r);
+	for(u32 i = 1; i < 255; i++) TEST_CHECK(lut.r[i] <= i);
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <string.h>
+#include "test.h"
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/font_6x10.h"
+#include "rgb_conv.h"
+
+
+#define FB_COL_H  (240u) // Frame buffer column height. The LCDs are rotated.
+#define WHITE     BGR8_2_565(255, 255, 255)
+#define BLACK     BGR8_2_565(0, 0, 0)
+
+
+ssize_t con_write(const char *ptr, size_t len);
+
+static u8 g_fbTop[400 * FB_COL_H * 3];
+static u8 g_fbBot[320 * FB_COL_H * 3];
+static GfxFmt g_fbFmt = GFX_BGR565;
+
+
+
+void* GFX_getBuffer(const GfxLcd lcd, const GfxSide side)
+{
+	return (lcd == GFX_LCD_TOP ? g_fbTop : g_fbBot);
+}
+
+GfxFmt GFX_getFormat(const GfxLcd lcd)
+{
+	return g_fbFmt;
+}
+
+void GFX_setDoubleBuffering(const GfxLcd lcd, const bool dBuf)
+{
+}
+
+void GFX_flushBuffers(void)
+{
+}
+
+Result fsQuickWrite(const char *const path, const void *const buf, u32 size)
+{
+	return RES_OK;
+}
+
+
+static void print(const char *const str)
+{
+	con_write(str, strlen(str));
+}
+
+// Pixel at x/y (top left origin) as BGR565 or BGR8 in the low 24 bits.
+static u32 fbPixel(const u8 *const fb, const u32 x, const u32 y)
+{
+	const u32 idx = x * FB_COL_H + (FB_COL_H - 1 - y);
+	if(g_fbFmt == GFX_BGR8) return fb[idx * 3] | (u32)fb[idx * 3 + 1]<<8 | (u32)fb[idx * 3 + 2]<<16;
+
+	return fb[idx * 2] | (u32)fb[idx * 2 + 1]<<8;
+}
+
+static u32 fbColor(const u16 bgr565)
+{
+	if(g_fbFmt != GFX_BGR8) return bgr565;
+
+	return rgbFive2Eight(bgr565 & 0x1Fu) | (u32)rgbSix2Eight(bgr565>>5 & 0x3Fu)<<8 |
+	       (u32)rgbFive2Eight(bgr565>>11)<<16;
+}
+
+// Compares one character cell with a glyph in the ConsoleFont format.
+// extraRows has a bit set for each row from the top which must be all foreground.
+static bool checkCell(const u8 *const fb, const u32 cellX, const u32 cellY, const u8 *const glyph,
+                      const u32 width, const u32 height, const u16 fg, const u16 bg, const u32 extraRows)
+{
+	const u32 rowBytes = (width + 7) / 8;
+	for(u32 y = 0; y < height; y++)
+	{
+		for(u32 x = 0; x < width; x++)
+		{
+			const bool set = (glyph[y * rowBytes + x / 8]<<(x % 8) & 0x80u) || (extraRows>>y & 1u);
+			if(fbPixel(fb, cellX * width + x, cellY * height + y) != fbColor(set ? fg : bg)) return false;
+		}
+	}
+
+	return true;
+}
+
+static bool checkDefaultCell(const u8 *const fb, const u32 cellX, const u32 cellY, const u8 c, const u32 extraRows)
+{
+	return checkCell(fb, cellX, cellY, &default_font[c * FONT_HEIGHT], FONT_WIDTH, FONT_HEIGHT,
+	                 WHITE, BLACK, extraRows);
+}
+
+static void testDefaultFont(const GfxFmt fmt)
+{
+	g_fbFmt = fmt;
+	memset(g_fbBot, 0x55, sizeof(g_fbBot));
+	PrintConsole *const con = consoleInit(GFX_LCD_BOT, NULL);
+	TEST_CHECK(con->consoleWidth == 53 && con->consoleHeight == 24);
+
+	print("Hello\x1b[4m_u\x1b[24m\n");
+	const char hello[] = "Hello";
+	for(u32 i = 0; i < 5; i++) TEST_CHECK(checkDefaultCell(g_fbBot, i, 0, hello[i], 0));
+	TEST_CHECK(checkDefaultCell(g_fbBot, 5, 0, '_', BIT(FONT_HEIGHT - 1)));
+	TEST_CHECK(checkDefaultCell(g_fbBot, 6, 0, 'u', BIT(FONT_HEIGHT - 1)));
+	TEST_CHECK(checkDefaultCell(g_fbBot, 7, 0, ' ', 0));
+
+	// Scroll by 7 lines. The last line ends with a newline so the bottom row is empty.
+	char line[16];
+	for(u32 i = 1; i < 30; i++)
+	{
+		snprintf(line, sizeof(line), "L%02lu\n", (unsigned long)i);
+		print(line);
+	}
+	for(u32 row = 0; row < 23; row++)
+	{
+		snprintf(line, sizeof(line), "L%02lu", (unsigned long)row + 7);
+		for(u32 i = 0; i < 3; i++) TEST_CHECK(checkDefaultCell(g_fbBot, i, row, line[i], 0));
+		TEST_CHECK(checkDefaultCell(g_fbBot, 3, row, ' ', 0));
+	}
+	for(u32 i = 0; i < 53; i++) TEST_CHECK(checkDefaultCell(g_fbBot, i, 23, ' ', 0));
+
+	// Clear line right of the cursor and move the cursor.
+	print("\x1b[3;2H\x1b[0K#");
+	TEST_CHECK(checkDefaultCell(g_fbBot, 0, 2, 'L', 0));
+	TEST_CHECK(checkDefaultCell(g_fbBot, 1, 2, '#', 0));
+	TEST_CHECK(checkDefaultCell(g_fbBot, 2, 2, ' ', 0));
+}
+
+// 3 glyphs of 9x7 pixels. Wider than 8 to cover 2 byte rows.
+static u8 g_sparseGfx[3 * 7 * 2];
+static const u16 g_sparseCps[3] = {'A', 0xE9, 0xFFFD};
+static const u16 g_reversedCps[3] = {0xFFFD, 0xE9, 'A'};
+
+static const u8* sparseGlyph(const u32 idx)
+{
+	return &g_sparseGfx[idx * 7 * 2];
+}
+
+static void testSparseFont(void)
+{
+	for(u32 i = 0; i < sizeof(g_sparseGfx); i++) g_sparseGfx[i] = testRand();
+
+	g_fbFmt = GFX_BGR565;
+	PrintConsole con;
+	consoleInit(GFX_LCD_TOP, &con);
+	ConsoleFont font = {g_sparseGfx, 0, 3, 9, 7, g_sparseCps};
+	TEST_CHECK(consoleSetFont(&con, &font));
+	TEST_CHECK(con.consoleWidth == 400 / 9 && con.consoleHeight == 240 / 7);
+
+	// Glyphs taller than 32 pixels are rejected.
+	ConsoleFont tall = {g_sparseGfx, 0, 3, 9, 33, g_sparseCps};
+	TEST_CHECK(!consoleSetFont(&con, &tall) && con.font.height == 7);
+
+	// Overlong encodings, surrogates, stray bytes and code points >U+FFFF
+	// all end up as U+FFFD. Unknown characters are also drawn as U+FFFD.
+	print("A\xC3\xA9\xFF\xC0\x80\xED\xA0\x80\xF0\x9F\x98\x80Z");
+	static const u8 expected[] = {0, 1, 2, 2, 2, 2, 2};
+	for(u32 x = 0; x < sizeof(expected); x++)
+	{
+		TEST_CHECK(checkCell(g_fbTop, x, 0, sparseGlyph(expected[x]), 9, 7, WHITE, BLACK, 0));
+	}
+	TEST_CHECK(con.cursorX == sizeof(expected));
+
+	// Same graphics and size but a different mapping must not reuse the cached glyph lookup.
+	PrintConsole con2;
+	consoleInit(GFX_LCD_BOT, &con2);
+	ConsoleFont font2 = {g_sparseGfx, 0, 3, 9, 7, g_reversedCps};
+	consoleSetFont(&con2, &font2);
+	print("A");
+	TEST_CHECK(checkCell(g_fbBot, 0, 0, sparseGlyph(2), 9, 7, WHITE, BLACK, 0));
+	consoleSelect(&con);
+	print("\rA");
+	TEST_CHECK(checkCell(g_fbTop, 0, 0, sparseGlyph(0), 9, 7, WHITE, BLACK, 0));
+}
+
+static int g_cbChars[16];
+static u32 g_cbNum = 0;
+
+static bool printCb(void *con, int c)
+{
+	if(g_cbNum < 16) g_cbChars[g_cbNum++] = c;
+	return true;
+}
+
+static void testUtf8PerConsole(void)
+{
+	g_fbFmt = GFX_BGR565;
+	PrintConsole a, b;
+	consoleInit(GFX_LCD_TOP, &a);
+	consoleInit(GFX_LCD_BOT, &b);
+	static ConsoleCell cellsA[66 * 24], cellsB[53 * 24];
+	consoleSetDeferred(&a, cellsA, 66 * 24);
+	consoleSetDeferred(&b, cellsB, 53 * 24);
+
+	// Interleaved multibyte sequences on 2 consoles must not mix.
+	consoleSelect(&a);
+	print("\xC3");
+	consoleSelect(&b);
+	print("\xE2\x82");
+	consoleSelect(&a);
+	print("\xA9");
+	consoleSelect(&b);
+	print("\xAC");
+	TEST_CHECK(cellsA[0].chr == 0xE9 && cellsB[0].chr == 0x20AC);
+
+	// The print callback gets decoded code points.
+	a.PrintChar = printCb;
+	consoleSelect(&a);
+	print("x\xC3\xA9\xC3Z\xF0\x9F\x98\x80\n");
+	static const int expected[] = {'x', 0xE9, 0xFFFD, 'Z', 0x1F600, '\n'};
+	TEST_CHECK(g_cbNum == 6 && memcmp(g_cbChars, expected, sizeof(expected)) == 0);
+	a.PrintChar = NULL;
+
+	consoleSetDeferred(&a, NULL, 0);
+	consoleSetDeferred(&b, NULL, 0);
+}
+
+int main(void)
+{
+	testDefaultFont(GFX_BGR565);
+	testDefaultFont(GFX_BGR8);
+	testSparseFont();
+	testUtf8PerConsole();
+
+	return testResult();
+}
\ No newline at end of file
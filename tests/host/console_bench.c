@@ -0,0 +1,170 @@
+#include <string.h>
+#include <time.h>
+#include "test.h"
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/font_6x10.h"
+#include "rgb_conv.h"
+
+
+// Console throughput against the renderer before glyph batching on the bottom
+// screen in BGR565. Both must produce the same frame buffer.
+#define FB_COL_H  (240u)
+#define COLS      (320u / FONT_WIDTH)
+#define ROWS      (FB_COL_H / FONT_HEIGHT)
+#define ITERATIONS (2000u)
+#define WHITE     BGR8_2_565(255, 255, 255)
+#define BLACK     BGR8_2_565(0, 0, 0)
+
+
+ssize_t con_write(const char *ptr, size_t len);
+
+static u16 g_fb[320 * FB_COL_H];
+static u16 g_refFb[320 * FB_COL_H];
+static u32 g_refX = 0, g_refY = 0;
+
+
+
+void* GFX_getBuffer(const GfxLcd lcd, const GfxSide side)
+{
+	return g_fb;
+}
+
+GfxFmt GFX_getFormat(const GfxLcd lcd)
+{
+	return GFX_BGR565;
+}
+
+void GFX_setDoubleBuffering(const GfxLcd lcd, const bool dBuf)
+{
+}
+
+void GFX_flushBuffers(void)
+{
+}
+
+Result fsQuickWrite(const char *const path, const void *const buf, u32 size)
+{
+	return RES_OK;
+}
+
+
+// The old renderer. One store per glyph pixel, the scroll copies every
+// column word by word and the new row is cleared by drawing spaces.
+static void refDrawChar(const u32 c)
+{
+	const u8 *const glyph = &default_font[c * FONT_HEIGHT];
+	u16 *screen = &g_refFb[g_refX * FONT_WIDTH * FB_COL_H + (FB_COL_H - 1 - (g_refY * FONT_HEIGHT + 9))];
+	for(u32 mask = 0x80; mask > 0x80>>FONT_WIDTH; mask >>= 1)
+	{
+		for(u32 y = FONT_HEIGHT; y > 0; y--) *screen++ = (glyph[y - 1] & mask ? WHITE : BLACK);
+		screen += FB_COL_H - FONT_HEIGHT;
+	}
+}
+
+static void refNewRow(void)
+{
+	if(++g_refY < ROWS) return;
+	g_refY--;
+
+	for(u32 x = 0; x < COLS * FONT_WIDTH; x++)
+	{
+		u16 *const col = &g_refFb[x * FB_COL_H];
+		u32 *to = (u32*)&col[FB_COL_H - 2];
+		const u32 *from = (const u32*)&col[FB_COL_H - 2 - FONT_HEIGHT];
+		for(u32 i = 0; i < (ROWS - 1) * FONT_HEIGHT / 2; i++) *to-- = *from--;
+	}
+
+	const u32 cursorX = g_refX;
+	for(g_refX = 0; g_refX < COLS; g_refX++) refDrawChar(' ');
+	g_refX = cursorX;
+}
+
+static void refWrite(const char *str, size_t len)
+{
+	for(; len > 0; len--)
+	{
+		const u8 c = *str++;
+		if(g_refX >= COLS)
+		{
+			g_refX = 0;
+			refNewRow();
+		}
+
+		if(c == '\n')
+		{
+			refNewRow();
+			g_refX = 0;
+		}
+		else
+		{
+			refDrawChar(c);
+			g_refX++;
+		}
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// MB/s of text for iterations of run().
+static double bench(void (*const run)(void), const size_t bytes)
+{
+	const double start = seconds();
+	for(u32 i = 0; i < ITERATIONS; i++) run();
+
+	return ITERATIONS * bytes / (seconds() - start) / 1e6;
+}
+
+// A full screen of text from the top left. No scrolling.
+static char g_screen[3 + ROWS * COLS];
+
+static void drawScreen(void)
+{
+	con_write(g_screen, sizeof(g_screen));
+}
+
+static void refDrawScreen(void)
+{
+	g_refX = g_refY = 0;
+	refWrite(g_screen + 3, sizeof(g_screen) - 3);
+}
+
+// Short lines at the bottom. Every line scrolls.
+static const char g_lines[] = "0123456789\n";
+
+static void scrollLines(void)
+{
+	con_write(g_lines, sizeof(g_lines) - 1);
+}
+
+static void refScrollLines(void)
+{
+	refWrite(g_lines, sizeof(g_lines) - 1);
+}
+
+static void report(const char *const name, void (*const run)(void), void (*const ref)(void), const size_t bytes)
+{
+	const double mbs = bench(run, bytes), refMbs = bench(ref, bytes);
+	printf("%s: %.2f MB/s, old renderer: %.2f MB/s (%.1fx)\n", name, mbs, refMbs, mbs / refMbs);
+	TEST_CHECK(memcmp(g_fb, g_refFb, sizeof(g_fb)) == 0);
+}
+
+int main(void)
+{
+	consoleInit(GFX_LCD_BOT, NULL);
+	for(u32 i = 0; i < 320 * FB_COL_H; i++) g_refFb[i] = BLACK;
+
+	memcpy(g_screen, "\x1b[H", 3);
+	for(u32 i = 0; i < ROWS * COLS; i++) g_screen[3 + i] = ' ' + i % 95;
+
+	report("glyphs", drawScreen, refDrawScreen, ROWS * COLS);
+	report("scroll", scrollLines, refScrollLines, sizeof(g_lines) - 1);
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include <string.h>
+#include "test.h"
+#include "dma330_sim.h"
+#include "drivers/corelink_dma-330.h"
+#include "drivers/corelink_dma-330_asm.h"
+
+
+#define MEM_BASE   (0x20000000u)
+#define MEM_SIZE   (16u * 1024 * 1024)
+#define FIFO_ADDR  (0x1000A040u) // Peripheral FIFO. Reads and writes are streams.
+
+
+static u8 g_mem[MEM_SIZE];
+static u8 g_fifoIn[MEM_SIZE];
+static u8 g_fifoOut[MEM_SIZE];
+static u32 g_fifoInPos, g_fifoOutPos;
+
+
+static u8* simMem(const u32 addr, const bool write)
+{
+	if(addr - FIFO_ADDR < 8) return (write ? &g_fifoOut[g_fifoOutPos++] : &g_fifoIn[g_fifoInPos++]);
+	if(addr < MEM_BASE || addr - MEM_BASE >= MEM_SIZE) return NULL;
+
+	return &g_mem[addr - MEM_BASE];
+}
+
+static void simInit(Dma330Sim *const s, const u32 frameReqs, const u32 frames)
+{
+	dma330SimInit(s, simMem, frameReqs, frames);
+	g_fifoInPos = g_fifoOutPos = 0;
+}
+
+
+// Same program as buildShaDmaProg() in sha.c.
+static void emitShaBurst(Dma330Asm *const a, UNUSED void *arg)
+{
+	DMA330_asmLd(a, DMA330_ALWAYS);
+	DMA330_asmWfp(a, DMA330_WFP_BURST, 11);
+	DMA330_asmStp(a, DMA330_BURST, 11);
+}
+
+static u32 buildShaProg(u8 *const prog, const u32 size, const u32 blocks)
+{
+	Dma330Asm a;
+	DMA330_asmInit(&a, prog, size);
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_LEN(16) | CCR_SRC_BURST_SIZE(2) | CCR_SRC_INC | CCR_SRC_PROT_CTRL(2) |
+	                              CCR_DST_BURST_LEN(16) | CCR_DST_BURST_SIZE(2) | CCR_DST_PROT_CTRL(2));
+	DMA330_asmMov(&a, DMA330_SAR, MEM_BASE);
+	DMA330_asmMov(&a, DMA330_DAR, FIFO_ADDR);
+	DMA330_asmFlushp(&a, 11);
+	DMA330_asmRepeat(&a, blocks, emitShaBurst, NULL);
+	DMA330_asmWmb(&a);
+	DMA330_asmSev(&a, 2);
+
+	const u32 progSize = DMA330_asmEnd(&a);
+	if(progSize == 0) TEST_CHECK(a.error == DMA330_ASM_OVERFLOW);
+
+	return progSize;
+}
+
+static void testShaProg(const u32 blocks)
+{
+	u8 prog[256];
+	if(buildShaProg(prog, sizeof(prog), blocks) == 0)
+	{
+		printf("SHA program for %lu blocks didn't fit.\n", (unsigned long)blocks);
+		TEST_CHECK(false);
+		return;
+	}
+
+	Dma330Sim s;
+	simInit(&s, 0, 0);
+	const bool ok = dma330SimRun(&s, prog, sizeof(prog));
+	if(!ok || s.wfps != blocks) printf("SHA program for %lu blocks:\n", (unsigned long)blocks);
+	TEST_CHECK(ok);
+	TEST_CHECK(s.wfps == blocks && s.sevMask == BIT(2));
+	TEST_CHECK(s.sar == MEM_BASE + blocks * 64 && s.dar == FIFO_ADDR);
+	TEST_CHECK(g_fifoOutPos == blocks * 64 && memcmp(g_fifoOut, g_mem, blocks * 64) == 0);
+}
+
+static void testShaProgs(void)
+{
+	for(u32 i = 0; i < MEM_SIZE; i++) g_mem[i] = testRand();
+
+	// Loop counter limits and counts that need more than one full loop nest.
+	static const u32 counts[] = {1, 2, 255, 256, 257, 511, 512, 513, 65535, 65536, 65537,
+	                             65536 * 2 + 256, 65536 * 3 + 17, MEM_SIZE / 64};
+	for(u32 i = 0; i < sizeof(counts) / sizeof(*counts); i++) testShaProg(counts[i]);
+	for(u32 i = 0; i < 20; i++) testShaProg(testRange(1, MEM_SIZE / 64));
+
+	// Up to 64 MiB fits the 256 bytes in sha.c. Anything that doesn't fit is an error.
+	u8 prog[256];
+	TEST_CHECK(buildShaProg(prog, sizeof(prog), 64 * 1024 * 1024 / 64 - 1) != 0);
+	TEST_CHECK(buildShaProg(prog, sizeof(prog), 128 * 1024 * 1024 / 64 - 1) == 0);
+}
+
+// Same program as buildDmaProg() in lgycap.c with configurable addresses.
+static void emitLdSt(Dma330Asm *const a, UNUSED void *arg)
+{
+	DMA330_asmLd(a, DMA330_ALWAYS);
+	DMA330_asmSt(a, DMA330_ALWAYS);
+}
+
+static u32 buildLgyCapProg(u8 *const prog, const u32 width, const u32 pixelSize, const u32 sar, const u32 dar)
+{
+	const u32 bytesPer8Lines = width * pixelSize * 8;
+	u32 transfers;
+	if(bytesPer8Lines % (16 * 8) == 0)      transfers = 16;
+	else if(bytesPer8Lines % (15 * 8) == 0) transfers = 15;
+	else return 0;
+
+	Dma330Asm a;
+	DMA330_asmInit(&a, prog, 64);
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_LEN(transfers) | CCR_SRC_BURST_SIZE(3) | CCR_SRC_PROT_CTRL(2) |
+	                              CCR_DST_BURST_LEN(transfers) | CCR_DST_BURST_SIZE(3) | CCR_DST_INC | CCR_DST_PROT_CTRL(2));
+	DMA330_asmMov(&a, DMA330_SAR, sar);
+	DMA330_asmFlushp(&a, 14);
+	DMA330_asmLpEndless(&a);
+	{
+		DMA330_asmMov(&a, DMA330_DAR, dar);
+		DMA330_asmLpForever(&a);
+		{
+			DMA330_asmWfp(&a, DMA330_WFP_PERIPH, 14);
+			DMA330_asmRepeat(&a, bytesPer8Lines / (transfers * 8) - 1, emitLdSt, NULL);
+			DMA330_asmLdp(&a, DMA330_BURST, 14);
+			DMA330_asmSt(&a, DMA330_ALWAYS);
+			DMA330_asmAddh(&a, DMA330_DAR, (512u - width) * pixelSize * 8);
+		}
+		DMA330_asmLpEnd(&a);
+		DMA330_asmWmb(&a);
+		DMA330_asmSev(&a, 1);
+	}
+	DMA330_asmLpEnd(&a);
+
+	return DMA330_asmEnd(&a);
+}
+
+static void testLgyCapProg(void)
+{
+	// The hand-written program lgycap.c used before it was generated.
+	static const u8 orig[44] =
+	{
+		0xBC, 0x01, 0xF6, 0xC2, 0xBD, 0x00, 0xBC, 0x00, 0x00, 0x10, 0x31, 0x10, 0x35, 0x70, 0x20, 0x01,
+		0xBC, 0x02, 0x00, 0x00, 0x20, 0x18, 0x31, 0x70, 0x22, 0x2B, 0x04, 0x08, 0x3C, 0x02, 0x27, 0x70,
+		0x08, 0x56, 0x80, 0x09, 0x28, 0x0E, 0x13, 0x34, 0x08, 0x38, 0x1B, 0x00
+	};
+	static const char *const listing[] =
+	{
+		"MOV CCR, SB16 SS64 SAF SP2 DB16 DS64 DAI DP2", "MOV SAR, 0x10311000", "FLUSHP 14", "LP lc0, 2",
+		"MOV DAR, 0x18200000", "WFP 14, periph", "LP lc1, 44", "LD", "ST", "LPEND lc1 @0x001A", "LDPB 14", "ST",
+		"ADDH DAR, 0x0980", "LPEND fe @0x0016", "WMB", "SEV 1", "LPEND lc0 @0x000E", "END"
+	};
+
+	u8 prog[64];
+	const u32 size = buildLgyCapProg(prog, 360, 2, 0x10311000, 0x18200000);
+	TEST_CHECK(size == sizeof(orig) && memcmp(prog, orig, sizeof(orig)) == 0);
+
+	u32 pos = 0;
+	char line[DMA330_DISASM_MAX_LEN];
+	for(u32 i = 0; i < sizeof(listing) / sizeof(*listing); i++)
+	{
+		const u32 len = DMA330_disasm(prog, size, pos, line, sizeof(line));
+		TEST_CHECK(len != 0 && strcmp(line, listing[i]) == 0);
+		if(len == 0) break;
+		pos += len;
+	}
+	TEST_CHECK(pos == size);
+
+	// Truncated and invalid instructions.
+	TEST_CHECK(DMA330_disasm(prog, 5, 0, line, sizeof(line)) == 0);
+	TEST_CHECK(DMA330_disasm((const u8[]){0xFF}, 1, 0, line, sizeof(line)) == 0);
+
+	// Run 2 frames for all supported widths. The second frame overwrites the first.
+	for(u32 pixelSize = 2; pixelSize <= 4; pixelSize++)
+	{
+		for(u32 width = 8; width <= 512; width += 8)
+		{
+			const u32 bytesPer8Lines = width * pixelSize * 8;
+			const u32 size = buildLgyCapProg(prog, width, pixelSize, FIFO_ADDR, MEM_BASE);
+			TEST_CHECK((size != 0) == (bytesPer8Lines % 128 == 0 || bytesPer8Lines % 120 == 0));
+			if(size == 0) continue;
+
+			for(u32 i = 0; i < bytesPer8Lines * 30 * 2; i++) g_fifoIn[i] = testRand();
+			memset(g_mem, 0, 512 * pixelSize * 240);
+
+			Dma330Sim s;
+			simInit(&s, 30, 2);
+			TEST_CHECK(dma330SimRun(&s, prog, size));
+			TEST_CHECK(s.wfps == 60 && s.sevMask == BIT(1) && g_fifoInPos == bytesPer8Lines * 60);
+
+			const u8 *const frame = &g_fifoIn[bytesPer8Lines * 30];
+			for(u32 i = 0; i < 30; i++)
+			{
+				const u8 *const block = &g_mem[512 * pixelSize * 8 * i];
+				TEST_CHECK(memcmp(block, &frame[bytesPer8Lines * i], bytesPer8Lines) == 0);
+				for(u32 j = bytesPer8Lines; j < 512 * pixelSize * 8; j++) TEST_CHECK(block[j] == 0);
+			}
+		}
+	}
+}
+
+static void testTransfer(void)
+{
+	static const u32 ccrs[] =
+	{
+		CCR_SRC_BURST_LEN(16) | CCR_SRC_BURST_SIZE(2) | CCR_SRC_INC | CCR_DST_BURST_LEN(16) | CCR_DST_BURST_SIZE(2) | CCR_DST_INC,
+		CCR_SRC_BURST_LEN(15) | CCR_SRC_BURST_SIZE(3) | CCR_SRC_INC | CCR_DST_BURST_LEN(15) | CCR_DST_BURST_SIZE(3) | CCR_DST_INC,
+		CCR_SRC_BURST_LEN(4)  | CCR_SRC_BURST_SIZE(0) | CCR_SRC_INC | CCR_DST_BURST_LEN(2)  | CCR_DST_BURST_SIZE(1) | CCR_DST_INC
+	};
+	static const u32 sizes[] = {8, 64, 120, 1000, 4096, 65536 * 64 + 56, 12345 * 8};
+
+	const u32 dst = MEM_BASE + MEM_SIZE / 2;
+	for(u32 i = 0; i < MEM_SIZE / 2; i++) g_mem[i] = testRand();
+	for(u32 c = 0; c < sizeof(ccrs) / sizeof(*ccrs); c++)
+	{
+		for(u32 i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+		{
+			const u32 size = sizes[i];
+			u8 prog[512];
+			Dma330Asm a;
+			DMA330_asmInit(&a, prog, sizeof(prog));
+			DMA330_asmMov(&a, DMA330_CCR, ccrs[c]);
+			DMA330_asmMov(&a, DMA330_SAR, MEM_BASE);
+			DMA330_asmMov(&a, DMA330_DAR, dst);
+			DMA330_asmTransfer(&a, size);
+			TEST_CHECK(DMA330_asmEnd(&a) != 0);
+
+			memset(&g_mem[MEM_SIZE / 2], 0, size + 64);
+			Dma330Sim s;
+			simInit(&s, 0, 0);
+			TEST_CHECK(dma330SimRun(&s, prog, sizeof(prog)));
+			TEST_CHECK(s.sar == MEM_BASE + size && s.dar == dst + size);
+			TEST_CHECK(memcmp(&g_mem[MEM_SIZE / 2], g_mem, size) == 0 && g_mem[MEM_SIZE / 2 + size] == 0);
+		}
+	}
+
+	// Not a multiple of the transfer size and different burst sizes in bytes.
+	u8 prog[64];
+	Dma330Asm a;
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_SIZE(2) | CCR_DST_BURST_SIZE(2));
+	DMA330_asmTransfer(&a, 6);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_ARG);
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_LEN(2) | CCR_SRC_BURST_SIZE(2) | CCR_DST_BURST_SIZE(2));
+	DMA330_asmTransfer(&a, 64);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_ARG);
+}
+
+static void testErrors(void)
+{
+	u8 prog[32];
+	Dma330Asm a;
+
+	// MFIFO overflow and underflow.
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmMov(&a, DMA330_CCR, CCR_SRC_BURST_LEN(16) | CCR_SRC_BURST_SIZE(3) | CCR_DST_BURST_LEN(16) | CCR_DST_BURST_SIZE(3));
+	DMA330_asmLd(&a, DMA330_ALWAYS);
+	TEST_CHECK(a.error == DMA330_ASM_OK);
+	DMA330_asmLd(&a, DMA330_ALWAYS);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_MFIFO);
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmSt(&a, DMA330_ALWAYS);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_MFIFO);
+
+	// A loop body that doesn't drain the MFIFO.
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmLp(&a, 3);
+	DMA330_asmLd(&a, DMA330_ALWAYS);
+	DMA330_asmLpEnd(&a);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_MFIFO);
+
+	// Bad loop counts, too many counted loops and unbalanced loops.
+	static const u32 badCounts[] = {0, 257};
+	for(u32 i = 0; i < 2; i++)
+	{
+		DMA330_asmInit(&a, prog, sizeof(prog));
+		DMA330_asmLp(&a, badCounts[i]);
+		TEST_CHECK(a.error == DMA330_ASM_LOOP);
+	}
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmLp(&a, 256);
+	DMA330_asmLp(&a, 2);
+	TEST_CHECK(a.error == DMA330_ASM_OK);
+	DMA330_asmLp(&a, 2);
+	TEST_CHECK(a.error == DMA330_ASM_LOOP);
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmLp(&a, 2);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_LOOP);
+	DMA330_asmInit(&a, prog, sizeof(prog));
+	DMA330_asmLpEnd(&a);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_LOOP);
+
+	// The first error is kept.
+	DMA330_asmInit(&a, prog, 7);
+	DMA330_asmMov(&a, DMA330_SAR, 0);
+	DMA330_asmMov(&a, DMA330_DAR, 0);
+	DMA330_asmLpEnd(&a);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_OVERFLOW);
+
+	// END must fit too.
+	DMA330_asmInit(&a, prog, 6);
+	DMA330_asmMov(&a, DMA330_SAR, 0);
+	TEST_CHECK(DMA330_asmEnd(&a) == 0 && a.error == DMA330_ASM_OVERFLOW);
+	DMA330_asmInit(&a, prog, 7);
+	DMA330_asmMov(&a, DMA330_SAR, 0);
+	TEST_CHECK(DMA330_asmEnd(&a) == 7);
+}
+
+int main(void)
+{
+	testShaProgs();
+	testLgyCapProg();
+	testTransfer();
+	testErrors();
+
+	return testResult();
+}
\ No newline at end of file
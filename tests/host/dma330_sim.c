@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include "dma330_sim.h"
+#include "drivers/corelink_dma-330.h"
+
+
+
+// One LD or ST with the given number of beats. Returns false on a bad access.
+static bool transfer(Dma330Sim *const s, const bool load, const u32 beats)
+{
+	const u32 ccr = s->ccr;
+	const u32 size = 1u<<(load ? (ccr & CCR_SRC_BURST_SIZE_MASK)>>CCR_SRC_BURST_SIZE_SHIFT :
+	                             (ccr & CCR_DST_BURST_SIZE_MASK)>>CCR_DST_BURST_SIZE_SHIFT);
+	const bool inc = (ccr & (load ? CCR_SRC_INC : CCR_DST_INC)) != 0;
+	u32 *const addr = (load ? &s->sar : &s->dar);
+	for(u32 i = 0; i < beats; i++)
+	{
+		for(u32 j = 0; j < size; j++)
+		{
+			if(load)
+			{
+				if(s->mfifoWr - s->mfifoRd == DMA330_ASM_MFIFO_SIZE) return false;
+				const u8 *const p = s->mem(*addr + j, false);
+				if(p == NULL) return false;
+				s->mfifo[s->mfifoWr++ % DMA330_ASM_MFIFO_SIZE] = *p;
+			}
+			else
+			{
+				if(s->mfifoWr == s->mfifoRd) return false;
+				u8 *const p = s->mem(*addr + j, true);
+				if(p == NULL) return false;
+				*p = s->mfifo[s->mfifoRd++ % DMA330_ASM_MFIFO_SIZE];
+			}
+		}
+		if(inc) *addr += size;
+	}
+
+	return true;
+}
+
+static u32 burstLen(const u32 ccr, const bool load)
+{
+	return (load ? (ccr & CCR_SRC_BURST_LEN_MASK)>>CCR_SRC_BURST_LEN_SHIFT :
+	               (ccr & CCR_DST_BURST_LEN_MASK)>>CCR_DST_BURST_LEN_SHIFT) + 1;
+}
+
+void dma330SimInit(Dma330Sim *const s, const Dma330SimMem mem, const u32 frameReqs, const u32 frames)
+{
+	memset(s, 0, sizeof(Dma330Sim));
+	s->mem       = mem;
+	s->frameReqs = frameReqs;
+	s->frames    = frames;
+}
+
+bool dma330SimRun(Dma330Sim *const s, const u8 *const prog, const u32 size)
+{
+	u32 pc = 0;
+	while(pc < size)
+	{
+		const u8 op = prog[pc];
+		if(op == 0x00) return s->mfifoWr == s->mfifoRd; // END.
+		else if(op == 0x12 || op == 0x13) pc++;          // RMB/WMB.
+		else if(op == 0x04 || op == 0x07 || op == 0x08 || op == 0x0B ||
+		        op == 0x27 || op == 0x2B)
+		{
+			// LD/LDB/ST/STB/LDPB/STPB. Requests are bursts so B always executes.
+			const bool load = (op & 0xEC) == 0x04 || op == 0x27;
+			if(!transfer(s, load, burstLen(s->ccr, load))) return false;
+			pc += (op >= 0x20 ? 2 : 1);
+		}
+		else if(op == 0x20 || op == 0x22)
+		{
+			s->lc[op>>1 & 1u] = prog[pc + 1];
+			pc += 2;
+		}
+		else if(op == 0x28 || op == 0x38 || op == 0x3C)
+		{
+			// LPEND. LPFE loops until the last request of the frame.
+			bool loop;
+			if(op == 0x28)
+			{
+				if(s->frameReqs == 0) return false;
+				loop = s->wfps % s->frameReqs != 0;
+			}
+			else
+			{
+				u8 *const lc = &s->lc[op>>2 & 1u];
+				loop = *lc != 0;
+				if(loop) (*lc)--;
+			}
+
+			if(loop)
+			{
+				if(prog[pc + 1] > pc) return false;
+				pc -= prog[pc + 1];
+			}
+			else pc += 2;
+		}
+		else if(op >= 0x30 && op <= 0x32)
+		{
+			s->wfps++;
+			pc += 2;
+		}
+		else if(op == 0x34)
+		{
+			s->sevMask |= 1u<<(prog[pc + 1]>>3);
+			if(++s->sevs == s->frames) return s->mfifoWr == s->mfifoRd;
+			pc += 2;
+		}
+		else if(op == 0x35) pc += 2; // FLUSHP.
+		else if(op == 0x54 || op == 0x56)
+		{
+			const u16 imm = prog[pc + 1] | (u16)prog[pc + 2]<<8;
+			*(op == 0x54 ? &s->sar : &s->dar) += imm;
+			pc += 3;
+		}
+		else if(op == 0xBC && prog[pc + 1] <= 2)
+		{
+			u32 imm;
+			memcpy(&imm, &prog[pc + 2], 4);
+			const u8 rd = prog[pc + 1];
+			*(rd == 0 ? &s->sar : (rd == 1 ? &s->ccr : &s->dar)) = imm;
+			pc += 6;
+		}
+		else
+		{
+			printf("Unexpected instruction 0x%02X at 0x%lX.\n", op, (unsigned long)pc);
+			return false;
+		}
+	}
+
+	return false; // Ran past the end.
+}
\ No newline at end of file
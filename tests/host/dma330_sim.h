@@ -0,0 +1,38 @@
+#pragma once
+
+#include "types.h"
+#include "drivers/corelink_dma-330_asm.h"
+
+
+// Returns the host location of one byte at a DMA address or NULL if the access is invalid.
+// FIFOs can return a new location for each access.
+typedef u8* (*Dma330SimMem)(u32 addr, bool write);
+
+// Minimal DMA-330 channel interpreter for the instructions the assembler emits.
+// Peripheral requests are always bursts. Every frameReqs requests the last one
+// is flagged which ends LPFE loops.
+typedef struct
+{
+	Dma330SimMem mem;
+	u32 frameReqs; // Peripheral requests per frame. 0 if LPFE is not used.
+	u32 frames;    // Stop after this many SEVs. 0 runs until DMAEND.
+
+	u32 ccr;
+	u32 sar;
+	u32 dar;
+	u8 lc[2];
+	u32 mfifoRd;   // Free running MFIFO indices.
+	u32 mfifoWr;
+	u8 mfifo[DMA330_ASM_MFIFO_SIZE];
+	u32 wfps;      // Number of executed WFPs.
+	u32 sevs;
+	u32 sevMask;   // Signaled events.
+} Dma330Sim;
+
+
+
+void dma330SimInit(Dma330Sim *const s, const Dma330SimMem mem, const u32 frameReqs, const u32 frames);
+
+// Runs the program until DMAEND or the last frame.
+// Returns false on an invalid instruction or access and if the MFIFO is not empty at the end.
+bool dma330SimRun(Dma330Sim *const s, const u8 *const prog, const u32 size);
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <string.h>
+#include "test.h"
+#include "gfx2d_ref.h"
+#include "arm11/gfx2d.h"
+#include "arm11/drivers/gx.h"
+#include "mem_map.h"
+
+
+// The fill engine and raw PPF copies are emulated for buffers in the mapped
+// VRAM. Host buffers are never GPU accessible.
+#define VRAM_TEST_SIZE (0x100000u)
+
+static u32 g_gxFills = 0, g_gxCopies = 0;
+
+static void checkVram(const void *const p, const u32 size)
+{
+	if((uintptr_t)p < VRAM_BASE || (uintptr_t)p + size > VRAM_BASE + VRAM_TEST_SIZE || ((uintptr_t)p & 7u) != 0)
+	{
+		printf("GX access outside of the VRAM or misaligned.\n");
+		exit(1);
+	}
+}
+
+void GX_memoryFill(u32 *buf0a, u32 buf0v, u32 buf0Sz, u32 val0, u32 *buf1a, u32 buf1v, u32 buf1Sz, u32 val1)
+{
+	checkVram(buf0a, buf0Sz);
+	TEST_CHECK(buf1a == NULL && buf0Sz % 8 == 0);
+	const u32 pixelSize = (buf0v == PSC_FILL_32_BITS ? 4 : (buf0v == PSC_FILL_24_BITS ? 3 : 2));
+	for(u32 i = 0; i < buf0Sz; i++) ((u8*)buf0a)[i] = val0>>(i % pixelSize * 8);
+	g_gxFills++;
+}
+
+void GX_displayTransfer(const u32 *const src, const u32 inDim, u32 *const dst, const u32 outDim, const u32 flags)
+{
+	abort();
+}
+
+void GX_textureCopy(const u32 *const src, const u32 inDim, u32 *const dst, const u32 outDim, const u32 size)
+{
+	checkVram(src, size);
+	checkVram(dst, size);
+	TEST_CHECK(inDim == 0 && outDim == 0 && size % 16 == 0);
+	memcpy(dst, src, size);
+	g_gxCopies++;
+}
+
+void GFX_waitForEvent(const GfxEvent event)
+{
+}
+
+void* GFX_getBuffer(const GfxLcd lcd, const GfxSide side)
+{
+	return NULL;
+}
+
+GfxFmt GFX_getFormat(const GfxLcd lcd)
+{
+	return GFX_BGR565;
+}
+
+GfxTopMode GFX_getTopMode(void)
+{
+	return GFX_TOP_2D;
+}
+
+void flushDCacheRange(const void *base, size_t size)
+{
+}
+
+void cleanDCacheRange(const void *base, size_t size)
+{
+}
+
+
+static void testRandomOps(void)
+{
+	for(u32 it = 0; it < 20000; it++)
+	{
+		const GfxFmt dFmt = testRand() % 5, sFmt = testRand() % 5;
+		const int dw = testRange(1, 40), dh = testRange(1, 40);
+		G2dSurface d = newSurface(dw, dh, dFmt);
+		G2dSurface ref = dupSurface(&d);
+
+		// Rectangles partially or fully outside and negative sizes.
+		const int x = testRange(-10, dw), y = testRange(-10, dh);
+		const int w = testRange(-2, dw + 10), h = testRange(-2, dh + 10);
+		const u32 op = testRand() % 5;
+		if(op == 0 || op == 1)
+		{
+			const u32 color = testRand();
+			if(op == 0) G2D_fillRect(&d, x, y, w, h, color);
+			else        G2D_blendFill(&d, x, y, w, h, color);
+			refFill(&ref, x, y, w, h, color, op == 1);
+		}
+		else if(op == 2 || op == 3)
+		{
+			// Same height surfaces allow contiguous column copies.
+			const int sw = testRange(1, 40), sh = (testRand() & 1 ? dh : testRange(1, 40));
+			G2dSurface s = newSurface(sw, sh, sFmt);
+			const int sx = testRange(-10, sw), sy = testRange(-10, sh);
+			const u8 alpha = (testRand() % 4 == 0 ? 255 : testRand());
+			if(op == 2) G2D_copyRect(&d, x, y, &s, sx, sy, w, h);
+			else        G2D_blendRect(&d, x, y, &s, sx, sy, w, h, alpha);
+			refCopy(&ref, x, y, &s, sx, sy, w, h, (op == 2 ? -1 : alpha));
+			free(s.buf);
+		}
+		else
+		{
+			const int sw = testRange(1, 40), sh = testRange(1, 40);
+			G2dSurface s = newSurface(sw, sh, sFmt);
+			const int rw = testRange(1, sw), rh = testRange(1, sh);
+			const int sx = testRange(0, sw - rw), sy = testRange(0, sh - rh);
+			const int scaledW = testRange(1, 60), scaledH = testRange(1, 60);
+			G2D_scaleBlit(&d, x, y, scaledW, scaledH, &s, sx, sy, rw, rh);
+			refScale(&ref, x, y, scaledW, scaledH, &s, sx, sy, rw, rh);
+			free(s.buf);
+		}
+
+		if(!sameSurface(&d, &ref)) printf("Op %lu, formats %d/%d:\n", (unsigned long)op, dFmt, sFmt);
+		TEST_CHECK(sameSurface(&d, &ref));
+		free(d.buf);
+		free(ref.buf);
+	}
+}
+
+static void testOverlappingCopy(void)
+{
+	for(u32 it = 0; it < 2000; it++)
+	{
+		const int w = testRange(1, 30), h = testRange(1, 30);
+		G2dSurface s = newSurface(w, h, testRand() % 5);
+		G2dSurface ref = dupSurface(&s);
+		G2dSurface orig = dupSurface(&s);
+
+		const int dx = testRange(-5, w), dy = testRange(-5, h);
+		const int sx = testRange(-5, w), sy = testRange(-5, h);
+		const int cw = testRange(0, w), ch = testRange(0, h);
+		G2D_copyRect(&s, dx, dy, &s, sx, sy, cw, ch);
+		refCopy(&ref, dx, dy, &orig, sx, sy, cw, ch, -1);
+		TEST_CHECK(sameSurface(&s, &ref));
+
+		free(s.buf);
+		free(ref.buf);
+		free(orig.buf);
+	}
+}
+
+// Full height operations in VRAM with the emulated GPU. Unaligned
+// surfaces and sizes leave heads and tails or fall back to software.
+static void testGx(void)
+{
+	testMapIo(VRAM_BASE, VRAM_TEST_SIZE);
+	for(u32 it = 0; it < 200; it++)
+	{
+		const GfxFmt fmt = testRand() % 5;
+		const int w = testRange(100, 400), h = 240;
+		const u32 size = w * h * pixelSize(fmt);
+		u8 *const vram = (u8*)VRAM_BASE;
+		const u32 dOff = (testRand() & 1 ? 8 : testRange(0, 16)), sOff = (size + 16 + testRange(0, 16)) & ~7u;
+
+		G2dSurface d = {vram + dOff, w, h, fmt};
+		G2dSurface s = {vram + sOff, w, h, fmt};
+		for(u32 i = 0; i < size; i++)
+		{
+			((u8*)d.buf)[i] = testRand();
+			((u8*)s.buf)[i] = testRand();
+		}
+		G2dSurface ref = dupSurface(&d);
+
+		const int x = testRange(-10, w), cw = testRange(1, w);
+		const u32 fills = g_gxFills, copies = g_gxCopies;
+		if(testRand() & 1)
+		{
+			const u32 color = testRand();
+			G2D_fillRect(&d, x, 0, cw, h, color);
+			refFill(&ref, x, 0, cw, h, color, false);
+			// Misaligned 16 and 32 bit pixels can't be filled by the GPU.
+			const int clipped = (x < 0 ? cw + x : (cw > w - x ? w - x : cw));
+			const u32 align = (pixelSize(fmt) == 3 ? 1 : pixelSize(fmt));
+			const bool gx = clipped > 0 && clipped * h * pixelSize(fmt) >= G2D_GX_MIN_SIZE && dOff % align == 0;
+			TEST_CHECK(g_gxFills == fills + gx);
+		}
+		else
+		{
+			const int sx = testRange(0, w - 1);
+			G2D_copyRect(&d, x, 0, &s, sx, 0, cw, h);
+			refCopy(&ref, x, 0, &s, sx, 0, cw, h, -1);
+		}
+		TEST_CHECK(sameSurface(&d, &ref));
+		free(ref.buf);
+
+		if(g_gxCopies != copies) TEST_CHECK(dOff % 8 == 0);
+	}
+
+	// Both paths were taken.
+	TEST_CHECK(g_gxFills > 10 && g_gxCopies > 10);
+}
+
+int main(void)
+{
+	for(u32 fmt = 0; fmt < 5; fmt++)
+	{
+		TEST_CHECK(G2D_packColor(fmt, G2D_RGBA(10, 200, 77, 128)) == fromRgba(fmt, G2D_RGBA(10, 200, 77, 128)));
+	}
+
+	testRandomOps();
+	testOverlappingCopy();
+	testGx();
+
+	return testResult();
+}
\ No newline at end of file
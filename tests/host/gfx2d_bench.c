@@ -0,0 +1,117 @@
+#include <string.h>
+#include <time.h>
+#include "test.h"
+#include "gfx2d_ref.h"
+#include "arm11/gfx2d.h"
+
+
+// Blitter throughput against the naive reference on 400x240 surfaces in host
+// memory. The GPU paths are never taken. Both must produce the same pixels.
+#define WIDTH      (400)
+#define HEIGHT     (240)
+#define ITERATIONS (100u)
+
+
+static G2dSurface g_dst, g_ref, g_src, g_srcBgr8, g_srcAbgr8;
+
+
+
+void GX_memoryFill(u32 *buf0a, u32 buf0v, u32 buf0Sz, u32 val0, u32 *buf1a, u32 buf1v, u32 buf1Sz, u32 val1)
+{
+	abort();
+}
+
+void GX_displayTransfer(const u32 *const src, const u32 inDim, u32 *const dst, const u32 outDim, const u32 flags)
+{
+	abort();
+}
+
+void GX_textureCopy(const u32 *const src, const u32 inDim, u32 *const dst, const u32 outDim, const u32 size)
+{
+	abort();
+}
+
+void GFX_waitForEvent(const GfxEvent event)
+{
+}
+
+void* GFX_getBuffer(const GfxLcd lcd, const GfxSide side)
+{
+	return NULL;
+}
+
+GfxFmt GFX_getFormat(const GfxLcd lcd)
+{
+	return GFX_BGR565;
+}
+
+GfxTopMode GFX_getTopMode(void)
+{
+	return GFX_TOP_2D;
+}
+
+void flushDCacheRange(const void *base, size_t size)
+{
+}
+
+void cleanDCacheRange(const void *base, size_t size)
+{
+}
+
+
+static void fill(void)         { G2D_fillRect(&g_dst, 0, 0, WIDTH, HEIGHT, G2D_RGB(12, 34, 56)); }
+static void refFillAll(void)   { refFill(&g_ref, 0, 0, WIDTH, HEIGHT, G2D_RGB(12, 34, 56), false); }
+static void fillBox(void)      { G2D_fillRect(&g_dst, 50, 50, 300, 140, G2D_RGB(200, 10, 99)); }
+static void refFillBox(void)   { refFill(&g_ref, 50, 50, 300, 140, G2D_RGB(200, 10, 99), false); }
+static void copy(void)         { G2D_copyRect(&g_dst, 0, 0, &g_src, 0, 0, WIDTH, HEIGHT); }
+static void refCopyAll(void)   { refCopy(&g_ref, 0, 0, &g_src, 0, 0, WIDTH, HEIGHT, -1); }
+static void convert(void)      { G2D_copyRect(&g_dst, 0, 0, &g_srcBgr8, 0, 0, WIDTH, HEIGHT); }
+static void refConvert(void)   { refCopy(&g_ref, 0, 0, &g_srcBgr8, 0, 0, WIDTH, HEIGHT, -1); }
+static void blendAll(void)     { G2D_blendRect(&g_dst, 0, 0, &g_srcAbgr8, 0, 0, WIDTH, HEIGHT, 200); }
+static void refBlendAll(void)  { refCopy(&g_ref, 0, 0, &g_srcAbgr8, 0, 0, WIDTH, HEIGHT, 200); }
+static void scale(void)        { G2D_scaleBlit(&g_dst, 0, 0, WIDTH, HEIGHT, &g_src, 100, 60, 200, 120); }
+static void refScaleAll(void)  { refScale(&g_ref, 0, 0, WIDTH, HEIGHT, &g_src, 100, 60, 200, 120); }
+
+static double seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// MPixel/s for iterations of run().
+static double bench(void (*const run)(void), const u32 pixels)
+{
+	const double start = seconds();
+	for(u32 i = 0; i < ITERATIONS; i++) run();
+
+	return ITERATIONS * (double)pixels / (seconds() - start) / 1e6;
+}
+
+static void report(const char *const name, void (*const run)(void), void (*const ref)(void), const u32 pixels)
+{
+	memcpy(g_ref.buf, g_dst.buf, WIDTH * HEIGHT * pixelSize(g_dst.fmt));
+
+	const double mps = bench(run, pixels), refMps = bench(ref, pixels);
+	printf("%s: %.1f MPixel/s, reference: %.1f MPixel/s (%.1fx)\n", name, mps, refMps, mps / refMps);
+	TEST_CHECK(sameSurface(&g_dst, &g_ref));
+}
+
+int main(void)
+{
+	g_dst      = newSurface(WIDTH, HEIGHT, GFX_BGR565);
+	g_ref      = dupSurface(&g_dst);
+	g_src      = newSurface(WIDTH, HEIGHT, GFX_BGR565);
+	g_srcBgr8  = newSurface(WIDTH, HEIGHT, GFX_BGR8);
+	g_srcAbgr8 = newSurface(WIDTH, HEIGHT, GFX_ABGR8);
+
+	report("fill", fill, refFillAll, WIDTH * HEIGHT);
+	report("fill box", fillBox, refFillBox, 300 * 140);
+	report("copy", copy, refCopyAll, WIDTH * HEIGHT);
+	report("BGR8 to BGR565", convert, refConvert, WIDTH * HEIGHT);
+	report("blend ABGR8", blendAll, refBlendAll, WIDTH * HEIGHT);
+	report("scale 2x", scale, refScaleAll, WIDTH * HEIGHT);
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <string.h>
+#include "test.h"
+#include "arm11/gfx2d.h"
+
+
+// Naive reference implementation. One pixel at a time with independent formulas.
+static u32 pixelSize(const GfxFmt fmt)
+{
+	return (fmt == GFX_ABGR8 ? 4 : (fmt == GFX_BGR8 ? 3 : 2));
+}
+
+static u8* pixelPtr(const G2dSurface *const s, const int x, const int y)
+{
+	return (u8*)s->buf + (x * s->height + (s->height - 1 - y)) * pixelSize(s->fmt);
+}
+
+static u32 readPixel(const G2dSurface *const s, const int x, const int y)
+{
+	u32 v = 0;
+	memcpy(&v, pixelPtr(s, x, y), pixelSize(s->fmt));
+	return v;
+}
+
+static void writePixel(const G2dSurface *const s, const int x, const int y, const u32 v)
+{
+	memcpy(pixelPtr(s, x, y), &v, pixelSize(s->fmt));
+}
+
+// Raw pixel to G2D_RGBA().
+static u32 toRgba(const GfxFmt fmt, const u32 v)
+{
+	u32 r, g, b, a = 255;
+	switch(fmt)
+	{
+		case GFX_ABGR8:
+			a = v & 0xFF; b = v>>8 & 0xFF; g = v>>16 & 0xFF; r = v>>24;
+			break;
+		case GFX_BGR8:
+			b = v & 0xFF; g = v>>8 & 0xFF; r = v>>16 & 0xFF;
+			break;
+		case GFX_BGR565:
+			// Same rounding as rgbFive2Eight()/rgbSix2Eight().
+			r = ((v>>11 & 31) * 527 + 23)>>6; g = ((v>>5 & 63) * 259 + 33)>>6; b = ((v & 31) * 527 + 23)>>6;
+			break;
+		case GFX_A1BGR5:
+			r = ((v>>11 & 31) * 527 + 23)>>6; g = ((v>>6 & 31) * 527 + 23)>>6; b = ((v>>1 & 31) * 527 + 23)>>6;
+			a = (v & 1 ? 255 : 0);
+			break;
+		default:
+			r = (v>>12 & 15) * 17; g = (v>>8 & 15) * 17; b = (v>>4 & 15) * 17; a = (v & 15) * 17;
+	}
+
+	return G2D_RGBA(r, g, b, a);
+}
+
+static u32 scaleRound(const u32 c, const u32 max)
+{
+	return (c * max + 127) / 255;
+}
+
+// G2D_RGBA() to raw pixel.
+static u32 fromRgba(const GfxFmt fmt, const u32 c)
+{
+	const u32 r = c & 0xFF, g = c>>8 & 0xFF, b = c>>16 & 0xFF, a = c>>24;
+	switch(fmt)
+	{
+		case GFX_ABGR8:  return a | b<<8 | g<<16 | r<<24;
+		case GFX_BGR8:   return b | g<<8 | r<<16;
+		case GFX_BGR565: return scaleRound(r, 31)<<11 | scaleRound(g, 63)<<5 | scaleRound(b, 31);
+		case GFX_A1BGR5: return scaleRound(r, 31)<<11 | scaleRound(g, 31)<<6 | scaleRound(b, 31)<<1 | (a >= 128);
+		default:         return scaleRound(r, 15)<<12 | scaleRound(g, 15)<<8 | scaleRound(b, 15)<<4 | scaleRound(a, 15);
+	}
+}
+
+// round(x / 255)
+static u32 div255(const u32 x)
+{
+	return (x * 2 + 255) / 510;
+}
+
+// Blends the color channels of s over d. The alpha of d is kept.
+static u32 blend(const u32 s, const u32 d, const u32 a)
+{
+	u32 out = d & 0xFF000000u;
+	for(u32 i = 0; i < 24; i += 8)
+	{
+		out |= div255((s>>i & 0xFF) * a + (d>>i & 0xFF) * (255 - a))<<i;
+	}
+
+	return out;
+}
+
+static G2dSurface newSurface(const int w, const int h, const GfxFmt fmt)
+{
+	const u32 size = w * h * pixelSize(fmt);
+	G2dSurface s = {aligned_alloc(8, (size + 7) & ~7u), w, h, fmt};
+	for(u32 i = 0; i < size; i++) ((u8*)s.buf)[i] = testRand();
+
+	return s;
+}
+
+static G2dSurface dupSurface(const G2dSurface *const s)
+{
+	const u32 size = s->width * s->height * pixelSize(s->fmt);
+	G2dSurface d = *s;
+	d.buf = aligned_alloc(8, (size + 7) & ~7u);
+	memcpy(d.buf, s->buf, size);
+
+	return d;
+}
+
+static bool sameSurface(const G2dSurface *const a, const G2dSurface *const b)
+{
+	return memcmp(a->buf, b->buf, a->width * a->height * pixelSize(a->fmt)) == 0;
+}
+
+static bool inside(const G2dSurface *const s, const int x, const int y)
+{
+	return x >= 0 && y >= 0 && x < s->width && y < s->height;
+}
+
+static void refFill(const G2dSurface *const d, const int x, const int y, const int w, const int h,
+                    const u32 color, const bool blended)
+{
+	const u32 a = color>>24;
+	for(int i = x; i < x + w; i++)
+	{
+		for(int j = y; j < y + h; j++)
+		{
+			if(!inside(d, i, j)) continue;
+
+			if(!blended) writePixel(d, i, j, fromRgba(d->fmt, color));
+			else if(a > 0) writePixel(d, i, j, fromRgba(d->fmt, blend(color, toRgba(d->fmt, readPixel(d, i, j)), a)));
+		}
+	}
+}
+
+static void refCopy(const G2dSurface *const d, const int dx, const int dy, const G2dSurface *const s,
+                    const int sx, const int sy, const int w, const int h, const int alpha)
+{
+	for(int i = 0; i < w; i++)
+	{
+		for(int j = 0; j < h; j++)
+		{
+			if(!inside(d, dx + i, dy + j) || !inside(s, sx + i, sy + j)) continue;
+
+			const u32 raw = readPixel(s, sx + i, sy + j);
+			const u32 c = toRgba(s->fmt, raw);
+			if(alpha < 0)
+			{
+				writePixel(d, dx + i, dy + j, (s->fmt == d->fmt ? raw : fromRgba(d->fmt, c)));
+				continue;
+			}
+
+			const u32 a = div255((c>>24) * alpha);
+			if(a == 0) continue;
+			const u32 dc = toRgba(d->fmt, readPixel(d, dx + i, dy + j));
+			writePixel(d, dx + i, dy + j, fromRgba(d->fmt, blend(c, dc, a)));
+		}
+	}
+}
+
+static void refScale(const G2dSurface *const d, const int dx, const int dy, const int dw, const int dh,
+                     const G2dSurface *const s, const int sx, const int sy, const int sw, const int sh)
+{
+	for(int i = 0; i < dw; i++)
+	{
+		for(int j = 0; j < dh; j++)
+		{
+			if(!inside(d, dx + i, dy + j)) continue;
+
+			// Sample at the pixel center.
+			const int u = sx + (int)((2LL * i + 1) * sw / (2 * dw));
+			const int v = sy + (int)((2LL * j + 1) * sh / (2 * dh));
+			const u32 raw = readPixel(s, u, v);
+			writePixel(d, dx + i, dy + j, (s->fmt == d->fmt ? raw : fromRgba(d->fmt, toRgba(s->fmt, raw))));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,434 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "test.h"
+#include "interleave.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/mcu.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/interrupt.h"
+#include "arm11/drivers/hw_cal.h"
+#include "kernel.h"
+#include "kevent.h"
+#include "debug.h"
+
+
+// The timer ISR is emulated by the test. For the ring it runs on another
+// thread interleaved with the reader at instruction granularity.
+#define READS   (300u)
+#define MAX_RUN (128u)
+
+// hid.c
+#define CPAD_THRESHOLD      (400)
+#define TOUCH_CAL_MIN_RANGE (256)
+
+
+TouchCalBase g_touchCal;
+CirclePadCal1Base g_cpadCal;
+
+static IrqIsr g_timerIsr = NULL;
+static u32 g_tasks = 0;
+static bool g_adcValid = false;
+static CdcAdcData g_adc;
+static atomic_bool g_stop = false;
+
+
+
+KHandle createEvent(UNUSED bool oneShot)
+{
+	return 1;
+}
+
+void deleteEvent(UNUSED KHandle const kevent) {}
+void signalEvent(UNUSED KHandle const kevent, UNUSED bool reschedule) {}
+
+KRes waitForEvent(UNUSED KHandle const kevent)
+{
+	return 0;
+}
+
+// The sampler task never runs. Touch and Circle-Pad are tested without sampling.
+KHandle createTask(UNUSED size_t stackSize, UNUSED uint8_t priority, UNUSED TaskFunc entry, UNUSED void *taskArg)
+{
+	g_tasks++;
+	return 1;
+}
+
+void IRQ_registerIsr(const Interrupt id, UNUSED const u32 prio, UNUSED u32 target, const IrqIsr isr)
+{
+	TEST_CHECK(id == IRQ_TIMER);
+	g_timerIsr = isr;
+}
+
+void IRQ_enable(UNUSED const Interrupt id) {}
+void IRQ_disable(UNUSED const Interrupt id) {}
+void TIMER_start(UNUSED const u16 prescaler, UNUSED const u32 ticks, UNUSED const u8 params) {}
+
+u32 TIMER_stop(void)
+{
+	return 0;
+}
+
+void CODEC_init(void) {}
+
+bool CODEC_getRawAdcData(CdcAdcData *data)
+{
+	if(g_adcValid) *data = g_adc;
+	return g_adcValid;
+}
+
+void MCU_init(void) {}
+
+u32 MCU_subscribeIrqs(UNUSED u32 mask)
+{
+	return 1;
+}
+
+u32 MCU_getSubIrqs(UNUSED u32 sub, UNUSED u32 mask)
+{
+	return 0;
+}
+
+u16 MCU_getExternalHardwareStatus(void)
+{
+	return 0;
+}
+
+u8 MCU_getEarlyButtonsHeld(void)
+{
+	return 0;
+}
+
+void panic(void)
+{
+	printf("panic()\n");
+	exit(1);
+}
+
+// Keys of sample seq in the ring test.
+static u32 keysFor(const u32 seq)
+{
+	return (seq * 2654435761u)>>7 & 0xFFFu;
+}
+
+static void setPad(const u32 keys)
+{
+	*(vu16*)HID_REGS_BASE = keys ^ 0xFFFu;
+}
+
+static void timerIrq(const u32 keys)
+{
+	setPad(keys);
+	g_timerIsr(IRQ_TIMER);
+}
+
+// The timer on the other core. Sample n has keysFor(n).
+static void* sampler(UNUSED void *arg)
+{
+	interleaveBegin(MAX_RUN);
+	while(!atomic_load(&g_stop)) timerIrq(keysFor(hidGetSamplePos()));
+	interleaveEnd();
+
+	return NULL;
+}
+
+static void testRing(void)
+{
+	TEST_CHECK(!hidSetSampleRate(HID_SAMPLE_RATE_MAX + 1));
+	TEST_CHECK(hidSetSampleRate(HID_SAMPLE_RATE_DEFAULT) && g_tasks == 1);
+	pthread_t thread;
+	pthread_create(&thread, NULL, sampler, NULL);
+
+	// Every sample returned must be intact and in order.
+	u32 pos = hidGetSamplePos(), samples = 0, skipped = 0;
+	HidSample buf[HID_RING_SIZE];
+	interleaveBegin(MAX_RUN);
+	for(u32 r = 0; r < READS; r++)
+	{
+		// Mostly fall behind until the ISR is about to overwrite the oldest
+		// sample and read only a few. That is where the ISR overtakes us.
+		u32 max = testRange(1, HID_RING_SIZE);
+		if(r % 4 != 0)
+		{
+			const u32 lag = testRange(HID_RING_SIZE - 1, HID_RING_SIZE);
+			while(hidGetSamplePos() - pos < lag) sched_yield();
+			max = testRange(1, 4);
+		}
+
+		const u32 before = pos;
+		const u32 num = hidReadSamples(&pos, buf, max);
+		bool ok = true;
+		for(u32 i = 0; i < num; i++)
+		{
+			ok &= buf[i].keys == keysFor(buf[i].seq);
+			ok &= i == 0 || buf[i].seq == buf[i - 1].seq + 1;
+		}
+		if(num > 0)
+		{
+			ok &= buf[num - 1].seq == pos - 1 && buf[0].seq >= before;
+			skipped += buf[0].seq - before;
+		}
+		TEST_CHECK(ok);
+		samples += num;
+	}
+	interleaveEnd();
+	atomic_store(&g_stop, true);
+	pthread_join(thread, NULL);
+
+	// Both lost samples and full reads happened.
+	TEST_CHECK(samples > READS && skipped > 0);
+
+	// After an overrun all but the slot being written are returned.
+	for(u32 i = 0; i < HID_RING_SIZE * 2; i++) timerIrq(keysFor(hidGetSamplePos()));
+	TEST_CHECK(hidReadSamples(&pos, buf, HID_RING_SIZE) == HID_RING_SIZE - 1 && buf[0].keys == keysFor(buf[0].seq));
+}
+
+static void testScan(void)
+{
+	// Drain the ring.
+	timerIrq(0);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == 0);
+
+	// A press and release between two scans shows up in down and up.
+	static const u32 pad[5] = {0, KEY_A, 0, KEY_B, KEY_B};
+	for(u32 i = 0; i < 5; i++) timerIrq(pad[i]);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == KEY_B && hidKeysDown() == (KEY_A | KEY_B) && hidKeysUp() == KEY_A);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == KEY_B && hidKeysDown() == 0 && hidKeysUp() == 0);
+	timerIrq(KEY_B | KEY_START);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == (KEY_B | KEY_START) && hidKeysDown() == KEY_START && hidKeysUp() == 0);
+
+	// More samples than the ring holds between scans.
+	for(u32 i = 0; i < HID_RING_SIZE * 3; i++) timerIrq(i & 1 ? KEY_X : 0);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == KEY_X && hidKeysDown() == KEY_X && hidKeysUp() == (KEY_B | KEY_START | KEY_X));
+
+	// Without sampling the pad is read directly.
+	TEST_CHECK(hidSetSampleRate(0));
+	setPad(KEY_Y);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == KEY_Y && hidKeysDown() == KEY_Y && hidKeysUp() == KEY_X);
+
+	// Restarting only scans samples taken from now on.
+	for(u32 i = 0; i < 4; i++) timerIrq(KEY_L);
+	TEST_CHECK(hidSetSampleRate(HID_SAMPLE_RATE_DEFAULT) && g_tasks == 1);
+	timerIrq(KEY_R);
+	hidScanInput();
+	TEST_CHECK(hidKeysHeld() == KEY_R && hidKeysDown() == KEY_R && hidKeysUp() == KEY_Y);
+}
+
+static void setTouch(const u32 x, const u32 y, const u32 penUpMask)
+{
+	for(u32 i = 0; i < 5; i++)
+	{
+		const u16 penUp = (penUpMask>>i & 1u ? BIT(12) : 0);
+		g_adc.touchX[i] = __builtin_bswap16(x | penUp);
+		g_adc.touchY[i] = __builtin_bswap16(y | penUp);
+	}
+}
+
+static void setCpad(const u32 x, const u32 y)
+{
+	for(u32 i = 0; i < 8; i++)
+	{
+		g_adc.cpadX[i] = __builtin_bswap16(x);
+		g_adc.cpadY[i] = __builtin_bswap16(y);
+	}
+}
+
+// Without sampling hidScanInput() reads the ADCs directly.
+static u32 scanAdc(void)
+{
+	hidScanInput();
+	return hidKeysHeld();
+}
+
+// hidInit() and with it the touch calibration only runs once per process.
+// Every calibration is tested in a child.
+static void withTouchCal(const TouchCalBase *const cal, void (*const test)(void))
+{
+	fflush(stdout);
+	const pid_t pid = fork();
+	if(pid == 0)
+	{
+		g_testFails = 0;
+		g_touchCal = *cal;
+		g_cpadCal = (CirclePadCal1Base){2048, 2048};
+		g_adcValid = true;
+		setCpad(2048, 2048);
+		hidInit();
+		test();
+		exit(g_testFails != 0);
+	}
+
+	int status;
+	TEST_CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// Every raw value must map to the nearest pixel on the line through the points.
+// The 16.16 scale is rounded so the error grows by up to half a step per raw value.
+static void checkTouchLine(const TouchCalBase *const cal)
+{
+	const TouchPos *const pos = hidGetTouchPosPtr();
+	bool ok = true;
+	for(u32 raw = 0; raw < 4096; raw++)
+	{
+		setTouch(raw, raw, 0);
+		ok &= scanAdc() == KEY_TOUCH;
+
+		double x = cal->pointX0 + ((double)raw - cal->rawX0) * (cal->pointX1 - cal->pointX0) / (cal->rawX1 - cal->rawX0);
+		double y = cal->pointY0 + ((double)raw - cal->rawY0) * (cal->pointY1 - cal->pointY0) / (cal->rawY1 - cal->rawY0);
+		x = fmin(fmax(x, 0), 319);
+		y = fmin(fmax(y, 0), 239);
+		ok &= fabs(pos->x - x) <= 0.5 + fabs(raw - (double)cal->rawX0) / 131072;
+		ok &= fabs(pos->y - y) <= 0.5 + fabs(raw - (double)cal->rawY0) / 131072;
+	}
+	TEST_CHECK(ok);
+}
+
+static void testTouchLine(void)
+{
+	checkTouchLine(&g_touchCal);
+}
+
+// Broken calibrations map the full ADC range to the screen exactly like
+// the driver did before calibration support.
+static void testTouchFallback(void)
+{
+	const TouchPos *const pos = hidGetTouchPosPtr();
+	bool ok = true;
+	for(u32 raw = 0; raw < 4096; raw++)
+	{
+		setTouch(raw, raw, 0);
+		ok &= scanAdc() == KEY_TOUCH;
+		ok &= pos->x == raw * 320u / 4096u && pos->y == raw * 240u / 4096u;
+	}
+	TEST_CHECK(ok);
+}
+
+static void testTouchFilter(void)
+{
+	// The median of 5 against a sort. All orders including equal samples.
+	// The upper 4 bits are ignored.
+	const TouchPos *const pos = hidGetTouchPosPtr();
+	for(u32 n = 0; n < 5 * 5 * 5 * 5 * 5; n++)
+	{
+		u16 raw[5];
+		u32 sorted[5];
+		for(u32 i = 0, k = n; i < 5; i++, k /= 5)
+		{
+			raw[i] = 200 + k % 5 * 900;
+			u32 j = i;
+			for(; j > 0 && sorted[j - 1] > raw[i]; j--) sorted[j] = sorted[j - 1];
+			sorted[j] = raw[i];
+		}
+
+		setTouch(sorted[2], 4095 - sorted[2], 0);
+		scanAdc();
+		const TouchPos expected = *pos;
+		setTouch(0, 0, 0);
+		for(u32 i = 0; i < 5; i++)
+		{
+			g_adc.touchX[i] = __builtin_bswap16(0xE000u | raw[i]);
+			g_adc.touchY[i] = __builtin_bswap16(0xE000u | (4095 - raw[i]));
+		}
+		scanAdc();
+		TEST_CHECK(pos->x == expected.x && pos->y == expected.y);
+	}
+
+	// A majority of pen down samples decides about KEY_TOUCH. The position
+	// only updates if all samples are pen down.
+	setTouch(2048, 2048, 0);
+	scanAdc();
+	const TouchPos last = *pos;
+	for(u32 penUpMask = 1; penUpMask < 32; penUpMask++)
+	{
+		setTouch(100, 100, penUpMask);
+		const u32 keys = scanAdc();
+		TEST_CHECK(keys == (__builtin_popcount(penUpMask) <= 2 ? KEY_TOUCH : 0));
+		TEST_CHECK(pos->x == last.x && pos->y == last.y);
+	}
+}
+
+static void testCpad(void)
+{
+	setTouch(0, 0, 0x1F);
+	g_cpadCal = (CirclePadCal1Base){2000, 2100};
+	const CpadPos *const pos = hidGetCpadPosPtr();
+	setCpad(2000, 2100);
+	TEST_CHECK(scanAdc() == 0 && pos->x == 0 && pos->y == 0);
+
+	// The average of 8 samples. The upper 4 bits are ignored. X is inverted.
+	for(u32 i = 0; i < 8; i++) g_adc.cpadX[i] = __builtin_bswap16(0xF000u | (i == 7 ? 4000 : 2500));
+	TEST_CHECK(scanAdc() == KEY_CPAD_LEFT && pos->x == -(2500 * 7 + 4000 - 2000 * 8) / 8 && pos->y == 0);
+
+	// Keys beyond the threshold.
+	static const s32 offsets[4] = {-CPAD_THRESHOLD - 1, -CPAD_THRESHOLD, CPAD_THRESHOLD, CPAD_THRESHOLD + 1};
+	for(u32 i = 0; i < 16; i++)
+	{
+		const s32 x = offsets[i % 4], y = offsets[i / 4];
+		setCpad(2000 - x, 2100 + y);
+		u32 expected = 0;
+		if(x > CPAD_THRESHOLD)  expected |= KEY_CPAD_RIGHT;
+		if(x < -CPAD_THRESHOLD) expected |= KEY_CPAD_LEFT;
+		if(y > CPAD_THRESHOLD)  expected |= KEY_CPAD_UP;
+		if(y < -CPAD_THRESHOLD) expected |= KEY_CPAD_DOWN;
+		TEST_CHECK(scanAdc() == expected && pos->x == x && pos->y == y);
+	}
+
+	// Without new ADC data the last keys and positions stay.
+	g_adcValid = false;
+	TEST_CHECK(scanAdc() == (KEY_CPAD_RIGHT | KEY_CPAD_UP) && pos->x == CPAD_THRESHOLD + 1);
+	g_adcValid = true;
+}
+
+static void testTouchAndCpad(void)
+{
+	testTouchLine();
+	testTouchFilter();
+	testCpad();
+}
+
+static void testCal(void)
+{
+	// The full ADC range, a typical calibration and a mirrored one.
+	static const TouchCalBase good[3] =
+	{
+		{0,     0,     0,   0,   4096,  4096,  320, 240},
+		{0x2A0, 0x3A0, 32,  24,  0xD71, 0xC61, 288, 216},
+		{0xD71, 0xC61, 32,  24,  0x2A0, 0x3A0, 288, 216}
+	};
+	withTouchCal(&good[0], testTouchAndCpad);
+	withTouchCal(&good[1], testTouchLine);
+	withTouchCal(&good[2], testTouchLine);
+
+	// Too small raw range, points outside of the screen and a zero point range.
+	static const TouchCalBase broken[4] =
+	{
+		{100, 100, 0,  0, 100 + TOUCH_CAL_MIN_RANGE - 1, 4000, 320, 240},
+		{100, 100 + TOUCH_CAL_MIN_RANGE - 1, 0, 0, 4000, 100, 320, 240},
+		{0,   0,   0,  0, 4096, 4096, 321, 240},
+		{0,   0,   10, 0, 4096, 4096, 10,  240}
+	};
+	for(u32 i = 0; i < 4; i++) withTouchCal(&broken[i], testTouchFallback);
+}
+
+int main(void)
+{
+	testMapIo(HID_REGS_BASE, 0x1000);
+	testMapIo(MPCORE_PRIV_BASE, 0x1000);
+	setPad(0);
+	testCal();
+	hidInit();
+
+	testRing();
+	testScan();
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+
+
+// C versions of the routines in memory.s with the same tail handling.
+
+void copy32(u32 *restrict dst, const u32 *restrict src, u32 size)
+{
+	memcpy(dst, src, size);
+}
+
+void clear32(u32 *ptr, const u32 value, u32 size)
+{
+	for(; size >= 4; size -= 4) *ptr++ = value;
+
+	u8 *p8 = (u8*)ptr;
+	if(size & 2u)
+	{
+		*(u16*)p8 = value;
+		p8 += 2;
+	}
+	if(size & 1u) *p8 = value;
+}
\ No newline at end of file
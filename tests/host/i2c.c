@@ -0,0 +1,460 @@
+#include <string.h>
+#include "test.h"
+#include "arm11/drivers/i2c.h"
+#include "arm11/drivers/interrupt.h"
+#include "kernel.h"
+#include "kevent.h"
+
+
+// Simulated slaves with 256 auto incrementing registers each. Writing the first
+// byte after a start in write mode sets the register pointer. The test queues
+// every transfer it submits on its bus with a plan of which bytes get a NACK.
+// The simulated bus follows the queue and checks the traffic against it.
+#define XFERS      (30000u)
+#define MAX_SIZE   (12u)
+#define QUEUE_SIZE (64u)
+#define TRIES      (8u) // Select tries per transfer in i2c.c.
+
+
+typedef struct
+{
+	I2cXfer xfer;
+	u8 data[MAX_SIZE];   // Input for writes or expected output for reads.
+	u8 buf[MAX_SIZE];
+	u32 selectNacks;     // Number of select bytes with a NACK.
+	u32 nackPhase;       // 0 device, 1 register or 2 device in read mode.
+	s32 dataNackAt;      // Data byte with a NACK or -1.
+	bool expectOk;
+	bool finished;       // Seen by the simulated bus.
+	bool checked;
+} Xfer;
+
+typedef struct
+{
+	Xfer *queue[QUEUE_SIZE];
+	u32 rd, wr;
+	s32 dev;             // Selected device or -1.
+	bool readMode;
+	bool regNext;        // The next byte sent is the register address.
+	bool regSent;        // The register address was accepted in this try.
+	u32 nacks;           // Select bytes with a NACK in the current transfer.
+	bool dataNacked;
+	u32 dataPos;
+} Bus;
+
+static const u8 g_devBus[18]  = {0, 0, 0, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 1, 0, 2};
+static const u8 g_devAddr[18] = {0x4A, 0x7A, 0x78, 0x4A, 0x78, 0x2C, 0x2E, 0x40, 0x44,
+                                 0xD6, 0xD0, 0xD2, 0xA4, 0x9A, 0xA0, 0xEE, 0x40, 0x54};
+static const Interrupt g_busIrq[3] = {IRQ_I2C1, IRQ_I2C2, IRQ_I2C3};
+
+static u8 g_regs[18][256], g_refRegs[18][256];
+static u8 g_ptr[18], g_refPtr[18];
+static Bus g_buses[3];
+static IrqIsr g_isr[3];
+static Xfer g_xfers[XFERS];
+static u32 g_numXfers = 0;
+static u32 g_signals[8];      // Pending event signals.
+static u32 g_numEvents = 0;
+static u32 g_callbacks = 0;
+static u32 g_waits = 0;
+static u32 g_yields = 0;
+
+
+
+KHandle createEvent(UNUSED bool oneShot)
+{
+	TEST_CHECK(g_numEvents < 8);
+	return ++g_numEvents;
+}
+
+void signalEvent(KHandle const kevent, UNUSED bool reschedule)
+{
+	TEST_CHECK(g_testCpsr & PSR_I);
+	g_signals[kevent]++;
+}
+
+static void pump(void);
+
+KRes waitForEvent(KHandle const kevent)
+{
+	TEST_CHECK((g_testCpsr & PSR_I) == 0);
+	for(u32 i = 0; g_signals[kevent] == 0; i++)
+	{
+		if(i == 1000000)
+		{
+			printf("Transfer never finished.\n");
+			exit(1);
+		}
+		pump();
+	}
+	g_signals[kevent]--;
+	g_waits++;
+
+	return 0;
+}
+
+void yieldTask(void)
+{
+	g_yields++;
+	pump();
+}
+
+void IRQ_registerIsr(const Interrupt id, UNUSED const u32 prio, UNUSED u32 target, const IrqIsr isr)
+{
+	for(u32 b = 0; b < 3; b++)
+	{
+		if(g_busIrq[b] == id) g_isr[b] = isr;
+	}
+}
+
+static s32 findDev(const u32 bus, const u8 addr)
+{
+	for(u32 d = 0; d < 18; d++)
+	{
+		if(g_devBus[d] == bus && g_devAddr[d] == addr) return d;
+	}
+
+	return -1;
+}
+
+// Does the operation started by the driver if there is one.
+static void busStep(const u32 b)
+{
+	I2cBus *const regs = getI2cBusRegs(b);
+	Bus *const bus = &g_buses[b];
+	const u8 cnt = regs->cnt;
+	if((cnt & I2C_EN) == 0) return;
+	TEST_CHECK(cnt & I2C_IRQ_EN);
+
+	Xfer *const x = (bus->rd != bus->wr ? bus->queue[bus->rd % QUEUE_SIZE] : NULL);
+	TEST_CHECK(x != NULL);
+	if(x == NULL)
+	{
+		regs->cnt = cnt & ~I2C_EN;
+		return;
+	}
+	const bool hasReg = x->xfer.regAddr < I2C_NO_REG_VAL;
+	const bool last = bus->dataPos == x->xfer.size - 1;
+
+	bool ack = true, end = false;
+	if(cnt & I2C_ERROR)
+	{
+		// Stop after a NACK.
+		TEST_CHECK(cnt & I2C_STOP);
+		bus->dev = -1;
+		bus->regSent = false;
+		end = bus->nacks == TRIES || bus->dataNacked;
+	}
+	else if(cnt & I2C_START)
+	{
+		const u8 addr = regs->data;
+		bus->dev      = findDev(b, addr & ~1u);
+		bus->readMode = addr & 1u;
+		bus->dataPos  = 0;
+		TEST_CHECK(bus->dev == x->xfer.devId);
+		TEST_CHECK(bus->readMode == (x->xfer.read && (!hasReg || bus->regSent)));
+		bus->regNext  = !bus->readMode && hasReg;
+		bus->regSent  = false;
+
+		const u32 phase = (bus->readMode && hasReg ? 2 : 0);
+		if(bus->nacks < x->selectNacks && x->nackPhase == phase)
+		{
+			ack = false;
+			bus->nacks++;
+			bus->dev = -1;
+		}
+	}
+	else if(cnt & I2C_DIR_R)
+	{
+		TEST_CHECK(bus->dev == x->xfer.devId && bus->readMode);
+		TEST_CHECK((cnt & I2C_STOP ? true : false) == last && (cnt & I2C_ACK ? true : false) == !last);
+		regs->data = g_regs[x->xfer.devId][g_ptr[x->xfer.devId]++];
+		bus->dataPos++;
+		end = last;
+	}
+	else
+	{
+		TEST_CHECK(bus->dev == x->xfer.devId && !bus->readMode);
+		const u8 data = regs->data;
+		if(bus->regNext)
+		{
+			TEST_CHECK(data == x->xfer.regAddr && (cnt & I2C_STOP) == 0);
+			if(bus->nacks < x->selectNacks && x->nackPhase == 1)
+			{
+				ack = false;
+				bus->nacks++;
+			}
+			else
+			{
+				g_ptr[bus->dev] = data;
+				bus->regSent = true;
+			}
+			bus->regNext = false;
+		}
+		else
+		{
+			const u32 pos = bus->dataPos++;
+			TEST_CHECK(data == x->data[pos] && (cnt & I2C_STOP ? true : false) == last);
+			if((s32)pos == x->dataNackAt)
+			{
+				ack = false;
+				bus->dataNacked = true;
+			}
+			else if(pos == 0 && !hasReg) g_ptr[bus->dev] = data;
+			else g_regs[bus->dev][g_ptr[bus->dev]++] = data;
+			end = last && ack;
+		}
+	}
+	if(!ack) bus->dev = -1;
+
+	if(end)
+	{
+		x->finished = true;
+		bus->rd++;
+		bus->nacks = 0;
+		bus->dataNacked = false;
+		bus->regSent = false;
+		bus->dev = -1;
+	}
+	regs->cnt = (cnt & ~(I2C_EN | I2C_ACK)) | (ack ? I2C_ACK : 0);
+
+	// The IRQ.
+	g_testCpsr |= PSR_I;
+	g_isr[b](g_busIrq[b]);
+	g_testCpsr &= ~PSR_I;
+}
+
+static void pump(void)
+{
+	TEST_CHECK((g_testCpsr & PSR_I) == 0);
+	busStep(testRand() % 3);
+}
+
+// Updates the reference registers. Transfers on a bus run in order so this
+// can be done at submission.
+static void model(Xfer *const x)
+{
+	const I2cXfer *const xfer = &x->xfer;
+	const u32 dev = xfer->devId;
+	const bool hasReg = xfer->regAddr < I2C_NO_REG_VAL;
+	const bool selectFail = x->selectNacks >= TRIES;
+	x->expectOk = !selectFail && x->dataNackAt < 0;
+
+	if(xfer->read)
+	{
+		if(hasReg && (!selectFail || x->nackPhase == 2)) g_refPtr[dev] = xfer->regAddr;
+		if(!selectFail)
+		{
+			for(u32 i = 0; i < xfer->size; i++) x->data[i] = g_refRegs[dev][g_refPtr[dev]++];
+		}
+	}
+	else if(!selectFail)
+	{
+		if(hasReg) g_refPtr[dev] = xfer->regAddr;
+		for(u32 i = 0; i < xfer->size && (s32)i != x->dataNackAt; i++)
+		{
+			if(i == 0 && !hasReg) g_refPtr[dev] = x->data[0];
+			else g_refRegs[dev][g_refPtr[dev]++] = x->data[i];
+		}
+	}
+}
+
+// A random transfer with a random plan.
+static Xfer* newXfer(const bool write)
+{
+	TEST_CHECK(g_numXfers < XFERS);
+	Xfer *const x = &g_xfers[g_numXfers++];
+	I2cXfer *const xfer = &x->xfer;
+	xfer->devId   = testRange(0, 17);
+	xfer->read    = !write && (testRand() & 1);
+	xfer->size    = testRange(1, (write ? I2C_ASYNC_MAX_SIZE : MAX_SIZE));
+	xfer->regAddr = (testRand() % 5 == 0 ? I2C_NO_REG_VAL : testRange(0, 255));
+	xfer->buf     = (xfer->read ? x->buf : x->data);
+	if(!xfer->read)
+	{
+		for(u32 i = 0; i < xfer->size; i++) x->data[i] = testRand();
+	}
+
+	const bool hasReg = xfer->regAddr < I2C_NO_REG_VAL;
+	x->selectNacks = (testRand() % 6 == 0 ? testRange(1, 10) : 0);
+	x->nackPhase   = (hasReg ? testRange(0, (xfer->read ? 2 : 1)) : 0);
+	x->dataNackAt  = (!xfer->read && testRand() % 8 == 0 ? testRange(0, xfer->size - 1) : -1);
+
+	return x;
+}
+
+// Must be called in the same order the driver gets the transfers.
+static void queueXfer(Xfer *const x)
+{
+	model(x);
+	Bus *const bus = &g_buses[g_devBus[x->xfer.devId]];
+	TEST_CHECK(bus->wr - bus->rd < QUEUE_SIZE);
+	bus->queue[bus->wr++ % QUEUE_SIZE] = x;
+}
+
+// Runs in the ISR. Sometimes queues a follow-up write.
+static void doneCb(I2cXfer *const xfer)
+{
+	TEST_CHECK(g_testCpsr & PSR_I);
+	TEST_CHECK(xfer->state != I2C_XFER_PENDING);
+	g_callbacks++;
+
+	if(testRand() & 1)
+	{
+		Xfer *const next = newXfer(true);
+		next->xfer.done = doneCb;
+		queueXfer(next);
+		I2C_submit(&next->xfer);
+	}
+}
+
+static bool finished(Xfer *const x)
+{
+	if(x->checked || x->xfer.state == I2C_XFER_PENDING) return x->checked;
+
+	TEST_CHECK(x->finished);
+	TEST_CHECK((x->xfer.state == I2C_XFER_OK) == x->expectOk);
+	if(x->expectOk && x->xfer.read) TEST_CHECK(memcmp(x->buf, x->data, x->xfer.size) == 0);
+	x->checked = true;
+
+	return true;
+}
+
+// Runs the buses until everything queued is done and checks the slaves.
+static void drain(void)
+{
+	for(u32 i = 0; i < 100000; i++) pump();
+	for(u32 b = 0; b < 3; b++) TEST_CHECK(g_buses[b].rd == g_buses[b].wr);
+	u32 unfinished = 0;
+	for(u32 i = 0; i < g_numXfers; i++) unfinished += !finished(&g_xfers[i]);
+	TEST_CHECK(unfinished == 0);
+	TEST_CHECK(memcmp(g_regs, g_refRegs, sizeof(g_regs)) == 0);
+
+	// Every signal was waited for.
+	for(u32 e = 0; e < 8; e++) TEST_CHECK(g_signals[e] == 0);
+}
+
+static void testRandom(void)
+{
+	u32 awaited = 0, waits = 0, callbacks = 0;
+	while(g_numXfers < XFERS - 1000)
+	{
+		const u32 action = testRand() % 10;
+		if(action < 3)
+		{
+			Xfer *const x = newXfer(false);
+			if(testRand() % 8 == 0)
+			{
+				x->xfer.done = doneCb;
+				callbacks++;
+			}
+			queueXfer(x);
+			I2C_submit(&x->xfer);
+		}
+		else if(action < 4)
+		{
+			// Fire and forget. The test keeps its own copy. Waiting for a
+			// free slot may run callbacks which submit transfers first.
+			Xfer *const x = newXfer(true);
+			x->checked = true;
+			TEST_CHECK(I2C_writeAsync(x->xfer.devId, x->xfer.regAddr, x->data, x->xfer.size));
+			queueXfer(x);
+		}
+		else if(action < 6)
+		{
+			// Wait for a random unfinished transfer.
+			Xfer *const x = &g_xfers[testRange(g_numXfers > 64 ? g_numXfers - 64 : 0, g_numXfers - 1)];
+			if(!x->checked)
+			{
+				// A single waiter always gets an event.
+				waits += x->xfer.state == I2C_XFER_PENDING;
+				TEST_CHECK(I2C_await(&x->xfer) == x->expectOk);
+				awaited++;
+			}
+		}
+		else pump();
+
+		for(u32 i = (g_numXfers > 64 ? g_numXfers - 64 : 0); i < g_numXfers; i++) finished(&g_xfers[i]);
+	}
+
+	drain();
+	TEST_CHECK(g_waits == waits);
+	TEST_CHECK(awaited > 1000 && g_callbacks >= callbacks && callbacks > 100);
+}
+
+static void testBlocking(void)
+{
+	I2cXfer xfer = {.buf = g_xfers[0].buf, .size = 0, .devId = I2C_DEV_CTR_MCU};
+	I2C_submit(&xfer);
+	TEST_CHECK(xfer.state == I2C_XFER_FAILED && !I2C_await(&xfer));
+	TEST_CHECK(!I2C_writeArray(I2C_DEV_CTR_MCU, 0, "", 0));
+	TEST_CHECK(!I2C_writeAsync(I2C_DEV_CTR_MCU, 0, "123456789", 9));
+
+	// The blocking wrappers on a planned transfer each. They use their own
+	// I2cXfer so only the simulated bus sees these.
+	Xfer *const w = &g_xfers[g_numXfers++];
+	w->xfer = (I2cXfer){.size = 1, .regAddr = 0x10, .devId = I2C_DEV_CTR_MCU};
+	w->data[0] = 0xA5;
+	w->dataNackAt = -1;
+	w->checked = true;
+	Xfer *const r = &g_xfers[g_numXfers++];
+	r->xfer = (I2cXfer){.size = 1, .regAddr = 0x10, .devId = I2C_DEV_CTR_MCU, .read = true};
+	r->dataNackAt = -1;
+	r->checked = true;
+	queueXfer(w);
+	queueXfer(r);
+	const Bus *const bus = &g_buses[I2C_BUS2];
+	TEST_CHECK(I2C_write(I2C_DEV_CTR_MCU, 0x10, 0xA5) && I2C_read(I2C_DEV_CTR_MCU, 0x10) == 0xA5);
+	TEST_CHECK(bus->rd == bus->wr);
+
+	// All select tries fail.
+	Xfer *const f = &g_xfers[g_numXfers++];
+	f->xfer = (I2cXfer){.size = 1, .regAddr = 0x10, .devId = I2C_DEV_CTR_MCU, .read = true};
+	f->selectNacks = TRIES;
+	f->dataNackAt = -1;
+	f->checked = true;
+	queueXfer(f);
+	TEST_CHECK(I2C_read(I2C_DEV_CTR_MCU, 0x10) == 0xFF);
+	TEST_CHECK(bus->rd == bus->wr);
+
+	// Reusing an awaited transfer without waiting must not signal its old event.
+	Xfer *const x = newXfer(false);
+	queueXfer(x);
+	I2C_submit(&x->xfer);
+	TEST_CHECK(I2C_await(&x->xfer) == x->expectOk);
+	x->checked = x->finished = false;
+	queueXfer(x);
+	I2C_submit(&x->xfer);
+	drain();
+
+	// All async slots can be pending at the same time.
+	const u32 yields = g_yields;
+	for(u32 i = 0; i < I2C_ASYNC_SLOTS + 1; i++)
+	{
+		TEST_CHECK(g_yields == yields);
+		Xfer *const a = newXfer(true);
+		a->checked = true;
+		TEST_CHECK(I2C_writeAsync(a->xfer.devId, a->xfer.regAddr, a->data, a->xfer.size));
+		queueXfer(a);
+	}
+	TEST_CHECK(g_yields > yields);
+	drain();
+}
+
+int main(void)
+{
+	testMapIo(I2C1_REGS_BASE, 0x1000);
+	testMapIo(I2C2_REGS_BASE, 0x1000);
+	testMapIo(I2C3_REGS_BASE, 0x1000);
+	for(u32 d = 0; d < 18; d++)
+	{
+		for(u32 r = 0; r < 256; r++) g_regs[d][r] = g_refRegs[d][r] = testRand();
+	}
+	for(u32 b = 0; b < 3; b++) g_buses[b].dev = -1;
+	I2C_init();
+
+	testRandom();
+	testBlocking();
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,394 @@
+#include <string.h>
+#include "test.h"
+#include "img_enc.h"
+
+
+#define MAX_HEIGHT  (300u)
+
+
+typedef struct
+{
+	u8 *buf;
+	u32 size;
+	u32 maxChunk; // Largest single write.
+	u32 writes;
+	u32 failAt;   // Fail this write. 0 never fails.
+} Output;
+
+static ImgEnc g_enc;
+static u8 g_image[MAX_HEIGHT * (IMGENC_MAX_WIDTH * 3 + 8)];
+static u8 g_decoded[MAX_HEIGHT * (1 + IMGENC_MAX_WIDTH * 3)];
+
+
+
+static Result writeCb(void *arg, const void *buf, u32 size)
+{
+	Output *const out = (Output*)arg;
+	if(++out->writes == out->failAt) return RES_DISK_FULL;
+
+	out->buf = realloc(out->buf, out->size + size);
+	memcpy(&out->buf[out->size], buf, size);
+	out->size += size;
+	if(size > out->maxChunk) out->maxChunk = size;
+
+	return RES_OK;
+}
+
+static u32 get32BE(const u8 *const p)
+{
+	return (u32)p[0]<<24 | (u32)p[1]<<16 | (u32)p[2]<<8 | p[3];
+}
+
+static u32 get32LE(const u8 *const p)
+{
+	return p[0] | (u32)p[1]<<8 | (u32)p[2]<<16 | (u32)p[3]<<24;
+}
+
+// Bitwise CRC-32 and Adler-32. Independent of the table driven versions in img_enc.c.
+static u32 refCrc32(const u8 *p, u32 size)
+{
+	u32 crc = 0xFFFFFFFFu;
+	while(size-- > 0)
+	{
+		crc ^= *p++;
+		for(u32 i = 0; i < 8; i++) crc = (crc>>1) ^ (0xEDB88320u & -(crc & 1u));
+	}
+
+	return ~crc;
+}
+
+static u32 refAdler32(const u8 *p, u32 size)
+{
+	u32 a = 1, b = 0;
+	while(size-- > 0)
+	{
+		a = (a + *p++) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	return b<<16 | a;
+}
+
+
+// Minimal inflate for stored and fixed Huffman blocks.
+typedef struct
+{
+	const u8 *in;
+	u32 size;
+	u32 pos;
+	u32 bitBuf;
+	u32 bitCnt;
+	bool error;
+} BitReader;
+
+static u32 getBits(BitReader *const br, const u32 num)
+{
+	while(br->bitCnt < num)
+	{
+		if(br->pos == br->size)
+		{
+			br->error = true;
+			return 0;
+		}
+		br->bitBuf |= (u32)br->in[br->pos++]<<br->bitCnt;
+		br->bitCnt += 8;
+	}
+
+	const u32 val = br->bitBuf & ((1u<<num) - 1);
+	br->bitBuf >>= num;
+	br->bitCnt -= num;
+
+	return val;
+}
+
+// Huffman codes are stored MSB first.
+static u32 getCode(BitReader *const br, const u32 len)
+{
+	u32 code = 0;
+	for(u32 i = 0; i < len; i++) code = code<<1 | getBits(br, 1);
+
+	return code;
+}
+
+static u32 decodeFixedLitLen(BitReader *const br)
+{
+	u32 code = getCode(br, 7);
+	if(code <= 23) return 256 + code;
+	code = code<<1 | getBits(br, 1);
+	if(code >= 48 && code <= 191) return code - 48;
+	if(code >= 192 && code <= 199) return 280 + code - 192;
+	code = code<<1 | getBits(br, 1);
+
+	return 144 + code - 400;
+}
+
+// Returns the decompressed size or 0 on error.
+static u32 inflate(const u8 *const in, const u32 size, u8 *const out, const u32 maxSize)
+{
+	static const u16 lenBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+	                                67, 83, 99, 115, 131, 163, 195, 227, 258};
+	static const u8 lenExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	static const u16 distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	                                 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+	static const u8 distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+	                                 11, 11, 12, 12, 13, 13};
+
+	BitReader br = {in, size, 0, 0, 0, false};
+	u32 outPos = 0;
+	bool final;
+	do
+	{
+		final = getBits(&br, 1);
+		const u32 type = getBits(&br, 2);
+		if(type == 0)
+		{
+			br.bitBuf = br.bitCnt = 0; // Skip to the byte boundary.
+			const u32 len = getBits(&br, 16);
+			if((len ^ getBits(&br, 16)) != 0xFFFF || br.size - br.pos < len || maxSize - outPos < len) return 0;
+			memcpy(&out[outPos], &br.in[br.pos], len);
+			br.pos += len;
+			outPos += len;
+		}
+		else if(type == 1)
+		{
+			while(!br.error)
+			{
+				const u32 sym = decodeFixedLitLen(&br);
+				if(sym < 256)
+				{
+					if(outPos == maxSize) return 0;
+					out[outPos++] = sym;
+				}
+				else if(sym == 256) break;
+				else if(sym <= 285)
+				{
+					// Length 258 must use code 285. zlib rejects 284 with all extra bits set.
+					const u32 len = lenBase[sym - 257] + getBits(&br, lenExtra[sym - 257]);
+					if(sym == 284 && len == 258) return 0;
+					const u32 distSym = getCode(&br, 5);
+					if(distSym >= 30) return 0;
+					const u32 dist = distBase[distSym] + getBits(&br, distExtra[distSym]);
+					if(dist > outPos || dist > IMGENC_WINDOW_SIZE || maxSize - outPos < len) return 0;
+					for(u32 i = 0; i < len; i++, outPos++) out[outPos] = out[outPos - dist];
+				}
+				else return 0;
+			}
+		}
+		else return 0; // The encoder never uses dynamic Huffman codes.
+	} while(!final && !br.error);
+
+	return (br.error ? 0 : outPos);
+}
+
+static u8 paeth(const u8 a, const u8 b, const u8 c)
+{
+	const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return (pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+}
+
+// Decodes a PNG and compares it with the BGR8 input image.
+static bool checkPng(const Output *const out, const u8 *const image, const u32 stride, const u32 width, const u32 height)
+{
+	static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	if(out->size < 8 || memcmp(out->buf, signature, 8) != 0) return false;
+
+	// Collect the IDAT data and check all CRCs.
+	static u8 zlib[MAX_HEIGHT * (1 + IMGENC_MAX_WIDTH * 3) * 2];
+	u32 zlibSize = 0;
+	u32 pos = 8;
+	bool ihdr = false, iend = false;
+	while(pos < out->size && !iend)
+	{
+		if(out->size - pos < 12) return false;
+		const u32 len = get32BE(&out->buf[pos]);
+		const u8 *const type = &out->buf[pos + 4];
+		const u8 *const data = &out->buf[pos + 8];
+		if(out->size - pos - 12 < len || get32BE(&data[len]) != refCrc32(type, 4 + len)) return false;
+
+		if(memcmp(type, "IHDR", 4) == 0)
+		{
+			static const u8 fmt[5] = {8, 2, 0, 0, 0};
+			if(pos != 8 || len != 13 || get32BE(data) != width || get32BE(&data[4]) != height ||
+			   memcmp(&data[8], fmt, 5) != 0) return false;
+			ihdr = true;
+		}
+		else if(memcmp(type, "IDAT", 4) == 0)
+		{
+			if(!ihdr || zlibSize + len > sizeof(zlib)) return false;
+			memcpy(&zlib[zlibSize], data, len);
+			zlibSize += len;
+		}
+		else if(memcmp(type, "IEND", 4) == 0) iend = (len == 0);
+		else return false;
+
+		pos += 12 + len;
+	}
+	if(!iend || pos != out->size || zlibSize < 6) return false;
+
+	// zlib header, deflate data and Adler-32 of the decompressed data.
+	if((zlib[0] & 0x0F) != 8 || (zlib[0]<<8 | zlib[1]) % 31 != 0 || (zlib[1] & 0x20) != 0) return false;
+	const u32 rowSize = 1 + width * 3;
+	const u32 size = inflate(&zlib[2], zlibSize - 6, g_decoded, sizeof(g_decoded));
+	if(size != rowSize * height || get32BE(&zlib[zlibSize - 4]) != refAdler32(g_decoded, size)) return false;
+
+	// Undo the filters in place and compare.
+	for(u32 y = 0; y < height; y++)
+	{
+		u8 *const row = &g_decoded[rowSize * y + 1];
+		const u8 *const prev = (y > 0 ? &g_decoded[rowSize * (y - 1) + 1] : NULL);
+		const u8 filter = row[-1];
+		for(u32 i = 0; i < width * 3; i++)
+		{
+			const u8 a = (i >= 3 ? row[i - 3] : 0), b = (prev ? prev[i] : 0), c = (prev && i >= 3 ? prev[i - 3] : 0);
+			switch(filter)
+			{
+				case 0: break;
+				case 1: row[i] += a; break;
+				case 2: row[i] += b; break;
+				case 3: row[i] += (a + b) / 2; break;
+				case 4: row[i] += paeth(a, b, c); break;
+				default: return false;
+			}
+		}
+
+		const u8 *const src = &image[stride * y];
+		for(u32 x = 0; x < width; x++)
+		{
+			if(row[x * 3] != src[x * 3 + 2] || row[x * 3 + 1] != src[x * 3 + 1] || row[x * 3 + 2] != src[x * 3])
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool checkBmp(const Output *const out, const u8 *const image, const u32 stride, const u32 width, const u32 height)
+{
+	const u32 rowSize = (width * 3 + 3) & ~3u;
+	const u8 *const hdr = out->buf;
+	if(out->size != 54 + rowSize * height || hdr[0] != 'B' || hdr[1] != 'M' || get32LE(&hdr[2]) != out->size ||
+	   get32LE(&hdr[10]) != 54 || get32LE(&hdr[14]) != 40 || get32LE(&hdr[18]) != width ||
+	   (s32)get32LE(&hdr[22]) != -(s32)height || hdr[26] != 1 || hdr[28] != 24 || get32LE(&hdr[30]) != 0)
+		return false;
+
+	// Top to bottom BGR rows padded with zeros.
+	for(u32 y = 0; y < height; y++)
+	{
+		const u8 *const row = &out->buf[54 + rowSize * y];
+		if(memcmp(row, &image[stride * y], width * 3) != 0) return false;
+		for(u32 i = width * 3; i < rowSize; i++) if(row[i] != 0) return false;
+	}
+
+	return true;
+}
+
+// Encodes in random batches of rows. The caller frees the output.
+static Result encode(Output *const out, const ImgEncFmt fmt, const u8 *const image, const u32 stride,
+                     const u32 width, const u32 height)
+{
+	Result res = IMGENC_start(&g_enc, fmt, width, height, writeCb, out);
+	for(u32 y = 0; y < height && res == RES_OK;)
+	{
+		const u32 num = testRange(1, (testRand() & 1 ? 3 : height - y));
+		res = IMGENC_writeRows(&g_enc, &image[stride * y], stride, (num > height - y ? height - y : num));
+		y += num;
+	}
+	if(res == RES_OK) res = IMGENC_finish(&g_enc);
+
+	return res;
+}
+
+static void fillImage(const u32 kind, const u32 stride, const u32 width, const u32 height)
+{
+	for(u32 y = 0; y < height; y++)
+	{
+		for(u32 i = 0; i < stride; i++)
+		{
+			const u32 x = i / 3;
+			u8 v;
+			switch(kind)
+			{
+				case 0:  v = testRand(); break;                              // Incompressible.
+				case 1:  v = ((x / 16 + y / 16) & 1) * 200 + i % 3; break;   // Long matches.
+				case 2:  v = (x * y + i % 3); break;                         // Gradients.
+				case 3:  v = (testRand() % 8 == 0 ? testRand() : 7); break;  // Short runs.
+				default: v = 7;                                              // Constant.
+			}
+			g_image[stride * y + i] = v;
+		}
+	}
+}
+
+static void testImages(void)
+{
+	static const u32 sizes[][2] = {{1, 1}, {1, 300}, {2, 3}, {13, 17}, {400, 240}, {320, 240}, {IMGENC_MAX_WIDTH, 100}};
+	for(u32 s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+	{
+		for(u32 kind = 0; kind < 5; kind++)
+		{
+			const u32 width = sizes[s][0], height = sizes[s][1];
+			const u32 stride = width * 3 + testRange(0, 2) * 4;
+			fillImage(kind, stride, width, height);
+
+			for(u32 fmt = IMGENC_BMP; fmt <= IMGENC_PNG; fmt++)
+			{
+				// The output must not depend on how the rows are batched.
+				Output a = {0}, b = {0};
+				TEST_CHECK(encode(&a, fmt, g_image, stride, width, height) == RES_OK);
+				TEST_CHECK(encode(&b, fmt, g_image, stride, width, height) == RES_OK);
+				TEST_CHECK(a.size == b.size && memcmp(a.buf, b.buf, a.size) == 0);
+				TEST_CHECK(a.maxChunk <= IMGENC_CHUNK_SIZE + 12);
+
+				const bool ok = (fmt == IMGENC_PNG ? checkPng(&a, g_image, stride, width, height) :
+				                                     checkBmp(&a, g_image, stride, width, height));
+				if(!ok) printf("Format %lu, %lux%lu, kind %lu:\n", (unsigned long)fmt, (unsigned long)width,
+				               (unsigned long)height, (unsigned long)kind);
+				TEST_CHECK(ok);
+
+				// Repeated content must compress to less than a quarter of the raw size.
+				if(fmt == IMGENC_PNG && (kind == 1 || kind == 4) && width * height >= 1000)
+					TEST_CHECK(a.size < width * height * 3 / 4);
+
+				free(a.buf);
+				free(b.buf);
+			}
+		}
+	}
+}
+
+static void testErrors(void)
+{
+	Output out = {0};
+	TEST_CHECK(IMGENC_start(&g_enc, IMGENC_PNG, 0, 1, writeCb, &out) == RES_INVALID_ARG);
+	TEST_CHECK(IMGENC_start(&g_enc, IMGENC_PNG, IMGENC_MAX_WIDTH + 1, 1, writeCb, &out) == RES_INVALID_ARG);
+	TEST_CHECK(IMGENC_start(&g_enc, IMGENC_BMP, 1, 0, writeCb, &out) == RES_INVALID_ARG);
+	TEST_CHECK(IMGENC_start(&g_enc, IMGENC_PNG + 1, 1, 1, writeCb, &out) == RES_INVALID_ARG);
+	TEST_CHECK(IMGENC_start(&g_enc, IMGENC_BMP, 1, 1, NULL, &out) == RES_INVALID_ARG);
+	TEST_CHECK(out.writes == 0);
+
+	// Too many rows and finishing early.
+	TEST_CHECK(IMGENC_start(&g_enc, IMGENC_PNG, 4, 2, writeCb, &out) == RES_OK);
+	TEST_CHECK(IMGENC_writeRows(&g_enc, g_image, 12, 3) == RES_INVALID_ARG);
+	TEST_CHECK(IMGENC_writeRows(&g_enc, g_image, 12, 1) == RES_OK);
+	TEST_CHECK(IMGENC_finish(&g_enc) == RES_INVALID_ARG);
+	free(out.buf);
+
+	// Write errors are sticky and stop all further writes.
+	for(u32 fmt = IMGENC_BMP; fmt <= IMGENC_PNG; fmt++)
+	{
+		fillImage(0, 400 * 3, 400, 240);
+		Output fail = {0};
+		fail.failAt = 3;
+		TEST_CHECK(encode(&fail, fmt, g_image, 400 * 3, 400, 240) == RES_DISK_FULL);
+		TEST_CHECK(fail.writes == 3 && IMGENC_finish(&g_enc) == RES_DISK_FULL && fail.writes == 3);
+		free(fail.buf);
+	}
+}
+
+int main(void)
+{
+	testImages();
+	testErrors();
+
+	return testResult();
+}
\ No newline at end of file
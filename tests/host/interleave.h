@@ -0,0 +1,44 @@
+#pragma once
+
+#include <sched.h>
+#include <signal.h>
+#include "types.h"
+
+
+// Interleaves threads at random instruction boundaries. A thread between
+// interleaveBegin() and interleaveEnd() is single stepped with the trap flag
+// and yields to the other threads after up to maxRun instructions. Short runs
+// are more likely. Even a single CPU host then sees all intermediate states.
+// Long runs stand in for a preempted core. x86-64 only.
+static _Thread_local u32 g_interleaveMaxRun = 1;
+
+static u32 interleaveRand(void)
+{
+	static _Thread_local u32 state = 0x9E3779B9u;
+	state ^= state<<13;
+	state ^= state>>17;
+	state ^= state<<5;
+	return state;
+}
+
+static void interleaveStep(UNUSED int sig)
+{
+	static _Thread_local u32 left = 0;
+	if(left-- == 0)
+	{
+		left = interleaveRand() % ((g_interleaveMaxRun>>(interleaveRand() % 8)) + 1);
+		sched_yield();
+	}
+}
+
+static inline void interleaveBegin(const u32 maxRun)
+{
+	g_interleaveMaxRun = maxRun;
+	signal(SIGTRAP, interleaveStep);
+	__asm__ volatile("pushfq\n\torq $0x100, (%%rsp)\n\tpopfq" ::: "cc", "memory");
+}
+
+static inline void interleaveEnd(void)
+{
+	__asm__ volatile("pushfq\n\tandq $~0x100, (%%rsp)\n\tpopfq" ::: "cc", "memory");
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "io_trap.h"
+
+
+#define EFLAGS_TF     (1u<<8)
+#define PF_ERR_WRITE  (1u<<1)
+
+
+static uintptr_t g_base;
+static size_t g_size;
+static IoTrapRead g_read;
+static IoTrapWrite g_write;
+static uintptr_t g_writeAddr = 0; // Register written by the instruction being stepped. 0 for reads.
+
+
+
+// Lets the faulting instruction access the real memory and single steps it.
+// The registers read are filled in beforehand and writes are picked up after the step.
+static void segvHandler(int sig, siginfo_t *info, void *ctx)
+{
+	ucontext_t *const uc = (ucontext_t*)ctx;
+	const uintptr_t addr = (uintptr_t)info->si_addr & ~(uintptr_t)3;
+	if(addr < g_base || addr - g_base >= g_size)
+	{
+		signal(sig, SIG_DFL);
+		return;
+	}
+
+	mprotect((void*)g_base, g_size, PROT_READ | PROT_WRITE);
+	if(uc->uc_mcontext.gregs[REG_ERR] & PF_ERR_WRITE) g_writeAddr = addr;
+	else *(volatile u32*)addr = g_read(addr);
+	uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+}
+
+static void trapHandler(UNUSED int sig, UNUSED siginfo_t *info, void *ctx)
+{
+	ucontext_t *const uc = (ucontext_t*)ctx;
+	if(g_writeAddr != 0) g_write(g_writeAddr, *(volatile u32*)g_writeAddr);
+	g_writeAddr = 0;
+
+	mprotect((void*)g_base, g_size, PROT_NONE);
+	uc->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+}
+
+void ioTrapInit(uintptr_t base, size_t size, IoTrapRead read, IoTrapWrite write)
+{
+	void *const p = mmap((void*)base, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(p != (void*)base)
+	{
+		printf("Failed to map IO region 0x%08lX.\n", (unsigned long)base);
+		exit(1);
+	}
+
+	g_base  = base;
+	g_size  = size;
+	g_read  = read;
+	g_write = write;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sa.sa_sigaction = segvHandler;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = trapHandler;
+	sigaction(SIGTRAP, &sa, NULL);
+}
\ No newline at end of file
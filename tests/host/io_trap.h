@@ -0,0 +1,13 @@
+#pragma once
+
+#include "types.h"
+
+
+// Emulates IO registers with side effects like FIFOs. The region is mapped
+// without access rights. Each access faults and is routed to the callbacks.
+// Only works on x86-64 Linux. Registers are 32 bit, byte accesses
+// see the whole register. Read-modify-write instructions are not supported.
+typedef u32 (*IoTrapRead)(uintptr_t addr);
+typedef void (*IoTrapWrite)(uintptr_t addr, u32 val);
+
+void ioTrapInit(uintptr_t base, size_t size, IoTrapRead read, IoTrapWrite write);
\ No newline at end of file
@@ -0,0 +1,291 @@
+#include <string.h>
+#include "test.h"
+#include "ipc_handler.h"
+#include "ipc_cache.h"
+
+
+// Two incoherent write back caches over one memory region. The ARM11 allocates
+// on writes and prefetches speculatively. The ARM9 only allocates on reads.
+// Lines are evicted at random. A byte read through either cache must always
+// be the last one written by the program.
+#define MEM_SIZE    (8192u)
+#define LINE_SIZE   (32u)
+#define LINES       (MEM_SIZE / LINE_SIZE)
+#define WHOLE_SIZE  (4096u) // Range operations switch to whole cache operations at this size like cache.s.
+#define ARM11       (0u)
+#define ARM9        (1u)
+
+
+typedef struct
+{
+	u8 data[LINE_SIZE];
+	bool valid;
+	bool dirty;
+} Line;
+
+alignas(LINE_SIZE) static u8 g_mem[MEM_SIZE];
+static u8 g_expected[MEM_SIZE]; // What the program expects to read.
+static Line g_caches[2][LINES];
+static u32 g_cpu = ARM11;       // Which CPU does the cache operations.
+static u32 g_lineOps = 0;
+
+
+
+static void writeBack(const u32 cpu, const u32 l)
+{
+	Line *const line = &g_caches[cpu][l];
+	if(line->valid && line->dirty)
+	{
+		memcpy(&g_mem[l * LINE_SIZE], line->data, LINE_SIZE);
+		line->dirty = false;
+	}
+}
+
+static void fill(const u32 cpu, const u32 l)
+{
+	Line *const line = &g_caches[cpu][l];
+	if(!line->valid)
+	{
+		memcpy(line->data, &g_mem[l * LINE_SIZE], LINE_SIZE);
+		line->valid = true;
+		line->dirty = false;
+	}
+}
+
+static u8 load(const u32 cpu, const u32 addr)
+{
+	fill(cpu, addr / LINE_SIZE);
+	return g_caches[cpu][addr / LINE_SIZE].data[addr % LINE_SIZE];
+}
+
+static void store(const u32 cpu, const u32 addr, const u8 val)
+{
+	Line *const line = &g_caches[cpu][addr / LINE_SIZE];
+	if(!line->valid)
+	{
+		if(cpu == ARM9)
+		{
+			g_mem[addr] = val;
+			return;
+		}
+		fill(cpu, addr / LINE_SIZE);
+	}
+	line->data[addr % LINE_SIZE] = val;
+	line->dirty = true;
+}
+
+// Random evictions and ARM11 speculative prefetches.
+static void noise(void)
+{
+	for(u32 cpu = 0; cpu < 2; cpu++)
+	{
+		if(testRand() % 4 == 0)
+		{
+			const u32 l = testRand() % LINES;
+			writeBack(cpu, l);
+			g_caches[cpu][l].valid = false;
+		}
+	}
+	if(testRand() % 3 == 0) fill(ARM11, testRand() % LINES);
+}
+
+static void lineRange(const void *const base, const size_t size, u32 *const start, u32 *const end)
+{
+	const u32 off = (const u8*)base - g_mem;
+	*start = off / LINE_SIZE;
+	*end   = (off + size + LINE_SIZE - 1) / LINE_SIZE;
+	if(off >= MEM_SIZE || *end > LINES)
+	{
+		printf("Cache operation outside of the memory.\n");
+		exit(1);
+	}
+}
+
+static void flushAll(void)
+{
+	for(u32 l = 0; l < LINES; l++)
+	{
+		writeBack(g_cpu, l);
+		g_caches[g_cpu][l].valid = false;
+	}
+}
+
+void cleanDCacheRange(const void *base, size_t size)
+{
+	if(size >= WHOLE_SIZE)
+	{
+		for(u32 l = 0; l < LINES; l++) writeBack(g_cpu, l);
+		return;
+	}
+
+	u32 start, end;
+	lineRange(base, size, &start, &end);
+	for(u32 l = start; l < end; l++, g_lineOps++) writeBack(g_cpu, l);
+}
+
+void flushDCacheRange(const void *base, size_t size)
+{
+	if(size >= WHOLE_SIZE)
+	{
+		flushAll();
+		return;
+	}
+
+	u32 start, end;
+	lineRange(base, size, &start, &end);
+	for(u32 l = start; l < end; l++, g_lineOps++)
+	{
+		writeBack(g_cpu, l);
+		g_caches[g_cpu][l].valid = false;
+	}
+}
+
+// Partial lines at both ends are cleaned first.
+void invalidateDCacheRange(const void *base, size_t size)
+{
+	if(size >= WHOLE_SIZE)
+	{
+		flushAll();
+		return;
+	}
+
+	u32 start, end;
+	lineRange(base, size, &start, &end);
+	const u32 off = (const u8*)base - g_mem;
+	if(off % LINE_SIZE != 0)          writeBack(g_cpu, start);
+	if((off + size) % LINE_SIZE != 0) writeBack(g_cpu, end - 1);
+	for(u32 l = start; l < end; l++, g_lineOps++) g_caches[g_cpu][l].valid = false;
+}
+
+
+// One command with up to 3 send and 3 receive buffers close together. Neighbours
+// share lines. The ARM9 fully writes the receive buffers in fullMask but maybe
+// only a part of the others. Returns false if the ARM11 read a wrong byte.
+static bool runCommand(const u32 cmd, const u32 fullMask, const u32 it)
+{
+	const u32 sendBufs = IPC_CMD_SEND_BUFS_MASK(cmd), bufs = sendBufs + IPC_CMD_RECV_BUFS_MASK(cmd);
+	if(bufs == 0) return true;
+
+	u32 buf[6 * sizeof(IpcBuffer) / 4];
+	u32 offs[6], sizes[6];
+	u32 pos = testRange(64, MEM_SIZE / 4);
+	for(u32 i = 0; i < bufs; i++)
+	{
+		pos += testRange(0, 39);
+		sizes[i] = (testRand() % 20 == 0 ? testRange(WHOLE_SIZE, WHOLE_SIZE + 255) : testRange(1, 100));
+		offs[i] = pos;
+		pos += sizes[i];
+		((IpcBuffer*)buf)[i] = (IpcBuffer){&g_mem[offs[i]], sizes[i]};
+	}
+	if(pos + 64 > MEM_SIZE) return true;
+
+	// The ARM11 writes buffers and neighbours (memset() before fRead() for example).
+	const u32 winStart = offs[0] - 64, winEnd = pos + 64;
+	for(u32 a = winStart; a < winEnd; a++)
+	{
+		if(testRand() % 3 == 0)
+		{
+			g_expected[a] = testRand();
+			store(ARM11, a, g_expected[a]);
+		}
+		else g_expected[a] = load(ARM11, a);
+		noise();
+	}
+	g_cpu = ARM11;
+	IPCCACHE_beforeSend(cmd, buf, 0);
+	noise();
+
+	g_cpu = ARM9;
+	IPCCACHE_beforeHandle(cmd, buf, 0);
+	bool ok = true;
+	for(u32 i = 0; i < sendBufs; i++)
+	{
+		for(u32 k = 0; k < sizes[i]; k++)
+		{
+			ok &= load(ARM9, offs[i] + k) == g_expected[offs[i] + k];
+			noise();
+		}
+	}
+	TEST_CHECK(ok);
+	for(u32 i = sendBufs; i < bufs; i++)
+	{
+		const u32 written = (fullMask & BIT(i) ? sizes[i] : testRange(0, sizes[i]));
+		for(u32 k = 0; k < written; k++)
+		{
+			g_expected[offs[i] + k] = testRand();
+			store(ARM9, offs[i] + k, g_expected[offs[i] + k]);
+			noise();
+		}
+	}
+	IPCCACHE_afterHandle(cmd, buf, 0);
+	noise();
+
+	// The ARM11 sees the results and its own data around them.
+	g_cpu = ARM11;
+	IPCCACHE_afterResponse(cmd, buf, 0);
+	u32 bad = 0;
+	for(u32 a = winStart; a < winEnd; a++)
+	{
+		bad += load(ARM11, a) != g_expected[a];
+		noise();
+	}
+	if(bad > 0) printf("Iteration %lu: %lu bad bytes.\n", (unsigned long)it, (unsigned long)bad);
+
+	return bad == 0;
+}
+
+static void testCommands(void)
+{
+	for(u32 it = 0; it < 20000; it++)
+	{
+		const u32 sendBufs = testRange(0, 3), recvBufs = testRange(0, 3);
+		u32 outMask = 0;
+		for(u32 i = sendBufs; i < sendBufs + recvBufs; i++) outMask |= (testRand() & 1)<<i;
+
+		TEST_CHECK(runCommand(outMask<<24 | sendBufs<<6 | recvBufs<<4, outMask, it));
+	}
+}
+
+static void testShortReads(void)
+{
+	// fRead() stops at the end of the file and fReadDir() at the last entry.
+	// The rest of the buffer must keep what the ARM11 wrote.
+	for(u32 it = 0; it < 2000; it++)
+	{
+		TEST_CHECK(runCommand(IPC_CMD9_FREAD, 0, it));
+		TEST_CHECK(runCommand(IPC_CMD9_FREAD_DIR, 0, it));
+	}
+}
+
+static void testSkip(void)
+{
+	// Skipped and empty buffers get no cache operations at all.
+	const u32 cmd = IPC_CMD_OUT_BUF(3) | 2u<<6 | 2u<<4;
+	IpcBuffer bufs[4] = {{&g_mem[0], 64}, {&g_mem[256], 0}, {&g_mem[512], 64}, {NULL, 64}};
+	const u32 *const buf = (const u32*)bufs;
+	g_lineOps = 0;
+	IPCCACHE_beforeSend(cmd, buf, BIT(0) | BIT(2));
+	IPCCACHE_afterResponse(cmd, buf, BIT(0) | BIT(2));
+	IPCCACHE_beforeHandle(cmd, buf, BIT(0) | BIT(2));
+	IPCCACHE_afterHandle(cmd, buf, BIT(0) | BIT(2));
+	TEST_CHECK(g_lineOps == 0);
+
+	// 2 lines each. Receive buffers twice on both sides.
+	IPCCACHE_beforeSend(cmd, buf, 0);
+	TEST_CHECK(g_lineOps == 4);
+	IPCCACHE_afterResponse(cmd, buf, 0);
+	TEST_CHECK(g_lineOps == 6);
+	IPCCACHE_beforeHandle(cmd, buf, 0);
+	TEST_CHECK(g_lineOps == 10);
+	IPCCACHE_afterHandle(cmd, buf, 0);
+	TEST_CHECK(g_lineOps == 12);
+}
+
+int main(void)
+{
+	testCommands();
+	testShortReads();
+	testSkip();
+
+	return testResult();
+}
\ No newline at end of file
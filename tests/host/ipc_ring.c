@@ -0,0 +1,311 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "test.h"
+#include "ipc_ring.h"
+#include "ipc_handler.h"
+
+
+// Incoherent cache model. Each side works on a private copy (its cache) of the ring.
+// Clean copies lines to memory and invalidate reloads them. Nothing else moves data
+// so a missing or misplaced cache operation shows up as stale data.
+#define PRODUCERS   (3u)
+#define ITERATIONS  (5000u)
+#define CMD_ECHO    (1u<<16 | 1u<<8 | 1u<<6 | 1u<<4) // 1 send and 1 receive buffer.
+#define BUF_WORDS   (2 * sizeof(IpcBuffer) / 4)
+
+
+alignas(IPC_RING_LINE_SIZE) static IpcRing g_viewProd, g_viewCons, g_mem;
+static _Thread_local u8 *g_view = (u8*)&g_viewProd;
+static IpcRingProducer g_prod;
+static IpcRingConsumer g_cons;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool g_doorbell = false, g_stop = false;
+static atomic_uint g_errors = 0;
+
+
+
+static void lineRange(const void *const p, const size_t size, size_t *const off, size_t *const len)
+{
+	const size_t o = (const u8*)p - g_view;
+	const size_t start = o & ~(size_t)(IPC_RING_LINE_SIZE - 1);
+	const size_t end = (o + size + IPC_RING_LINE_SIZE - 1) & ~(size_t)(IPC_RING_LINE_SIZE - 1);
+	if(o >= sizeof(IpcRing) || end > sizeof(IpcRing))
+	{
+		printf("Cache operation outside of the ring.\n");
+		exit(1);
+	}
+	*off = start;
+	*len = end - start;
+}
+
+void cleanDCacheRange(const void *base, size_t size)
+{
+	if(size == 0) return;
+	size_t off, len;
+	lineRange(base, size, &off, &len);
+	memcpy((u8*)&g_mem + off, g_view + off, len);
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+void invalidateDCacheRange(const void *base, size_t size)
+{
+	if(size == 0) return;
+	size_t off, len;
+	atomic_thread_fence(memory_order_seq_cst);
+	lineRange(base, size, &off, &len);
+	memcpy(g_view + off, (u8*)&g_mem + off, len);
+}
+
+void flushDCacheRange(const void *base, size_t size)
+{
+	cleanDCacheRange(base, size);
+}
+
+
+// Publishes a record without buffers. Returns NULL if the ring is full.
+static IpcRingRec* sendRec(const u32 lines, const u32 tag)
+{
+	IpcRingRec *const rec = IPCRING_reserve(&g_prod, lines);
+	if(rec == NULL) return NULL;
+
+	rec->cmd   = tag<<IPC_CMD_TAG_SHIFT | 1u<<8;
+	rec->words = (lines - 1) * IPC_RING_LINE_SIZE / 4;
+	u32 *const params = IPCRING_params(rec);
+	for(u32 i = 0; i < rec->words; i++) params[i] = tag * 1000 + i;
+	IPCRING_publish(&g_prod, rec);
+
+	return rec;
+}
+
+// Handles the next record on the consumer side and returns its tag. 0 if there is none.
+static u32 handleNext(void)
+{
+	g_view = (u8*)&g_viewCons;
+	IpcRingRec *const rec = IPCRING_next(&g_cons);
+	u32 tag = 0;
+	if(rec != NULL)
+	{
+		tag = IPC_CMD_TAG_MASK(rec->cmd);
+		const u32 *const params = IPCRING_params(rec);
+		bool ok = true;
+		for(u32 i = 0; i < rec->words; i++) ok &= params[i] == tag * 1000 + i;
+		TEST_CHECK(ok);
+		IPCRING_complete(rec, tag + 1);
+	}
+	g_view = (u8*)&g_viewProd;
+
+	return tag;
+}
+
+static void testLimits(void)
+{
+	IPCRING_init(&g_prod, &g_viewProd);
+	IPCRING_attach(&g_cons, &g_viewCons);
+	TEST_CHECK(IPCRING_reserve(&g_prod, 1) == NULL && IPCRING_reserve(&g_prod, IPC_RING_MAX_REC + 1) == NULL);
+
+	// A header line plus whole lines for the parameters and each inline buffer.
+	TEST_CHECK(IPCRING_recLines(0, 0, 0) == 1 && IPCRING_recLines(8, 0, 0) == 2 && IPCRING_recLines(9, 0, 0) == 3);
+	TEST_CHECK(IPCRING_recLines(1, 1, 1) == 3 && IPCRING_recLines(1, 33, 1) == 4 && IPCRING_recLines(1, 2, 2) == 4);
+	for(u32 it = 0; it < 1000; it++)
+	{
+		const u32 words = testRange(0, IPC_RING_MAX_WORDS), a = testRange(1, 300), b = testRange(1, 300);
+		const u32 lines = 1 + (words * 4 + 31) / 32 + (a + 31) / 32 + (b + 31) / 32;
+		TEST_CHECK(IPCRING_recLines(words, a + b, 2) >= lines && IPCRING_recLines(words, a + b, 2) <= lines + 1);
+	}
+}
+
+static void testFull(void)
+{
+	// Fill the whole ring with 4 line records.
+	IpcRingRec *recs[IPC_RING_LINES / 4];
+	for(u32 i = 0; i < IPC_RING_LINES / 4; i++) TEST_CHECK((recs[i] = sendRec(4, i + 1)) != NULL);
+	TEST_CHECK(sendRec(2, 99) == NULL);
+
+	// Released records are only reused after the consumer passed them.
+	for(u32 i = 0; i < IPC_RING_LINES / 4; i++) IPCRING_release(recs[i]);
+	TEST_CHECK(sendRec(2, 99) == NULL);
+	for(u32 i = 0; i < IPC_RING_LINES / 4; i++) TEST_CHECK(handleNext() == i + 1);
+	TEST_CHECK(handleNext() == 0);
+
+	// And in order. An unreleased record blocks everything behind it.
+	for(u32 i = 0; i < IPC_RING_LINES / 4; i++) TEST_CHECK((recs[i] = sendRec(4, i + 1)) != NULL);
+	for(u32 i = 0; i < IPC_RING_LINES / 4; i++)
+	{
+		TEST_CHECK(handleNext() == i + 1 && IPCRING_isDone(recs[i]) && recs[i]->res == i + 2);
+		if(i > 0) IPCRING_release(recs[i]);
+	}
+	TEST_CHECK(sendRec(2, 99) == NULL);
+	IPCRING_release(recs[0]);
+	IpcRingRec *const rec = sendRec(IPC_RING_MAX_REC, 99);
+	TEST_CHECK(rec != NULL && handleNext() == 99);
+	IPCRING_release(rec);
+}
+
+static void testPadding(void)
+{
+	// Records never wrap. The rest of the ring is skipped with padding which
+	// is only reused after the consumer skipped it too.
+	for(u32 it = 0; it < 2000; it++)
+	{
+		const u32 lines = testRange(2, IPC_RING_MAX_REC);
+		const u32 idx = g_prod.head % IPC_RING_LINES;
+		IpcRingRec *const rec = sendRec(lines, it % 200 + 1);
+		TEST_CHECK(rec != NULL);
+		if(rec == NULL) return;
+
+		const u32 recIdx = ((u8*)rec - g_viewProd.data) / IPC_RING_LINE_SIZE;
+		TEST_CHECK(recIdx + lines <= IPC_RING_LINES && recIdx == (idx + lines > IPC_RING_LINES ? 0 : idx));
+		TEST_CHECK(handleNext() == it % 200 + 1 && handleNext() == 0);
+		TEST_CHECK(IPCRING_isDone(rec) && rec->res == it % 200 + 2);
+		IPCRING_release(rec);
+	}
+}
+
+
+static void* consumer(UNUSED void *arg)
+{
+	g_view = (u8*)&g_viewCons;
+	while(!atomic_load(&g_stop))
+	{
+		if(!atomic_exchange(&g_doorbell, false))
+		{
+			sched_yield();
+			continue;
+		}
+
+		// Echo the send buffer into the receive buffer. The result sums up all words and bytes.
+		IpcRingRec *rec;
+		while((rec = IPCRING_next(&g_cons)) != NULL)
+		{
+			const u32 *const params = IPCRING_params(rec);
+			const IpcBuffer *const sendBuf = (const IpcBuffer*)params;
+			const IpcBuffer *const recvBuf = (const IpcBuffer*)&params[BUF_WORDS / 2];
+			u32 sum = 0;
+			for(u32 i = 0; i < sendBuf->size; i++) sum += ((u8*)sendBuf->ptr)[i];
+			const u32 n = (sendBuf->size < recvBuf->size ? sendBuf->size : recvBuf->size);
+			for(u32 i = 0; i < n; i++) ((u8*)recvBuf->ptr)[i] = ((u8*)sendBuf->ptr)[i] ^ 0x5A;
+			for(u32 w = BUF_WORDS; w < rec->words; w++) sum += params[w] * w;
+			IPCRING_complete(rec, sum);
+		}
+	}
+
+	return NULL;
+}
+
+// Same flow as PXI_sendCmdRing() with buffers inline while they fit.
+static void* producer(UNUSED void *arg)
+{
+	g_view = (u8*)&g_viewProd;
+	for(u32 it = 0; it < ITERATIONS; it++)
+	{
+		u8 in[600], out[600];
+		u32 buf[IPC_RING_MAX_WORDS];
+		pthread_mutex_lock(&g_lock);
+		const u32 sendSize = testRange(1, 500), recvSize = testRange(1, 500);
+		const u32 words = BUF_WORDS + testRange(0, IPC_RING_MAX_WORDS - BUF_WORDS);
+		for(u32 i = 0; i < sendSize; i++) in[i] = testRand();
+		for(u32 w = BUF_WORDS; w < words; w++) buf[w] = testRand();
+		pthread_mutex_unlock(&g_lock);
+		memset(out, 0xEE, sizeof(out));
+
+		IpcBuffer *const bufs = (IpcBuffer*)buf;
+		bufs[0] = (IpcBuffer){in, sendSize};
+		bufs[1] = (IpcBuffer){out, recvSize};
+		u32 expected = 0;
+		for(u32 i = 0; i < sendSize; i++) expected += in[i];
+		for(u32 w = BUF_WORDS; w < words; w++) expected += buf[w] * w;
+
+		u32 inlineMask = 0, inlineBytes = 0, inlineBufs = 0;
+		for(u32 i = 0; i < 2; i++)
+		{
+			if(IPCRING_recLines(words, inlineBytes + bufs[i].size, inlineBufs + 1) <= IPC_RING_MAX_REC)
+			{
+				inlineMask |= BIT(i);
+				inlineBytes += bufs[i].size;
+				inlineBufs++;
+			}
+		}
+		const u32 lines = IPCRING_recLines(words, inlineBytes, inlineBufs);
+
+		IpcRingRec *rec;
+		while(1)
+		{
+			pthread_mutex_lock(&g_lock);
+			rec = IPCRING_reserve(&g_prod, lines);
+			if(rec != NULL) break;
+			pthread_mutex_unlock(&g_lock);
+			sched_yield();
+		}
+
+		rec->cmd        = CMD_ECHO;
+		rec->words      = words;
+		rec->inlineMask = inlineMask;
+		u32 *const params = IPCRING_params(rec);
+		memcpy(params, buf, words * 4);
+		u32 inlineOffs[2];
+		u8 *data = (u8*)params + (words * 4 + IPC_RING_LINE_SIZE - 1) / IPC_RING_LINE_SIZE * IPC_RING_LINE_SIZE;
+		for(u32 i = 0; i < 2; i++)
+		{
+			if(!(inlineMask & BIT(i))) continue;
+
+			IpcBuffer *const ipcBuf = (IpcBuffer*)&params[i * BUF_WORDS / 2];
+			inlineOffs[i] = IPCRING_putInline(&g_prod, data, ipcBuf->ptr, ipcBuf->size);
+			ipcBuf->ptr = (void*)(uintptr_t)inlineOffs[i];
+			data += (ipcBuf->size + IPC_RING_LINE_SIZE - 1) / IPC_RING_LINE_SIZE * IPC_RING_LINE_SIZE;
+		}
+		if(data > (u8*)rec + lines * IPC_RING_LINE_SIZE) atomic_fetch_add(&g_errors, 1);
+		IPCRING_publish(&g_prod, rec);
+		atomic_store(&g_doorbell, true);
+		pthread_mutex_unlock(&g_lock);
+
+		while(1)
+		{
+			pthread_mutex_lock(&g_lock);
+			const bool done = IPCRING_isDone(rec);
+			pthread_mutex_unlock(&g_lock);
+			if(done) break;
+			sched_yield();
+		}
+
+		// Bytes past the echoed ones keep their old contents.
+		bool ok = rec->res == expected;
+		const u8 *const res = (inlineMask & BIT(1) ? IPCRING_inlinePtr(&g_prod, inlineOffs[1]) : out);
+		const u32 n = (sendSize < recvSize ? sendSize : recvSize);
+		for(u32 i = 0; i < n; i++) ok &= res[i] == (in[i] ^ 0x5A);
+		if(!(inlineMask & BIT(1))) for(u32 i = n; i < recvSize; i++) ok &= res[i] == 0xEE;
+		if(!ok) atomic_fetch_add(&g_errors, 1);
+
+		pthread_mutex_lock(&g_lock);
+		IPCRING_release(rec);
+		pthread_mutex_unlock(&g_lock);
+	}
+
+	return NULL;
+}
+
+static void testThreads(void)
+{
+	IPCRING_init(&g_prod, &g_viewProd);
+	IPCRING_attach(&g_cons, &g_viewCons);
+
+	pthread_t cons, prods[PRODUCERS];
+	pthread_create(&cons, NULL, consumer, NULL);
+	for(u32 i = 0; i < PRODUCERS; i++) pthread_create(&prods[i], NULL, producer, NULL);
+	for(u32 i = 0; i < PRODUCERS; i++) pthread_join(prods[i], NULL);
+	atomic_store(&g_stop, true);
+	pthread_join(cons, NULL);
+
+	TEST_CHECK(atomic_load(&g_errors) == 0);
+}
+
+int main(void)
+{
+	testLimits();
+	testFull();
+	testPadding();
+	testThreads();
+
+	return testResult();
+}
\ No newline at end of file
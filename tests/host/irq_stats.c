@@ -0,0 +1,143 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "test.h"
+#include "interleave.h"
+#include "arm11/drivers/interrupt.h"
+
+
+#define ENTRIES      (224u)
+#define TORN_IDX     (96u + 40) // External IRQ 40.
+#define TORN_CYCLES  (0xFFFFFFFFu)
+#define TORN_UPDATES (2000u)
+#define MAX_RUN      (16u) // The writer must never stall the retries of a reader.
+
+
+// irq_stats.c
+void irqStatsRecord(const u32 idx, const u32 cycles, const u32 latency);
+
+static IrqStats g_ref[ENTRIES];
+static atomic_bool g_stop = false;
+
+
+
+static u32 statsIndex(const u32 id, const u32 core)
+{
+	return (id < 32 ? 32 * core + id : 96u + id);
+}
+
+static void record(const u32 idx, const u32 cycles, const u32 latency)
+{
+	irqStatsRecord(idx, cycles, latency);
+
+	IrqStats *const ref = &g_ref[idx];
+	ref->count++;
+	ref->totalCycles += cycles;
+	if(cycles > ref->maxCycles) ref->maxCycles = cycles;
+	if(latency > ref->maxLatency) ref->maxLatency = latency;
+}
+
+static bool statsEqual(const IrqStats *const a, const IrqStats *const b)
+{
+	return a->count == b->count && a->maxCycles == b->maxCycles &&
+	       a->totalCycles == b->totalCycles && a->maxLatency == b->maxLatency;
+}
+
+static void testStats(void)
+{
+	IrqStatsEntry top[9]; // 1 guard entry.
+	TEST_CHECK(IRQ_getTopStats(top, 8) == 0);
+
+	// Random IRQs. External IRQ 80 is a storm.
+	for(u32 i = 0; i < 200000; i++)
+	{
+		u32 id = (testRand() % 3 == 0 ? 80 : testRange(0, 127));
+		const u32 core = (id < 32 ? testRange(0, 3) : 0);
+		record(statsIndex(id, core), testRand() % 5000, testRange(20, 219));
+	}
+
+	// Shared IRQs are the same on all cores.
+	for(u32 id = 0; id < 128; id++)
+	{
+		for(u32 core = 0; core < 4; core++)
+		{
+			IrqStats stats;
+			TEST_CHECK(IRQ_getStats(id, core, &stats) == RES_OK);
+			TEST_CHECK(statsEqual(&stats, &g_ref[statsIndex(id, (id < 32 ? core : 0))]));
+		}
+	}
+	IrqStats stats;
+	TEST_CHECK(IRQ_getStats(128, 0, &stats) == RES_INVALID_ARG && IRQ_getStats(0, 4, &stats) == RES_INVALID_ARG);
+
+	// Sorted by total cycles and nothing left out is bigger.
+	for(u32 max = 1; max <= 8; max++)
+	{
+		memset(&top[max], 0xAA, sizeof(IrqStatsEntry));
+		const u32 num = IRQ_getTopStats(top, max);
+		TEST_CHECK(num == max && top[max].id == 0xAA);
+		for(u32 i = 0; i < num; i++)
+		{
+			const u32 idx = statsIndex(top[i].id, top[i].core);
+			TEST_CHECK(statsEqual(&top[i].stats, &g_ref[idx]));
+			TEST_CHECK(i == 0 || top[i].stats.totalCycles <= top[i - 1].stats.totalCycles);
+
+			u32 bigger = 0;
+			for(u32 k = 0; k < ENTRIES; k++) bigger += g_ref[k].totalCycles > top[i].stats.totalCycles;
+			TEST_CHECK(bigger <= i);
+		}
+	}
+	TEST_CHECK(top[0].id == 80 && top[0].core == 0);
+
+	// Less entries with stats than requested.
+	IRQ_resetStats();
+	TEST_CHECK(IRQ_getTopStats(top, 8) == 0);
+	record(statsIndex(5, 2), 100, 1);
+	record(statsIndex(100, 0), 300, 1);
+	record(statsIndex(5, 3), 200, 1);
+	TEST_CHECK(IRQ_getTopStats(top, 8) == 3);
+	TEST_CHECK(top[0].id == 100 && top[1].id == 5 && top[1].core == 3 && top[2].id == 5 && top[2].core == 2);
+	IRQ_resetStats();
+	TEST_CHECK(IRQ_getStats(5, 2, &stats) == RES_OK && stats.count == 0 && stats.totalCycles == 0);
+}
+
+// The other core updating an entry while we read it.
+static void* writer(UNUSED void *arg)
+{
+	interleaveBegin(MAX_RUN);
+	for(u32 i = 0; i < TORN_UPDATES; i++) irqStatsRecord(TORN_IDX, TORN_CYCLES, 1);
+	interleaveEnd();
+	atomic_store(&g_stop, true);
+
+	return NULL;
+}
+
+static void testTearing(void)
+{
+	IRQ_resetStats();
+	pthread_t thread;
+	pthread_create(&thread, NULL, writer, NULL);
+
+	// Every update keeps total == count * TORN_CYCLES.
+	u32 torn = 0, lastCount = 0, reads = 0;
+	interleaveBegin(MAX_RUN);
+	while(!atomic_load(&g_stop))
+	{
+		IrqStats stats;
+		IRQ_getStats(40, 0, &stats);
+		torn += stats.totalCycles != (u64)stats.count * TORN_CYCLES || stats.count < lastCount;
+		lastCount = stats.count;
+		reads++;
+	}
+	interleaveEnd();
+	pthread_join(thread, NULL);
+
+	TEST_CHECK(torn == 0 && reads > 100);
+}
+
+int main(void)
+{
+	testStats();
+	testTearing();
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include <string.h>
+#include "test.h"
+#include "arm11/drivers/mcu.h"
+#include "arm11/drivers/i2c.h"
+#include "arm11/drivers/interrupt.h"
+#include "arm11/drivers/gpio.h"
+#include "arm11/drivers/cfg11.h"
+#include "arm11/drivers/pdn.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "arm11/drivers/timer.h"
+#include "kevent.h"
+#include "debug.h"
+
+
+// The status cache against a fake MCU register file. I2C transfers complete
+// right away except for the async IRQ register read which the test finishes.
+#define CYCLES_PER_MS (268111u) // Old 3DS.
+#define FRAME_CYCLES  (CYCLES_PER_MS * 50 / 3)
+
+
+static u8 g_mcuRegs[256];
+static u32 g_lastChange[256];  // Cycle counter at the last change.
+static u32 g_statusXfers = 0;  // Transfers of status registers.
+static u32 g_lastStatusSize = 0;
+static I2cXfer *g_irqXfer = NULL;
+static IrqIsr g_mcuIsr = NULL;
+static void (*g_burstHook)(void) = NULL; // Runs after the status burst was read.
+static TimerAlarm *g_alarm = NULL;     // The armed timeout alarm.
+static u32 g_alarmTicks = 0;
+static KHandle g_signaled = 0;         // Last signaled event.
+static void (*g_waitHook)(void) = NULL; // Runs in waitForEvent().
+
+
+
+bool I2C_readArray(const I2cDevice devId, const u32 regAddr, void *out, u32 size)
+{
+	TEST_CHECK(devId == I2C_DEV_CTR_MCU && regAddr + size <= 256);
+	memcpy(out, &g_mcuRegs[regAddr], size);
+
+	// The IRQ registers are cleared on read.
+	if(regAddr == MCU_REG_IRQ) memset(&g_mcuRegs[MCU_REG_IRQ], 0, 4);
+
+	if(regAddr >= MCU_REG_3D_SLIDER_RAW && regAddr <= MCU_REG_EX_HW_STAT)
+	{
+		g_statusXfers++;
+		g_lastStatusSize = size;
+		if(regAddr == MCU_REG_3D_SLIDER_RAW && size == 8 && g_burstHook != NULL) g_burstHook();
+	}
+
+	return true;
+}
+
+bool I2C_writeArray(const I2cDevice devId, const u32 regAddr, const void *in, u32 size)
+{
+	TEST_CHECK(devId == I2C_DEV_CTR_MCU && regAddr + size <= 256);
+	memcpy(&g_mcuRegs[regAddr], in, size);
+
+	return true;
+}
+
+u8 I2C_read(const I2cDevice devId, const u32 regAddr)
+{
+	u8 data;
+	I2C_readArray(devId, regAddr, &data, 1);
+
+	return data;
+}
+
+bool I2C_write(const I2cDevice devId, const u32 regAddr, const u8 data)
+{
+	return I2C_writeArray(devId, regAddr, &data, 1);
+}
+
+bool I2C_writeRegIntSafe(const I2cDevice devId, const u8 regAddr, const u8 data)
+{
+	return I2C_write(devId, regAddr, data);
+}
+
+void I2C_init(void) {}
+
+void I2C_submit(I2cXfer *const xfer)
+{
+	TEST_CHECK(g_irqXfer == NULL && xfer->read && xfer->regAddr == MCU_REG_IRQ && xfer->size == 4);
+	g_irqXfer = xfer;
+}
+
+KHandle createEvent(UNUSED bool oneShot)
+{
+	static KHandle handle = 0;
+	return ++handle;
+}
+
+void signalEvent(KHandle const kevent, UNUSED bool reschedule)
+{
+	g_signaled = kevent;
+}
+
+KRes waitForEvent(UNUSED KHandle const kevent)
+{
+	if(g_waitHook != NULL) g_waitHook();
+	return 0;
+}
+
+void TIMER_setAlarm(TimerAlarm *const alarm, const u32 ticks, const TimerAlarmCb cb, void *const arg)
+{
+	TEST_CHECK(g_alarm == NULL);
+	alarm->cb    = cb;
+	alarm->arg   = arg;
+	alarm->armed = true;
+	g_alarm      = alarm;
+	g_alarmTicks = ticks;
+}
+
+bool TIMER_cancelAlarm(TimerAlarm *const alarm)
+{
+	TEST_CHECK(g_alarm == alarm);
+	const bool armed = alarm->armed;
+	alarm->armed = false;
+	g_alarm = NULL;
+
+	return armed;
+}
+
+void GPIO_config(UNUSED Gpio gpio, UNUSED u8 cfg) {}
+
+void IRQ_registerIsr(const Interrupt id, UNUSED const u32 prio, UNUSED u32 target, const IrqIsr isr)
+{
+	TEST_CHECK(id == IRQ_CTR_MCU);
+	g_mcuIsr = isr;
+}
+
+void panic(void)
+{
+	printf("panic()\n");
+	exit(1);
+}
+
+static void setReg(const u32 reg, const u8 val)
+{
+	g_mcuRegs[reg] = val;
+	g_lastChange[reg] = g_testCcnt;
+}
+
+// Raises MCU IRQs and finishes the IRQ register read like the I2C ISR.
+static void raiseIrqs(const u32 irqs)
+{
+	u32 regs;
+	memcpy(&regs, &g_mcuRegs[MCU_REG_IRQ], 4);
+	regs |= irqs;
+	memcpy(&g_mcuRegs[MCU_REG_IRQ], &regs, 4);
+
+	g_testCpsr |= PSR_I;
+	g_mcuIsr(IRQ_CTR_MCU);
+	while(g_irqXfer != NULL)
+	{
+		I2cXfer *const xfer = g_irqXfer;
+		g_irqXfer = NULL;
+		I2C_readArray(xfer->devId, xfer->regAddr, xfer->buf, xfer->size);
+		xfer->state = I2C_XFER_OK;
+		xfer->done(xfer);
+	}
+	g_testCpsr &= ~PSR_I;
+}
+
+static void testInit(void)
+{
+	for(u32 i = 0; i < 256; i++) g_mcuRegs[i] = testRand();
+	g_mcuRegs[MCU_REG_IRQ] = 0xFF; // Stale IRQs are discarded by init.
+	MCU_init();
+	TEST_CHECK(g_testPmnc == (PM_CCNT_NODIV | PM_EN));
+	TEST_CHECK(MCU_getIrqs(0xFFFFFFFFu) == 0);
+}
+
+// A status UI calling 6 getters per frame for 10 minutes.
+static void testFrames(void)
+{
+	const u32 start = g_statusXfers;
+	for(u32 frame = 0; frame < 36000; frame++)
+	{
+		if(testRand() % 20 == 0) setReg(testRange(MCU_REG_3D_SLIDER_RAW, MCU_REG_EX_HW_STAT), testRand());
+
+		const u8 vals[5] = {MCU_get3dSliderPosition(), MCU_getVolumeSliderPosition(), (u8)MCU_getBatteryTemperature(),
+		                    MCU_getBatteryLevel(), MCU_getBatteryVoltage() / 0.02f + 0.5f};
+		const u16 hwStatus = MCU_getExternalHardwareStatus();
+
+		// Values may only be older than the registers by the max age.
+		static const u8 regs[5] = {MCU_REG_3D_SLIDER_RAW, MCU_REG_VOL_SLIDER, MCU_REG_BATT_TEMP, MCU_REG_BATT_LEVEL, MCU_REG_BATT_VOLT};
+		const u32 maxAge = MCU_STATUS_MAX_AGE_DEFAULT * CYCLES_PER_MS;
+		for(u32 i = 0; i < 5; i++)
+		{
+			if(vals[i] != g_mcuRegs[regs[i]]) TEST_CHECK(g_testCcnt - g_lastChange[regs[i]] < maxAge);
+		}
+		if(hwStatus != (g_mcuRegs[MCU_REG_EX_HW_STAT2]<<8 | g_mcuRegs[MCU_REG_EX_HW_STAT]))
+		{
+			TEST_CHECK(g_testCcnt - g_lastChange[MCU_REG_EX_HW_STAT2] < maxAge ||
+			           g_testCcnt - g_lastChange[MCU_REG_EX_HW_STAT] < maxAge);
+		}
+
+		g_testCcnt += FRAME_CYCLES + testRange(0, 999);
+	}
+
+	// One burst every second frame.
+	const u32 xfers = g_statusXfers - start;
+	TEST_CHECK(xfers >= 36000 / 2 && xfers <= 36000 / 2 + 100);
+}
+
+static void changeDuringBurst(void)
+{
+	g_burstHook = NULL;
+	setReg(MCU_REG_VOL_SLIDER, 0x20);
+	raiseIrqs(MCU_IRQ_VOL_SLIDER_CHANGE);
+}
+
+static void testIrqs(void)
+{
+	// Status IRQs discard the cache. Others don't.
+	setReg(MCU_REG_VOL_SLIDER, 0x10);
+	raiseIrqs(MCU_IRQ_VOL_SLIDER_CHANGE);
+	TEST_CHECK(MCU_getVolumeSliderPosition() == 0x10);
+	u32 xfers = g_statusXfers;
+	setReg(MCU_REG_VOL_SLIDER, 0x3F);
+	raiseIrqs(MCU_IRQ_POWER_PRESS);
+	TEST_CHECK(MCU_getVolumeSliderPosition() != 0x3F && g_statusXfers == xfers);
+	raiseIrqs(MCU_IRQ_VOL_SLIDER_CHANGE);
+	TEST_CHECK(MCU_getVolumeSliderPosition() == 0x3F && g_statusXfers == xfers + 1);
+	TEST_CHECK(MCU_getIrqs(0xFFFFFFFFu) == (MCU_IRQ_POWER_PRESS | MCU_IRQ_VOL_SLIDER_CHANGE));
+
+	// A status IRQ during the refill. The caller gets what was read
+	// but it must not be cached.
+	setReg(MCU_REG_VOL_SLIDER, 0x30);
+	raiseIrqs(MCU_IRQ_CHARGER_PLUG);
+	g_burstHook = changeDuringBurst;
+	TEST_CHECK(MCU_getVolumeSliderPosition() == 0x30);
+	TEST_CHECK(MCU_getVolumeSliderPosition() == 0x20);
+	xfers = g_statusXfers;
+	TEST_CHECK(MCU_getVolumeSliderPosition() == 0x20 && g_statusXfers == xfers);
+	MCU_getIrqs(0xFFFFFFFFu);
+}
+
+static void changeMaxAge(void)
+{
+	g_burstHook = NULL;
+	MCU_setStatusMaxAge(100);
+}
+
+static void testMaxAge(void)
+{
+	// Without cache every getter reads only its own registers.
+	MCU_setStatusMaxAge(0);
+	u32 xfers = g_statusXfers;
+	setReg(MCU_REG_BATT_LEVEL, 42);
+	TEST_CHECK(MCU_getBatteryLevel() == 42 && MCU_getBatteryLevel() == 42 && g_statusXfers == xfers + 2);
+	TEST_CHECK(g_lastStatusSize == 1);
+	setReg(MCU_REG_EX_HW_STAT2, 0x12);
+	setReg(MCU_REG_EX_HW_STAT, 0x34);
+	TEST_CHECK(MCU_getExternalHardwareStatus() == 0x1234);
+
+	// Setting the max age discards the cache.
+	MCU_setStatusMaxAge(100);
+	xfers = g_statusXfers;
+	for(u32 i = 0; i < 100; i++)
+	{
+		MCU_getBatteryLevel();
+		g_testCcnt += CYCLES_PER_MS;
+	}
+	TEST_CHECK(g_statusXfers == xfers + 1);
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 2);
+
+	// Also while a refill is in progress.
+	MCU_setStatusMaxAge(100);
+	g_burstHook = changeMaxAge;
+	MCU_getBatteryLevel();
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 4);
+
+	// The New 3DS at 804 MHz and the divided cycle counter.
+	Cfg11 *const cfg11 = getCfg11Regs();
+	Pdn *const pdn = getPdnRegs();
+	*(vu16*)&cfg11->socinfo = SOCINFO_LGR1;
+	pdn->lgr_socmode = SOCMODE_LGR2_804MHZ;
+	MCU_setStatusMaxAge(10);
+	xfers = g_statusXfers;
+	MCU_getBatteryLevel();
+	g_testCcnt += 29 * CYCLES_PER_MS;
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 1);
+	g_testCcnt += CYCLES_PER_MS;
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 2);
+
+	g_testPmnc |= PM_CCNT_DIV64;
+	MCU_setStatusMaxAge(640);
+	xfers = g_statusXfers;
+	MCU_getBatteryLevel();
+	g_testCcnt += 640 * (CYCLES_PER_MS * 3 / 64) - 1;
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 1);
+	g_testCcnt += 1;
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 2);
+
+	// Huge ages are clamped below the counter wrap.
+	MCU_setStatusMaxAge(0xFFFFFFFFu);
+	MCU_getBatteryLevel();
+	g_testCcnt += 0x7FFFFFFFu;
+	xfers = g_statusXfers;
+	MCU_getBatteryLevel();
+	TEST_CHECK(g_statusXfers == xfers + 1);
+}
+
+static void fireAlarm(void)
+{
+	TimerAlarm *const alarm = g_alarm;
+	g_testCpsr |= PSR_I;
+	alarm->armed = false;
+	alarm->cb(alarm->arg);
+	g_testCpsr &= ~PSR_I;
+}
+
+static void raisePowerPress(void)
+{
+	raiseIrqs(MCU_IRQ_POWER_PRESS);
+}
+
+static void testTimeout(void)
+{
+	const u32 sub = MCU_subscribeIrqs(MCU_IRQ_POWER_PRESS);
+	TEST_CHECK(sub != MCU_IRQ_SUB_INVALID);
+
+	// The alarm wakes the waiter through the subscriber event.
+	g_waitHook = fireAlarm;
+	g_signaled = 0;
+	TEST_CHECK(MCU_waitSubIrqs(sub, MCU_IRQ_POWER_PRESS, 10) == 0);
+	TEST_CHECK(g_alarmTicks == 10 * TIMER_FREQ(1, 1000) && g_alarm == NULL);
+	const KHandle event = g_signaled;
+	TEST_CHECK(event != 0);
+
+	// IRQs before the deadline cancel the alarm.
+	g_waitHook = raisePowerPress;
+	TEST_CHECK(MCU_waitSubIrqs(sub, MCU_IRQ_POWER_PRESS, 10) == MCU_IRQ_POWER_PRESS);
+	TEST_CHECK(g_alarm == NULL);
+	raiseIrqs(MCU_IRQ_POWER_PRESS);
+	TEST_CHECK(MCU_waitSubIrqs(sub, MCU_IRQ_POWER_PRESS, 10) == MCU_IRQ_POWER_PRESS);
+
+	// Long timeouts are clamped to the alarm range.
+	g_waitHook = fireAlarm;
+	g_signaled = 0;
+	TEST_CHECK(MCU_waitSubIrqs(sub, MCU_IRQ_POWER_PRESS, 0xFFFFFFFFu) == 0);
+	TEST_CHECK(g_alarmTicks == UINT32_MAX && g_signaled == event);
+
+	g_waitHook = NULL;
+	MCU_unsubscribeIrqs(sub);
+	MCU_getIrqs(0xFFFFFFFFu);
+}
+
+int main(void)
+{
+	testMapIo(CFG11_REGS_BASE, 0x2000); // CFG11 and PDN.
+
+	testInit();
+	testFrames();
+	testIrqs();
+	testMaxAge();
+	testTimeout();
+
+	return testResult();
+}
\ No newline at end of file
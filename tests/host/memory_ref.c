@@ -0,0 +1,65 @@
+#include <string.h>
+#include "test.h"
+#include "memory.h"
+
+
+#define BUF_SIZE  (4096u)
+
+
+static int sign(const int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+// Sizes around the word, cache line and unrolled block sizes plus some larger ones.
+static u32 randomSize(void)
+{
+	return (testRand() & 3 ? testRange(0, 300) : testRange(0, 3000));
+}
+
+int main(void)
+{
+	static u8 a[BUF_SIZE], b[BUF_SIZE], c[BUF_SIZE];
+	for(u32 it = 0; it < 50000; it++)
+	{
+		// The whole buffer is compared to catch writes outside of the range.
+		const u32 size = randomSize();
+		const u32 offA = testRange(0, 64), offC = testRange(0, 64);
+		for(u32 i = 0; i < BUF_SIZE; i++)
+		{
+			a[i] = testRand();
+			c[i] = testRand();
+		}
+		memcpy(b, a, BUF_SIZE);
+
+		switch(it % 4)
+		{
+			case 0:
+				copyMemRef(a + offA, c + offC, size);
+				memcpy(b + offA, c + offC, size);
+				break;
+			case 1:
+				// Overlapping in both directions.
+				moveMemRef(a + offA, a + offC, size);
+				memmove(b + offA, b + offC, size);
+				break;
+			case 2:
+				fillMemRef(a + offA, offC * 7, size);
+				memset(b + offA, (u8)(offC * 7), size);
+				break;
+			case 3:
+			{
+				// Equal or one differing byte anywhere in the range.
+				memcpy(c + offC, a + offA, size);
+				if(size > 0 && testRand() & 1) c[offC + testRand() % size] ^= testRange(1, 255);
+				TEST_CHECK(sign(compareMemRef(a + offA, c + offC, size)) == sign(memcmp(a + offA, c + offC, size)));
+			}
+		}
+
+		if(memcmp(a, b, BUF_SIZE) != 0) printf("Op %lu, size %lu, offsets %lu/%lu:\n", (unsigned long)it % 4,
+		                                       (unsigned long)size, (unsigned long)offA, (unsigned long)offC);
+		TEST_CHECK(memcmp(a, b, BUF_SIZE) == 0);
+	}
+
+	return testResult();
+}
\ No newline at end of file
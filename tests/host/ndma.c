@@ -0,0 +1,183 @@
+#include <string.h>
+#include "test.h"
+#include "arm9/drivers/ndma.h"
+#include "arm9/drivers/interrupt.h"
+#include "arm.h"
+
+
+#define BUF_SIZE  (64u * 1024)
+
+// NDMA_BURST() uses intLog2() which assumes a 32 bit long.
+#define BURST_LOG2(l)  ((u32)(l)<<NDMA_BURST_SHIFT)
+
+
+static IrqIsr g_isrs[32];
+static u32 *g_src = (u32*)FCRAM_BASE; // Outside of the TCMs for NDMA_copy().
+static u32 *g_dst = (u32*)(FCRAM_BASE + BUF_SIZE);
+static u32 g_cbCalls = 0;
+
+
+
+void IRQ_registerIsr(const Interrupt id, const IrqIsr isr)
+{
+	g_isrs[id] = isr;
+}
+
+void __fb_assert(const char *const file, const unsigned line, const char *const cond)
+{
+	printf("%s:%u: assertion failed: %s\n", file, line, cond);
+	exit(1);
+}
+
+
+// Executes one pending immediate transfer and raises its IRQ.
+static void runHardware(void)
+{
+	for(u32 ch = 0; ch < NDMA_CHANNELS; ch++)
+	{
+		NdmaCh *const regs = getNdmaChRegs(ch);
+		const u32 cnt = regs->cnt;
+		if((cnt & NDMA_EN) == 0) continue;
+		TEST_CHECK((cnt & NDMA_START_IMMEDIATE) == NDMA_START_IMMEDIATE && (cnt & NDMA_DAD_FIX) == NDMA_DAD_INC);
+
+		u32 *const dst = (u32*)(uintptr_t)regs->dad;
+		const u32 *const src = (const u32*)(uintptr_t)regs->sad;
+		for(u32 i = 0; i < regs->wcnt; i++)
+		{
+			dst[i] = ((cnt & NDMA_SAD_FILL) == NDMA_SAD_FILL ? regs->fdata : src[i]);
+		}
+
+		regs->cnt = cnt & ~NDMA_EN;
+		if(cnt & NDMA_IRQ_EN) g_isrs[IRQ_DMAC_1_0 + ch](IRQ_DMAC_1_0 + ch);
+		return;
+	}
+}
+
+static void countCb(void *arg)
+{
+	TEST_CHECK(arg == &g_cbCalls);
+	g_cbCalls++;
+}
+
+static void testDescs(void)
+{
+	// The burst is the largest power of 2 dividing the size, max 16 words.
+	NdmaDesc d;
+	NDMA_descCopy(&d, g_dst, g_src, 64);
+	TEST_CHECK(d.sad == (u32)(uintptr_t)g_src && d.dad == (u32)(uintptr_t)g_dst && d.wcnt == 16 && d.next == NULL);
+	TEST_CHECK(d.cnt == (NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE | BURST_LOG2(4) | NDMA_SAD_INC | NDMA_DAD_INC));
+	NDMA_descCopy(&d, g_dst, g_src, 12);
+	TEST_CHECK(d.cnt == (NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE | BURST_LOG2(0) | NDMA_SAD_INC | NDMA_DAD_INC));
+	NDMA_descCopy(&d, g_dst, g_src, 4096);
+	TEST_CHECK((d.cnt & BURST_LOG2(15)) == BURST_LOG2(4));
+
+	NDMA_descFill(&d, g_dst, 0xAA55AA55u, 8);
+	TEST_CHECK(d.fdata == 0xAA55AA55u && d.wcnt == 2);
+	TEST_CHECK(d.cnt == (NDMA_EN | NDMA_IRQ_EN | NDMA_START_IMMEDIATE | BURST_LOG2(1) | NDMA_SAD_FILL | NDMA_DAD_INC));
+
+	// Size 0 is repeat mode without IRQ.
+	NDMA_descStartup(&d, NDMA_START_TMIO3, NDMA_SAD_FIX | NDMA_DAD_INC, 1, 2, 0, 512);
+	TEST_CHECK(d.sad == 2 && d.dad == 1 && d.wcnt == 128);
+	TEST_CHECK(d.cnt == (NDMA_EN | NDMA_START_TMIO3 | NDMA_REPEAT_MODE | BURST_LOG2(4) | NDMA_SAD_FIX | NDMA_DAD_INC));
+	NDMA_descStartup(&d, NDMA_START_SHA_IN, NDMA_SAD_INC | NDMA_DAD_FIX, 1, 2, 4096, 64);
+	TEST_CHECK(d.tcnt == 1024 && d.wcnt == 16);
+	TEST_CHECK(d.cnt == (NDMA_EN | NDMA_IRQ_EN | NDMA_START_SHA_IN | NDMA_TCNT_MODE | BURST_LOG2(4) |
+	                     NDMA_SAD_INC | NDMA_DAD_FIX));
+}
+
+static void testAlloc(void)
+{
+	for(u32 ch = 0; ch < NDMA_CH_SYNC; ch++) TEST_CHECK(NDMA_allocChannel() == ch);
+	TEST_CHECK(NDMA_allocChannel() == NDMA_NO_CHANNEL);
+
+	NDMA_freeChannel(NDMA_CH_SYNC);
+	TEST_CHECK(NDMA_allocChannel() == NDMA_NO_CHANNEL);
+	NDMA_freeChannel(3);
+	TEST_CHECK(NDMA_allocChannel() == 3);
+	for(u32 ch = 0; ch < NDMA_CH_SYNC; ch++) NDMA_freeChannel(ch);
+
+	// Only allocated channels take transfers.
+	NdmaDesc desc;
+	NDMA_descFill(&desc, g_dst, 0, 64);
+	TEST_CHECK(!NDMA_submit(0, &desc, NULL, NULL));
+	TEST_CHECK(!NDMA_submit(NDMA_CH_SYNC, &desc, NULL, NULL));
+	TEST_CHECK(!NDMA_submit(NDMA_CHANNELS, &desc, NULL, NULL));
+	TEST_CHECK(!NDMA_submit(NDMA_NO_CHANNEL, &desc, NULL, NULL));
+	for(u32 ch = 0; ch < NDMA_CHANNELS; ch++) TEST_CHECK(!NDMA_isBusy(ch) && getNdmaChRegs(ch)->cnt == 0);
+}
+
+static void testChain(void)
+{
+	for(u32 i = 0; i < BUF_SIZE / 4; i++) g_src[i] = testRand();
+	memset(g_dst, 0, BUF_SIZE);
+
+	// Copy, fill, copy.
+	NdmaDesc descs[3];
+	NDMA_descCopy(&descs[0], g_dst, g_src, 4096);
+	NDMA_descFill(&descs[1], &g_dst[1024], 0x12345678u, 100);
+	NDMA_descCopy(&descs[2], &g_dst[2048], &g_src[2048], 12);
+	descs[0].next = &descs[1];
+	descs[1].next = &descs[2];
+
+	const u8 ch = NDMA_allocChannel();
+	TEST_CHECK(NDMA_submit(ch, &descs[0], countCb, &g_cbCalls));
+	TEST_CHECK(NDMA_isBusy(ch) && !NDMA_submit(ch, &descs[2], NULL, NULL));
+	for(u32 i = 0; i < 3; i++)
+	{
+		TEST_CHECK(NDMA_isBusy(ch) && g_cbCalls == 0);
+		runHardware();
+	}
+	TEST_CHECK(!NDMA_isBusy(ch) && g_cbCalls == 1);
+
+	bool ok = memcmp(g_dst, g_src, 4096) == 0 && memcmp(&g_dst[2048], &g_src[2048], 12) == 0;
+	for(u32 i = 0; i < 25; i++) ok &= g_dst[1024 + i] == 0x12345678u;
+	TEST_CHECK(ok && g_dst[1024 + 25] == 0 && g_dst[2048 + 3] == 0);
+
+	// A stopped chain ignores a late IRQ and doesn't call the callback.
+	TEST_CHECK(NDMA_submit(ch, &descs[0], countCb, &g_cbCalls));
+	runHardware();
+	NDMA_stop(ch);
+	TEST_CHECK(!NDMA_isBusy(ch) && getNdmaChRegs(ch)->cnt == 0);
+	g_isrs[IRQ_DMAC_1_0 + ch](IRQ_DMAC_1_0 + ch);
+	TEST_CHECK(!NDMA_isBusy(ch) && getNdmaChRegs(ch)->cnt == 0 && g_cbCalls == 1);
+
+	TEST_CHECK(NDMA_submit(ch, &descs[2], NULL, NULL));
+	runHardware();
+	TEST_CHECK(!NDMA_isBusy(ch) && g_cbCalls == 1);
+	NDMA_freeChannel(ch);
+}
+
+// IRQs must be disabled between the busy check and __wfi().
+static void syncWfi(void)
+{
+	TEST_CHECK(g_testCpsr & PSR_I);
+	runHardware();
+}
+
+static void testSync(void)
+{
+	// NDMA_wait() sleeps in __wfi() until the IRQ handler ends the chain.
+	g_testWfiHook = syncWfi;
+	memset(g_dst, 0, BUF_SIZE);
+	NDMA_copy(g_dst, g_src, BUF_SIZE);
+	TEST_CHECK(memcmp(g_dst, g_src, BUF_SIZE) == 0);
+	NDMA_fill(g_dst, 0xCAFEu, 64);
+	TEST_CHECK(g_dst[0] == 0xCAFEu && g_dst[15] == 0xCAFEu && g_dst[16] == g_src[16]);
+	TEST_CHECK((g_testCpsr & PSR_I) == 0);
+	g_testWfiHook = NULL;
+}
+
+int main(void)
+{
+	testMapIo(NDMA_REGS_BASE, 0x1000);
+	testMapIo(FCRAM_BASE, BUF_SIZE * 2);
+	NDMA_init();
+	TEST_CHECK(REG_NDMA_GCNT == (NDMA_ROUND_ROBIN(32) | NDMA_REG_READBACK));
+
+	testDescs();
+	testAlloc();
+	testChain();
+	testSync();
+
+	return testResult();
+}
\ No newline at end of file
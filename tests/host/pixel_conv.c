@@ -0,0 +1,149 @@
+#include <string.h>
+#include "test.h"
+#include "pixel_conv.h"
+#include "rgb_conv.h"
+
+
+#define PIXELS  (65536u)
+
+
+static const u32 g_pixelSize[5] = {4, 3, 2, 2, 2};
+
+
+
+// Reference conversion through 8 bits per channel (r in the low byte) with rgb_conv.h.
+static u32 toRgba8(const GfxFmt fmt, const u32 v)
+{
+	u32 r, g, b, a = 255;
+	switch(fmt)
+	{
+		case GFX_ABGR8:
+			return __builtin_bswap32(v);
+		case GFX_BGR8:
+			r = v>>16 & 0xFF; g = v>>8 & 0xFF; b = v & 0xFF;
+			break;
+		case GFX_BGR565:
+			r = rgbFive2Eight(v>>11 & 0x1F); g = rgbSix2Eight(v>>5 & 0x3F); b = rgbFive2Eight(v & 0x1F);
+			break;
+		case GFX_A1BGR5:
+			r = rgbFive2Eight(v>>11 & 0x1F); g = rgbFive2Eight(v>>6 & 0x1F); b = rgbFive2Eight(v>>1 & 0x1F);
+			a = (v & 1 ? 255 : 0);
+			break;
+		default:
+			r = rgbFour2Eight(v>>12 & 0xF); g = rgbFour2Eight(v>>8 & 0xF); b = rgbFour2Eight(v>>4 & 0xF);
+			a = rgbFour2Eight(v & 0xF);
+	}
+
+	return r | g<<8 | b<<16 | a<<24;
+}
+
+static u32 fromRgba8(const GfxFmt fmt, const u32 c)
+{
+	const u32 r = c & 0xFF, g = c>>8 & 0xFF, b = c>>16 & 0xFF, a = c>>24;
+	switch(fmt)
+	{
+		case GFX_ABGR8:  return __builtin_bswap32(c);
+		case GFX_BGR8:   return r<<16 | g<<8 | b;
+		case GFX_BGR565: return rgbEight2Five(r)<<11 | rgbEight2Six(g)<<5 | rgbEight2Five(b);
+		case GFX_A1BGR5: return rgbEight2Five(r)<<11 | rgbEight2Five(g)<<6 | rgbEight2Five(b)<<1 | a>>7;
+		default:         return rgbEight2Four(r)<<12 | rgbEight2Four(g)<<8 | rgbEight2Four(b)<<4 | rgbEight2Four(a);
+	}
+}
+
+static u32 convert(const GfxFmt dstFmt, const GfxFmt srcFmt, const u32 v)
+{
+	return (dstFmt == srcFmt ? v : fromRgba8(dstFmt, toRgba8(srcFmt, v)));
+}
+
+static u32 loadPixel(const u8 *const p, const GfxFmt fmt)
+{
+	u32 v = 0;
+	for(u32 i = 0; i < g_pixelSize[fmt]; i++) v |= (u32)p[i]<<(i * 8);
+
+	return v;
+}
+
+static void storePixel(u8 *const p, const GfxFmt fmt, const u32 v)
+{
+	for(u32 i = 0; i < g_pixelSize[fmt]; i++) p[i] = v>>(i * 8);
+}
+
+static void testConvert(const GfxFmt dstFmt, const GfxFmt srcFmt)
+{
+	static u8 src[PIXELS * 4 + 16], dst[PIXELS * 4 + 16], ref[PIXELS * 4 + 16];
+
+	// All values for 16 bit sources, random ones otherwise.
+	const u32 srcSize = g_pixelSize[srcFmt], dstSize = g_pixelSize[dstFmt];
+	for(u32 i = 0; i < PIXELS; i++) storePixel(&src[i * srcSize], srcFmt, (srcSize == 2 ? i : testRand()));
+	for(u32 i = 0; i < PIXELS; i++)
+	{
+		storePixel(&ref[i * dstSize], dstFmt, convert(dstFmt, srcFmt, loadPixel(&src[i * srcSize], srcFmt)));
+	}
+	memset(dst, 0, PIXELS * dstSize);
+	convertPixels(dst, dstFmt, src, srcFmt, PIXELS);
+	if(memcmp(dst, ref, PIXELS * dstSize) != 0) printf("Formats %d -> %d:\n", srcFmt, dstFmt);
+	TEST_CHECK(memcmp(dst, ref, PIXELS * dstSize) == 0);
+
+	// Misaligned buffers and counts which are not a multiple of 4.
+	for(u32 it = 0; it < 2000; it++)
+	{
+		const u32 srcOffset = testRange(0, 7), dstOffset = testRange(0, 7), count = testRange(0, 40);
+		memset(dst, 0xCC, 40 * 4 + 16);
+		memcpy(ref, dst, 40 * 4 + 16);
+		for(u32 i = 0; i < count; i++)
+		{
+			const u32 v = loadPixel(&src[srcOffset + i * srcSize], srcFmt);
+			storePixel(&ref[dstOffset + i * dstSize], dstFmt, convert(dstFmt, srcFmt, v));
+		}
+		convertPixels(&dst[dstOffset], dstFmt, &src[srcOffset], srcFmt, count);
+		TEST_CHECK(memcmp(dst, ref, 40 * 4 + 16) == 0);
+	}
+
+	// In place for formats of the same size.
+	if(srcSize == dstSize)
+	{
+		memcpy(dst, src, PIXELS * srcSize);
+		for(u32 i = 0; i < PIXELS; i++)
+		{
+			storePixel(&ref[i * dstSize], dstFmt, convert(dstFmt, srcFmt, loadPixel(&src[i * srcSize], srcFmt)));
+		}
+		convertPixels(dst, dstFmt, dst, srcFmt, PIXELS);
+		TEST_CHECK(memcmp(dst, ref, PIXELS * dstSize) == 0);
+	}
+}
+
+static void testRotated(const GfxFmt dstFmt, const GfxFmt fbFmt)
+{
+	// Rows 3 to 12 of a 40x24 frame buffer with padding at the end of each row.
+	const u32 width = 40, height = 24, y = 3, rows = 10;
+	const u32 stride = width * g_pixelSize[dstFmt] + 4;
+	u8 fb[40 * 24 * 4], dst[10 * (40 * 4 + 4)], ref[sizeof(dst)];
+	for(u32 i = 0; i < sizeof(fb); i++) fb[i] = testRand();
+	memset(dst, 0, sizeof(dst));
+	memset(ref, 0, sizeof(ref));
+
+	for(u32 row = 0; row < rows; row++)
+	{
+		for(u32 x = 0; x < width; x++)
+		{
+			const u32 v = loadPixel(&fb[(x * height + (height - 1 - (y + row))) * g_pixelSize[fbFmt]], fbFmt);
+			storePixel(&ref[row * stride + x * g_pixelSize[dstFmt]], dstFmt, convert(dstFmt, fbFmt, v));
+		}
+	}
+	convertPixelsRotated(dst, dstFmt, stride, fb, fbFmt, width, height, y, rows);
+	TEST_CHECK(memcmp(dst, ref, sizeof(dst)) == 0);
+}
+
+int main(void)
+{
+	for(u32 srcFmt = 0; srcFmt < 5; srcFmt++)
+	{
+		for(u32 dstFmt = 0; dstFmt < 5; dstFmt++)
+		{
+			testConvert(dstFmt, srcFmt);
+			testRotated(dstFmt, srcFmt);
+		}
+	}
+
+	return testResult();
+}
\ No newline at end of file
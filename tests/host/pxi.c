@@ -0,0 +1,450 @@
+#include <setjmp.h>
+#include <string.h>
+#include "test.h"
+#include "io_trap.h"
+#include "drivers/pxi.h"
+#include "arm9/drivers/interrupt.h"
+#include "ipc_handler.h"
+#include "ipc_ring.h"
+#include "arm.h"
+
+
+// The ARM9 side of the driver talks to an emulated ARM11 through emulated FIFOs.
+#define FIFO_DEPTH  (16u)
+#define RING_ADDR   (FCRAM_BASE)
+#define REG_SYNC    (PXI_REGS_BASE + 0x0)
+#define REG_CNT     (PXI_REGS_BASE + 0x4)
+#define REG_SEND    (PXI_REGS_BASE + 0x8)
+#define REG_RECV    (PXI_REGS_BASE + 0xC)
+#define SYNC_IRQ    ((u32)PXI_SYNC_IRQ_IRQ<<24)
+#define SYNC_IRQ_EN ((u32)PXI_SYNC_IRQ_IRQ_EN<<24)
+
+
+typedef struct
+{
+	u32 rd;
+	u32 wr;
+	u32 data[FIFO_DEPTH];
+} Fifo;
+
+typedef struct
+{
+	u8 id;
+	u32 sendBufs;
+	u32 recvBufs;
+	u32 params[IPC_MAX_PARAMS];
+} HandledCmd;
+
+static Fifo g_toArm9, g_toArm11;
+static u32 g_cnt = 0;          // Enable bits of REG_PXI_CNT.
+static bool g_fifoError = false;
+static u32 g_syncIrqs = 0;     // Sync IRQs sent to the ARM11.
+static u32 g_syncWords = 0;    // Words in the send FIFO at the last sync IRQ.
+static bool g_sendIrqsOn = false;
+static u32 g_lastCmd = 0;      // Last command received by the ARM11.
+static u32 g_lastParams[IPC_MAX_PARAMS];
+static u32 g_cmdLog[PXI_MAX_PENDING]; // Commands received by the ARM11 in order.
+static u32 g_numCmds = 0;
+static IrqIsr g_pxiIsr = NULL;
+static jmp_buf g_panicJmp;
+static HandledCmd g_handled[8];
+static u32 g_numHandled = 0;
+static IpcRingProducer g_prod;
+static void (*g_remoteHook)(void) = NULL; // Runs right before the ARM11 answers.
+
+
+
+void IRQ_registerIsr(const Interrupt id, const IrqIsr isr)
+{
+	TEST_CHECK(id == IRQ_PXI_SYNC);
+	g_pxiIsr = isr;
+}
+
+void panic(void)
+{
+	longjmp(g_panicJmp, 1);
+}
+
+void __fb_assert(const char *const file, const unsigned line, const char *const cond)
+{
+	printf("%s:%u: assertion failed: %s\n", file, line, cond);
+	exit(1);
+}
+
+// Coherent memory on the host.
+void cleanDCacheRange(UNUSED const void *base, UNUSED size_t size) {}
+void invalidateDCacheRange(UNUSED const void *base, UNUSED size_t size) {}
+void flushDCacheRange(UNUSED const void *base, UNUSED size_t size) {}
+
+// Remembers the command and returns a result derived from all words.
+u32 IPC_handleCmd(u8 cmdId, u32 sendBufs, u32 recvBufs, const u32 *const buf)
+{
+	HandledCmd *const cmd = &g_handled[g_numHandled++ % 8];
+	cmd->id       = cmdId;
+	cmd->sendBufs = sendBufs;
+	cmd->recvBufs = recvBufs;
+	memcpy(cmd->params, buf, sizeof(cmd->params));
+
+	// Receive buffers are filled with their index.
+	u32 res = cmdId;
+	for(u32 i = 0; i < sendBufs + recvBufs; i++)
+	{
+		const IpcBuffer *const ipcBuf = (const IpcBuffer*)&buf[i * sizeof(IpcBuffer) / 4];
+		for(u32 b = 0; b < ipcBuf->size; b++)
+		{
+			if(i < sendBufs) res = res * 31 + ((u8*)ipcBuf->ptr)[b];
+			else ((u8*)ipcBuf->ptr)[b] = i;
+		}
+	}
+
+	return res;
+}
+
+
+static u32 fifoCount(const Fifo *const f)
+{
+	return f->wr - f->rd;
+}
+
+static void fifoPush(Fifo *const f, const u32 word)
+{
+	if(fifoCount(f) == FIFO_DEPTH) g_fifoError = true;
+	else f->data[f->wr++ % FIFO_DEPTH] = word;
+}
+
+static u32 fifoPop(Fifo *const f)
+{
+	if(fifoCount(f) == 0)
+	{
+		g_fifoError = true;
+		return 0;
+	}
+	return f->data[f->rd++ % FIFO_DEPTH];
+}
+
+static u32 pxiRead(const uintptr_t addr)
+{
+	switch(addr)
+	{
+		case REG_CNT:
+		{
+			u32 cnt = g_cnt;
+			if(fifoCount(&g_toArm11) == 0)          cnt |= PXI_CNT_SEND_EMPTY;
+			if(fifoCount(&g_toArm11) == FIFO_DEPTH) cnt |= PXI_CNT_SEND_FULL;
+			if(fifoCount(&g_toArm9) == 0)           cnt |= PXI_CNT_RECV_EMPTY;
+			if(fifoCount(&g_toArm9) == FIFO_DEPTH)  cnt |= PXI_CNT_RECV_FULL;
+			if(g_fifoError)                         cnt |= PXI_CNT_FIFO_ERROR;
+			return cnt;
+		}
+		case REG_RECV:
+			return fifoPop(&g_toArm9);
+		default:
+			return 0;
+	}
+}
+
+static void pxiWrite(const uintptr_t addr, const u32 val)
+{
+	switch(addr)
+	{
+		case REG_SYNC:
+			if(val & SYNC_IRQ)
+			{
+				g_syncIrqs++;
+				g_syncWords = fifoCount(&g_toArm11);
+			}
+			g_sendIrqsOn = (val & SYNC_IRQ_EN) != 0;
+			break;
+		case REG_CNT:
+			if(val & PXI_CNT_FLUSH_SEND) g_toArm11.rd = g_toArm11.wr;
+			if(val & PXI_CNT_FIFO_ERROR) g_fifoError = false;
+			g_cnt = val & (PXI_CNT_SEND_NOT_FULL_IRQ_EN | PXI_CNT_RECV_NOT_EMPTY_IRQ_EN | PXI_CNT_EN_FIFOS);
+			break;
+		case REG_SEND:
+			// Sending must not race with responses sent by the ARM9 IRQ handler.
+			// The init handshake runs before the handler is registered.
+			TEST_CHECK(g_pxiIsr == NULL || g_testCpsr & PSR_I);
+			fifoPush(&g_toArm11, val);
+			break;
+	}
+}
+
+static void raiseIrq(void)
+{
+	const u32 savedCpsr = g_testCpsr;
+	g_testCpsr |= PSR_I;
+	g_pxiIsr(IRQ_PXI_SYNC);
+	g_testCpsr = savedCpsr;
+}
+
+static u32 remoteRes(const u32 cmd, const u32 *const params)
+{
+	u32 res = cmd;
+	for(u32 i = 0; i < IPC_CMD_PARAMS_MASK(cmd); i++) res = res * 31 + params[i];
+
+	return res;
+}
+
+// The ARM11 answers all complete commands in the send FIFO
+// and raises one sync IRQ. Responses echo the tagged command.
+static void remoteRespond(void)
+{
+	if(g_remoteHook != NULL) g_remoteHook();
+
+	while(fifoCount(&g_toArm11) > 0)
+	{
+		const u32 cmd = fifoPop(&g_toArm11);
+		TEST_CHECK(fifoCount(&g_toArm11) >= IPC_CMD_PARAMS_MASK(cmd));
+		for(u32 i = 0; i < IPC_CMD_PARAMS_MASK(cmd); i++) g_lastParams[i] = fifoPop(&g_toArm11);
+		g_lastCmd = cmd;
+		g_cmdLog[g_numCmds++ % PXI_MAX_PENDING] = cmd;
+		fifoPush(&g_toArm9, cmd | IPC_CMD_RESP_FLAG);
+		fifoPush(&g_toArm9, remoteRes(cmd, g_lastParams));
+	}
+	raiseIrq();
+}
+
+static void testInit(void)
+{
+	// Junk before the handshake is skipped.
+	fifoPush(&g_toArm9, 0x55);
+	fifoPush(&g_toArm9, 0x11);
+	fifoPush(&g_toArm9, RING_ADDR);
+	PXI_init();
+	TEST_CHECK(fifoCount(&g_toArm11) == 1 && fifoPop(&g_toArm11) == 0x99);
+	TEST_CHECK(fifoCount(&g_toArm9) == 0 && !g_fifoError && g_pxiIsr != NULL);
+	TEST_CHECK(g_cnt == PXI_CNT_EN_FIFOS && g_syncIrqs == 0 && g_sendIrqsOn);
+
+	IPCRING_init(&g_prod, (IpcRing*)RING_ADDR);
+}
+
+static void testSendCmd(void)
+{
+	u32 lastSeq = 0;
+	for(u32 i = 0; i < 200; i++)
+	{
+		const u32 params = i % (IPC_MAX_PARAMS + 1);
+		const u32 cmd = (i % 100)<<8 | params;
+		u32 buf[IPC_MAX_PARAMS];
+		for(u32 p = 0; p < params; p++) buf[p] = testRand();
+
+		// Check the words as they arrive at the ARM11.
+		const u32 syncIrqs = g_syncIrqs;
+		const u32 res = PXI_sendCmd(cmd, buf, params);
+		TEST_CHECK(g_syncIrqs == syncIrqs + 1 && g_syncWords == 1);
+		TEST_CHECK(fifoCount(&g_toArm9) == 0 && fifoCount(&g_toArm11) == 0 && !g_fifoError);
+
+		TEST_CHECK(res == remoteRes(g_lastCmd, buf) && memcmp(g_lastParams, buf, params * 4) == 0);
+
+		// Slot 0 is free again each time. The sequence number counts 1 to 63.
+		const u32 tag = IPC_CMD_TAG_MASK(g_lastCmd);
+		TEST_CHECK((g_lastCmd & ~(0xFFu<<IPC_CMD_TAG_SHIFT)) == cmd && (tag & (PXI_MAX_PENDING - 1)) == 0);
+		const u32 seq = tag>>2;
+		TEST_CHECK(seq == (lastSeq == 63 ? 1 : lastSeq + 1));
+		lastSeq = seq;
+	}
+	TEST_CHECK(!(g_testCpsr & PSR_I));
+}
+
+static void pushRemoteCmd(const u32 cmd, const u32 *const params)
+{
+	fifoPush(&g_toArm9, cmd);
+	for(u32 i = 0; i < IPC_CMD_PARAMS_MASK(cmd); i++) fifoPush(&g_toArm9, params[i]);
+}
+
+// Without buffers the handler returns the command ID.
+static void checkRemoteResp(const u32 cmd)
+{
+	TEST_CHECK(fifoCount(&g_toArm11) >= 2 && fifoPop(&g_toArm11) == (cmd | IPC_CMD_RESP_FLAG));
+	TEST_CHECK(fifoPop(&g_toArm11) == IPC_CMD_ID_MASK(cmd));
+}
+
+// Commands from the ARM11 go to the IPC handler and get a response with the same tag.
+static void testRemoteCmds(void)
+{
+	const u32 cmdA = 5u<<IPC_CMD_TAG_SHIFT | 3u<<8 | 2, paramsA[2] = {0x1234, 0x5678};
+	const u32 cmdB = 0x37u<<IPC_CMD_TAG_SHIFT | 9u<<8 | 0;
+	const u32 cmdC = 0u<<IPC_CMD_TAG_SHIFT | 0x7Fu<<8 | IPC_MAX_PARAMS;
+	u32 paramsC[IPC_MAX_PARAMS];
+	for(u32 i = 0; i < IPC_MAX_PARAMS; i++) paramsC[i] = testRand();
+
+	// One IRQ handles everything in the FIFO.
+	const u32 syncIrqs = g_syncIrqs;
+	g_numHandled = 0;
+	pushRemoteCmd(cmdA, paramsA);
+	pushRemoteCmd(cmdB, NULL);
+	raiseIrq();
+	TEST_CHECK(g_numHandled == 2 && g_handled[0].id == 3 && g_handled[1].id == 9);
+	TEST_CHECK(g_handled[0].params[0] == paramsA[0] && g_handled[0].params[1] == paramsA[1]);
+	TEST_CHECK(g_syncIrqs == syncIrqs + 2 && fifoCount(&g_toArm11) == 4 && fifoCount(&g_toArm9) == 0);
+	checkRemoteResp(cmdA);
+	checkRemoteResp(cmdB);
+
+	pushRemoteCmd(cmdC, paramsC);
+	raiseIrq();
+	TEST_CHECK(g_numHandled == 3 && memcmp(g_handled[2].params, paramsC, sizeof(paramsC)) == 0);
+	checkRemoteResp(cmdC);
+	TEST_CHECK(!g_fifoError);
+}
+
+static void pushRemoteCmdB(void)
+{
+	pushRemoteCmd(0x37u<<IPC_CMD_TAG_SHIFT | 9u<<8, NULL);
+}
+
+static void testMixed(void)
+{
+	// A command from the ARM11 arrives before the response in the same IRQ.
+	g_numHandled = 0;
+	g_remoteHook = pushRemoteCmdB;
+	const u32 param = 42;
+	const u32 res = PXI_sendCmd(7u<<8 | 1, &param, 1);
+	g_remoteHook = NULL;
+	TEST_CHECK(res == remoteRes(g_lastCmd, &param) && g_numHandled == 1 && g_handled[0].id == 9);
+	checkRemoteResp(0x37u<<IPC_CMD_TAG_SHIFT | 9u<<8);
+	TEST_CHECK(fifoCount(&g_toArm11) == 0 && fifoCount(&g_toArm9) == 0);
+}
+
+static void sendNested(void)
+{
+	// The IRQ handler isn't running yet. All commands are in flight until the innermost one waits.
+	static u32 depth = 0;
+	if(++depth == PXI_MAX_PENDING - 1) g_remoteHook = NULL;
+	const u32 param = depth;
+	TEST_CHECK(PXI_sendCmd(param<<8 | 1, &param, 1) == remoteRes(g_cmdLog[param], &param));
+}
+
+static void testNested(void)
+{
+	// Each command in flight gets its own slot. All responses arrive in the same IRQ.
+	const u32 param = 0;
+	g_numCmds = 0;
+	g_remoteHook = sendNested;
+	TEST_CHECK(PXI_sendCmd(0u<<8 | 1, &param, 1) == remoteRes(g_cmdLog[0], &param));
+	TEST_CHECK(g_remoteHook == NULL && g_numCmds == PXI_MAX_PENDING);
+	for(u32 i = 0; i < PXI_MAX_PENDING; i++)
+	{
+		TEST_CHECK(IPC_CMD_ID_MASK(g_cmdLog[i]) == i && (IPC_CMD_TAG_MASK(g_cmdLog[i]) & (PXI_MAX_PENDING - 1)) == i);
+	}
+
+	// All slots are free again.
+	PXI_sendCmd(0u<<8, NULL, 0);
+	TEST_CHECK((IPC_CMD_TAG_MASK(g_lastCmd) & (PXI_MAX_PENDING - 1)) == 0);
+}
+
+static void testBadResponses(void)
+{
+	g_numHandled = 0;
+
+	// Untagged responses from the fatal error paths are dropped.
+	fifoPush(&g_toArm9, IPC_CMD_RESP_FLAG | 4u<<8);
+	fifoPush(&g_toArm9, 123);
+	raiseIrq();
+	TEST_CHECK(fifoCount(&g_toArm9) == 0 && fifoCount(&g_toArm11) == 0);
+
+	// A response for a free slot and a late duplicate of the last response.
+	const u32 stray[2] = {(1u<<2 | 1)<<IPC_CMD_TAG_SHIFT | 4u<<8, IPC_CMD_TAG_MASK(g_lastCmd)<<IPC_CMD_TAG_SHIFT};
+	for(u32 i = 0; i < 2; i++)
+	{
+		bool panicked = false;
+		fifoPush(&g_toArm9, IPC_CMD_RESP_FLAG | stray[i]);
+		fifoPush(&g_toArm9, 0);
+		if(setjmp(g_panicJmp) == 0) raiseIrq();
+		else panicked = true;
+		TEST_CHECK(panicked);
+	}
+
+	// More words than IPC_MAX_PARAMS.
+	bool panicked = false;
+	fifoPush(&g_toArm9, 3u<<6 | 3u<<4 | 4);
+	if(setjmp(g_panicJmp) == 0) raiseIrq();
+	else panicked = true;
+	TEST_CHECK(panicked && g_numHandled == 0);
+
+	g_toArm9.rd = g_toArm9.wr;
+	g_testCpsr &= ~PSR_I;
+}
+
+// Ring records are handled in the IRQ. The sync IRQ is only a doorbell.
+static void testRing(void)
+{
+	for(u32 it = 0; it < 300; it++)
+	{
+		IpcRingRec *recs[3];
+		u32 sums[3];
+		const u32 num = testRange(1, 3);
+		for(u32 r = 0; r < num; r++)
+		{
+			// One inline send and one inline receive buffer followed by plain parameters.
+			const u32 sendSize = testRange(1, 200), recvSize = testRange(1, 100), params = testRange(0, 20);
+			const u32 bufWords = 2 * sizeof(IpcBuffer) / 4, words = bufWords + params;
+			const u32 lines = IPCRING_recLines(words, sendSize + recvSize, 2);
+			IpcRingRec *const rec = IPCRING_reserve(&g_prod, lines);
+			TEST_CHECK(rec != NULL);
+			if(rec == NULL) return;
+
+			const u32 id = testRange(0, 127);
+			rec->cmd        = (1u<<2 | r)<<IPC_CMD_TAG_SHIFT | id<<8 | 1u<<6 | 1u<<4;
+			rec->words      = words;
+			rec->inlineMask = 3;
+			u32 *const p = IPCRING_params(rec);
+			for(u32 i = bufWords; i < words; i++) p[i] = testRand();
+
+			u8 *data = (u8*)p + (words * 4 + IPC_RING_LINE_SIZE - 1) / IPC_RING_LINE_SIZE * IPC_RING_LINE_SIZE;
+			u8 sendBuf[200];
+			sums[r] = id;
+			for(u32 i = 0; i < sendSize; i++)
+			{
+				sendBuf[i] = testRand();
+				sums[r] = sums[r] * 31 + sendBuf[i];
+			}
+			IpcBuffer *const bufs = (IpcBuffer*)p;
+			bufs[0].ptr  = (void*)(uintptr_t)IPCRING_putInline(&g_prod, data, sendBuf, sendSize);
+			bufs[0].size = sendSize;
+			data += (sendSize + IPC_RING_LINE_SIZE - 1) / IPC_RING_LINE_SIZE * IPC_RING_LINE_SIZE;
+			bufs[1].ptr  = (void*)(uintptr_t)IPCRING_putInline(&g_prod, data, NULL, recvSize);
+			bufs[1].size = recvSize;
+
+			IPCRING_publish(&g_prod, rec);
+			recs[r] = rec;
+		}
+
+		const u32 syncIrqs = g_syncIrqs;
+		g_numHandled = 0;
+		raiseIrq();
+		TEST_CHECK(g_syncIrqs == syncIrqs + num && g_numHandled == num);
+		for(u32 r = 0; r < num; r++)
+		{
+			IpcRingRec *const rec = recs[r];
+			TEST_CHECK(IPCRING_isDone(rec) && rec->res == sums[r]);
+			TEST_CHECK(g_handled[r].sendBufs == 1 && g_handled[r].recvBufs == 1);
+
+			// The handler wrote its buffer index into the inline receive buffer.
+			const IpcBuffer *const recvBuf = &((const IpcBuffer*)IPCRING_params(rec))[1];
+			const u8 *const recvData = recvBuf->ptr;
+			TEST_CHECK(recvData >= ((IpcRing*)RING_ADDR)->data && recvData + recvBuf->size <= (u8*)RING_ADDR + sizeof(IpcRing));
+			bool ok = true;
+			for(u32 i = 0; i < recvBuf->size; i++) ok &= recvData[i] == 1;
+			TEST_CHECK(ok);
+			IPCRING_release(rec);
+		}
+		TEST_CHECK(fifoCount(&g_toArm11) == 0);
+	}
+}
+
+int main(void)
+{
+	ioTrapInit(PXI_REGS_BASE, 0x1000, pxiRead, pxiWrite);
+	testMapIo(RING_ADDR, sizeof(IpcRing));
+	g_testWfiHook = remoteRespond;
+
+	testInit();
+	testSendCmd();
+	testRemoteCmds();
+	testMixed();
+	testNested();
+	testBadResponses();
+	testRing();
+
+	return testResult();
+}
\ No newline at end of file
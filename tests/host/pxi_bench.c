@@ -0,0 +1,234 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "test.h"
+#include "drivers/pxi.h"
+#include "ipc_handler.h"
+
+
+// Two thread model of the PXI FIFO pair. The ARM9 thread handles one command
+// at a time back to back. On the ARM11 side client tasks send commands and a
+// receive thread plays the sync IRQ handler that routes responses by tag.
+// Compares one command in flight (the old PXI_sendCmd()) with PXI_MAX_PENDING.
+// Delays are sleeps so the numbers depend on the host timer resolution.
+#define FIFO_DEPTH  (16u)
+#define CLIENTS     (3u)
+#define COMMANDS    (500u) // Per client.
+#define PARAMS      (5u)
+#define HANDLE_US   (20u)  // ARM9 time per command. Storage access for example.
+#define THINK_US    (20u)  // Client time between commands.
+
+
+typedef struct
+{
+	atomic_uint rd;
+	atomic_uint wr;
+	u32 data[FIFO_DEPTH];
+} Fifo;
+
+typedef struct
+{
+	u32 cmd;              // Tagged command code while in flight. 0 if the slot is free.
+	u32 res;
+	atomic_bool done;
+} Slot;
+
+static Fifo g_toArm9, g_toArm11;
+static Slot g_slots[PXI_MAX_PENDING];
+static u32 g_maxPending = 1;
+static u32 g_tagSeq = 0;
+static pthread_mutex_t g_slotLock = PTHREAD_MUTEX_INITIALIZER; // enterCriticalSection() in the driver.
+static pthread_mutex_t g_sendLock = PTHREAD_MUTEX_INITIALIZER; // g_sendMutex in the driver.
+static pthread_mutex_t g_statLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool g_stop = false;
+static atomic_uint g_errors = 0;
+static double g_latencySum = 0;
+
+
+
+static double micros(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void sleepUs(const u32 us)
+{
+	const struct timespec ts = {0, us * 1000l};
+	nanosleep(&ts, NULL);
+}
+
+static bool fifoEmpty(Fifo *const f)
+{
+	return atomic_load(&f->wr) == atomic_load(&f->rd);
+}
+
+// Both sides yield while the FIFO is full or empty like sendWordYield().
+static void fifoPush(Fifo *const f, const u32 word)
+{
+	while(atomic_load(&f->wr) - atomic_load(&f->rd) == FIFO_DEPTH) sched_yield();
+	f->data[atomic_load(&f->wr) % FIFO_DEPTH] = word;
+	atomic_fetch_add(&f->wr, 1);
+}
+
+static u32 fifoPop(Fifo *const f)
+{
+	while(fifoEmpty(f)) sched_yield();
+	const u32 word = f->data[atomic_load(&f->rd) % FIFO_DEPTH];
+	atomic_fetch_add(&f->rd, 1);
+
+	return word;
+}
+
+static u32 cmdResult(const u32 cmd, const u32 *const params)
+{
+	u32 res = cmd;
+	for(u32 i = 0; i < PARAMS; i++) res = res * 31 + params[i];
+
+	return res;
+}
+
+static void* arm9(UNUSED void *arg)
+{
+	while(!atomic_load(&g_stop))
+	{
+		if(fifoEmpty(&g_toArm9))
+		{
+			sched_yield();
+			continue;
+		}
+
+		const u32 cmd = fifoPop(&g_toArm9);
+		u32 params[PARAMS];
+		for(u32 i = 0; i < PARAMS; i++) params[i] = fifoPop(&g_toArm9);
+		sleepUs(HANDLE_US);
+		fifoPush(&g_toArm11, cmd | IPC_CMD_RESP_FLAG);
+		fifoPush(&g_toArm11, cmdResult(cmd, params));
+	}
+
+	return NULL;
+}
+
+// The ARM11 sync IRQ handler.
+static void* arm11Irq(UNUSED void *arg)
+{
+	while(!atomic_load(&g_stop))
+	{
+		if(fifoEmpty(&g_toArm11))
+		{
+			sched_yield();
+			continue;
+		}
+
+		const u32 cmd = fifoPop(&g_toArm11);
+		const u32 res = fifoPop(&g_toArm11);
+		Slot *const slot = &g_slots[IPC_CMD_TAG_MASK(cmd) & (PXI_MAX_PENDING - 1)];
+		if(slot->cmd != (cmd & ~IPC_CMD_RESP_FLAG)) atomic_fetch_add(&g_errors, 1);
+		slot->res = res;
+		atomic_store(&slot->done, true);
+	}
+
+	return NULL;
+}
+
+// Same as allocRequest() but limited to g_maxPending slots.
+static Slot* allocSlot(const u32 cmd)
+{
+	Slot *slot = NULL;
+	pthread_mutex_lock(&g_slotLock);
+	for(u32 i = 0; i < g_maxPending; i++)
+	{
+		if(g_slots[i].cmd == 0)
+		{
+			u32 seq = g_tagSeq + 1;
+			if(seq > 0xFFu>>2) seq = 1;
+			g_tagSeq = seq;
+
+			slot = &g_slots[i];
+			atomic_store(&slot->done, false);
+			slot->cmd = cmd | (seq<<2 | i)<<IPC_CMD_TAG_SHIFT;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_slotLock);
+
+	return slot;
+}
+
+static void* client(void *arg)
+{
+	const u32 id = (uintptr_t)arg;
+	double latency = 0;
+	for(u32 it = 0; it < COMMANDS; it++)
+	{
+		sleepUs(THINK_US);
+		const u32 cmd = (id * COMMANDS + it) % 128<<8 | PARAMS;
+		u32 params[PARAMS];
+		for(u32 i = 0; i < PARAMS; i++) params[i] = id<<24 | it<<4 | i;
+
+		const double start = micros();
+		Slot *slot;
+		while((slot = allocSlot(cmd)) == NULL) sched_yield();
+
+		pthread_mutex_lock(&g_sendLock);
+		fifoPush(&g_toArm9, slot->cmd);
+		for(u32 i = 0; i < PARAMS; i++) fifoPush(&g_toArm9, params[i]);
+		pthread_mutex_unlock(&g_sendLock);
+
+		while(!atomic_load(&slot->done)) sched_yield();
+		latency += micros() - start;
+		if(slot->res != cmdResult(slot->cmd, params)) atomic_fetch_add(&g_errors, 1);
+
+		pthread_mutex_lock(&g_slotLock);
+		slot->cmd = 0;
+		pthread_mutex_unlock(&g_slotLock);
+	}
+
+	pthread_mutex_lock(&g_statLock);
+	g_latencySum += latency;
+	pthread_mutex_unlock(&g_statLock);
+
+	return NULL;
+}
+
+// Returns commands per second. The mean latency in us is stored in latency.
+static double run(const u32 maxPending, double *const latency)
+{
+	g_maxPending = maxPending;
+	g_latencySum = 0;
+
+	pthread_t clients[CLIENTS];
+	const double start = micros();
+	for(uintptr_t i = 0; i < CLIENTS; i++) pthread_create(&clients[i], NULL, client, (void*)i);
+	for(u32 i = 0; i < CLIENTS; i++) pthread_join(clients[i], NULL);
+	const double elapsed = micros() - start;
+
+	*latency = g_latencySum / (CLIENTS * COMMANDS);
+	return CLIENTS * COMMANDS / (elapsed / 1e6);
+}
+
+int main(void)
+{
+	pthread_t arm9Thread, irqThread;
+	pthread_create(&arm9Thread, NULL, arm9, NULL);
+	pthread_create(&irqThread, NULL, arm11Irq, NULL);
+
+	double oneLat, tagLat;
+	const double one = run(1, &oneLat);
+	const double tagged = run(PXI_MAX_PENDING, &tagLat);
+	printf("1 in flight: %.0f commands/s, mean latency %.1f us\n", one, oneLat);
+	printf("%u in flight: %.0f commands/s, mean latency %.1f us (%.2fx throughput, %.2fx latency)\n",
+	       PXI_MAX_PENDING, tagged, tagLat, tagged / one, tagLat / oneLat);
+
+	atomic_store(&g_stop, true);
+	pthread_join(arm9Thread, NULL);
+	pthread_join(irqThread, NULL);
+
+	TEST_CHECK(atomic_load(&g_errors) == 0);
+	TEST_CHECK(fifoEmpty(&g_toArm9) && fifoEmpty(&g_toArm11));
+
+	return testResult();
+}
\ No newline at end of file
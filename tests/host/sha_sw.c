@@ -0,0 +1,121 @@
+#include <string.h>
+#include "test.h"
+#include "sha_sw.h"
+#include "drivers/sha.h"
+
+
+typedef struct
+{
+	u16 mode;
+	const char *msg;
+	u32 repeat;      // The message is repeated this many times.
+	const char *hex; // Expected hash.
+} ShaVector;
+
+// FIPS 180-2 example messages.
+#define MSG_448  "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+
+static const ShaVector g_vectors[] =
+{
+	{SHA_256_MODE, "",      1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+	{SHA_256_MODE, "abc",   1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+	{SHA_256_MODE, MSG_448, 1, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+	{SHA_256_MODE, "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+	{SHA_224_MODE, "",      1, "d14a028c2a3a2bc9476102bb288234c415a2b01f828ea62ac5b3e42f"},
+	{SHA_224_MODE, "abc",   1, "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7"},
+	{SHA_224_MODE, MSG_448, 1, "75388b16512776cc5dba5da1fd890150b0c6455cb4f58b1952522525"},
+	{SHA_224_MODE, "a", 1000000, "20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67"},
+	{SHA_1_MODE,   "",      1, "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+	{SHA_1_MODE,   "abc",   1, "a9993e364706816aba3e25717850c26c9cd0d89d"},
+	{SHA_1_MODE,   MSG_448, 1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+	{SHA_1_MODE,   "a", 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"}
+};
+
+
+
+static u32 hashSize(const u16 mode)
+{
+	return (mode == SHA_256_MODE ? 32 : (mode == SHA_224_MODE ? 28 : 20));
+}
+
+static bool matchesHex(const u32 *const hash, const char *const hex)
+{
+	char str[65];
+	const u32 size = strlen(hex) / 2;
+	for(u32 i = 0; i < size; i++) sprintf(&str[i * 2], "%02x", ((const u8*)hash)[i]);
+
+	return memcmp(str, hex, size * 2) == 0;
+}
+
+static void testVectors(void)
+{
+	static u8 buf[1000000];
+	for(u32 i = 0; i < sizeof(g_vectors) / sizeof(*g_vectors); i++)
+	{
+		const ShaVector *const v = &g_vectors[i];
+		const u32 msgLen = strlen(v->msg);
+		const u32 size = msgLen * v->repeat;
+		for(u32 k = 0; k < v->repeat; k++) memcpy(&buf[k * msgLen], v->msg, msgLen);
+
+		u32 hash[8];
+		sha_sw(buf, size, hash, v->mode | SHA_IN_BIG, SHA_OUT_BIG);
+		TEST_CHECK(matchesHex(hash, v->hex));
+
+		// Random update sizes and unaligned pointers.
+		ShaSwState st;
+		SHA_swStart(&st, v->mode | SHA_IN_BIG);
+		for(u32 off = 0; off < size; )
+		{
+			u32 n = testRand() % (testRand() & 1 ? 200 : 5000);
+			if(n > size - off) n = size - off;
+			SHA_swUpdate(&st, &buf[off], n);
+			off += n;
+		}
+		memset(hash, 0, sizeof(hash));
+		SHA_swFinish(&st, hash, SHA_OUT_BIG);
+		TEST_CHECK(matchesHex(hash, v->hex));
+	}
+}
+
+// Little endian input swaps every word like the hardware. Little endian output gives native words.
+static void testEndianess(void)
+{
+	static const u16 modes[3] = {SHA_256_MODE, SHA_224_MODE, SHA_1_MODE};
+	u8 data[1024], swapped[1024];
+	for(u32 it = 0; it < 300; it++)
+	{
+		const u32 size = testRand() % sizeof(data) & ~3u;
+		for(u32 i = 0; i < size; i++) data[i] = testRand();
+		for(u32 i = 0; i < size; i++) swapped[i] = data[(i & ~3u) + 3 - i % 4];
+
+		const u16 mode = modes[it % 3];
+		u32 little[8], big[8], native[8];
+		sha_sw(data, size, little, mode | SHA_IN_LITTLE, SHA_OUT_BIG);
+		sha_sw(swapped, size, big, mode | SHA_IN_BIG, SHA_OUT_BIG);
+		TEST_CHECK(memcmp(little, big, hashSize(mode)) == 0);
+
+		sha_sw(swapped, size, native, mode | SHA_IN_BIG, SHA_OUT_LITTLE);
+		for(u32 i = 0; i < hashSize(mode) / 4; i++) TEST_CHECK(native[i] == __builtin_bswap32(big[i]));
+
+		// Word multiple updates in little endian mode.
+		ShaSwState st;
+		SHA_swStart(&st, mode | SHA_IN_LITTLE);
+		for(u32 off = 0; off < size; )
+		{
+			u32 n = (testRand() % 100) * 4;
+			if(n > size - off) n = size - off;
+			SHA_swUpdate(&st, &data[off], n);
+			off += n;
+		}
+		SHA_swFinish(&st, little, SHA_OUT_BIG);
+		TEST_CHECK(memcmp(little, big, hashSize(mode)) == 0);
+	}
+}
+
+int main(void)
+{
+	testVectors();
+	testEndianess();
+
+	return testResult();
+}
\ No newline at end of file
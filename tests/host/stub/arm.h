@@ -0,0 +1,50 @@
+#pragma once
+
+// Host replacement for arm.h. The CPSR is a variable shared by all files so code can
+// disable and restore IRQs. Nothing actually interrupts the test.
+// A test can set g_testWfiHook to emulate hardware while the code waits in __wfi().
+
+#include "types.h"
+
+
+#define PSR_USER_MODE   (16)
+#define PSR_FIQ_MODE    (17)
+#define PSR_IRQ_MODE    (18)
+#define PSR_SVC_MODE    (19)
+#define PSR_ABORT_MODE  (23)
+#define PSR_UNDEF_MODE  (27)
+#define PSR_SYS_MODE    (31)
+#define PSR_MODE_MASK   (PSR_SYS_MODE)
+
+#define PSR_T           (1<<5)
+#define PSR_F           (1<<6)
+#define PSR_I           (1<<7)
+#define PSR_A           (1<<8)
+#define PSR_INT_OFF     (PSR_I | PSR_F)
+
+
+WEAK u32 g_testCpsr = PSR_SYS_MODE;
+WEAK void (*g_testWfiHook)(void) = NULL;
+
+#define __cpsid(flags)  (g_testCpsr |= PSR_I)
+#define __cpsie(flags)  (g_testCpsr &= ~PSR_I)
+
+static inline u32 __getCpsr(void)
+{
+	return g_testCpsr;
+}
+
+static inline void __setCpsr_c(const u32 val)
+{
+	g_testCpsr = (g_testCpsr & ~0xFFu) | (val & 0xFFu);
+}
+
+static inline void __wfi(void)
+{
+	if(g_testWfiHook != NULL) g_testWfiHook();
+}
+
+static inline u32 __getCpuId(void)
+{
+	return 0;
+}
\ No newline at end of file
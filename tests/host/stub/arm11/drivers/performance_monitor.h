@@ -0,0 +1,30 @@
+#pragma once
+
+// Host replacement for performance_monitor.h. The cycle counter and PMNC
+// are variables. A test advances g_testCcnt to let time pass.
+
+#include "types.h"
+
+
+#define PM_EN           (1u)
+#define PM_CCNT_NODIV   (0u)
+#define PM_CCNT_DIV64   (1u<<3)
+
+
+WEAK u32 g_testPmnc = 0;
+WEAK u32 g_testCcnt = 0;
+
+static inline void __setPmnc(u32 val)
+{
+	g_testPmnc = val;
+}
+
+static inline u32 __getPmnc(void)
+{
+	return g_testPmnc;
+}
+
+static inline u32 __getCcnt(void)
+{
+	return g_testCcnt;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+// Minimal helpers shared by the host tests.
+// A test is a plain program. It prints what failed and exits with 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "types.h"
+
+
+static u32 g_testFails = 0;
+
+#define TEST_CHECK(cond)                                                  \
+do                                                                        \
+{                                                                         \
+	if(!(cond))                                                           \
+	{                                                                     \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);   \
+		if(++g_testFails >= 20) exit(1);                                  \
+	}                                                                     \
+} while(0)
+
+
+
+// Deterministic xorshift32 so runs are reproducible on every host libc.
+static inline u32 testRand(void)
+{
+	static u32 state = 0x12345678u;
+	u32 x = state;
+	x ^= x<<13;
+	x ^= x>>17;
+	x ^= x<<5;
+	state = x;
+
+	return x;
+}
+
+// Random number in the range lo-hi inclusive.
+static inline s32 testRange(const s32 lo, const s32 hi)
+{
+	return lo + (s32)(testRand() % (u32)(hi - lo + 1));
+}
+
+// Backs an IO register region with RAM at its real address.
+static inline void testMapIo(const uintptr_t base, const size_t size)
+{
+	void *const p = mmap((void*)base, size, PROT_READ | PROT_WRITE,
+	                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(p != (void*)base)
+	{
+		printf("Failed to map IO region 0x%08lX.\n", (unsigned long)base);
+		exit(1);
+	}
+}
+
+static inline int testResult(void)
+{
+	puts(g_testFails == 0 ? "OK" : "FAILED");
+
+	return g_testFails != 0;
+}
\ No newline at end of file
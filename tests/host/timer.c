@@ -0,0 +1,203 @@
+#include "test.h"
+#include "io_trap.h"
+#include "arm11/drivers/timer.h"
+#include "arm11/drivers/interrupt.h"
+
+
+// Watchdog alarms against an emulated watchdog. Time only advances in
+// __wfi() and jumps to the next watchdog expiry. Callbacks record when
+// they ran.
+#define IDLE_TICKS  (1000u) // Time per __wfi() without armed watchdog.
+
+
+static u64 g_now = 0;
+static u32 g_wdCounter = 0, g_wdCnt = 0, g_wdIntStat = 0;
+static IrqIsr g_wdIsr = NULL;
+static u32 g_fired[8];
+static u64 g_firedAt[8];
+static u32 g_firedCount = 0;
+
+
+
+void __fb_assert(const char *const file, const unsigned line, const char *const cond)
+{
+	printf("%s:%u: assertion failed: %s\n", file, line, cond);
+	exit(1);
+}
+
+void IRQ_registerIsr(const Interrupt id, UNUSED const u32 prio, UNUSED u32 target, const IrqIsr isr)
+{
+	if(id == IRQ_WATCHDOG) g_wdIsr = isr;
+}
+
+static u32 timerRead(const uintptr_t addr)
+{
+	switch(addr - TIMER_REGS_BASE)
+	{
+		case offsetof(Timer, wd_counter):  return g_wdCounter;
+		case offsetof(Timer, wd_cnt):      return g_wdCnt;
+		case offsetof(Timer, wd_int_stat): return g_wdIntStat;
+	}
+	return 0;
+}
+
+static void timerWrite(const uintptr_t addr, const u32 val)
+{
+	switch(addr - TIMER_REGS_BASE)
+	{
+		case offsetof(Timer, wd_load):     g_wdCounter = val; break;
+		case offsetof(Timer, wd_cnt):      g_wdCnt = val; break;
+		case offsetof(Timer, wd_int_stat): g_wdIntStat &= ~val; break;
+	}
+}
+
+// Runs the watchdog to its expiry and raises the IRQ unless masked.
+static void wdWfi(void)
+{
+	u32 ticks = IDLE_TICKS;
+	if(g_wdCnt & TIMER_EN && g_wdCounter > 0)
+	{
+		TEST_CHECK((g_wdCnt & ~TIMER_EN) == (TIMER_IRQ_EN | TIMER_SINGLE_SHOT | WD_TIMER_MODE));
+		ticks = g_wdCounter;
+		g_wdCounter = 0;
+		g_wdIntStat = 1;
+	}
+	g_now += ticks;
+
+	if(g_wdIntStat && !(g_testCpsr & PSR_I))
+	{
+		g_testCpsr |= PSR_I;
+		g_wdIsr(IRQ_WATCHDOG);
+		g_testCpsr &= ~PSR_I;
+		TEST_CHECK(g_wdIntStat == 0);
+	}
+}
+
+static void record(void *arg)
+{
+	TEST_CHECK(g_testCpsr & PSR_I);
+	g_fired[g_firedCount] = (uintptr_t)arg;
+	g_firedAt[g_firedCount++] = g_now;
+}
+
+static void waitFired(const u32 count)
+{
+	while(g_firedCount < count) __wfi();
+}
+
+static void testSleep(void)
+{
+	// 100 us is 13405 ticks and 2 ms 268111.
+	u64 start = g_now;
+	TIMER_sleepUs(100);
+	TEST_CHECK(g_now - start == 13405);
+
+	// With IRQs disabled the sleep handles the expiry itself.
+	g_testCpsr |= PSR_I;
+	start = g_now;
+	TIMER_sleepMs(2);
+	TEST_CHECK(g_now - start == 268111);
+	g_testCpsr &= ~PSR_I;
+	TEST_CHECK(g_wdIntStat == 0 && !(g_wdCnt & TIMER_EN));
+}
+
+static void testOrder(void)
+{
+	// Sorted by deadline. Equal deadlines fire in the order they were set.
+	TimerAlarm alarms[4];
+	g_firedCount = 0;
+	const u64 start = g_now;
+	TIMER_setAlarm(&alarms[0], 300, record, (void*)0);
+	TIMER_setAlarm(&alarms[1], 100, record, (void*)1);
+	TIMER_setAlarm(&alarms[2], 200, record, (void*)2);
+	TIMER_setAlarm(&alarms[3], 100, record, (void*)3);
+	waitFired(4);
+	TEST_CHECK(g_fired[0] == 1 && g_fired[1] == 3 && g_fired[2] == 2 && g_fired[3] == 0);
+	TEST_CHECK(g_firedAt[0] == start + 100 && g_firedAt[1] == start + 100);
+	TEST_CHECK(g_firedAt[2] == start + 200 && g_firedAt[3] == start + 300);
+	for(u32 i = 0; i < 4; i++) TEST_CHECK(!alarms[i].armed);
+	TEST_CHECK(!(g_wdCnt & TIMER_EN));
+
+	// Alarms due right away still fire from the IRQ.
+	g_firedCount = 0;
+	TIMER_setAlarm(&alarms[0], 0, record, (void*)0);
+	waitFired(1);
+	TEST_CHECK(g_firedAt[0] - start == 301);
+}
+
+static void testCancel(void)
+{
+	TimerAlarm first, second;
+	g_firedCount = 0;
+	const u64 start = g_now;
+	TIMER_setAlarm(&first, 100, record, (void*)0);
+	TIMER_setAlarm(&second, 200, record, (void*)1);
+	TEST_CHECK(TIMER_cancelAlarm(&first));
+	TEST_CHECK(!TIMER_cancelAlarm(&first));
+	waitFired(1);
+	TEST_CHECK(g_fired[0] == 1 && g_firedAt[0] == start + 200);
+	TEST_CHECK(!TIMER_cancelAlarm(&second));
+
+	// Canceling the last alarm stops the watchdog.
+	TIMER_setAlarm(&first, 100, record, (void*)0);
+	TEST_CHECK(TIMER_cancelAlarm(&first) && !(g_wdCnt & TIMER_EN));
+}
+
+static void testLater(void)
+{
+	// An earlier alarm set while the watchdog runs for a later one.
+	// The time that already passed must not be lost.
+	TimerAlarm late, early, other;
+	g_firedCount = 0;
+	const u64 start = g_now;
+	TIMER_setAlarm(&late, 1000, record, (void*)0);
+	g_wdCounter -= 400;
+	g_now += 400;
+	TIMER_setAlarm(&early, 100, record, (void*)1);
+	waitFired(2);
+	TEST_CHECK(g_fired[0] == 1 && g_firedAt[0] == start + 500);
+	TEST_CHECK(g_fired[1] == 0 && g_firedAt[1] == start + 1000);
+
+	// A sleep ends at its own deadline even if an alarm fires first.
+	g_firedCount = 0;
+	const u64 sleepStart = g_now;
+	TIMER_setAlarm(&other, 5000, record, (void*)2);
+	TIMER_sleepUs(100);
+	TEST_CHECK(g_now - sleepStart == 13405);
+	TEST_CHECK(g_firedCount == 1 && g_firedAt[0] == sleepStart + 5000);
+}
+
+static TimerAlarm g_periodic;
+
+static void periodic(void *arg)
+{
+	record(arg);
+	if(g_firedCount < 3) TIMER_setAlarm(&g_periodic, 50, periodic, arg);
+}
+
+static void testRearm(void)
+{
+	// The callback may set its own alarm again.
+	g_firedCount = 0;
+	const u64 start = g_now;
+	TIMER_setAlarm(&g_periodic, 50, periodic, (void*)0);
+	waitFired(3);
+	TEST_CHECK(g_firedAt[0] == start + 50 && g_firedAt[1] == start + 100 && g_firedAt[2] == start + 150);
+	TEST_CHECK(!g_periodic.armed);
+}
+
+int main(void)
+{
+	ioTrapInit(MPCORE_PRIV_BASE, 0x1000, timerRead, timerWrite);
+	g_testWfiHook = wdWfi;
+	TIMER_init();
+	TEST_CHECK(g_wdIsr != NULL);
+
+	testSleep();
+	testOrder();
+	testCancel();
+	testLater();
+	testRearm();
+
+	return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include <string.h>
+#include "drivers/gfx.h"
+#include "arm11/console.h"
+#include "arm11/fmt.h"
+#include "arm11/drivers/hid.h"
+#include "arm11/drivers/performance_monitor.h"
+#include "arm11/drivers/codec.h"
+#include "arm11/power.h"
+#include "memory.h"
+
+
+#define MAX_SIZE  (64u * 1024)
+#define RUNS      (8u)
+
+
+typedef enum
+{
+	OP_COPY    = 0u,
+	OP_COPY_UA = 1u, // Unaligned source.
+	OP_MOVE    = 2u, // Overlapping backwards move.
+	OP_FILL    = 3u,
+	OP_CMP     = 4u,
+	NUM_OPS    = 5u
+} BenchOp;
+
+static const char *const g_opNames[NUM_OPS] = {"copy", "copy ua", "move", "fill", "cmp"};
+static const u32 g_sizes[] = {4, 16, 64, 256, 1024, 4096, 16 * 1024, MAX_SIZE};
+
+alignas(32) static u8 g_src[MAX_SIZE + 32];
+alignas(32) static u8 g_dst[MAX_SIZE + 32];
+
+
+
+static u32 run(const BenchOp op, const bool tuned, const u32 size)
+{
+	u32 best = 0xFFFFFFFFu;
+	for(u32 i = 0; i < RUNS; i++)
+	{
+		__setPmnc(0);
+		perfMonitorCountCycles();
+		switch(op)
+		{
+			case OP_COPY:
+				if(tuned) copyMem(g_dst, g_src, size);
+				else      memcpy(g_dst, g_src, size);
+				break;
+			case OP_COPY_UA:
+				if(tuned) copyMem(g_dst, g_src + 1, size);
+				else      memcpy(g_dst, g_src + 1, size);
+				break;
+			case OP_MOVE:
+				if(tuned) moveMem(g_dst + 4, g_dst, size);
+				else      memmove(g_dst + 4, g_dst, size);
+				break;
+			case OP_FILL:
+				if(tuned) fillMem(g_dst, 0xA5, size);
+				else      memset(g_dst, 0xA5, size);
+				break;
+			case OP_CMP:
+				if(tuned) (void)compareMem(g_dst, g_src, size);
+				else      (void)memcmp(g_dst, g_src, size);
+				break;
+			default:
+				break;
+		}
+		const u32 cycles = __getCcnt();
+		__setPmnc(0);
+
+		if(cycles < best) best = cycles;
+	}
+
+	return best;
+}
+
+static bool verify(void)
+{
+	for(u32 i = 0; i < sizeof(g_src); i++) g_src[i] = i * 7;
+
+	bool ok = true;
+	for(u32 size = 0; size < 300 && ok; size++)
+	{
+		for(u32 offset = 0; offset < 8 && ok; offset++)
+		{
+			fillMem(g_dst, 0, 512);
+			copyMem(g_dst + offset, g_src + (size & 7), size);
+			ok &= compareMemRef(g_dst + offset, g_src + (size & 7), size) == 0;
+
+			copyMem(g_dst + (size & 7), g_src, size);
+			moveMem(g_dst + offset, g_dst + (size & 7), size);
+			ok &= compareMemRef(g_dst + offset, g_src, size) == 0;
+
+			fillMem(g_dst + offset, 0x5A, size);
+			ok &= compareMem(g_dst + offset, g_dst + offset, size) == 0;
+			ok &= compareMem(g_dst + offset, g_src, size) == compareMemRef(g_dst + offset, g_src, size);
+		}
+	}
+
+	return ok;
+}
+
+int main(void)
+{
+	GFX_init(GFX_BGR8, GFX_BGR565, GFX_TOP_2D);
+	GFX_setLcdLuminance(80);
+	consoleInit(GFX_LCD_BOT, NULL);
+
+	ee_printf("Memory benchmark. Best of %u runs.\nVerify: %s\n", RUNS, (verify() ? "OK" : "FAILED"));
+	for(u32 op = 0; op < NUM_OPS; op++)
+	{
+		ee_printf("\n%s (cycles libc/tuned):\n", g_opNames[op]);
+		for(u32 i = 0; i < sizeof(g_sizes) / sizeof(*g_sizes); i++)
+		{
+			const u32 size = g_sizes[i];
+			ee_printf(" %6lu: %8lu %8lu\n", size, run(op, false, size), run(op, true, size));
+		}
+	}
+
+	ee_puts("\nPress POWER to exit.");
+	while(1)
+	{
+		hidScanInput();
+		if(hidGetExtraKeys(0) & (KEY_POWER_HELD | KEY_POWER)) break;
+
+		GFX_waitForVBlank0();
+	}
+
+	CODEC_deinit();
+	GFX_deinit();
+
+	power_off();
+
+	return 0;
+}
\ No newline at end of file